@@ -243,7 +243,7 @@ validate_search(hyperclient* cl,
     hyperclient_returncode sstatus;
     hyperclient_attribute* attrs;
     size_t attrs_sz;
-    int64_t sid = cl->search(space, eq, eq_sz, rn, rn_sz, &sstatus, &attrs, &attrs_sz);
+    int64_t sid = cl->search(space, eq, eq_sz, rn, rn_sz, NULL, 0, NULL, 0, &sstatus, &attrs, &attrs_sz);
 
     if (sid < 0)
     {
@@ -142,7 +142,7 @@ main(int argc, char* argv[])
             hyperclient_returncode gstatus;
             hyperclient_attribute* gload;
             size_t gload_sz;
-            int64_t getid = cl.get(space.c_str(), beic, sizeof(beic),
+            int64_t getid = cl.get(space.c_str(), beic, sizeof(beic), NULL, 0,
                                    &gstatus, &gload, &gload_sz);
             int64_t getdi = cl.loop(-1, &status);
             assert(getid == getdi);
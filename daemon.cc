@@ -49,7 +49,7 @@ main(int argc, char* argv[])
     google::InitGoogleLogging(argv[0]);
     google::InstallFailureSignalHandler();
 
-    if (argc != 4 && argc != 5)
+    if (argc < 4 || argc > 6)
     {
         return usage();
     }
@@ -60,13 +60,19 @@ main(int argc, char* argv[])
         po6::net::location coordinator = po6::net::location(argv[1], atoi(argv[2]));
         po6::net::ipaddr bind_to = po6::net::ipaddr(argv[3]);
         po6::pathname base = ".";
+        po6::pathname cold = "";
 
-        if (argc == 5)
+        if (argc >= 5)
         {
             base = argv[4];
         }
 
-        return hyperdaemon::daemon(base, coordinator, 2, bind_to, 0, 0);
+        if (argc == 6)
+        {
+            cold = argv[5];
+        }
+
+        return hyperdaemon::daemon(base, cold, coordinator, 2, bind_to, 0, 0);
     }
     catch (std::exception& e)
     {
@@ -79,7 +85,7 @@ main(int argc, char* argv[])
 int
 usage()
 {
-    std::cerr << "Usage:  hyperdexd <coordinator ip> <coordinator port> <bind to> [<datadir>]"
+    std::cerr << "Usage:  hyperdexd <coordinator ip> <coordinator port> <bind to> [<datadir> [<cold datadir>]]"
               << std::endl;
     return EXIT_FAILURE;
 }
@@ -187,10 +187,17 @@ class Coordinator(object):
             space_str = 'space {space} {subspace} {dims}\n' \
                         .format(space=space.name, subspace=spacenum,
                                 dims=' '.join([d.name + ' ' + d.type for d in space.dimensions]))
+            for dimnum, dim in enumerate(space.dimensions):
+                if dim.quantiles:
+                    space_str += 'quantiles {space} {dim} {bounds}\n' \
+                                 .format(space=spacenum, dim=dimnum,
+                                         bounds=' '.join([str(b) for b in dim.quantiles]))
             for subspacenum, subspace in enumerate(space.subspaces):
                 hashes_str = ''
                 for dim in space.dimensions:
-                    if dim.name in subspace.dimensions:
+                    if dim.name in subspace.ordered:
+                        hashes_str += ' ordered'
+                    elif dim.name in subspace.dimensions:
                         hashes_str += ' true'
                     else:
                         hashes_str += ' false'
@@ -34,9 +34,9 @@ import unittest
 from pyparsing import Combine, Forward, Group, Literal, Optional, Suppress, ZeroOrMore, Word, delimitedList, stringEnd
 
 
-Dimension = collections.namedtuple("Dimension", ["name", "type"])
+Dimension = collections.namedtuple("Dimension", ["name", "type", "quantiles"])
 Region = collections.namedtuple("Region", ["mask", "prefix", "replicas"])
-Subspace = collections.namedtuple("Subspace", ["dimensions", "nosearch", "regions"])
+Subspace = collections.namedtuple("Subspace", ["dimensions", "nosearch", "ordered", "regions"])
 Space = collections.namedtuple("Space", ["name", "dimensions", "subspaces"])
 
 
@@ -88,7 +88,7 @@ def _fill_to_region(upper_bound, auto_prefix, auto_replication, target):
 
 
 def parse_dimension(dim):
-    return Dimension(dim[0], dim[1])
+    return Dimension(dim[0], dim[1], list(dim[2]))
 
 
 def parse_regions(regions):
@@ -130,18 +130,29 @@ def parse_regions(regions):
 def parse_subspace(subspace):
     return Subspace(dimensions=list(subspace[0]),
                     nosearch=list(subspace[1]),
-                    regions=list(subspace[2]))
+                    ordered=list(subspace[2]),
+                    regions=list(subspace[3]))
 
 
 def parse_space(space):
     dims = [dim.name for dim in list(space.dimensions)]
     if space.key not in dims:
         raise ValueError("Space key must be one of its dimensions.")
+    for dim in space.dimensions:
+        if dim.quantiles and dim.type != "uint64":
+            raise ValueError("Quantiles of {0} require it to be a uint64.".format(repr(dim.name)))
+        if sorted(set(dim.quantiles)) != dim.quantiles:
+            raise ValueError("Quantiles of {0} must be strictly increasing.".format(repr(dim.name)))
     for subspace in space.subspaces:
         for dim in set(subspace.dimensions):
             if dim not in dims:
                 raise ValueError("Subspace dimension {0} must be one of its dimensions.".format(repr(name)))
-    keysubspace = Subspace(dimensions=[space.key], nosearch=[], regions=list(space.keyregions))
+        for dim in set(subspace.ordered):
+            if dim not in subspace.dimensions:
+                raise ValueError("Ordered dimension {0} must be a subspace dimension.".format(repr(dim)))
+            if [d.type for d in space.dimensions if d.name == dim] != ["string"]:
+                raise ValueError("Ordered dimension {0} must be a string.".format(repr(dim)))
+    keysubspace = Subspace(dimensions=[space.key], nosearch=[], ordered=[], regions=list(space.keyregions))
     subspaces = [keysubspace] + list(space.subspaces)
     return Space(name=space.name, dimensions=space.dimensions, subspaces=subspaces)
 
@@ -152,7 +163,10 @@ hexnum  = Combine(Literal("0x") + Word(string.hexdigits)).setParseAction(lambda
 dimension = identifier.setResultsName("name") + \
             Optional(Suppress(Literal("(")) +
                      (Literal("string") | Literal("uint64")) +
-                     Suppress(Literal(")")), default="string").setResultsName("type")
+                     Suppress(Literal(")")), default="string").setResultsName("type") + \
+            Optional(Suppress(Literal("quantiles")) + Suppress(Literal("[")) +
+                     Group(delimitedList(integer)) +
+                     Suppress(Literal("]")), default=[]).setResultsName("quantiles")
 dimension.setParseAction(parse_dimension)
 autoregion = Literal("auto") + integer + integer
 staticregion = Literal("region") + integer + hexnum + integer
@@ -162,6 +176,8 @@ subspace = Literal("subspace").suppress() + \
            Group(delimitedList(identifier)) + \
            Optional(Suppress(Literal("nosearch")) +
                    Group(delimitedList(identifier)), default=[]) + \
+           Optional(Suppress(Literal("ordered")) +
+                   Group(delimitedList(identifier)), default=[]) + \
            Group(region)
 subspace.setParseAction(parse_subspace)
 space = Literal("space").suppress() + identifier.setResultsName("name") + \
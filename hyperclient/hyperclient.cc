@@ -41,12 +41,20 @@
 #include "hyperdex/hyperdex/coordinatorlink.h"
 #include "hyperdex/hyperdex/instance.h"
 #include "hyperdex/hyperdex/network_constants.h"
+#include "hyperdex/hyperdex/packing.h"
 
 // HyperClient
 #include "hyperclient/hyperclient.h"
 
 #define HDRSIZE (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t) + 2 * sizeof(uint16_t) + 2 * hyperdex::entityid::SERIALIZEDSIZE + sizeof(uint64_t))
 
+// Searches ask each server for up to SEARCH_BATCH_ITEMS objects (or about
+// SEARCH_BATCH_BYTES bytes) per response, with SEARCH_CREDIT responses in
+// flight at once.
+#define SEARCH_BATCH_ITEMS 1024
+#define SEARCH_BATCH_BYTES 262144
+#define SEARCH_CREDIT 4
+
 // XXX 2012-01-22 When failures happen, this code is not robust.  It may throw
 // exceptions, and it will fail to properly cleanup state.  For instance, if a
 // socket error is detected when sending a SEARCH_ITEM_NEXT message, it returns
@@ -86,12 +94,13 @@ hyperclient_destroy(struct hyperclient* client)
 
 int64_t
 hyperclient_get(struct hyperclient* client, const char* space, const char* key,
-                size_t key_sz, hyperclient_returncode* status,
+                size_t key_sz, const char** project, size_t project_sz,
+                hyperclient_returncode* status,
                 struct hyperclient_attribute** attrs, size_t* attrs_sz)
 {
     try
     {
-        return client->get(space, key, key_sz, status, attrs, attrs_sz);
+        return client->get(space, key, key_sz, project, project_sz, status, attrs, attrs_sz);
     }
     catch (po6::error& e)
     {
@@ -153,12 +162,14 @@ int64_t
 hyperclient_search(struct hyperclient* client, const char* space,
                    const struct hyperclient_attribute* eq, size_t eq_sz,
                    const struct hyperclient_range_query* rn, size_t rn_sz,
+                   const struct hyperclient_prefix_query* pf, size_t pf_sz,
+                   const char** project, size_t project_sz,
                    enum hyperclient_returncode* status,
                    struct hyperclient_attribute** attrs, size_t* attrs_sz)
 {
     try
     {
-        return client->search(space, eq, eq_sz, rn, rn_sz, status, attrs, attrs_sz);
+        return client->search(space, eq, eq_sz, rn, rn_sz, pf, pf_sz, project, project_sz, status, attrs, attrs_sz);
     }
     catch (po6::error& e)
     {
@@ -209,13 +220,15 @@ attributes_from_value(const hyperdex::configuration& config,
                       const uint8_t* key,
                       size_t key_sz,
                       const std::vector<e::slice>& value,
+                      const e::bitfield& projection,
                       hyperclient_returncode* status,
                       hyperclient_attribute** attrs,
                       size_t* attrs_sz)
 {
     std::vector<hyperdex::attribute> dimension_names = config.dimension_names(entity.get_space());
 
-    if (value.size() + 1 != dimension_names.size())
+    if (value.size() + 1 != dimension_names.size() ||
+        (projection.bits() != 0 && projection.bits() != value.size()))
     {
         *status = HYPERCLIENT_SERVERERROR;
         return false;
@@ -223,10 +236,15 @@ attributes_from_value(const hyperdex::configuration& config,
 
     size_t sz = sizeof(hyperclient_attribute) * dimension_names.size() + key_sz
               + dimension_names[0].name.size() + 1;
+    size_t selected = 0;
 
     for (size_t i = 0; i < value.size(); ++i)
     {
-        sz += dimension_names[i + 1].name.size() + 1 + value[i].size();
+        if (projection.bits() == 0 || projection.get(i))
+        {
+            sz += dimension_names[i + 1].name.size() + 1 + value[i].size();
+            ++selected;
+        }
     }
 
     std::vector<hyperclient_attribute> ha;
@@ -240,7 +258,7 @@ attributes_from_value(const hyperdex::configuration& config,
     }
 
     e::guard g = e::makeguard(free, ret);
-    char* data = ret + sizeof(hyperclient_attribute) * value.size();
+    char* data = ret + sizeof(hyperclient_attribute) * selected;
 
     if (key)
     {
@@ -258,6 +276,11 @@ attributes_from_value(const hyperdex::configuration& config,
 
     for (size_t i = 0; i < value.size(); ++i)
     {
+        if (projection.bits() != 0 && !projection.get(i))
+        {
+            continue;
+        }
+
         ha.push_back(hyperclient_attribute());
         size_t attr_sz = dimension_names[i + 1].name.size() + 1;
         ha.back().attr = data;
@@ -383,6 +406,8 @@ class hyperclient::pending
         virtual handled_how handle_response(hyperdex::network_msgtype type,
                                             e::buffer* msg,
                                             hyperclient_returncode* status) = 0;
+        // Called when loop returns a completedop for this operation.
+        virtual void complete(hyperclient_returncode why) { set_status(why); }
 
     private:
         friend class e::intrusive_ptr<pending>;
@@ -428,6 +453,7 @@ class hyperclient::pending_get : public hyperclient::pending
 {
     public:
         pending_get(hyperclient* cl,
+                    const e::bitfield& projection,
                     hyperclient_returncode* status,
                     struct hyperclient_attribute** attrs,
                     size_t* attrs_sz);
@@ -448,16 +474,19 @@ class hyperclient::pending_get : public hyperclient::pending
 
     private:
         hyperclient* m_cl;
+        e::bitfield m_projection;
         hyperclient_attribute** m_attrs;
         size_t* m_attrs_sz;
 };
 
 hyperclient :: pending_get :: pending_get(hyperclient* cl,
+                                          const e::bitfield& projection,
                                           hyperclient_returncode* status,
                                           struct hyperclient_attribute** attrs,
                                           size_t* attrs_sz)
     : pending(status)
     , m_cl(cl)
+    , m_projection(projection)
     , m_attrs(attrs)
     , m_attrs_sz(attrs_sz)
 {
@@ -509,6 +538,9 @@ hyperclient :: pending_get :: handle_response(hyperdex::network_msgtype type,
         case hyperdex::NET_NOTUS:
             set_status(HYPERCLIENT_RECONFIGURE);
             return REMOVE;
+        case hyperdex::NET_OVERLOADED:
+            set_status(HYPERCLIENT_OVERLOADED);
+            return REMOVE;
         case hyperdex::NET_SERVERERROR:
         default:
             set_status(HYPERCLIENT_SERVERERROR);
@@ -525,7 +557,7 @@ hyperclient :: pending_get :: handle_response(hyperdex::network_msgtype type,
     }
 
     if (!attributes_from_value(*m_cl->m_config, entity(), NULL, 0, value,
-                               status, m_attrs, m_attrs_sz))
+                               m_projection, status, m_attrs, m_attrs_sz))
     {
         set_status(*status);
         return REMOVE;
@@ -618,6 +650,9 @@ hyperclient :: pending_statusonly :: handle_response(hyperdex::network_msgtype t
         case hyperdex::NET_NOTUS:
             set_status(HYPERCLIENT_RECONFIGURE);
             break;
+        case hyperdex::NET_OVERLOADED:
+            set_status(HYPERCLIENT_OVERLOADED);
+            break;
         case hyperdex::NET_SERVERERROR:
         default:
             set_status(HYPERCLIENT_SERVERERROR);
@@ -633,6 +668,7 @@ class hyperclient::pending_search : public hyperclient::pending
         pending_search(hyperclient* cl,
                        uint64_t searchid,
                        std::tr1::shared_ptr<uint64_t> refcount,
+                       const e::bitfield& projection,
                        hyperclient_returncode* status,
                        hyperclient_attribute** attrs,
                        size_t* attrs_sz);
@@ -644,10 +680,14 @@ class hyperclient::pending_search : public hyperclient::pending
         virtual handled_how handle_response(hyperdex::network_msgtype type,
                                             e::buffer* msg,
                                             hyperclient_returncode* status);
+        virtual void complete(hyperclient_returncode why);
 
     private:
         pending_search(const pending_search& other);
 
+    private:
+        handled_how handle_batch(e::buffer* msg, hyperclient_returncode* status);
+
     private:
         pending_search& operator = (const pending_search& rhs);
 
@@ -656,29 +696,40 @@ class hyperclient::pending_search : public hyperclient::pending
         hyperdex::network_msgtype m_reqtype;
         uint64_t m_searchid;
         std::tr1::shared_ptr<uint64_t> m_refcount;
+        e::bitfield m_projection;
         hyperclient_attribute** m_attrs;
         size_t* m_attrs_sz;
+        // Objects from a batch which loop has yet to return.
+        std::queue<std::pair<hyperclient_attribute*, size_t> > m_items;
 };
 
 hyperclient :: pending_search :: pending_search(hyperclient* cl,
                                                 uint64_t searchid,
                                                 std::tr1::shared_ptr<uint64_t> refcount,
+                                                const e::bitfield& projection,
                                                 hyperclient_returncode* status,
                                                 hyperclient_attribute** attrs,
                                                 size_t* attrs_sz)
     : pending(status)
     , m_cl(cl)
-    , m_reqtype(hyperdex::REQ_SEARCH_START)
+    , m_reqtype(hyperdex::REQ_SEARCH_BATCH_START)
     , m_searchid(searchid)
     , m_refcount(refcount)
+    , m_projection(projection)
     , m_attrs(attrs)
     , m_attrs_sz(attrs_sz)
+    , m_items()
 {
     ++*m_refcount;
 }
 
 hyperclient :: pending_search :: ~pending_search() throw ()
 {
+    while (!m_items.empty())
+    {
+        hyperclient_destroy_attrs(m_items.front().first, m_items.front().second);
+        m_items.pop();
+    }
 }
 
 hyperdex::network_msgtype
@@ -690,7 +741,9 @@ hyperclient :: pending_search :: request_type() const
 bool
 hyperclient :: pending_search :: matches_response_type(hyperdex::network_msgtype t) const
 {
-    return t == hyperdex::RESP_SEARCH_ITEM || t == hyperdex::RESP_SEARCH_DONE;
+    return t == hyperdex::RESP_SEARCH_ITEM ||
+           t == hyperdex::RESP_SEARCH_BATCH ||
+           t == hyperdex::RESP_SEARCH_DONE;
 }
 
 handled_how
@@ -713,6 +766,11 @@ hyperclient :: pending_search :: handle_response(hyperdex::network_msgtype type,
         return SILENTREMOVE;
     }
 
+    if (type == hyperdex::RESP_SEARCH_BATCH)
+    {
+        return handle_batch(msg, status);
+    }
+
     // Otheriwise it is a SEARCH_ITEM message.
     e::slice key;
     std::vector<e::slice> value;
@@ -734,7 +792,7 @@ hyperclient :: pending_search :: handle_response(hyperdex::network_msgtype type,
 
     if (!attributes_from_value(*m_cl->m_config, entity(),
                                key.data(), key.size(), value,
-                               status, &attrs, &attrs_sz))
+                               m_projection, status, &attrs, &attrs_sz))
     {
         set_status(*status);
 
@@ -777,6 +835,91 @@ hyperclient :: pending_search :: handle_response(hyperdex::network_msgtype type,
     return KEEP;
 }
 
+void
+hyperclient :: pending_search :: complete(hyperclient_returncode why)
+{
+    if (why == HYPERCLIENT_SUCCESS && !m_items.empty())
+    {
+        *m_attrs = m_items.front().first;
+        *m_attrs_sz = m_items.front().second;
+        m_items.pop();
+    }
+
+    set_status(why);
+}
+
+handled_how
+hyperclient :: pending_search :: handle_batch(e::buffer* msg,
+                                              hyperclient_returncode* status)
+{
+    e::buffer::unpacker up = msg->unpack_from(HDRSIZE);
+    uint32_t count = 0;
+    up = up >> count;
+    *status = HYPERCLIENT_SERVERERROR;
+
+    for (uint32_t i = 0; !up.error() && i < count; ++i)
+    {
+        e::slice key;
+        std::vector<e::slice> value;
+        hyperclient_attribute* attrs;
+        size_t attrs_sz;
+        up = up >> key >> value;
+
+        if (up.error() ||
+            !attributes_from_value(*m_cl->m_config, entity(),
+                                   key.data(), key.size(), value,
+                                   m_projection, status, &attrs, &attrs_sz))
+        {
+            // Objects queued from this batch are freed with the operation.
+            count = 0;
+            break;
+        }
+
+        m_items.push(std::make_pair(attrs, attrs_sz));
+    }
+
+    if (up.error() || count == 0)
+    {
+        set_status(*status);
+
+        if (--*m_refcount == 0)
+        {
+            m_cl->m_completed.push(completedop(this, HYPERCLIENT_SEARCHDONE));
+        }
+
+        return REMOVE;
+    }
+
+    // Replace the credit this batch used.  The nonce stays the same for the
+    // life of the search, as the server may have more batches in flight.
+    std::auto_ptr<e::buffer> smsg(e::buffer::create(HDRSIZE + sizeof(uint64_t) + sizeof(uint16_t)));
+    bool packed = !(smsg->pack_at(HDRSIZE) << static_cast<uint64_t>(id())
+                                           << static_cast<uint16_t>(1)).error();
+    assert(packed);
+    m_reqtype = hyperdex::REQ_SEARCH_CREDIT;
+
+    if (m_cl->send(chan(), this, smsg.get()) < 0)
+    {
+        set_status(HYPERCLIENT_DISCONNECT);
+
+        if (--*m_refcount == 0)
+        {
+            m_cl->m_completed.push(completedop(this, HYPERCLIENT_SEARCHDONE));
+        }
+
+        return FAIL;
+    }
+
+    // Return the first object now, and the rest from subsequent loops.
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        m_cl->m_completed.push(completedop(this, HYPERCLIENT_SUCCESS));
+    }
+
+    complete(HYPERCLIENT_SUCCESS);
+    return KEEP;
+}
+
 ///////////////////////////////// Public Class /////////////////////////////////
 
 hyperclient :: hyperclient(const char* coordinator, in_port_t port)
@@ -805,6 +948,7 @@ hyperclient :: ~hyperclient() throw ()
 
 int64_t
 hyperclient :: get(const char* space, const char* key, size_t key_sz,
+                   const char** project, size_t project_sz,
                    hyperclient_returncode* status,
                    struct hyperclient_attribute** attrs, size_t* attrs_sz)
 {
@@ -813,14 +957,23 @@ hyperclient :: get(const char* space, const char* key, size_t key_sz,
         return -1;
     }
 
+    e::bitfield projection(0);
+    int64_t ret = parse_projection(space, project, project_sz, &projection, status);
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
     e::intrusive_ptr<pending> op;
-    op = new pending_get(this, status, attrs, attrs_sz);
+    op = new pending_get(this, projection, status, attrs, attrs_sz);
     size_t sz = HDRSIZE
               + sizeof(uint32_t)
-              + key_sz;
+              + key_sz
+              + hyperdex::packspace(projection);
     std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
     e::buffer::packer p = msg->pack_at(HDRSIZE);
-    p = p << e::slice(key, key_sz);
+    p = p << e::slice(key, key_sz) << projection;
     assert(!p.error());
     return add_keyop(space, key, key_sz, msg, op);
 }
@@ -880,6 +1033,8 @@ int64_t
 hyperclient :: search(const char* space,
                       const struct hyperclient_attribute* eq, size_t eq_sz,
                       const struct hyperclient_range_query* rn, size_t rn_sz,
+                      const struct hyperclient_prefix_query* pf, size_t pf_sz,
+                      const char** project, size_t project_sz,
                       enum hyperclient_returncode* status,
                       struct hyperclient_attribute** attrs, size_t* attrs_sz)
 {
@@ -934,6 +1089,7 @@ hyperclient :: search(const char* space,
             return -1 - i;
         }
 
+        seen.set(dimnum);
         s.equality_set(dimnum, e::slice(eq[i].value, eq[i].value_sz));
     }
 
@@ -968,9 +1124,54 @@ hyperclient :: search(const char* space,
             return -1 - eq_sz - i;
         }
 
+        seen.set(dimnum);
         s.range_set(dimnum, rn[i].lower, rn[i].upper);
     }
 
+    // Check the prefix conditions.
+    for (size_t i = 0; i < pf_sz; ++i)
+    {
+        std::vector<hyperdex::attribute>::const_iterator dim;
+        dim = dimension_names.begin();
+
+        while (dim < dimension_names.end() && dim->name != pf[i].attr)
+        {
+            ++dim;
+        }
+
+        if (dim == dimension_names.begin())
+        {
+            *status = HYPERCLIENT_DONTUSEKEY;
+            return -1 - eq_sz - rn_sz - i;
+        }
+
+        if (dim == dimension_names.end())
+        {
+            *status = HYPERCLIENT_UNKNOWNATTR;
+            return -1 - eq_sz - rn_sz - i;
+        }
+
+        uint16_t dimnum = dim - dimension_names.begin();
+
+        if (seen.get(dimnum))
+        {
+            *status = HYPERCLIENT_DUPEATTR;
+            return -1 - eq_sz - rn_sz - i;
+        }
+
+        seen.set(dimnum);
+        s.prefix_set(dimnum, e::slice(pf[i].prefix, pf[i].prefix_sz));
+    }
+
+    // Check the projection.
+    e::bitfield projection(0);
+    int64_t ret = parse_projection(space, project, project_sz, &projection, status);
+
+    if (ret < 0)
+    {
+        return ret - eq_sz - rn_sz - pf_sz;
+    }
+
     // Get the hosts that match our search terms.
     std::map<hyperdex::entityid, hyperdex::instance> search_entities;
     search_entities = m_config->search_entities(si, s);
@@ -980,15 +1181,24 @@ hyperclient :: search(const char* space,
     ++m_requestid;
 
     // Pack the message to send
-    std::auto_ptr<e::buffer> msg(e::buffer::create(HDRSIZE + sizeof(uint64_t) + s.packed_size()));
-    bool packed = !(msg->pack_at(HDRSIZE) << searchid << s).error();
+    std::auto_ptr<e::buffer> msg(e::buffer::create(HDRSIZE + sizeof(uint64_t)
+                                                   + 2 * sizeof(uint32_t) + sizeof(uint16_t)
+                                                   + s.packed_size()
+                                                   + hyperdex::packspace(projection)));
+    e::buffer::packer pa = msg->pack_at(HDRSIZE);
+    pa = pa << searchid
+            << static_cast<uint32_t>(SEARCH_BATCH_ITEMS)
+            << static_cast<uint32_t>(SEARCH_BATCH_BYTES)
+            << static_cast<uint16_t>(SEARCH_CREDIT)
+            << s << projection;
+    bool packed = !pa.error();
     assert(packed);
     std::tr1::shared_ptr<uint64_t> refcount(new uint64_t(0));
 
     for (std::map<hyperdex::entityid, hyperdex::instance>::const_iterator ent_inst = search_entities.begin();
             ent_inst != search_entities.end(); ++ent_inst)
     {
-        e::intrusive_ptr<pending> op   = new pending_search(this, searchid, refcount, status, attrs, attrs_sz);
+        e::intrusive_ptr<pending> op   = new pending_search(this, searchid, refcount, projection, status, attrs, attrs_sz);
         e::intrusive_ptr<channel> chan = get_channel(ent_inst->second, status);
 
         if (!chan)
@@ -1211,7 +1421,7 @@ hyperclient :: loop(int timeout, hyperclient_returncode* status)
     {
         *status = HYPERCLIENT_SUCCESS;
         int64_t ret = m_completed.front().op->id();
-        m_completed.front().op->set_status(m_completed.front().why);
+        m_completed.front().op->complete(m_completed.front().why);
         m_completed.pop();
         return ret;
     }
@@ -1350,6 +1560,68 @@ hyperclient :: pack_attrs_sz(const struct hyperclient_attribute* attrs,
     return sz;
 }
 
+int64_t
+hyperclient :: parse_projection(const char* space,
+                                const char** project,
+                                size_t project_sz,
+                                e::bitfield* projection,
+                                hyperclient_returncode* status)
+{
+    hyperdex::spaceid si = m_config->space(space);
+
+    if (si == hyperdex::spaceid())
+    {
+        *status = HYPERCLIENT_UNKNOWNSPACE;
+        return -1;
+    }
+
+    // An empty projection asks for every attribute.
+    if (project_sz == 0)
+    {
+        *projection = e::bitfield(0);
+        return 0;
+    }
+
+    std::vector<hyperdex::attribute> dimension_names = m_config->dimension_names(si);
+    assert(dimension_names.size() > 0);
+    *projection = e::bitfield(dimension_names.size() - 1);
+
+    for (size_t i = 0; i < project_sz; ++i)
+    {
+        std::vector<hyperdex::attribute>::const_iterator dim;
+        dim = dimension_names.begin();
+
+        while (dim < dimension_names.end() && dim->name != project[i])
+        {
+            ++dim;
+        }
+
+        if (dim == dimension_names.begin())
+        {
+            *status = HYPERCLIENT_DONTUSEKEY;
+            return -1 - i;
+        }
+
+        if (dim == dimension_names.end())
+        {
+            *status = HYPERCLIENT_UNKNOWNATTR;
+            return -1 - i;
+        }
+
+        uint16_t dimnum = dim - dimension_names.begin();
+
+        if (projection->get(dimnum - 1))
+        {
+            *status = HYPERCLIENT_DUPEATTR;
+            return -1 - i;
+        }
+
+        projection->set(dimnum - 1);
+    }
+
+    return 0;
+}
+
 int64_t
 hyperclient :: send(e::intrusive_ptr<channel> chan,
                     e::intrusive_ptr<pending> op,
@@ -1549,6 +1821,7 @@ operator << (std::ostream& lhs, hyperclient_returncode rhs)
         stringify(HYPERCLIENT_SEEERRNO);
         stringify(HYPERCLIENT_NONEPENDING);
         stringify(HYPERCLIENT_DONTUSEKEY);
+        stringify(HYPERCLIENT_OVERLOADED);
         stringify(HYPERCLIENT_EXCEPTION);
         stringify(HYPERCLIENT_ZERO);
         stringify(HYPERCLIENT_A);
@@ -51,6 +51,7 @@
 #include <po6/io/fd.h>
 
 // e
+#include <e/bitfield.h>
 #include <e/buffer.h>
 #include <e/intrusive_ptr.h>
 #include <e/lockfree_hash_map.h>
@@ -83,6 +84,15 @@ struct hyperclient_range_query
     uint64_t upper;
 };
 
+/* Matches every value of attr which starts with the prefix_sz bytes of prefix.
+ * The search visits fewer hosts when attr is hashed as "ordered". */
+struct hyperclient_prefix_query
+{
+    const char* attr;
+    const char* prefix;
+    size_t prefix_sz;
+};
+
 /* HyperClient returncode occupies [8448, 8576) */
 enum hyperclient_returncode
 {
@@ -104,6 +114,7 @@ enum hyperclient_returncode
     HYPERCLIENT_SEEERRNO     = 8522,
     HYPERCLIENT_NONEPENDING  = 8523,
     HYPERCLIENT_DONTUSEKEY   = 8524,
+    HYPERCLIENT_OVERLOADED   = 8525,
 
     /* This should never happen.  It indicates a bug */
     HYPERCLIENT_EXCEPTION    = 8574,
@@ -138,13 +149,20 @@ hyperclient_destroy(struct hyperclient* client);
  * Allocated memory will be returned in *attrs.  This memory *MUST* be freed
  * using hyperclient_attribute_free.
  *
- * - space, key must point to memory that exists for the duration of this call
+ * If project_sz > 0, only the attributes named in "project" are retrieved;
+ * the server does not send the others.  If this returns a value < 0 and
+ * *status == HYPERCLIENT_UNKNOWNATTR, then abs(returned value) - 1 == the
+ * index into "project" which caused the error.
+ *
+ * - space, key, project must point to memory that exists for the duration of
+ *   this call
  * - client, status, attrs, attrs_sz must point to memory that exists until the
  *   request is considered complete
  */
 int64_t
 hyperclient_get(struct hyperclient* client, const char* space, const char* key,
-                size_t key_sz, enum hyperclient_returncode* status,
+                size_t key_sz, const char** project, size_t project_sz,
+                enum hyperclient_returncode* status,
                 struct hyperclient_attribute** attrs, size_t* attrs_sz);
 
 /* Store the secondary attributes under "key" in "space".
@@ -154,6 +172,9 @@ hyperclient_get(struct hyperclient* client, const char* space, const char* key,
  * All attributes not specified by the put are left as-is (if the key already
  * exists), or set to "" (if the key doesn't yet exist).
  *
+ * A put or del completes with HYPERCLIENT_OVERLOADED if the server has too many
+ * writes waiting to be flushed.  Nothing was written; retry it later.
+ *
  * - space, key, attrs must point to memory that exists for the duration of this
  *   call
  * - client, status must point to memory that exists until the request is
@@ -174,7 +195,7 @@ int64_t
 hyperclient_del(struct hyperclient* client, const char* space, const char* key,
                 size_t key_sz, enum hyperclient_returncode* status);
 
-/* Perform a search for objects which match "eq" and "rn".
+/* Perform a search for objects which match "eq", "rn" and "pf".
  *
  * Each time hyperclient_loop returns the identifier generated by a call to
  * hyperclient_search the memory pointed to by status, attrs, and attrs_sz will
@@ -183,7 +204,12 @@ hyperclient_del(struct hyperclient* client, const char* space, const char* key,
  *
  * If this returns a value < 0 and *status == HYPERCLIENT_UNKNOWNATTR, then
  * abs(returned value) - 1 == the attribute which caused the error.  If the
- * attr's index >= eq_sz, it is an index into rn.
+ * attr's index >= eq_sz, it is an index into rn.  If the index >= eq_sz +
+ * rn_sz, it is an index into pf.  If the index >= eq_sz + rn_sz + pf_sz, it is
+ * an index into project.
+ *
+ * If project_sz > 0, each object returned carries its key and only the
+ * attributes named in "project".
  *
  * If an error is encountered early in the search such that no hosts have been
  * contacted for the search, -1 will be returned, and *status will be set to the
@@ -193,6 +219,8 @@ int64_t
 hyperclient_search(struct hyperclient* client, const char* space,
                    const struct hyperclient_attribute* eq, size_t eq_sz,
                    const struct hyperclient_range_query* rn, size_t rn_sz,
+                   const struct hyperclient_prefix_query* pf, size_t pf_sz,
+                   const char** project, size_t project_sz,
                    enum hyperclient_returncode* status,
                    struct hyperclient_attribute** attrs, size_t* attrs_sz);
 
@@ -235,6 +263,7 @@ class hyperclient
 
     public:
         int64_t get(const char* space, const char* key, size_t key_sz,
+                    const char** project, size_t project_sz,
                     hyperclient_returncode* status,
                     struct hyperclient_attribute** attrs, size_t* attrs_sz);
         int64_t put(const char* space, const char* key, size_t key_sz,
@@ -245,6 +274,8 @@ class hyperclient
         int64_t search(const char* space,
                        const struct hyperclient_attribute* eq, size_t eq_sz,
                        const struct hyperclient_range_query* rn, size_t rn_sz,
+                       const struct hyperclient_prefix_query* pf, size_t pf_sz,
+                       const char** project, size_t project_sz,
                        enum hyperclient_returncode* status,
                        struct hyperclient_attribute** attrs, size_t* attrs_sz);
         int64_t loop(int timeout, hyperclient_returncode* status);
@@ -273,6 +304,11 @@ class hyperclient
                            hyperclient_returncode* status);
         size_t pack_attrs_sz(const struct hyperclient_attribute* attrs,
                              size_t attrs_sz);
+        int64_t parse_projection(const char* space,
+                                 const char** project,
+                                 size_t project_sz,
+                                 e::bitfield* projection,
+                                 hyperclient_returncode* status);
         int64_t send(e::intrusive_ptr<channel> chan,
                      e::intrusive_ptr<pending> op,
                      e::buffer* msg);
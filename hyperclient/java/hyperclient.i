@@ -67,6 +67,7 @@ enum ReturnCode
     DUPEATTR     = 8521,
     SEEERRNO     = 8522,
     NONEPENDING  = 8523,
+    OVERLOADED   = 8525,
     EXCEPTION    = 8574,
     ZERO         = 8575
 };
@@ -59,6 +59,8 @@ HyperClient :: get(const std::string& space,
     id = m_client.get(space.c_str(),
                       key.data(),
                       key.size(),
+                      NULL,
+                      0,
                       &stat1,
                       &attrs,
                       &attrs_sz);
@@ -206,7 +208,7 @@ HyperClient :: range_search(const std::string& space,
     hyperclient_attribute* attrs = NULL;
     size_t attrs_sz = 0;
 
-    id = m_client.search(space.c_str(), NULL, 0, &rn, 1, &status, &attrs, &attrs_sz);
+    id = m_client.search(space.c_str(), NULL, 0, &rn, 1, NULL, 0, NULL, 0, &status, &attrs, &attrs_sz);
 
     if (id < 0)
     {
@@ -60,6 +60,11 @@ cdef extern from "../hyperclient.h":
         uint64_t lower
         uint64_t upper
 
+    cdef struct hyperclient_prefix_query:
+        char* attr
+        char* prefix
+        size_t prefix_sz
+
     cdef enum hyperclient_returncode:
         HYPERCLIENT_SUCCESS      = 8448
         HYPERCLIENT_NOTFOUND     = 8449
@@ -77,6 +82,7 @@ cdef extern from "../hyperclient.h":
         HYPERCLIENT_SEEERRNO     = 8522
         HYPERCLIENT_NONEPENDING  = 8523
         HYPERCLIENT_DONTUSEKEY   = 8524
+        HYPERCLIENT_OVERLOADED   = 8525
         HYPERCLIENT_EXCEPTION    = 8574
         HYPERCLIENT_ZERO         = 8575
         HYPERCLIENT_A            = 8576
@@ -84,10 +90,10 @@ cdef extern from "../hyperclient.h":
 
     hyperclient* hyperclient_create(char* coordinator, in_port_t port)
     void hyperclient_destroy(hyperclient* client)
-    int64_t hyperclient_get(hyperclient* client, char* space, char* key, size_t key_sz, hyperclient_returncode* status, hyperclient_attribute** attrs, size_t* attrs_sz)
+    int64_t hyperclient_get(hyperclient* client, char* space, char* key, size_t key_sz, char** project, size_t project_sz, hyperclient_returncode* status, hyperclient_attribute** attrs, size_t* attrs_sz)
     int64_t hyperclient_put(hyperclient* client, char* space, char* key, size_t key_sz, hyperclient_attribute* attrs, size_t attrs_sz, hyperclient_returncode* status)
     int64_t hyperclient_del(hyperclient* client, char* space, char* key, size_t key_sz, hyperclient_returncode* status)
-    int64_t hyperclient_search(hyperclient* client, char* space, hyperclient_attribute* eq, size_t eq_sz, hyperclient_range_query* rn, size_t rn_sz, hyperclient_returncode* status, hyperclient_attribute** attrs, size_t* attrs_sz)
+    int64_t hyperclient_search(hyperclient* client, char* space, hyperclient_attribute* eq, size_t eq_sz, hyperclient_range_query* rn, size_t rn_sz, hyperclient_prefix_query* pf, size_t pf_sz, char** project, size_t project_sz, hyperclient_returncode* status, hyperclient_attribute** attrs, size_t* attrs_sz)
     int64_t hyperclient_loop(hyperclient* client, int timeout, hyperclient_returncode* status)
     void hyperclient_destroy_attrs(hyperclient_attribute* attrs, size_t attrs_sz)
 
@@ -113,6 +119,7 @@ class HyperClientException(Exception):
                   ,HYPERCLIENT_SEEERRNO: 'See ERRNO'
                   ,HYPERCLIENT_NONEPENDING: 'None pending'
                   ,HYPERCLIENT_DONTUSEKEY: "Don't use the key in the search predicate"
+                  ,HYPERCLIENT_OVERLOADED: 'Server overloaded (retry later)'
                   ,HYPERCLIENT_EXCEPTION: 'Internal Error (file a bug)'
                   }.get(status, 'Unknown Error (file a bug)')
 
@@ -160,7 +167,7 @@ cdef class DeferredLookup(Deferred):
         cdef char* space_cstr = space
         cdef char* key_cstr = key
         self._reqid = hyperclient_get(client._client, space_cstr,
-                                      key_cstr, len(key),
+                                      key_cstr, len(key), NULL, 0,
                                       &self._status,
                                       &self._attrs, &self._attrs_sz)
         if self._reqid < 0:
@@ -285,6 +292,8 @@ cdef class Search:
                                              self._space,
                                              eq, len(equalities),
                                              rn, len(ranges),
+                                             NULL, 0,
+                                             NULL, 0,
                                              &self._status,
                                              &self._attrs,
                                              &self._attrs_sz)
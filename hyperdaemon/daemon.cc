@@ -29,17 +29,24 @@
 #include <signal.h>
 
 // STL
+#include <fstream>
+#include <memory>
 #include <tr1/memory>
 
 // Google Log
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 
+// po6
+#include <po6/error.h>
+#include <po6/pathname.h>
+
 // e
 #include <e/timer.h>
 
 // HyperDex
 #include "hyperdex/hyperdex/coordinatorlink.h"
+#include "hyperdex/hyperdex/instance.h"
 
 // HyperDaemon
 #include "hyperdaemon/hyperdaemon/daemon.h"
@@ -63,8 +70,50 @@ sig_handle(int /*signum*/)
     s_continue = false;
 }
 
+// The ports we were bound to are kept in this file in the data directory, so
+// that a restarted daemon announces itself as the same instance.  The
+// coordinator then hands back its regions, and the datalayer recovers them.
+static po6::pathname
+instance_filename(const po6::pathname& datadir)
+{
+    return po6::join(datadir, po6::pathname("instance"));
+}
+
+static bool
+read_instance_ports(const po6::pathname& datadir,
+                    in_port_t* incoming,
+                    in_port_t* outgoing)
+{
+    std::ifstream fin(instance_filename(datadir).get());
+    in_port_t inc;
+    in_port_t out;
+
+    if (!(fin >> inc >> out))
+    {
+        return false;
+    }
+
+    *incoming = inc;
+    *outgoing = out;
+    return true;
+}
+
+static void
+write_instance_ports(const po6::pathname& datadir,
+                     const hyperdex::instance& inst)
+{
+    std::ofstream fout(instance_filename(datadir).get());
+    fout << inst.inbound_port << " " << inst.outbound_port << std::endl;
+
+    if (!fout)
+    {
+        LOG(WARNING) << "Could not record our ports; a restart will not recover our regions";
+    }
+}
+
 int
 hyperdaemon :: daemon(po6::pathname datadir,
+                      po6::pathname colddir,
                       po6::net::location coordinator,
                       uint16_t num_threads,
                       po6::net::ipaddr bind_to,
@@ -93,9 +142,30 @@ hyperdaemon :: daemon(po6::pathname datadir,
     // Setup our link to the coordinator.
     hyperdex::coordinatorlink cl(coordinator);
     // Setup the data component.
-    datalayer data(&cl, datadir);
-    // Setup the communication component.
-    logical comm(&cl, bind_to, incoming, outgoing, num_threads);
+    datalayer data(&cl, datadir, colddir);
+    // Setup the communication component.  Unless told which ports to use, we
+    // reuse the ports of the last daemon to use this data directory.
+    bool reused = incoming == 0 && outgoing == 0 &&
+                  read_instance_ports(datadir, &incoming, &outgoing);
+    std::auto_ptr<logical> commptr;
+
+    try
+    {
+        commptr.reset(new logical(&cl, bind_to, incoming, outgoing, num_threads));
+    }
+    catch (po6::error& e)
+    {
+        if (!reused)
+        {
+            throw;
+        }
+
+        PLOG(WARNING) << "Could not bind to the ports we used before; our regions will not be recovered";
+        commptr.reset(new logical(&cl, bind_to, 0, 0, num_threads));
+    }
+
+    logical& comm(*commptr);
+    write_instance_ports(datadir, comm.inst());
     // Create our announce string.
     std::ostringstream announce;
     announce << "instance\t" << comm.inst().address << "\t"
@@ -29,16 +29,22 @@
 
 // C
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 // POSIX
+#include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 // C++
 #include <limits>
 
 // STL
+#include <algorithm>
 #include <iomanip>
 #include <set>
 #include <sstream>
@@ -51,8 +57,12 @@
 #include <po6/pathname.h>
 
 // e
+#include <e/guard.h>
 #include <e/timer.h>
 
+// HyperDisk
+#include "hyperdisk/hyperdisk/compressor.h"
+
 // HyperDex
 #include "hyperdex/hyperdex/configuration.h"
 #include "hyperdex/hyperdex/coordinatorlink.h"
@@ -70,20 +80,103 @@ using hyperdex::coordinatorlink;
 typedef e::intrusive_ptr<hyperdisk::disk> disk_ptr;
 typedef std::map<hyperdex::regionid, disk_ptr> disk_map_t;
 
-hyperdaemon :: datalayer :: datalayer(coordinatorlink* cl, const po6::pathname& base)
+// Rename the directory of a disk left behind by an earlier process, keeping
+// it for inspection, so that a new disk may be created in its place.
+static void
+move_disk_aside(const po6::pathname& path)
+{
+    std::ostringstream aside;
+    aside << path.get() << ".stale-" << e::time();
+    LOG(WARNING) << "Moving the disk left behind in " << path.get()
+                 << " to " << aside.str();
+
+    if (rename(path.get(), aside.str().c_str()) < 0)
+    {
+        throw po6::error(errno);
+    }
+}
+
+// Remove the directory of a disk left behind by an earlier process without
+// reading it, or move it aside if it cannot be removed.
+static void
+discard_disk(const po6::pathname& path)
+{
+    DIR* dir = opendir(path.get());
+    bool removed = dir != NULL;
+
+    if (dir)
+    {
+        e::guard dir_guard = e::makeguard(closedir, dir);
+        dir_guard.use_variable();
+        struct dirent* ent;
+        errno = 0;
+
+        while ((ent = readdir(dir)))
+        {
+            if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0 &&
+                unlinkat(dirfd(dir), ent->d_name, 0) < 0)
+            {
+                removed = false;
+            }
+        }
+
+        removed = removed && errno == 0;
+    }
+
+    if (!removed || rmdir(path.get()) < 0)
+    {
+        move_disk_aside(path);
+    }
+}
+
+// The value attributes which the disk should keep in columns:  as many of the
+// uint64 attributes as a shard may hold.
+static uint64_t
+columnar_attributes(const std::vector<hyperdex::attribute>& attrs)
+{
+    uint64_t columnar = 0;
+
+    // Attribute 0 is the key.
+    for (size_t i = 1; i < attrs.size() && i <= 64; ++i)
+    {
+        if (attrs[i].type == hyperdex::DATATYPE_UINT64 &&
+            static_cast<unsigned int>(__builtin_popcountll(columnar)) < hyperdisk::geometry::max_columns())
+        {
+            columnar |= 1ULL << (i - 1);
+        }
+    }
+
+    return columnar;
+}
+
+hyperdaemon :: datalayer :: datalayer(coordinatorlink* cl,
+                                      const po6::pathname& base,
+                                      const po6::pathname& cold)
     : m_cl(cl)
     , m_shutdown(false)
     , m_base(base)
+    , m_cold(cold)
     , m_optimistic_io_thread(std::tr1::bind(&datalayer::optimistic_io_thread, this))
     , m_flush_threads()
+    , m_log_commit_thread(std::tr1::bind(&datalayer::log_commit_thread, this))
+    , m_scrub_thread(std::tr1::bind(&datalayer::scrub_thread, this))
     , m_disks()
-    , m_preallocate_rr()
+    , m_recover(true)
     , m_last_preallocation(0)
-    , m_optimistic_rr()
     , m_last_dose_of_optimism(0)
-    , m_flushed_recently(false)
+    , m_last_compression_report(0)
+    , m_pressure_lock()
+    , m_pressure_cond(&m_pressure_lock)
+    , m_log_bytes(0)
+    , m_idle_flushers(0)
+    , m_failed_lock()
+    , m_us()
+    , m_failed()
+    , m_failure_reported(false)
 {
     m_optimistic_io_thread.start();
+    m_log_commit_thread.start();
+    m_scrub_thread.start();
 
     for (size_t i = 0; i < FLUSH_THREADS; ++i)
     {
@@ -102,6 +195,8 @@ hyperdaemon :: datalayer :: ~datalayer() throw ()
     }
 
     m_optimistic_io_thread.join();
+    m_log_commit_thread.join();
+    m_scrub_thread.join();
 
     for (size_t i = 0; i < m_flush_threads.size(); ++i)
     {
@@ -115,11 +210,13 @@ hyperdaemon :: datalayer :: prepare(const configuration& newconfig, const instan
     std::set<regionid> regions = newconfig.regions_for(us);
     std::map<uint16_t, regionid> in_transfers = newconfig.transfers_to(us);
     std::map<uint16_t, regionid>::iterator t;
+    std::set<regionid> transferred;
 
     // Make sure that inbound state exists for each in-progress transfer to us.
     for (t = in_transfers.begin(); t != in_transfers.end(); ++t)
     {
         regions.insert(t->second);
+        transferred.insert(t->second);
     }
 
     for (std::set<regionid>::const_iterator r = regions.begin();
@@ -127,16 +224,25 @@ hyperdaemon :: datalayer :: prepare(const configuration& newconfig, const instan
     {
         if (!m_disks.contains(*r))
         {
+            // Only the regions of the first configuration (those the
+            // coordinator hands back to us after a restart) are recovered.
+            // Inbound transfers start afresh.
+            bool recover = m_recover && transferred.find(*r) == transferred.end();
             create_disk(*r, newconfig.disk_hasher(r->get_subspace()),
-                        newconfig.dimensions(r->get_space()));
+                        newconfig.dimensions(r->get_space()),
+                        columnar_attributes(newconfig.dimension_names(r->get_space())),
+                        recover);
         }
     }
+
+    m_recover = false;
 }
 
 void
-hyperdaemon :: datalayer :: reconfigure(const configuration&, const instance&)
+hyperdaemon :: datalayer :: reconfigure(const configuration&, const instance& us)
 {
-    // Do nothing.
+    po6::threads::mutex::hold hold(&m_failed_lock);
+    m_us = po6::net::location(us.address, us.inbound_port);
 }
 
 void
@@ -165,6 +271,8 @@ void
 hyperdaemon :: datalayer :: shutdown()
 {
     m_shutdown = true;
+    po6::threads::mutex::hold hold(&m_pressure_lock);
+    m_pressure_cond.broadcast();
 }
 
 e::intrusive_ptr<hyperdisk::snapshot>
@@ -191,7 +299,8 @@ hyperdaemon :: datalayer :: make_rolling_snapshot(const regionid& ri)
         return e::intrusive_ptr<hyperdisk::rolling_snapshot>();
     }
 
-    return r->make_rolling_snapshot();
+    // Transfers may be slow, so keep the log they have yet to send on disk.
+    return r->make_rolling_snapshot(true);
 }
 
 hyperdisk::returncode
@@ -208,7 +317,14 @@ hyperdaemon :: datalayer :: get(const regionid& ri,
         return hyperdisk::MISSINGDISK;
     }
 
-    return r->get(key, value, version, ref);
+    hyperdisk::returncode ret = r->get(key, value, version, ref);
+
+    if (ret == hyperdisk::CORRUPT)
+    {
+        report_corruption(ri);
+    }
+
+    return ret;
 }
 
 hyperdisk::returncode
@@ -225,7 +341,29 @@ hyperdaemon :: datalayer :: put(const regionid& ri,
         return hyperdisk::MISSINGDISK;
     }
 
-    return r->put(backing, key, value, version);
+    hyperdisk::returncode ret = r->put(backing, key, value, version);
+    notify_writes();
+    return ret;
+}
+
+hyperdisk::returncode
+hyperdaemon :: datalayer :: put(const regionid& ri,
+                                const std::tr1::shared_ptr<e::buffer>* backings,
+                                const e::slice* keys,
+                                const std::vector<e::slice>* values,
+                                const uint64_t* versions,
+                                size_t count)
+{
+    e::intrusive_ptr<hyperdisk::disk> r;
+
+    if (!m_disks.lookup(ri, &r))
+    {
+        return hyperdisk::MISSINGDISK;
+    }
+
+    hyperdisk::returncode ret = r->put(backings, keys, values, versions, count);
+    notify_writes();
+    return ret;
 }
 
 hyperdisk::returncode
@@ -240,7 +378,9 @@ hyperdaemon :: datalayer :: del(const regionid& ri,
         return hyperdisk::MISSINGDISK;
     }
 
-    return r->del(backing, key);
+    hyperdisk::returncode ret = r->del(backing, key);
+    notify_writes();
+    return ret;
 }
 
 hyperdisk::returncode
@@ -257,107 +397,163 @@ hyperdaemon :: datalayer :: flush(const regionid& ri,
     return r->flush(n);
 }
 
+bool
+hyperdaemon :: datalayer :: has_log_memory()
+{
+    uint64_t limit = LOG_MEMORY_LIMIT * 1024ULL * 1024ULL;
+    return limit == 0 || __sync_add_and_fetch(&m_log_bytes, 0) <= limit;
+}
+
 typedef std::map<hyperdex::regionid, e::intrusive_ptr<hyperdisk::disk> > disk_map_t;
-typedef std::queue<hyperdex::regionid> disk_queue_t;
+
+// A disk, and how urgently it needs background work (see disk::pressure).
+struct disk_pressure
+{
+    disk_pressure() : disk(), entries(0), bytes(0), fullest(0) {}
+    e::intrusive_ptr<hyperdisk::disk> disk;
+    uint64_t entries;
+    uint64_t bytes;
+    int fullest;
+};
+
+// Disks holding the most memory in unflushed writes come first.  Equally large
+// logs are ordered by their number of entries.
+static bool
+more_to_flush(const disk_pressure& lhs, const disk_pressure& rhs)
+{
+    if (lhs.bytes != rhs.bytes)
+    {
+        return lhs.bytes > rhs.bytes;
+    }
+
+    return lhs.entries > rhs.entries;
+}
+
+static bool
+more_full(const disk_pressure& lhs, const disk_pressure& rhs)
+{
+    return lhs.fullest > rhs.fullest;
+}
 
 void
 hyperdaemon :: datalayer :: optimistic_io_thread()
 {
     LOG(WARNING) << "Started optimistic-I/O thread.";
+    uint64_t preallocation_interval = 1000000000. / PREALLOCATIONS_PER_SECOND;
+    uint64_t optimism_interval = 1000000000. / OPTIMISM_BURSTS_PER_SECOND;
 
     while (!m_shutdown)
     {
-        // Ensure that all regions are in the preallocation and optimistic-I/O
-        // queues.
+        // Visit the disks with the fullest shards first, as they are the
+        // closest to stalling a flush until their shards are split.
+        std::vector<disk_pressure> disks;
+
         for (disk_map_t::iterator d = m_disks.begin(); d != m_disks.end(); d.next())
         {
-            if (std::find(m_preallocate_rr.begin(), m_preallocate_rr.end(), d.key())
-                    == m_preallocate_rr.end())
-            {
-                m_preallocate_rr.push_back(d.key());
-            }
-
-            if (std::find(m_optimistic_rr.begin(), m_optimistic_rr.end(), d.key())
-                    == m_optimistic_rr.end())
-            {
-                m_optimistic_rr.push_back(d.key());
-            }
+            disks.push_back(disk_pressure());
+            disks.back().disk = d.value();
+            d.value()->pressure(&disks.back().entries, &disks.back().bytes, &disks.back().fullest);
         }
 
-        // We rate-limit the number of preallocations we do each second.
-        uint64_t nanos_since_last_prealloc = e::time() - m_last_preallocation;
-        uint64_t preallocation_interval = 1000000000. / PREALLOCATIONS_PER_SECOND;
+        std::stable_sort(disks.begin(), disks.end(), more_full);
+        // We rate-limit the preallocations and optimistic splits we do each
+        // second, unless a shard is nearly full.
+        bool urgent = !disks.empty() && disks.front().fullest >= URGENT_FULLNESS;
+        uint64_t now = e::time();
 
-        if (nanos_since_last_prealloc / preallocation_interval >= 1)
+        if (urgent || now - m_last_preallocation >= preallocation_interval)
         {
-            for (size_t i = 0; i < m_preallocate_rr.size(); ++i)
+            for (size_t i = 0; i < disks.size(); ++i)
             {
-                e::intrusive_ptr<hyperdisk::disk> d;
+                hyperdisk::returncode ret = disks[i].disk->preallocate();
 
-                if (m_disks.lookup(m_preallocate_rr.front(), &d))
+                if (ret == hyperdisk::SUCCESS)
                 {
-                    m_preallocate_rr.push_back(m_preallocate_rr.front());
-                    hyperdisk::returncode ret = d->preallocate();
-
-                    if (ret == hyperdisk::SUCCESS)
-                    {
-                        break;
-                    }
-                    else if (ret == hyperdisk::DIDNOTHING)
-                    {
-                    }
-                    else
-                    {
-                        PLOG(WARNING) << "Disk preallocation failed";
-                    }
+                    break;
+                }
+                else if (ret == hyperdisk::DIDNOTHING)
+                {
+                }
+                else
+                {
+                    PLOG(WARNING) << "Disk preallocation failed";
                 }
-
-                m_preallocate_rr.pop_front();
             }
 
-            m_last_preallocation = e::time();
+            m_last_preallocation = now;
         }
 
-        // We rate-limit the number of optimistic splits we do each second.
-        uint64_t nanos_since_last_optimism = e::time() - m_last_dose_of_optimism;
-        uint64_t optimism_interval = 1000000000. / OPTIMISM_BURSTS_PER_SECOND;
-
-        if (nanos_since_last_optimism / optimism_interval >= 1)
+        if (urgent || now - m_last_dose_of_optimism >= optimism_interval)
         {
-            for (size_t i = 0; i < m_optimistic_rr.size(); ++i)
+            for (size_t i = 0; i < disks.size(); ++i)
             {
-                e::intrusive_ptr<hyperdisk::disk> d;
+                hyperdisk::returncode ret = disks[i].disk->do_optimistic_io();
 
-                if (m_disks.lookup(m_optimistic_rr.front(), &d))
+                if (ret == hyperdisk::SUCCESS)
+                {
+                    break;
+                }
+                else if (ret == hyperdisk::DIDNOTHING)
                 {
-                    m_optimistic_rr.push_back(m_optimistic_rr.front());
-                    hyperdisk::returncode ret = d->do_optimistic_io();
-
-                    if (ret == hyperdisk::SUCCESS)
-                    {
-                        break;
-                    }
-                    else if (ret == hyperdisk::DIDNOTHING)
-                    {
-                    }
-                    else
-                    {
-                        PLOG(WARNING) << "Optimistic disk I/O failed";
-                    }
                 }
+                else
+                {
+                    PLOG(WARNING) << "Optimistic disk I/O failed";
+                }
+            }
+
+            // Every disk measures how busy its shards are on each burst.
+            for (size_t i = 0; i < disks.size(); ++i)
+            {
+                hyperdisk::returncode ret = disks[i].disk->tier_shards();
 
-                m_optimistic_rr.pop_front();
+                if (ret != hyperdisk::SUCCESS && ret != hyperdisk::DIDNOTHING)
+                {
+                    PLOG(WARNING) << "Moving a shard between tiers failed";
+                }
             }
 
-            m_last_dose_of_optimism = e::time();
+            m_last_dose_of_optimism = now;
         }
 
-        (void) __sync_and_and_fetch(&m_flushed_recently, false);
+        if (COMPRESSION &&
+            now - m_last_compression_report >= COMPRESSION_REPORT_INTERVAL * 1000000000ULL)
+        {
+            report_compression();
+            m_last_compression_report = now;
+        }
+
+        // Sleep until the next burst is due, waking periodically to notice
+        // shards filling up and shutdown.
+        uint64_t next = std::min(m_last_preallocation + preallocation_interval,
+                                 m_last_dose_of_optimism + optimism_interval);
+        uint64_t millis = 10;
+        now = e::time();
+
+        if (!urgent && next > now)
+        {
+            millis = std::min<uint64_t>((next - now) / 1000000, 100);
+        }
+
+        e::sleep_ms(millis / 1000, std::max<uint64_t>(millis % 1000, 1));
+    }
+}
 
-        do
+void
+hyperdaemon :: datalayer :: report_compression()
+{
+    for (disk_map_t::iterator d = m_disks.begin(); d != m_disks.end(); d.next())
+    {
+        uint64_t raw;
+        uint64_t stored;
+        d.value()->compression(&raw, &stored);
+
+        if (raw > 0 && stored > 0)
         {
-            e::sleep_ms(0, 10);
-        } while (!m_shutdown && !__sync_and_and_fetch(&m_flushed_recently, true));
+            LOG(INFO) << "Disk " << d.key() << " stores " << raw << " bytes of values in "
+                      << stored << " bytes (compression ratio " << std::fixed
+                      << std::setprecision(2) << static_cast<double>(raw) / stored << ")";
+        }
     }
 }
 
@@ -368,16 +564,46 @@ hyperdaemon :: datalayer :: flush_thread()
 
     while (!m_shutdown)
     {
-        bool sleep = true;
+        std::vector<disk_pressure> disks;
+        uint64_t log_bytes = 0;
 
-        for (disk_map_t::iterator d = m_disks.begin();
-                d != m_disks.end(); d.next())
+        for (disk_map_t::iterator d = m_disks.begin(); d != m_disks.end(); d.next())
         {
-            hyperdisk::returncode ret = d.value()->flush(10000);
+            disk_pressure p;
+            p.disk = d.value();
+            p.disk->pressure(&p.entries, &p.bytes, &p.fullest);
+            log_bytes += p.bytes;
+
+            if (p.entries > 0)
+            {
+                disks.push_back(p);
+            }
+        }
+
+        // Publish the memory held by the logs for has_log_memory.
+        (void) __sync_lock_test_and_set(&m_log_bytes, log_bytes);
+
+        if (disks.empty())
+        {
+            wait_for_writes();
+            continue;
+        }
+
+        std::stable_sort(disks.begin(), disks.end(), more_to_flush);
+        bool progress = false;
+
+        for (size_t i = 0; i < disks.size(); ++i)
+        {
+            // Deeper logs are flushed in larger batches, so that a busy disk
+            // drains in a few passes while the other disks are still visited
+            // on every pass.
+            size_t batch = std::min<uint64_t>(disks[i].entries, FLUSH_BATCH_MAX);
+            batch = std::max(batch, FLUSH_BATCH_MIN);
+            hyperdisk::returncode ret = disks[i].disk->flush(batch);
 
             if (ret == hyperdisk::SUCCESS)
             {
-                sleep = false;
+                progress = true;
             }
             else if (ret == hyperdisk::DIDNOTHING)
             {
@@ -385,9 +611,13 @@ hyperdaemon :: datalayer :: flush_thread()
             else if (ret == hyperdisk::DATAFULL || ret == hyperdisk::SEARCHFULL)
             {
                 hyperdisk::returncode ioret;
-                ioret = d.value()->do_mandatory_io();
+                ioret = disks[i].disk->do_mandatory_io();
 
-                if (ioret != hyperdisk::SUCCESS && ioret != hyperdisk::DIDNOTHING)
+                if (ioret == hyperdisk::SUCCESS)
+                {
+                    progress = true;
+                }
+                else if (ioret != hyperdisk::DIDNOTHING)
                 {
                     PLOG(ERROR) << "Disk I/O returned " << ioret;
                 }
@@ -398,41 +628,345 @@ hyperdaemon :: datalayer :: flush_thread()
             }
         }
 
-        if (sleep)
+        // The logs hold entries which cannot be flushed right now (the disks
+        // are busy, or failing), so back off rather than spin.
+        if (!progress)
         {
-            e::sleep_ms(0, 10);
+            e::sleep_ms(0, FLUSH_BACKOFF_MS);
         }
-        else
+    }
+}
+
+void
+hyperdaemon :: datalayer :: wait_for_writes()
+{
+    po6::threads::mutex::hold hold(&m_pressure_lock);
+    __sync_add_and_fetch(&m_idle_flushers, 1);
+
+    // A write which arrived before this thread became idle would not have
+    // notified it, so check once more before sleeping.
+    bool idle = true;
+
+    for (disk_map_t::iterator d = m_disks.begin(); d != m_disks.end(); d.next())
+    {
+        uint64_t entries;
+        uint64_t bytes;
+        int fullest;
+        d.value()->pressure(&entries, &bytes, &fullest);
+        idle = idle && entries == 0;
+    }
+
+    if (idle && !m_shutdown)
+    {
+        m_pressure_cond.wait();
+    }
+
+    __sync_sub_and_fetch(&m_idle_flushers, 1);
+}
+
+void
+hyperdaemon :: datalayer :: notify_writes()
+{
+    if (__sync_add_and_fetch(&m_idle_flushers, 0) > 0)
+    {
+        po6::threads::mutex::hold hold(&m_pressure_lock);
+        m_pressure_cond.broadcast();
+    }
+}
+
+// Group commit for the durable logs.  Each disk commits everything logged
+// since the last pass with a single fdatasync.
+void
+hyperdaemon :: datalayer :: log_commit_thread()
+{
+    if (!DURABLE_LOG)
+    {
+        return;
+    }
+
+    LOG(WARNING) << "Started log-commit thread.";
+    uint64_t commit_interval = 1000000000. / LOG_COMMITS_PER_SECOND;
+
+    while (true)
+    {
+        uint64_t start = e::time();
+        bool stopping = m_shutdown;
+
+        for (disk_map_t::iterator d = m_disks.begin(); d != m_disks.end(); d.next())
+        {
+            hyperdisk::returncode ret = d.value()->commit();
+
+            if (ret != hyperdisk::SUCCESS && ret != hyperdisk::DIDNOTHING)
+            {
+                PLOG(ERROR) << "Could not commit the log for disk " << d.key();
+            }
+        }
+
+        // Make one final pass after shutdown begins.
+        if (stopping)
+        {
+            break;
+        }
+
+        uint64_t elapsed = e::time() - start;
+
+        if (elapsed < commit_interval)
+        {
+            uint64_t millis = (commit_interval - elapsed) / 1000000;
+            e::sleep_ms(millis / 1000, millis % 1000);
+        }
+    }
+}
+
+// Scrub one disk at a time, in order of region, checking at most
+// SCRUB_ENTRIES_PER_SECOND entries each second.  This thread also reports
+// failed regions to the coordinator, retrying until the report is accepted.
+void
+hyperdaemon :: datalayer :: scrub_thread()
+{
+    LOG(WARNING) << "Started scrub thread.";
+    uint64_t scrub_interval = 1000000000ULL / SCRUB_BATCHES_PER_SECOND;
+    size_t batch = std::max(SCRUB_ENTRIES_PER_SECOND / SCRUB_BATCHES_PER_SECOND, 1U);
+    uint64_t last_report = 0;
+    regionid current;
+
+    while (!m_shutdown)
+    {
+        uint64_t start = e::time();
+
+        if (start - last_report >= FAILURE_REPORT_INTERVAL * 1000000000ULL)
+        {
+            send_failure_report();
+            last_report = start;
+        }
+
+        if (!SCRUB_ENTRIES_PER_SECOND)
+        {
+            e::sleep_ms(0, 1000 / SCRUB_BATCHES_PER_SECOND);
+            continue;
+        }
+
+        std::map<regionid, disk_ptr> disks;
+
+        for (disk_map_t::iterator d = m_disks.begin(); d != m_disks.end(); d.next())
+        {
+            disks[d.key()] = d.value();
+        }
+
+        std::map<regionid, disk_ptr>::iterator d = disks.lower_bound(current);
+
+        if (d == disks.end())
+        {
+            d = disks.begin();
+        }
+
+        if (d != disks.end())
+        {
+            current = d->first;
+            hyperdisk::returncode ret = d->second->scrub(batch);
+
+            if (ret == hyperdisk::SUCCESS)
+            {
+            }
+            else if (ret == hyperdisk::DIDNOTHING)
+            {
+                // This pass over the disk is done; move on to the next.
+                ++d;
+                current = d == disks.end() ? regionid() : d->first;
+            }
+            else if (ret == hyperdisk::CORRUPT)
+            {
+                report_corruption(current);
+            }
+            else
+            {
+                LOG(ERROR) << "Scrubbing disk " << current << " returned " << ret;
+            }
+        }
+
+        uint64_t elapsed = e::time() - start;
+
+        if (elapsed < scrub_interval)
+        {
+            uint64_t millis = (scrub_interval - elapsed) / 1000000;
+            e::sleep_ms(millis / 1000, millis % 1000);
+        }
+    }
+}
+
+void
+hyperdaemon :: datalayer :: report_corruption(const regionid& ri)
+{
+    if (fail_region(ri))
+    {
+        LOG(ERROR) << "Disk " << ri << " holds a corrupt entry";
+    }
+}
+
+bool
+hyperdaemon :: datalayer :: fail_region(const regionid& ri)
+{
+    po6::threads::mutex::hold hold(&m_failed_lock);
+    return m_failed.insert(ri).second;
+}
+
+void
+hyperdaemon :: datalayer :: send_failure_report()
+{
+    po6::net::location us;
+    regionid ri;
+
+    {
+        po6::threads::mutex::hold hold(&m_failed_lock);
+
+        // Wait for the first configuration to learn where we are.
+        if (m_failure_reported || m_failed.empty() || m_us == po6::net::location())
         {
-            (void) __sync_or_and_fetch(&m_flushed_recently, true);
+            return;
         }
+
+        us = m_us;
+        ri = *m_failed.begin();
+    }
+
+    LOG(ERROR) << "Failing " << us << " so that its regions are rebuilt from other replicas";
+
+    switch (m_cl->fail_location(us))
+    {
+        case hyperdex::coordinatorlink::SUCCESS:
+            {
+                po6::threads::mutex::hold hold(&m_failed_lock);
+                m_failure_reported = true;
+            }
+            break;
+        case hyperdex::coordinatorlink::SHUTDOWN:
+            LOG(WARNING) << "Could not report the failure of " << ri << ":  error(SHUTDOWN)";
+            break;
+        case hyperdex::coordinatorlink::CONNECTFAIL:
+            LOG(WARNING) << "Could not report the failure of " << ri << ":  error(CONNECTFAIL)";
+            break;
+        case hyperdex::coordinatorlink::DISCONNECT:
+            LOG(WARNING) << "Could not report the failure of " << ri << ":  error(DISCONNECT)";
+            break;
+        case hyperdex::coordinatorlink::LOGICERROR:
+            LOG(WARNING) << "Could not report the failure of " << ri << ":  error(LOGICERROR)";
+            break;
+        default:
+            LOG(WARNING) << "Could not report the failure of " << ri << ":  error unknown";
+            break;
     }
 }
 
 void
 hyperdaemon :: datalayer :: create_disk(const regionid& ri,
                                         const hyperspacehashing::mask::hasher& hasher,
-                                        uint16_t num_columns)
+                                        uint16_t num_columns,
+                                        uint64_t columnar,
+                                        bool recover)
 {
     std::ostringstream ostr;
     ostr << ri;
     po6::pathname path = po6::join(m_base, po6::pathname(ostr.str()));
     disk_ptr d;
+    bool recovered = false;
 
     try
     {
-        // XXX fail this region.
-        d = hyperdisk::disk::create(path, hasher, num_columns);
+        hyperdisk::geometry geom;
+
+        if (ADAPTIVE_SHARDS)
+        {
+            geom = hyperdisk::geometry::adaptive();
+        }
+
+        if (COLUMNAR_ATTRIBUTES)
+        {
+            geom.columnar = columnar;
+        }
+
+        if (COMPRESSION)
+        {
+            if (COMPRESSION <= hyperdisk::compressor::MAX_ID &&
+                hyperdisk::compressor::lookup(COMPRESSION))
+            {
+                geom.compression = COMPRESSION;
+            }
+            else
+            {
+                LOG(WARNING) << "Compressor " << COMPRESSION << " is unknown; "
+                             << "storing disk " << ri << " uncompressed";
+            }
+        }
+
+        struct stat st;
+        bool left_behind = stat(path.get(), &st) == 0;
+
+        // Without the durable log, a disk left behind by a crash is missing
+        // the writes which were never flushed, so only a durable disk is
+        // recovered.
+        bool recovering = left_behind && recover && DURABLE_LOG;
+
+        if (recovering)
+        {
+            try
+            {
+                d = hyperdisk::disk::open(path, hasher, num_columns, true, geom);
+                recovered = true;
+            }
+            catch (po6::error& e)
+            {
+                errno = e;
+                PLOG(ERROR) << "Could not recover disk " << ri << "; starting over";
+            }
+            catch (std::exception& e)
+            {
+                LOG(ERROR) << "Could not recover disk " << ri << "; starting over:  " << e.what();
+            }
+        }
+
+        // A disk which could not be recovered is kept aside for inspection.
+        // Any other disk left behind is removed before starting over, so that
+        // none of its shards outlive it.
+        if (!recovered)
+        {
+            if (recovering)
+            {
+                move_disk_aside(path);
+            }
+            else if (left_behind)
+            {
+                discard_disk(path);
+            }
+
+            d = hyperdisk::disk::create(path, hasher, num_columns, DURABLE_LOG != 0, geom);
+        }
+
+        d->recycle_shards(RECYCLE_SHARDS != 0);
+        d->verify_reads(VERIFY_READS != 0);
+
+        if (strlen(m_cold.get()) > 0)
+        {
+            d->store_cold_shards(po6::join(m_cold, po6::pathname(ostr.str())));
+        }
     }
     catch (po6::error& e)
     {
-        PLOG(ERROR) << "Could not create disk " << ri;
+        errno = e;
+        PLOG(ERROR) << "Could not create disk " << ri << "; failing the region";
+        fail_region(ri);
+        return;
+    }
+    catch (std::exception& e)
+    {
+        LOG(ERROR) << "Could not create disk " << ri << "; failing the region:  " << e.what();
+        fail_region(ri);
         return;
     }
 
     if (m_disks.insert(ri, d))
     {
-        LOG(INFO) << "Created disk " << ri << " with " << num_columns << " columns";
+        LOG(INFO) << (recovered ? "Recovered" : "Created") << " disk " << ri
+                  << " with " << num_columns << " columns";
     }
     else
     {
@@ -446,6 +980,8 @@ hyperdaemon :: datalayer :: drop_disk(const regionid& ri)
     if (m_disks.remove(ri))
     {
         LOG(INFO) << "Dropped disk " << ri;
+        po6::threads::mutex::hold hold(&m_failed_lock);
+        m_failed.erase(ri);
     }
     else
     {
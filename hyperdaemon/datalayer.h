@@ -29,13 +29,15 @@
 #define hyperdaemon_datalayer_h_
 
 // STL
-#include <list>
 #include <map>
 #include <set>
 #include <tr1/memory>
 #include <vector>
 
 // po6
+#include <po6/net/location.h>
+#include <po6/threads/cond.h>
+#include <po6/threads/mutex.h>
 #include <po6/threads/rwlock.h>
 #include <po6/threads/thread.h>
 
@@ -65,7 +67,10 @@ namespace hyperdaemon
 class datalayer
 {
     public:
-        datalayer(hyperdex::coordinatorlink* cl, const po6::pathname& base);
+        // If "cold" is not empty, each disk keeps its least used shards in a
+        // directory under "cold" rather than under "base".
+        datalayer(hyperdex::coordinatorlink* cl, const po6::pathname& base,
+                  const po6::pathname& cold);
         ~datalayer() throw ();
 
     public:
@@ -79,7 +84,8 @@ class datalayer
 
     // Key-Value store operations.
     public:
-        // May return SUCCESS, NOTFOUND or MISSINGDISK.
+        // May return SUCCESS, NOTFOUND or MISSINGDISK, or CORRUPT if reads
+        // are verified.
         hyperdisk::returncode get(const hyperdex::regionid& ri, const e::slice& key,
                                   std::vector<e::slice>* value, uint64_t* version,
                                   hyperdisk::reference* ref);
@@ -89,17 +95,47 @@ class datalayer
                                   const e::slice& key,
                                   const std::vector<e::slice>& value,
                                   uint64_t version);
+        // PUT "count" objects at once, hashing them together.  May return
+        // SUCCESS, WRONGARITY (in which case none is written) or MISSINGDISK.
+        hyperdisk::returncode put(const hyperdex::regionid& ri,
+                                  const std::tr1::shared_ptr<e::buffer>* backings,
+                                  const e::slice* keys,
+                                  const std::vector<e::slice>* values,
+                                  const uint64_t* versions,
+                                  size_t count);
         // May return SUCCESS or MISSINGDISK.
         hyperdisk::returncode del(const hyperdex::regionid& ri,
                                   std::tr1::shared_ptr<e::buffer> backing,
                                   const e::slice& key);
         // May return SUCCESS or DIDNOTHING.
         hyperdisk::returncode flush(const hyperdex::regionid& ri, size_t n);
+        // False while the writes waiting to be flushed hold more than
+        // LOG_MEMORY_LIMIT megabytes.  Check this before accepting a write
+        // from a client.  Writes along a chain were accepted upstream and
+        // should not be turned away.
+        bool has_log_memory();
 
     private:
         static uint64_t regionid_hash(const hyperdex::regionid& r) { return r.hash(); }
         typedef e::lockfree_hash_map<hyperdex::regionid, e::intrusive_ptr<hyperdisk::disk>, regionid_hash>
                 disk_map_t;
+        // Each flush moves between FLUSH_BATCH_MIN and FLUSH_BATCH_MAX entries,
+        // scaled to the depth of the disk's log.
+        static const size_t FLUSH_BATCH_MIN = 1000;
+        static const size_t FLUSH_BATCH_MAX = 100000;
+        // A flush thread sleeps this long after a pass which flushed nothing.
+        static const uint64_t FLUSH_BACKOFF_MS = 10;
+        // A disk whose fullest shard is at least this full (as a percentage)
+        // is split without waiting for the next optimism burst.
+        static const int URGENT_FULLNESS = 90;
+        // The scrubber wakes this many times each second.
+        static const unsigned SCRUB_BATCHES_PER_SECOND = 10;
+        // A failure report the coordinator did not take is retried every
+        // FAILURE_REPORT_INTERVAL seconds.
+        static const unsigned FAILURE_REPORT_INTERVAL = 1;
+        // With compression enabled, the compression achieved by each disk is
+        // logged every COMPRESSION_REPORT_INTERVAL seconds.
+        static const unsigned COMPRESSION_REPORT_INTERVAL = 300;
 
     private:
         datalayer(const datalayer&);
@@ -107,9 +143,33 @@ class datalayer
     private:
         void optimistic_io_thread();
         void flush_thread();
+        // Sleep until a write arrives or the datalayer shuts down.
+        void wait_for_writes();
+        // Wake the threads in wait_for_writes.
+        void notify_writes();
+        void log_commit_thread();
+        void scrub_thread();
+        // Log the compression ratio of every disk.
+        void report_compression();
+        // Note that the disk for "ri" holds a corrupt entry, and fail it.
+        void report_corruption(const hyperdex::regionid& ri);
+        // Note that this instance cannot serve "ri".  This is cheap, and safe
+        // to call from any thread.  Returns false if "ri" had already failed.
+        bool fail_region(const hyperdex::regionid& ri);
+        // If any region has failed, fail this instance at the coordinator, so
+        // that its regions are reassigned to other replicas.  The coordinator
+        // can only fail a whole instance, not a single region.  Called from
+        // the scrub thread until the coordinator takes the report.
+        void send_failure_report();
+        // If "recover" is true, the disk left behind for "ri" by an earlier
+        // process (if any) is reopened rather than replaced.  A disk left
+        // behind which is not recovered is removed without being read.  If
+        // no disk can be created, the region fails.
         void create_disk(const hyperdex::regionid& ri,
                          const hyperspacehashing::mask::hasher& hasher,
-                         uint16_t num_columns);
+                         uint16_t num_columns,
+                         uint64_t columnar,
+                         bool recover);
         void drop_disk(const hyperdex::regionid& ri);
 
     private:
@@ -119,14 +179,32 @@ class datalayer
         hyperdex::coordinatorlink* m_cl;
         volatile bool m_shutdown;
         po6::pathname m_base;
+        po6::pathname m_cold;
         po6::threads::thread m_optimistic_io_thread;
         std::vector<std::tr1::shared_ptr<po6::threads::thread> > m_flush_threads;
+        po6::threads::thread m_log_commit_thread;
+        po6::threads::thread m_scrub_thread;
         disk_map_t m_disks;
-        std::list<hyperdex::regionid> m_preallocate_rr;
+        // True until the first configuration has been prepared.  The disks
+        // for its regions are recovered from those left behind in m_base.
+        bool m_recover;
         uint64_t m_last_preallocation;
-        std::list<hyperdex::regionid> m_optimistic_rr;
         uint64_t m_last_dose_of_optimism;
-        volatile bool m_flushed_recently;
+        uint64_t m_last_compression_report;
+        // Flush threads with nothing to do wait on m_pressure_cond for writes.
+        // m_log_bytes holds the unflushed bytes of every disk, as of the last
+        // flush pass.  The counters are updated atomically.
+        po6::threads::mutex m_pressure_lock;
+        po6::threads::cond m_pressure_cond;
+        uint64_t m_log_bytes;
+        size_t m_idle_flushers;
+        // The location at which the coordinator knows us (as of the last
+        // reconfiguration), the regions which failed, and whether the
+        // coordinator has been told.  Protected by m_failed_lock.
+        po6::threads::mutex m_failed_lock;
+        po6::net::location m_us;
+        std::set<hyperdex::regionid> m_failed;
+        bool m_failure_reported;
 };
 
 } // namespace hyperdaemon
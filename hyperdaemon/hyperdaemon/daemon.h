@@ -40,6 +40,7 @@ namespace hyperdaemon
 
 int
 daemon(po6::pathname datadir,
+       po6::pathname colddir,
        po6::net::location coordinator,
        uint16_t num_threads,
        po6::net::ipaddr bind_to,
@@ -32,6 +32,7 @@
 #endif
 
 // C
+#include <cstring>
 #include <stdint.h>
 
 // STL
@@ -169,6 +170,17 @@ hyperdaemon :: logical :: send(const hyperdex::entityid& from,
                                const hyperdex::entityid& to,
                                const network_msgtype msg_type,
                                std::auto_ptr<e::buffer> msg)
+{
+    return send(from, to, msg_type, msg, std::vector<e::slice>(), std::tr1::shared_ptr<void>());
+}
+
+bool
+hyperdaemon :: logical :: send(const hyperdex::entityid& from,
+                               const hyperdex::entityid& to,
+                               const network_msgtype msg_type,
+                               std::auto_ptr<e::buffer> msg,
+                               const std::vector<e::slice>& gather,
+                               std::tr1::shared_ptr<void> pin)
 {
 #ifdef HD_LOG_ALL_MESSAGES
     LOG(INFO) << "SEND " << from << "->" << to << " " << msg_type << " " << msg->hex();
@@ -221,13 +233,34 @@ hyperdaemon :: logical :: send(const hyperdex::entityid& from,
 
     if (dst == m_us)
     {
+        // Messages to ourselves are delivered as one buffer.
+        if (!gather.empty())
+        {
+            size_t sz = 0;
+
+            for (size_t i = 0; i < gather.size(); ++i)
+            {
+                sz += gather[i].size();
+            }
+
+            std::auto_ptr<e::buffer> flat(e::buffer::create(sz));
+
+            for (size_t i = 0; i < gather.size(); ++i)
+            {
+                memmove(flat->data() + flat->size(), gather[i].data(), gather[i].size());
+                flat->resize(flat->size() + gather[i].size());
+            }
+
+            msg = flat;
+        }
+
         m_physical.deliver(po6::net::location(m_us.address, m_us.outbound_port), msg);
     }
     else
     {
         po6::net::location loc(dst.address, dst.inbound_port);
 
-        switch (m_physical.send(loc, msg))
+        switch (m_physical.send(loc, msg, gather, pin))
         {
             case physical::SUCCESS:
             case physical::QUEUED:
@@ -30,6 +30,8 @@
 
 // STL
 #include <map>
+#include <tr1/memory>
+#include <vector>
 
 // po6
 #include <po6/net/location.h>
@@ -88,6 +90,13 @@ class logical
         bool send(const hyperdex::entityid& from, const hyperdex::entityid& to,
                   const hyperdex::network_msgtype msg_type,
                   std::auto_ptr<e::buffer> msg);
+        // Send without copying the message into one buffer (see
+        // physical::send).  The header is written into "msg".
+        bool send(const hyperdex::entityid& from, const hyperdex::entityid& to,
+                  const hyperdex::network_msgtype msg_type,
+                  std::auto_ptr<e::buffer> msg,
+                  const std::vector<e::slice>& gather,
+                  std::tr1::shared_ptr<void> pin);
         // Receive one message.
         bool recv(hyperdex::entityid* from, hyperdex::entityid* to,
                   hyperdex::network_msgtype* msg_type,
@@ -109,8 +109,9 @@ hyperdaemon :: network_worker :: run()
         if (type == hyperdex::REQ_GET)
         {
             e::slice key;
+            e::bitfield projection(0);
 
-            if ((up >> nonce >> key).error())
+            if ((up >> nonce >> key >> projection).error())
             {
                 LOG(WARNING) << "unpack of REQ_GET failed; here's some hex:  " << msg->hex();
                 continue;
@@ -136,11 +137,16 @@ hyperdaemon :: network_worker :: run()
                     LOG(ERROR) << "GET caused a MISSINGDISK at the data layer.";
                     result = hyperdex::NET_SERVERERROR;
                     break;
+                case hyperdisk::CORRUPT:
+                    LOG(ERROR) << "GET found a corrupt entry at the data layer.";
+                    result = hyperdex::NET_SERVERERROR;
+                    break;
                 case hyperdisk::DATAFULL:
                 case hyperdisk::SEARCHFULL:
                 case hyperdisk::SYNCFAILED:
                 case hyperdisk::DROPFAILED:
                 case hyperdisk::SPLITFAILED:
+                case hyperdisk::MERGEFAILED:
                 case hyperdisk::DIDNOTHING:
                 default:
                     LOG(ERROR) << "GET returned unacceptable error code.";
@@ -148,13 +154,56 @@ hyperdaemon :: network_worker :: run()
                     break;
             }
 
+            // Blank the attributes the client did not ask for before sizing
+            // the response, so they are neither packed nor gathered.
+            if (result == hyperdex::NET_SUCCESS && !hyperdex::project(projection, &value))
+            {
+                result = hyperdex::NET_WRONGARITY;
+                value.clear();
+            }
+
             size_t sz = m_comm->header_size() + sizeof(uint64_t)
                       + sizeof(uint16_t) + hyperdex::packspace(value);
-            msg.reset(e::buffer::create(sz));
+            // The nonce, result, and value count precede a size for each value.
+            size_t fixed = m_comm->header_size() + sizeof(uint64_t)
+                         + sizeof(uint16_t) + sizeof(uint32_t);
+            size_t sizes = value.size() * sizeof(uint32_t);
+            size_t value_sz = sz - fixed - sizes;
+
+            if (value_sz < GATHER_THRESHOLD)
+            {
+                msg.reset(e::buffer::create(sz));
+                e::buffer::packer pa = msg->pack_at(m_comm->header_size());
+                pa = pa << nonce << static_cast<uint16_t>(result) << value;
+                assert(!pa.error());
+                m_comm->send(to, from, hyperdex::RESP_GET, msg);
+                continue;
+            }
+
+            // Pack everything but the values themselves, and send the values
+            // from the shard (or log) which holds them.  The reference keeps
+            // that memory alive until the response is written.
+            msg.reset(e::buffer::create(fixed + sizes));
             e::buffer::packer pa = msg->pack_at(m_comm->header_size());
-            pa = pa << nonce << static_cast<uint16_t>(result) << value;
+            pa = pa << nonce << static_cast<uint16_t>(result)
+                    << static_cast<uint32_t>(value.size());
+            std::vector<e::slice> gather;
+            gather.reserve(value.size() * 2);
+            size_t packed = 0;
+
+            for (size_t i = 0; i < value.size(); ++i)
+            {
+                pa = pa << static_cast<uint32_t>(value[i].size());
+                size_t end = fixed + (i + 1) * sizeof(uint32_t);
+                gather.push_back(e::slice(msg->data() + packed, end - packed));
+                gather.push_back(value[i]);
+                packed = end;
+            }
+
             assert(!pa.error());
-            m_comm->send(to, from, hyperdex::RESP_GET, msg);
+            assert(packed == msg->size());
+            std::tr1::shared_ptr<void> pin(new hyperdisk::reference(ref));
+            m_comm->send(to, from, hyperdex::RESP_GET, msg, gather, pin);
         }
         else if (type == hyperdex::REQ_PUT)
         {
@@ -196,8 +245,9 @@ hyperdaemon :: network_worker :: run()
         {
             uint64_t searchid;
             hyperspacehashing::search s(0);
+            e::bitfield projection(0);
 
-            if ((up >> nonce >> searchid >> s).error())
+            if ((up >> nonce >> searchid >> s >> projection).error())
             {
                 LOG(WARNING) << "unpack of REQ_SEARCH_START failed; here's some hex:  " << msg->hex();
                 continue;
@@ -205,7 +255,7 @@ hyperdaemon :: network_worker :: run()
 
             if (s.sanity_check())
             {
-                m_ssss->start(to, from, searchid, nonce, msg, s);
+                m_ssss->start(to, from, searchid, nonce, msg, s, projection);
             }
             else
             {
@@ -224,6 +274,43 @@ hyperdaemon :: network_worker :: run()
 
             m_ssss->next(to, from, searchid, nonce);
         }
+        else if (type == hyperdex::REQ_SEARCH_BATCH_START)
+        {
+            uint64_t searchid;
+            uint32_t batch_items;
+            uint32_t batch_bytes;
+            uint16_t credit;
+            hyperspacehashing::search s(0);
+            e::bitfield projection(0);
+
+            if ((up >> nonce >> searchid >> batch_items >> batch_bytes >> credit >> s >> projection).error())
+            {
+                LOG(WARNING) << "unpack of REQ_SEARCH_BATCH_START failed; here's some hex:  " << msg->hex();
+                continue;
+            }
+
+            if (s.sanity_check())
+            {
+                m_ssss->start_batched(to, from, searchid, nonce, batch_items, batch_bytes, credit, msg, s, projection);
+            }
+            else
+            {
+                LOG(INFO) << "Dropping search which fails sanity_check.";
+            }
+        }
+        else if (type == hyperdex::REQ_SEARCH_CREDIT)
+        {
+            uint64_t searchid;
+            uint16_t credit;
+
+            if ((up >> nonce >> searchid >> credit).error())
+            {
+                LOG(WARNING) << "unpack of REQ_SEARCH_CREDIT failed; here's some hex:  " << msg->hex();
+                continue;
+            }
+
+            m_ssss->credit(to, from, searchid, credit);
+        }
         else if (type == hyperdex::REQ_SEARCH_STOP)
         {
             uint64_t searchid;
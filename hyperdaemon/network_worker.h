@@ -56,6 +56,11 @@ class network_worker
         void run();
         void shutdown();
 
+    private:
+        // GET responses whose values hold at least this many bytes are sent
+        // straight from the disk's memory instead of being copied.
+        static const size_t GATHER_THRESHOLD = 4096;
+
     private:
         network_worker(const network_worker&);
 
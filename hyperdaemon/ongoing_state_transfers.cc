@@ -104,6 +104,8 @@ class hyperdaemon::ongoing_state_transfers::transfer_in
         po6::threads::mutex lock;
         std::map<uint64_t, e::intrusive_ptr<op> > ops;
         std::map<std::pair<e::slice, uint64_t>, std::tr1::shared_ptr<e::buffer> > triggers;
+        // PUTs taken from "ops" in order, but not yet written to disk.
+        std::vector<e::intrusive_ptr<op> > puts;
         const hyperdex::entityid replicate_from;
         uint64_t xfer_num;
         bool failed;
@@ -126,6 +128,7 @@ hyperdaemon :: ongoing_state_transfers :: transfer_in :: transfer_in(const hyper
     : lock()
     , ops()
     , triggers()
+    , puts()
     , replicate_from(from)
     , xfer_num(0)
     , failed(false)
@@ -338,6 +341,13 @@ hyperdaemon :: ongoing_state_transfers :: region_transfer_send(const entityid& f
         ++t->xfer_num;
         t->snap->next();
     }
+    else if (t->snap->failed())
+    {
+        LOG(ERROR) << "Lost part of the log for outgoing transfer #" << from.subspace;
+        t->failed = true;
+        m_cl->fail_transfer(from.subspace);
+        return;
+    }
     else
     {
         type = hyperdex::XFER_DONE;
@@ -419,6 +429,7 @@ hyperdaemon :: ongoing_state_transfers :: region_transfer_recv(const hyperdex::e
         {
             t->triggered = true;
             LOG(INFO) << "COMPLETE TRANSFER " << xfer_id;
+            apply_puts(xfer_id, t.get());
             return;
         }
 
@@ -429,23 +440,29 @@ hyperdaemon :: ongoing_state_transfers :: region_transfer_recv(const hyperdex::e
         if (t->triggers.lower_bound(std::make_pair(oneop.key, 0)) ==
                 t->triggers.upper_bound(std::make_pair(oneop.key, UINT64_MAX)))
         {
-            hyperdisk::returncode res;
-
+            // Consecutive PUTs are written together so that they are hashed
+            // together.  A DEL must wait for the PUTs before it.
             if (oneop.has_value)
             {
-                res = m_data->put(t->replicate_from.get_region(), oneop.backing, oneop.key, oneop.value, oneop.version);
+                t->puts.push_back(t->ops.begin()->second);
             }
             else
             {
+                if (!apply_puts(xfer_id, t.get()))
+                {
+                    return;
+                }
+
+                hyperdisk::returncode res;
                 res = m_data->del(t->replicate_from.get_region(), oneop.backing, oneop.key);
-            }
 
-            if (res != hyperdisk::SUCCESS)
-            {
-                LOG(ERROR) << "transfer " << xfer_id << " failed because HyperDisk returned " << res;
-                t->failed = true;
-                m_cl->fail_transfer(xfer_id);
-                return;
+                if (res != hyperdisk::SUCCESS)
+                {
+                    LOG(ERROR) << "transfer " << xfer_id << " failed because HyperDisk returned " << res;
+                    t->failed = true;
+                    m_cl->fail_transfer(xfer_id);
+                    return;
+                }
             }
         }
 
@@ -453,6 +470,11 @@ hyperdaemon :: ongoing_state_transfers :: region_transfer_recv(const hyperdex::e
         ++t->xfer_num;
     }
 
+    if (!apply_puts(xfer_id, t.get()))
+    {
+        return;
+    }
+
     t->started = true;
     std::auto_ptr<e::buffer> msg(e::buffer::create(m_comm->header_size()));
 
@@ -598,3 +620,44 @@ hyperdaemon :: ongoing_state_transfers :: finish_transfers()
         }
     }
 }
+
+bool
+hyperdaemon :: ongoing_state_transfers :: apply_puts(uint16_t xfer_id, transfer_in* t)
+{
+    if (t->puts.empty())
+    {
+        return true;
+    }
+
+    std::vector<std::tr1::shared_ptr<e::buffer> > backings;
+    std::vector<e::slice> keys;
+    std::vector<std::vector<e::slice> > values;
+    std::vector<uint64_t> versions;
+    backings.reserve(t->puts.size());
+    keys.reserve(t->puts.size());
+    values.reserve(t->puts.size());
+    versions.reserve(t->puts.size());
+
+    for (size_t i = 0; i < t->puts.size(); ++i)
+    {
+        backings.push_back(t->puts[i]->backing);
+        keys.push_back(t->puts[i]->key);
+        values.push_back(t->puts[i]->value);
+        versions.push_back(t->puts[i]->version);
+    }
+
+    hyperdisk::returncode res;
+    res = m_data->put(t->replicate_from.get_region(), &backings[0], &keys[0],
+                      &values[0], &versions[0], t->puts.size());
+    t->puts.clear();
+
+    if (res != hyperdisk::SUCCESS)
+    {
+        LOG(ERROR) << "transfer " << xfer_id << " failed because HyperDisk returned " << res;
+        t->failed = true;
+        m_cl->fail_transfer(xfer_id);
+        return false;
+    }
+
+    return true;
+}
@@ -106,6 +106,9 @@ class ongoing_state_transfers
         void periodic();
         void start_transfers();
         void finish_transfers();
+        // Write the PUTs queued in "t" to its disk as one batch.  Returns
+        // false (after failing the transfer) if the disk refuses them.
+        bool apply_puts(uint16_t xfer_id, transfer_in* t);
 
     private:
         ongoing_state_transfers& operator = (const ongoing_state_transfers&);
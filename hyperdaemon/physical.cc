@@ -25,9 +25,15 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+// POSIX
+#include <sys/uio.h>
+
 // Linux
 #include <sys/epoll.h>
 
+// STL
+#include <algorithm>
+
 // Google Log
 #include <glog/logging.h>
 
@@ -130,8 +136,18 @@ hyperdaemon :: physical :: shutdown()
 hyperdaemon::physical::returncode
 hyperdaemon :: physical :: send(const po6::net::location& to,
                                 std::auto_ptr<e::buffer> msg)
+{
+    return send(to, msg, std::vector<e::slice>(), std::tr1::shared_ptr<void>());
+}
+
+hyperdaemon::physical::returncode
+hyperdaemon :: physical :: send(const po6::net::location& to,
+                                std::auto_ptr<e::buffer> msg,
+                                const std::vector<e::slice>& gather,
+                                std::tr1::shared_ptr<void> pin)
 {
     assert(msg->capacity() >= sizeof(uint32_t));
+    assert(gather.empty() || gather[0].data() == msg->data());
     hazard_ptr hptr = m_hazard_ptrs.get();
     channel* chan;
 
@@ -142,7 +158,18 @@ hyperdaemon :: physical :: send(const po6::net::location& to,
         return res;
     }
 
-    *msg << static_cast<uint32_t>(msg->size());
+    size_t sz = gather.empty() ? msg->size() : 0;
+
+    for (size_t i = 0; i < gather.size(); ++i)
+    {
+        sz += gather[i].size();
+    }
+
+    *msg << static_cast<uint32_t>(sz);
+    outgoing_message m;
+    m.buf = msg;
+    m.gather = gather;
+    m.pin = pin;
 
     if (chan->mtx.trylock())
     {
@@ -151,12 +178,12 @@ hyperdaemon :: physical :: send(const po6::net::location& to,
 
         if (chan->outprogress.empty())
         {
-            chan->outnow = msg;
-            chan->outprogress = chan->outnow->as_slice();
+            chan->outnow = m;
+            begin_write(chan);
         }
         else
         {
-            chan->outgoing.push(msg);
+            chan->outgoing.push(m);
         }
 
         if (!work_write(chan))
@@ -171,7 +198,7 @@ hyperdaemon :: physical :: send(const po6::net::location& to,
     }
     else
     {
-        chan->outgoing.push(msg);
+        chan->outgoing.push(m);
         postpone_event(chan->soc.get(), EPOLLOUT);
         return QUEUED;
     }
@@ -617,10 +644,25 @@ hyperdaemon :: physical :: work_write(channel* chan)
             return true;
         }
 
-        chan->outprogress = chan->outnow->as_slice();
+        begin_write(chan);
     }
 
-    ssize_t ret = chan->soc.write(chan->outprogress.data(), chan->outprogress.size());
+    // Write the rest of the current message with a single call.
+    iovec iov[MAX_GATHER];
+    size_t iovcnt = 0;
+    iov[iovcnt].iov_base = const_cast<uint8_t*>(chan->outprogress.data());
+    iov[iovcnt].iov_len = chan->outprogress.size();
+    ++iovcnt;
+
+    for (size_t i = chan->outslice + 1;
+            i < chan->outnow.gather.size() && iovcnt < MAX_GATHER; ++i)
+    {
+        iov[iovcnt].iov_base = const_cast<uint8_t*>(chan->outnow.gather[i].data());
+        iov[iovcnt].iov_len = chan->outnow.gather[i].size();
+        ++iovcnt;
+    }
+
+    ssize_t ret = writev(chan->soc.get(), iov, iovcnt);
 
     if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
     {
@@ -630,14 +672,14 @@ hyperdaemon :: physical :: work_write(channel* chan)
 
     if (ret > 0)
     {
-        chan->outprogress.advance(ret);
+        advance_write(chan, ret);
     }
 
     if (chan->outprogress.empty())
     {
         if (chan->outgoing.pop(&chan->outnow))
         {
-            chan->outprogress = chan->outnow->as_slice();
+            begin_write(chan);
             postpone_event(chan->soc.get(), EPOLLOUT);
         }
     }
@@ -645,12 +687,51 @@ hyperdaemon :: physical :: work_write(channel* chan)
     return true;
 }
 
+void
+hyperdaemon :: physical :: begin_write(channel* chan)
+{
+    chan->outslice = 0;
+    chan->outprogress = chan->outnow.gather.empty() ?
+        chan->outnow.buf->as_slice() : chan->outnow.gather[0];
+    advance_write(chan, 0);
+}
+
+void
+hyperdaemon :: physical :: advance_write(channel* chan, size_t sz)
+{
+    while (true)
+    {
+        size_t adv = std::min(sz, chan->outprogress.size());
+        chan->outprogress.advance(adv);
+        sz -= adv;
+
+        if (!chan->outprogress.empty() ||
+            chan->outslice + 1 >= chan->outnow.gather.size())
+        {
+            break;
+        }
+
+        ++chan->outslice;
+        chan->outprogress = chan->outnow.gather[chan->outslice];
+    }
+
+    assert(sz == 0);
+
+    if (chan->outprogress.empty())
+    {
+        chan->outnow.buf.reset();
+        chan->outnow.gather.clear();
+        chan->outnow.pin.reset();
+    }
+}
+
 hyperdaemon :: physical :: channel :: channel(po6::net::socket* conn)
     : mtx()
     , soc()
     , loc(conn->getpeername())
     , outgoing()
     , outnow()
+    , outslice(0)
     , outprogress()
     , inprogress()
     , inoffset(0)
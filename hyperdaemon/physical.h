@@ -32,6 +32,7 @@
 #include <map>
 #include <queue>
 #include <tr1/memory>
+#include <vector>
 
 // po6
 #include <po6/net/ipaddr.h>
@@ -45,6 +46,7 @@
 #include <e/hazard_ptrs.h>
 #include <e/lockfree_fifo.h>
 #include <e/lockfree_hash_map.h>
+#include <e/slice.h>
 #include <e/striped_lock.h>
 #include <e/worker_barrier.h>
 
@@ -88,6 +90,14 @@ class physical
         // space.  Receivers may ignore this space.
         size_t header_size() const { return sizeof(uint32_t); }
         returncode send(const po6::net::location& to, std::auto_ptr<e::buffer> msg);
+        // Send a message without first copying it into one buffer.  If
+        // "gather" is empty the message is "msg"; otherwise, it is the bytes
+        // of "gather" in order.  The first slice must begin with the header
+        // reserved at the start of "msg", and the rest may point into "msg" or
+        // into memory which "pin" keeps alive until the message is written.
+        returncode send(const po6::net::location& to, std::auto_ptr<e::buffer> msg,
+                        const std::vector<e::slice>& gather,
+                        std::tr1::shared_ptr<void> pin);
         returncode recv(po6::net::location* from, std::auto_ptr<e::buffer>* msg);
         // Deliver a message (put it on the queue) as if it came from "from".
         // This will *not* wake up threads.  This is intentional so the thread
@@ -109,6 +119,16 @@ class physical
             std::auto_ptr<e::buffer> buf;
         };
 
+        struct outgoing_message
+        {
+            outgoing_message() : buf(), gather(), pin() {}
+            ~outgoing_message() throw () {}
+
+            std::auto_ptr<e::buffer> buf;
+            std::vector<e::slice> gather;
+            std::tr1::shared_ptr<void> pin;
+        };
+
         struct pending
         {
             pending() : fd(), events() {}
@@ -129,8 +149,9 @@ class physical
                 po6::threads::mutex mtx; // Anyone touching the socket should hold this.
                 po6::net::socket soc; // The socket over which we are communicating.
                 po6::net::location loc; // A cached soc.getpeername.
-                e::lockfree_fifo<std::auto_ptr<e::buffer> > outgoing; // Messages buffered for writing.
-                std::auto_ptr<e::buffer> outnow; // The current message we are writing to the network.
+                e::lockfree_fifo<outgoing_message> outgoing; // Messages buffered for writing.
+                outgoing_message outnow; // The current message we are writing to the network.
+                size_t outslice; // The slice of outnow.gather we are writing.
                 e::slice outprogress; // A pointer into what we've written so far.
                 std::auto_ptr<e::buffer> inprogress; // When reading from the network, we buffer partial reads here.
                 size_t inoffset; // How much we've buffered in inbuffer.
@@ -144,6 +165,8 @@ class physical
         };
 
         typedef std::auto_ptr<e::hazard_ptrs<channel, 1>::hazard_ptr> hazard_ptr;
+        // The most slices passed to one writev.
+        static const size_t MAX_GATHER = 64;
 
     private:
         physical(const physical&);
@@ -179,6 +202,13 @@ class physical
         // error to report (using *res).  If there is an error to report, the
         // caller must call work_close.
         bool work_write(channel* chan);
+        // Start writing chan->outnow.  Must be called while holding chan->mtx,
+        // as must advance_write.
+        void begin_write(channel* chan);
+        // Move outprogress forward by "sz" bytes of chan->outnow, skipping
+        // ahead through its slices.  Once the whole message is written, its
+        // memory is released and outprogress is left empty.
+        void advance_write(channel* chan, size_t sz);
 
     private:
         physical& operator = (const physical&);
@@ -398,6 +398,15 @@ hyperdaemon :: replication_manager :: client_common(bool has_value,
         return;
     }
 
+    // Turn new writes away while the flush threads catch up.  The client
+    // may retry them.  Chain operations were accepted upstream, so they are
+    // never turned away.
+    if (!m_data->has_log_memory())
+    {
+        respond_to_client(to, from, nonce, retcode, hyperdex::NET_OVERLOADED);
+        return;
+    }
+
     // Automatically respond with "SERVERERROR" whenever we return without g.dismiss()
     e::guard g = e::makeobjguard(*this, &replication_manager::respond_to_client, to, from, nonce, retcode, hyperdex::NET_SERVERERROR);
 
@@ -677,6 +686,8 @@ hyperdaemon :: replication_manager :: from_disk(const regionid& r,
         case hyperdisk::SYNCFAILED:
         case hyperdisk::DROPFAILED:
         case hyperdisk::SPLITFAILED:
+        case hyperdisk::MERGEFAILED:
+        case hyperdisk::CORRUPT:
         case hyperdisk::DIDNOTHING:
         default:
             LOG(WARNING) << "Data layer returned unexpected result when reading old value.";
@@ -715,6 +726,8 @@ hyperdaemon :: replication_manager :: put_to_disk(const regionid& pending_in,
             case hyperdisk::SYNCFAILED:
             case hyperdisk::DROPFAILED:
             case hyperdisk::SPLITFAILED:
+            case hyperdisk::MERGEFAILED:
+            case hyperdisk::CORRUPT:
             case hyperdisk::DIDNOTHING:
                 LOG(ERROR) << "commit caused error " << rc;
                 success = false;
@@ -740,6 +753,8 @@ hyperdaemon :: replication_manager :: put_to_disk(const regionid& pending_in,
             case hyperdisk::SYNCFAILED:
             case hyperdisk::DROPFAILED:
             case hyperdisk::SPLITFAILED:
+            case hyperdisk::MERGEFAILED:
+            case hyperdisk::CORRUPT:
             case hyperdisk::DIDNOTHING:
                 LOG(ERROR) << "commit caused error " << rc;
                 success = false;
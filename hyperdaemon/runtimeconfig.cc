@@ -35,3 +35,12 @@ e::envconfig<size_t> hyperdaemon::LOCK_STRIPING("HYPERDEX_LOCK_STRIPING", 1024);
 e::envconfig<size_t> hyperdaemon::TRANSFERS_IN_FLIGHT("HYPERDEX_TRANSFERS_IN_FLIGHT", 1000);
 e::envconfig<uint16_t> hyperdaemon::REPLICATION_HASHTABLE_SIZE("HYPERDEX_REPLICATION_HASHTABLE_SIZE", 10);
 e::envconfig<uint16_t> hyperdaemon::STATE_TRANSFER_HASHTABLE_SIZE("HYPERDEX_STATE_TRANSFER_HASHTABLE_SIZE", 10);
+e::envconfig<unsigned int> hyperdaemon::DURABLE_LOG("HYPERDEX_DURABLE_LOG", 0);
+e::envconfig<unsigned int> hyperdaemon::LOG_COMMITS_PER_SECOND("HYPERDEX_LOG_COMMITS_PER_SECOND", 100);
+e::envconfig<unsigned int> hyperdaemon::ADAPTIVE_SHARDS("HYPERDEX_ADAPTIVE_SHARDS", 1);
+e::envconfig<unsigned int> hyperdaemon::COLUMNAR_ATTRIBUTES("HYPERDEX_COLUMNAR_ATTRIBUTES", 1);
+e::envconfig<unsigned int> hyperdaemon::RECYCLE_SHARDS("HYPERDEX_RECYCLE_SHARDS", 0);
+e::envconfig<size_t> hyperdaemon::LOG_MEMORY_LIMIT("HYPERDEX_LOG_MEMORY_LIMIT", 1024);
+e::envconfig<unsigned int> hyperdaemon::COMPRESSION("HYPERDEX_COMPRESSION", 0);
+e::envconfig<unsigned int> hyperdaemon::VERIFY_READS("HYPERDEX_VERIFY_READS", 0);
+e::envconfig<unsigned int> hyperdaemon::SCRUB_ENTRIES_PER_SECOND("HYPERDEX_SCRUB_ENTRIES_PER_SECOND", 0);
@@ -46,6 +46,32 @@ extern e::envconfig<size_t> LOCK_STRIPING;
 extern e::envconfig<size_t> TRANSFERS_IN_FLIGHT;
 extern e::envconfig<uint16_t> REPLICATION_HASHTABLE_SIZE;
 extern e::envconfig<uint16_t> STATE_TRANSFER_HASHTABLE_SIZE;
+// If non-zero, every disk keeps a durable log which is committed
+// LOG_COMMITS_PER_SECOND times each second, and a restarted daemon recovers
+// the disks of the regions the coordinator hands back to it.
+extern e::envconfig<unsigned int> DURABLE_LOG;
+extern e::envconfig<unsigned int> LOG_COMMITS_PER_SECOND;
+// If non-zero, every disk sizes its shards to suit the objects it holds.
+extern e::envconfig<unsigned int> ADAPTIVE_SHARDS;
+// If non-zero, shards keep uint64 attributes in columns so that range searches
+// may skip objects without parsing them.
+extern e::envconfig<unsigned int> COLUMNAR_ATTRIBUTES;
+// If non-zero, the files of retired shards are reused as spares.  Off by
+// default.
+extern e::envconfig<unsigned int> RECYCLE_SHARDS;
+// Client writes are turned away (with NET_OVERLOADED) while the writes not yet
+// flushed to shards hold more than LOG_MEMORY_LIMIT megabytes of message
+// buffers.  Zero disables the limit.
+extern e::envconfig<size_t> LOG_MEMORY_LIMIT;
+// The id of the hyperdisk compressor used for values in new disks (1 is
+// snappy when built with it).  Zero stores values uncompressed.
+extern e::envconfig<unsigned int> COMPRESSION;
+// If non-zero, every GET checks the checksum of the entry it reads from a shard.
+extern e::envconfig<unsigned int> VERIFY_READS;
+// The background scrubber checks at most SCRUB_ENTRIES_PER_SECOND shard entries
+// each second.  Zero (the default) disables it.  A corrupt entry, found by the
+// scrubber or by VERIFY_READS, fails this whole instance at the coordinator.
+extern e::envconfig<unsigned int> SCRUB_ENTRIES_PER_SECOND;
 
 } // namespace hyperdaemon
 
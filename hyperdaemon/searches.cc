@@ -25,6 +25,9 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+// STL
+#include <algorithm>
+
 // Google Log
 #include <glog/logging.h>
 
@@ -46,6 +49,10 @@ using hyperdex::regionid;
 using hyperspacehashing::search;
 using hyperspacehashing::mask::coordinate;
 
+// Bound what a client may ask of a batched search.
+static const uint32_t MAX_BATCH_BYTES = 1048576;
+static const uint32_t MAX_CREDIT = 64;
+
 hyperdaemon :: searches :: searches(coordinatorlink* cl,
                                     datalayer* data,
                                     logical* comm)
@@ -86,27 +93,14 @@ hyperdaemon :: searches :: start(const hyperdex::entityid& us,
                                  uint64_t search_num,
                                  uint64_t nonce,
                                  std::auto_ptr<e::buffer> msg,
-                                 const hyperspacehashing::search& terms)
+                                 const hyperspacehashing::search& terms,
+                                 const e::bitfield& projection)
 {
-    search_id key(us.get_region(), client, search_num);
-
-    if (m_searches.contains(key))
-    {
-        LOG(INFO) << "DROPPED";
-        return;
-    }
-
-    if (m_config.dimensions(us.get_space()) != terms.size())
+    if (!create(us, client, search_num, msg, terms, projection))
     {
-        LOG(INFO) << "DROPPED";
         return;
     }
 
-    hyperspacehashing::mask::hasher hasher(m_config.disk_hasher(us.get_subspace()));
-    hyperspacehashing::mask::coordinate coord(hasher.hash(terms));
-    e::intrusive_ptr<hyperdisk::snapshot> snap = m_data->make_snapshot(us.get_region(), terms);
-    e::intrusive_ptr<search_state> state = new search_state(us.get_region(), coord, msg, terms, snap);
-    m_searches.insert(key, state);
     next(us, client, search_num, nonce);
 }
 
@@ -133,14 +127,17 @@ hyperdaemon :: searches :: next(const hyperdex::entityid& us,
         {
             if (state->terms.matches(state->snap->key(), state->snap->value()))
             {
+                std::vector<e::slice> value(state->snap->value());
+                bool projected = hyperdex::project(state->projection, &value);
+                assert(projected);
                 size_t sz = m_comm->header_size() + sizeof(uint64_t)
                           + sizeof(uint32_t) + state->snap->key().size()
-                          + hyperdex::packspace(state->snap->value());
+                          + hyperdex::packspace(value);
                 std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
                 bool fits = !(msg->pack_at(m_comm->header_size())
                                 << nonce
                                 << state->snap->key()
-                                << state->snap->value()).error();
+                                << value).error();
                 assert(fits);
                 m_comm->send(us, client, hyperdex::RESP_SEARCH_ITEM, msg);
                 state->snap->next();
@@ -158,6 +155,53 @@ hyperdaemon :: searches :: next(const hyperdex::entityid& us,
     stop(us, client, search_num);
 }
 
+void
+hyperdaemon :: searches :: start_batched(const hyperdex::entityid& us,
+                                         const hyperdex::entityid& client,
+                                         uint64_t search_num,
+                                         uint64_t nonce,
+                                         uint32_t batch_items,
+                                         uint32_t batch_bytes,
+                                         uint16_t credit,
+                                         std::auto_ptr<e::buffer> msg,
+                                         const hyperspacehashing::search& terms,
+                                         const e::bitfield& projection)
+{
+    e::intrusive_ptr<search_state> state = create(us, client, search_num, msg, terms, projection);
+
+    if (!state)
+    {
+        return;
+    }
+
+    po6::threads::mutex::hold hold(&state->lock);
+    state->nonce = nonce;
+    state->batch_items = std::max(batch_items, static_cast<uint32_t>(1));
+    state->batch_bytes = std::min(batch_bytes, MAX_BATCH_BYTES);
+    state->credit = std::min(static_cast<uint32_t>(credit), MAX_CREDIT);
+    send_batches(us, client, search_num, state.get());
+}
+
+void
+hyperdaemon :: searches :: credit(const hyperdex::entityid& us,
+                                  const hyperdex::entityid& client,
+                                  uint64_t search_num,
+                                  uint16_t credit)
+{
+    search_id key(us.get_region(), client, search_num);
+    e::intrusive_ptr<search_state> state;
+
+    // Credit may arrive after the final batch was sent and the search removed.
+    if (!m_searches.lookup(key, &state))
+    {
+        return;
+    }
+
+    po6::threads::mutex::hold hold(&state->lock);
+    state->credit = std::min(state->credit + credit, MAX_CREDIT);
+    send_batches(us, client, search_num, state.get());
+}
+
 void
 hyperdaemon :: searches :: stop(const hyperdex::entityid& us,
                                 const hyperdex::entityid& client,
@@ -172,18 +216,130 @@ hyperdaemon :: searches :: hash(const search_id& si)
     return si.region.hash() + si.client.hash() + si.search_number;
 }
 
+e::intrusive_ptr<hyperdaemon::searches::search_state>
+hyperdaemon :: searches :: create(const hyperdex::entityid& us,
+                                  const hyperdex::entityid& client,
+                                  uint64_t search_num,
+                                  std::auto_ptr<e::buffer> msg,
+                                  const hyperspacehashing::search& terms,
+                                  const e::bitfield& projection)
+{
+    search_id key(us.get_region(), client, search_num);
+
+    if (m_searches.contains(key))
+    {
+        LOG(INFO) << "DROPPED";
+        return e::intrusive_ptr<search_state>();
+    }
+
+    if (m_config.dimensions(us.get_space()) != terms.size())
+    {
+        LOG(INFO) << "DROPPED";
+        return e::intrusive_ptr<search_state>();
+    }
+
+    if (projection.bits() != 0 && projection.bits() + 1 != terms.size())
+    {
+        LOG(INFO) << "DROPPED";
+        return e::intrusive_ptr<search_state>();
+    }
+
+    hyperspacehashing::mask::hasher hasher(m_config.disk_hasher(us.get_subspace()));
+    hyperspacehashing::mask::coordinate coord(hasher.hash(terms));
+    e::intrusive_ptr<hyperdisk::snapshot> snap = m_data->make_snapshot(us.get_region(), terms);
+    e::intrusive_ptr<search_state> state = new search_state(us.get_region(), coord, msg, terms, projection, snap);
+    m_searches.insert(key, state);
+    return state;
+}
+
+void
+hyperdaemon :: searches :: send_batches(const hyperdex::entityid& us,
+                                        const hyperdex::entityid& client,
+                                        uint64_t search_num,
+                                        search_state* state)
+{
+    // The nonce and item count precede the items.
+    const size_t start = m_comm->header_size() + sizeof(uint64_t) + sizeof(uint32_t);
+
+    while (state->credit > 0)
+    {
+        std::auto_ptr<e::buffer> msg(e::buffer::create(start + state->batch_bytes));
+        e::buffer::packer pa = msg->pack_at(start);
+        size_t used = start;
+        uint32_t count = 0;
+
+        while (count < state->batch_items && state->snap->valid())
+        {
+            if (!state->search_coord.intersects(state->snap->coordinate()) ||
+                !state->terms.matches(state->snap->key(), state->snap->value()))
+            {
+                state->snap->next();
+                continue;
+            }
+
+            std::vector<e::slice> value(state->snap->value());
+            bool projected = hyperdex::project(state->projection, &value);
+            assert(projected);
+            size_t sz = sizeof(uint32_t) + state->snap->key().size()
+                      + hyperdex::packspace(value);
+
+            if (used + sz > msg->capacity())
+            {
+                if (count > 0)
+                {
+                    break;
+                }
+
+                // An object larger than a whole batch goes out on its own.
+                msg.reset(e::buffer::create(start + sz));
+                pa = msg->pack_at(start);
+            }
+
+            pa = pa << state->snap->key() << value;
+            used += sz;
+            ++count;
+            state->snap->next();
+        }
+
+        if (count > 0)
+        {
+            bool fits = !pa.error() &&
+                        !(msg->pack_at(m_comm->header_size()) << state->nonce << count).error();
+            assert(fits);
+            m_comm->send(us, client, hyperdex::RESP_SEARCH_BATCH, msg);
+            --state->credit;
+        }
+
+        if (!state->snap->valid())
+        {
+            msg.reset(e::buffer::create(m_comm->header_size() + sizeof(uint64_t)));
+            bool fits = !(msg->pack_at(m_comm->header_size()) << state->nonce).error();
+            assert(fits);
+            m_comm->send(us, client, hyperdex::RESP_SEARCH_DONE, msg);
+            stop(us, client, search_num);
+            return;
+        }
+    }
+}
+
 
 hyperdaemon :: searches :: search_state :: search_state(const regionid& r,
                                                         const coordinate& sc,
                                                         std::auto_ptr<e::buffer> msg,
                                                         const hyperspacehashing::search& t,
+                                                        const e::bitfield& p,
                                                         e::intrusive_ptr<hyperdisk::snapshot> s)
     : lock()
     , region(r)
     , search_coord(sc)
     , backing(msg)
     , terms(t)
+    , projection(p)
     , snap(s)
+    , nonce(0)
+    , batch_items(0)
+    , batch_bytes(0)
+    , credit(0)
     , m_ref(0)
 {
 }
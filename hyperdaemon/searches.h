@@ -32,6 +32,7 @@
 #include <po6/threads/mutex.h>
 
 // e
+#include <e/bitfield.h>
 #include <e/intrusive_ptr.h>
 #include <e/lockfree_hash_map.h>
 #include <e/tuple_compare.h>
@@ -68,16 +69,36 @@ class searches
         void cleanup(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
 
     public:
+        // Only the attributes in "projection" are returned with each object;
+        // an empty projection returns every attribute.
         void start(const hyperdex::entityid& us,
                    const hyperdex::entityid& client,
                    uint64_t searchid,
                    uint64_t nonce,
                    std::auto_ptr<e::buffer> msg,
-                   const hyperspacehashing::search& wc);
+                   const hyperspacehashing::search& wc,
+                   const e::bitfield& projection);
         void next(const hyperdex::entityid& us,
                   const hyperdex::entityid& client,
                   uint64_t searchid,
                   uint64_t nonce);
+        // Start a search which packs up to batch_items objects (or roughly
+        // batch_bytes bytes) into each response, and which sends up to
+        // "credit" responses without waiting for the client.
+        void start_batched(const hyperdex::entityid& us,
+                           const hyperdex::entityid& client,
+                           uint64_t searchid,
+                           uint64_t nonce,
+                           uint32_t batch_items,
+                           uint32_t batch_bytes,
+                           uint16_t credit,
+                           std::auto_ptr<e::buffer> msg,
+                           const hyperspacehashing::search& wc,
+                           const e::bitfield& projection);
+        void credit(const hyperdex::entityid& us,
+                    const hyperdex::entityid& client,
+                    uint64_t searchid,
+                    uint16_t credit);
         void stop(const hyperdex::entityid& us,
                   const hyperdex::entityid& client,
                   uint64_t searchid);
@@ -88,6 +109,18 @@ class searches
 
     private:
         static uint64_t hash(const search_id&);
+        e::intrusive_ptr<search_state> create(const hyperdex::entityid& us,
+                                              const hyperdex::entityid& client,
+                                              uint64_t searchid,
+                                              std::auto_ptr<e::buffer> msg,
+                                              const hyperspacehashing::search& wc,
+                                              const e::bitfield& projection);
+        // Send batches while the client has credit.  The caller must hold
+        // state->lock.
+        void send_batches(const hyperdex::entityid& us,
+                          const hyperdex::entityid& client,
+                          uint64_t searchid,
+                          search_state* state);
 
     private:
         searches(const searches&);
@@ -110,6 +143,7 @@ class searches::search_state
                      const hyperspacehashing::mask::coordinate& search_coord,
                      std::auto_ptr<e::buffer> msg,
                      const hyperspacehashing::search& terms,
+                     const e::bitfield& projection,
                      e::intrusive_ptr<hyperdisk::snapshot> snap);
         ~search_state() throw ();
 
@@ -119,7 +153,13 @@ class searches::search_state
         const hyperspacehashing::mask::coordinate search_coord;
         const std::auto_ptr<e::buffer> backing;
         hyperspacehashing::search terms;
+        const e::bitfield projection;
         e::intrusive_ptr<hyperdisk::snapshot> snap;
+        // Only batched searches use these.
+        uint64_t nonce;
+        uint32_t batch_items;
+        uint32_t batch_bytes;
+        uint32_t credit;
 
     private:
         friend class e::intrusive_ptr<search_state>;
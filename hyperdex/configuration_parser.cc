@@ -36,6 +36,8 @@ hyperdex :: configuration_parser :: configuration_parser()
     , m_subspaces()
     , m_repl_attrs()
     , m_disk_attrs()
+    , m_ordered_attrs()
+    , m_quantiles()
     , m_regions()
     , m_entities()
     , m_transfers()
@@ -73,13 +75,15 @@ hyperdex :: configuration_parser :: generate()
 
     for (ri = m_repl_attrs.begin(); ri != m_repl_attrs.end(); ++ri)
     {
-        hyperspacehashing::prefix::hasher h(attrs_to_hashfuncs(ri->first, ri->second));
+        hyperspacehashing::prefix::hasher h(attrs_to_hashfuncs(ri->first, ri->second),
+                                            m_quantiles[ri->first.get_space()]);
         repl_hashers.insert(std::make_pair(ri->first, h));
     }
 
     for (di = m_disk_attrs.begin(); di != m_disk_attrs.end(); ++di)
     {
-        hyperspacehashing::mask::hasher h(attrs_to_hashfuncs(di->first, di->second));
+        hyperspacehashing::mask::hasher h(attrs_to_hashfuncs(di->first, di->second),
+                                          m_quantiles[di->first.get_space()]);
         disk_hashers.insert(std::make_pair(di->first, h));
     }
 
@@ -130,6 +134,10 @@ hyperdex :: configuration_parser :: parse(const std::string& config)
         {
             ABORT_ON_ERROR(parse_region(start, eol));
         }
+        else if (strncmp("quantiles ", start, 10) == 0)
+        {
+            ABORT_ON_ERROR(parse_quantiles(start, eol));
+        }
         else if (strncmp("transfer ", start, 9) == 0)
         {
             ABORT_ON_ERROR(parse_transfer(start, eol));
@@ -375,17 +383,31 @@ hyperdex :: configuration_parser :: parse_subspace(char* start,
 
     std::vector<bool> repl_attrs(si->second.size(), false);
     std::vector<bool> disk_attrs(si->second.size(), false);
+    std::vector<bool> ordered_attrs(si->second.size(), false);
 
     for (size_t i = 0; i < si->second.size(); ++i)
     {
         bool repl;
         bool disk;
+        bool ordered = false;
 
         SKIP_WHITESPACE(start, eol);
         end = start;
         SKIP_TO_WHITESPACE(end, eol);
         *end = '\0';
-        ABORT_ON_ERROR(extract_bool(start, end, &repl));
+
+        // An "ordered" dimension hashes strings in order so that prefix
+        // searches map to a contiguous range of regions.
+        if (strcmp(start, "ordered") == 0)
+        {
+            repl = true;
+            ordered = true;
+        }
+        else
+        {
+            ABORT_ON_ERROR(extract_bool(start, end, &repl));
+        }
+
         start = end + 1;
 
         SKIP_WHITESPACE(start, eol);
@@ -405,8 +427,14 @@ hyperdex :: configuration_parser :: parse_subspace(char* start,
             return CP_BAD_ATTR_CHOICE;
         }
 
+        if (ordered && si->second[i].type != DATATYPE_STRING)
+        {
+            return CP_BAD_ATTR_CHOICE;
+        }
+
         repl_attrs[i] = repl;
         disk_attrs[i] = disk;
+        ordered_attrs[i] = ordered;
     }
 
     if (end != eol)
@@ -428,6 +456,7 @@ hyperdex :: configuration_parser :: parse_subspace(char* start,
     m_subspaces.insert(subspaceid(space, subspace));
     m_repl_attrs[subspaceid(space, subspace)] = repl_attrs;
     m_disk_attrs[subspaceid(space, subspace)] = disk_attrs;
+    m_ordered_attrs[subspaceid(space, subspace)] = ordered_attrs;
     return CP_SUCCESS;
 }
 
@@ -525,6 +554,87 @@ hyperdex :: configuration_parser :: parse_region(char* start,
     return CP_SUCCESS;
 }
 
+hyperdex::configuration_parser::error
+hyperdex :: configuration_parser :: parse_quantiles(char* start,
+                                                    char* const eol)
+{
+    char* end;
+    uint32_t space;
+    uint16_t attr;
+    std::vector<uint64_t> bounds;
+
+    // Skip "quantiles "
+    start += 10;
+
+    // Pull out the space id
+    SKIP_WHITESPACE(start, eol);
+    end = start;
+    SKIP_TO_WHITESPACE(end, eol);
+    *end = '\0';
+    ABORT_ON_ERROR(extract_uint32_t(start, end, &space));
+    start = end + 1;
+
+    // Pull out the attribute number
+    SKIP_WHITESPACE(start, eol);
+    end = start;
+    SKIP_TO_WHITESPACE(end, eol);
+    *end = '\0';
+    ABORT_ON_ERROR(extract_uint16_t(start, end, &attr));
+    start = end + 1;
+
+    while (start < eol)
+    {
+        uint64_t bound;
+
+        SKIP_WHITESPACE(start, eol);
+        end = start;
+        SKIP_TO_WHITESPACE(end, eol);
+        *end = '\0';
+        ABORT_ON_ERROR(extract_uint64_t(start, end, &bound));
+        start = end + 1;
+
+        if (!bounds.empty() && bounds.back() >= bound)
+        {
+            return CP_BAD_QUANTILES;
+        }
+
+        bounds.push_back(bound);
+    }
+
+    if (end != eol)
+    {
+        return CP_EXCESS_DATA;
+    }
+
+    std::map<spaceid, std::vector<attribute> >::const_iterator si;
+
+    if ((si = m_spaces.find(spaceid(space))) == m_spaces.end())
+    {
+        return CP_MISSING_SPACE;
+    }
+
+    if (attr >= si->second.size())
+    {
+        return CP_UNKNOWN_ATTR;
+    }
+
+    if (si->second[attr].type != DATATYPE_UINT64 || bounds.empty())
+    {
+        return CP_BAD_QUANTILES;
+    }
+
+    std::vector<std::vector<uint64_t> >& quantiles(m_quantiles[spaceid(space)]);
+    quantiles.resize(si->second.size());
+
+    if (!quantiles[attr].empty())
+    {
+        return CP_DUPE_ATTR;
+    }
+
+    quantiles[attr] = bounds;
+    return CP_SUCCESS;
+}
+
 hyperdex::configuration_parser::error
 hyperdex :: configuration_parser :: parse_transfer(char* start,
                                                    char* const eol)
@@ -808,6 +918,10 @@ hyperdex :: configuration_parser :: attrs_to_hashfuncs(const subspaceid& ssi,
     si = m_spaces.find(ssi.get_space());
     assert(si != m_spaces.end());
     assert(si->second.size() == attrs.size());
+    std::map<subspaceid, std::vector<bool> >::const_iterator oi;
+    oi = m_ordered_attrs.find(ssi);
+    assert(oi != m_ordered_attrs.end());
+    assert(oi->second.size() == attrs.size());
     std::vector<hyperspacehashing::hash_t> hfuncs;
     hfuncs.reserve(attrs.size());
 
@@ -818,7 +932,8 @@ hyperdex :: configuration_parser :: attrs_to_hashfuncs(const subspaceid& ssi,
             switch (si->second[i].type)
             {
                 case DATATYPE_STRING:
-                    hfuncs.push_back(hyperspacehashing::EQUALITY);
+                    hfuncs.push_back(oi->second[i] ? hyperspacehashing::ORDERED
+                                                   : hyperspacehashing::EQUALITY);
                     break;
                 case DATATYPE_UINT64:
                     hfuncs.push_back(hyperspacehashing::RANGE);
@@ -67,6 +67,7 @@ class configuration_parser
             CP_BAD_UINT16,
             CP_BAD_UINT8,
             CP_BAD_ATTR_CHOICE,
+            CP_BAD_QUANTILES,
             EOE
         };
 
@@ -89,6 +90,8 @@ class configuration_parser
                              char* const eol);
         error parse_region(char* start,
                            char* const eol);
+        error parse_quantiles(char* start,
+                              char* const eol);
         error parse_transfer(char* start,
                              char* const eol);
         error extract_bool(char* start,
@@ -124,6 +127,8 @@ class configuration_parser
         std::set<subspaceid> m_subspaces;
         std::map<subspaceid, std::vector<bool> > m_repl_attrs;
         std::map<subspaceid, std::vector<bool> > m_disk_attrs;
+        std::map<subspaceid, std::vector<bool> > m_ordered_attrs;
+        std::map<spaceid, std::vector<std::vector<uint64_t> > > m_quantiles;
         std::set<regionid> m_regions;
         std::map<entityid, instance> m_entities;
         std::map<std::pair<instance, uint16_t>, hyperdex::regionid> m_transfers;
@@ -41,7 +41,9 @@ enum network_returncode
     NET_NOTFOUND    = 8321,
     NET_WRONGARITY  = 8322,
     NET_NOTUS       = 8323,
-    NET_SERVERERROR = 8324
+    NET_SERVERERROR = 8324,
+    // The server is too far behind to take the write now; retry it later.
+    NET_OVERLOADED  = 8325
 };
 
 enum network_msgtype
@@ -60,6 +62,12 @@ enum network_msgtype
     REQ_SEARCH_STOP     = 34,
     RESP_SEARCH_ITEM    = 35,
     RESP_SEARCH_DONE    = 36,
+    // Batched searches pack many items into each RESP_SEARCH_BATCH.  The
+    // client grants credit for a number of batches in flight, and tops it up
+    // with REQ_SEARCH_CREDIT as batches arrive.
+    REQ_SEARCH_BATCH_START  = 37,
+    REQ_SEARCH_CREDIT       = 38,
+    RESP_SEARCH_BATCH       = 39,
 
     CHAIN_PUT       = 64,
     CHAIN_DEL       = 65,
@@ -95,6 +103,9 @@ operator << (std::ostream& lhs, const network_msgtype& rhs)
         stringify(REQ_SEARCH_STOP);
         stringify(RESP_SEARCH_ITEM);
         stringify(RESP_SEARCH_DONE);
+        stringify(REQ_SEARCH_BATCH_START);
+        stringify(REQ_SEARCH_CREDIT);
+        stringify(RESP_SEARCH_BATCH);
         stringify(CHAIN_PUT);
         stringify(CHAIN_DEL);
         stringify(CHAIN_PENDING);
@@ -29,6 +29,7 @@
 #define hyperdex_packing_h_
 
 // e
+#include <e/bitfield.h>
 #include <e/buffer.h>
 #include <e/slice.h>
 
@@ -48,6 +49,39 @@ packspace(const std::vector<e::slice>& slices)
     return sum;
 }
 
+inline size_t
+packspace(const e::bitfield& bits)
+{
+    return sizeof(uint32_t) + bits.bits();
+}
+
+// Replace the values of attributes which are not part of "projection" with
+// empty slices.  An empty projection selects every attribute.  Returns false
+// if the projection does not match the arity of the value.
+inline bool
+project(const e::bitfield& projection, std::vector<e::slice>* value)
+{
+    if (projection.bits() == 0)
+    {
+        return true;
+    }
+
+    if (projection.bits() != value->size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < value->size(); ++i)
+    {
+        if (!projection.get(i))
+        {
+            (*value)[i] = e::slice();
+        }
+    }
+
+    return true;
+}
+
 } // namespace hyperdex
 
 #endif // hyperdex_packing_h_
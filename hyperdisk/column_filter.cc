@@ -0,0 +1,60 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// HyperDisk
+#include "hyperdisk/column_filter.h"
+
+hyperdisk :: column_filter :: column_filter()
+    : m_attrs()
+    , m_lower()
+    , m_upper()
+{
+}
+
+hyperdisk :: column_filter :: column_filter(const hyperspacehashing::search& terms)
+    : m_attrs()
+    , m_lower()
+    , m_upper()
+{
+    // Dimension 0 is the key, which is never columnar.
+    for (size_t i = 1; i < terms.size(); ++i)
+    {
+        if (terms.is_range(i))
+        {
+            uint64_t lower;
+            uint64_t upper;
+            terms.range_value(i, &lower, &upper);
+            m_attrs.push_back(i - 1);
+            m_lower.push_back(lower);
+            m_upper.push_back(upper);
+        }
+    }
+}
+
+hyperdisk :: column_filter :: ~column_filter() throw ()
+{
+}
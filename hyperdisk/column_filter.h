@@ -0,0 +1,75 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef hyperdisk_column_filter_h_
+#define hyperdisk_column_filter_h_
+
+// C
+#include <stdint.h>
+
+// STL
+#include <vector>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/search.h"
+
+namespace hyperdisk
+{
+
+// The range predicates of a search which apply to value attributes.  Shards
+// with columnar attributes (see geometry.h) use these to skip entries without
+// parsing them.  Entries which pass the filter must still be checked against
+// the search itself.
+
+class column_filter
+{
+    public:
+        column_filter();
+        column_filter(const hyperspacehashing::search& terms);
+        ~column_filter() throw ();
+
+    public:
+        bool empty() const { return m_attrs.empty(); }
+        size_t size() const { return m_attrs.size(); }
+        // The value attribute constrained by predicate "i".
+        uint16_t attr(size_t i) const { return m_attrs[i]; }
+        // True if "val" satisfies predicate "i".
+        bool matches(size_t i, uint64_t val) const
+        { return m_lower[i] <= val && val < m_upper[i]; }
+        // True if some value in [min, max] satisfies predicate "i".
+        bool overlaps(size_t i, uint64_t min, uint64_t max) const
+        { return m_lower[i] <= max && min < m_upper[i]; }
+
+    private:
+        std::vector<uint16_t> m_attrs;
+        std::vector<uint64_t> m_lower;
+        std::vector<uint64_t> m_upper;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_column_filter_h_
@@ -0,0 +1,176 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// C
+#include <cstdlib>
+#include <cstring>
+
+// po6
+#include <po6/threads/mutex.h>
+
+#if defined(HAVE_LIBSNAPPY) && defined(HAVE_SNAPPY_C_H)
+// Snappy
+#include <snappy-c.h>
+#endif
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/compressor.h"
+
+namespace
+{
+
+#if defined(HAVE_LIBSNAPPY) && defined(HAVE_SNAPPY_C_H)
+class snappy : public hyperdisk::compressor
+{
+    public:
+        snappy() : compressor(1, "snappy") {}
+        virtual ~snappy() throw () {}
+
+    public:
+        virtual size_t bound(size_t sz) const
+        {
+            return snappy_max_compressed_length(sz);
+        }
+
+        virtual size_t compress(const uint8_t* in, size_t sz, uint8_t* out) const
+        {
+            size_t out_sz = snappy_max_compressed_length(sz);
+
+            if (snappy_compress(reinterpret_cast<const char*>(in), sz,
+                                reinterpret_cast<char*>(out), &out_sz) != SNAPPY_OK)
+            {
+                // The output is sized by bound, so this cannot happen.
+                abort();
+            }
+
+            return out_sz;
+        }
+
+        virtual bool decompress(const uint8_t* in, size_t sz,
+                                uint8_t* out, size_t raw) const
+        {
+            size_t out_sz = raw;
+            return snappy_uncompressed_length(reinterpret_cast<const char*>(in), sz, &out_sz) == SNAPPY_OK &&
+                   out_sz == raw &&
+                   snappy_uncompress(reinterpret_cast<const char*>(in), sz,
+                                     reinterpret_cast<char*>(out), &out_sz) == SNAPPY_OK &&
+                   out_sz == raw;
+        }
+};
+#endif
+
+// The registry is created on first use, so that compressors may be added from
+// static initializers.
+struct registry
+{
+    registry()
+        : lock()
+        , compressors()
+    {
+#if defined(HAVE_LIBSNAPPY) && defined(HAVE_SNAPPY_C_H)
+        static snappy s;
+        compressors[s.id()] = &s;
+#endif
+    }
+
+    po6::threads::mutex lock;
+    const hyperdisk::compressor* compressors[hyperdisk::compressor::MAX_ID + 1];
+};
+
+registry&
+get_registry()
+{
+    static registry r;
+    return r;
+}
+
+} // namespace
+
+const hyperdisk::compressor*
+hyperdisk :: compressor :: lookup(uint16_t id)
+{
+    if (id == 0 || id > MAX_ID)
+    {
+        return NULL;
+    }
+
+    registry& r(get_registry());
+    po6::threads::mutex::hold hold(&r.lock);
+    return r.compressors[id];
+}
+
+const hyperdisk::compressor*
+hyperdisk :: compressor :: lookup(const char* name)
+{
+    registry& r(get_registry());
+    po6::threads::mutex::hold hold(&r.lock);
+
+    for (uint16_t id = 1; id <= MAX_ID; ++id)
+    {
+        if (r.compressors[id] && strcmp(r.compressors[id]->name(), name) == 0)
+        {
+            return r.compressors[id];
+        }
+    }
+
+    return NULL;
+}
+
+bool
+hyperdisk :: compressor :: add(const compressor* c)
+{
+    if (c->id() == 0 || c->id() > MAX_ID)
+    {
+        return false;
+    }
+
+    registry& r(get_registry());
+    po6::threads::mutex::hold hold(&r.lock);
+
+    if (r.compressors[c->id()])
+    {
+        return false;
+    }
+
+    r.compressors[c->id()] = c;
+    return true;
+}
+
+hyperdisk :: compressor :: compressor(uint16_t i, const char* n)
+    : m_id(i)
+    , m_name(n)
+{
+}
+
+hyperdisk :: compressor :: ~compressor() throw ()
+{
+}
@@ -28,13 +28,25 @@
 #define __STDC_LIMIT_MACROS
 
 // C
+#include <climits>
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
+#include <cstring>
 
 // POSIX
+#include <dirent.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
+// STL
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
 // e
 #include <e/guard.h>
 
@@ -43,14 +55,217 @@
 
 // HyperDisk
 #include "hyperdisk/hyperdisk/disk.h"
+#include "hyperdisk/column_filter.h"
 #include "hyperdisk/log_entry.h"
+#include "hyperdisk/log_spill.h"
 #include "hyperdisk/offset_update.h"
 #include "hyperdisk/shard.h"
 #include "hyperdisk/shard_snapshot.h"
 #include "hyperdisk/shard_vector.h"
+#include "hyperdisk/write_ahead_log.h"
 
 using hyperspacehashing::mask::coordinate;
 
+// The most recent unflushed write to a key.  Readers copy the fields while
+// holding "lock".  Writers additionally hold the stripe of m_stored_locks which
+// covers the key.
+class hyperdisk::disk::stored
+{
+    public:
+        stored(const log_entry& e);
+        ~stored() throw ();
+
+    public:
+        void update(const log_entry& e);
+
+    public:
+        po6::threads::mutex lock;
+        // The number of writes to this key in m_log which are not yet flushed.
+        size_t pending;
+        bool is_put;
+        std::tr1::shared_ptr<e::buffer> backing;
+        std::vector<e::slice> value;
+        uint64_t version;
+
+    private:
+        friend class e::intrusive_ptr<stored>;
+
+    private:
+        stored(const stored&);
+
+    private:
+        void inc() { __sync_add_and_fetch(&m_ref, 1); }
+        void dec() { if (__sync_sub_and_fetch(&m_ref, 1) == 0) delete this; }
+
+    private:
+        stored& operator = (const stored&);
+
+    private:
+        size_t m_ref;
+};
+
+hyperdisk :: disk :: stored :: stored(const log_entry& e)
+    : lock()
+    , pending(1)
+    , is_put(e.is_put)
+    , backing(e.backing)
+    , value(e.value)
+    , version(e.version)
+    , m_ref(0)
+{
+}
+
+hyperdisk :: disk :: stored :: ~stored() throw ()
+{
+}
+
+void
+hyperdisk :: disk :: stored :: update(const log_entry& e)
+{
+    po6::threads::mutex::hold hold(&lock);
+    ++pending;
+    is_put = e.is_put;
+    backing = e.backing;
+    value = e.value;
+    version = e.version;
+}
+
+// Charge the page faults taken by this thread while in scope to the disk,
+// multiplied by "weight".  A weight of zero measures nothing.
+class hyperdisk::disk::fault_scope
+{
+    public:
+        fault_scope(disk* d, uint64_t weight);
+        ~fault_scope() throw ();
+
+    private:
+        static bool faults(uint64_t* minor, uint64_t* major);
+
+    private:
+        fault_scope(const fault_scope&);
+        fault_scope& operator = (const fault_scope&);
+
+    private:
+        disk* m_disk;
+        uint64_t m_weight;
+        uint64_t m_minor;
+        uint64_t m_major;
+};
+
+hyperdisk :: disk :: fault_scope :: fault_scope(disk* d, uint64_t weight)
+    : m_disk(d)
+    , m_weight(weight)
+    , m_minor(0)
+    , m_major(0)
+{
+    if (m_weight && !faults(&m_minor, &m_major))
+    {
+        m_weight = 0;
+    }
+}
+
+hyperdisk :: disk :: fault_scope :: ~fault_scope() throw ()
+{
+    uint64_t minor;
+    uint64_t major;
+
+    if (m_weight && faults(&minor, &major))
+    {
+        __sync_add_and_fetch(&m_disk->m_minor_faults, (minor - m_minor) * m_weight);
+        __sync_add_and_fetch(&m_disk->m_major_faults, (major - m_major) * m_weight);
+    }
+}
+
+bool
+hyperdisk :: disk :: fault_scope :: faults(uint64_t* minor, uint64_t* major)
+{
+    struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+    if (getrusage(RUSAGE_THREAD, &ru) < 0)
+#else
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+#endif
+    {
+        return false;
+    }
+
+    *minor = ru.ru_minflt;
+    *major = ru.ru_majflt;
+    return true;
+}
+
+// The outcome of applying a log entry to the shards.
+class hyperdisk::disk::flush_result
+{
+    public:
+        flush_result();
+        ~flush_result() throw ();
+
+    public:
+        bool del_needed;
+        size_t del_num;
+        uint32_t del_offset;
+        bool put_succeeded;
+        size_t put_num;
+        uint32_t put_offset;
+        // The shard which is full, if the entry could not be applied.
+        size_t full_num;
+};
+
+hyperdisk :: disk :: flush_result :: flush_result()
+    : del_needed(false)
+    , del_num(0)
+    , del_offset(0)
+    , put_succeeded(false)
+    , put_num(0)
+    , put_offset(0)
+    , full_num(0)
+{
+}
+
+hyperdisk :: disk :: flush_result :: ~flush_result() throw ()
+{
+}
+
+// A prefix of the log which is certain to fit in the shards, with the shard
+// each entry will DEL from already located.  The entries of one group touch no
+// shard touched by another group, so groups may be applied in parallel, as
+// long as each group is applied in log order.
+class hyperdisk::disk::flush_batch
+{
+    public:
+        flush_batch();
+        ~flush_batch() throw ();
+
+    public:
+        std::vector<const log_entry*> entries;
+        std::vector<flush_result> results;
+        // Indices into "entries", in log order.
+        std::vector<std::vector<size_t> > groups;
+        // The next group to apply.  Claimed atomically.
+        size_t next_group;
+        // The number of threads applying groups.  Protected by m_flush_lock.
+        size_t workers;
+
+    private:
+        flush_batch(const flush_batch&);
+        flush_batch& operator = (const flush_batch&);
+};
+
+hyperdisk :: disk :: flush_batch :: flush_batch()
+    : entries()
+    , results()
+    , groups()
+    , next_group(0)
+    , workers(0)
+{
+}
+
+hyperdisk :: disk :: flush_batch :: ~flush_batch() throw ()
+{
+}
+
 // LOCKING:  IF YOU DO ANYTHING WITH THIS CODE, READ THIS FIRST!
 //
 // At any given time, only one thread should be mutating shards.  In this
@@ -58,6 +273,14 @@ using hyperspacehashing::mask::coordinate;
 // cleaning/splitting/joining the shard. The m_shard_mutate mutex is used to
 // enforce this constraint.
 //
+// Cleaning and splitting are serialized by m_compact_lock, which is acquired
+// before m_shards_mutate.  Only the holder of m_compact_lock may change
+// m_shards, so it may read m_shards without other locks.  Replacement shards
+// are filled from a snapshot of the old shard without holding m_shards_mutate,
+// so that flushes may continue in the meantime.  Afterwards, m_shards_mutate is
+// held just long enough to apply the flushes made during the copy to the
+// replacements, and to swap the shard_vector.
+//
 // Certain mutations require changing the shard_vector (e.g., to replace a shard
 // with its equivalent that has had dead space collected).  These mutations
 // conflict with reading from the shards (e.g. for a GET).  To that end, the
@@ -75,13 +298,56 @@ using hyperspacehashing::mask::coordinate;
 // accesses, but using the WAL to detect them.  PUT/DEL do this by writing to
 // the WAL.  Trickle does this by using locking when exchanging the
 // shard_vectors.
+//
+// Flushing is the exception:  the flushing thread holds m_shards_mutate, and
+// plans which shards each entry of a batch will touch.  Entries are grouped so
+// that no two groups touch the same shard, and other flushing threads (which
+// fail to acquire m_shards_mutate) help by applying whole groups.  Each shard
+// is then mutated by one thread at a time.  The offsets are only published, in
+// log order, by the flushing thread once every group has been applied.
+//
+// GET does not scan the WAL.  Instead, m_stored indexes the most recent write
+// to every key with unflushed writes in the WAL.  PUT/DEL append to the WAL and
+// update m_stored while holding the stripe of m_stored_locks for the key.
+// Flush removes a key from m_stored (under the same stripe) only after the
+// write has been applied to the shards and the shard offsets updated, so a GET
+// which misses in m_stored will find the key in the shards.
 
 e::intrusive_ptr<hyperdisk::disk>
 hyperdisk :: disk :: create(const po6::pathname& directory,
                             const hyperspacehashing::mask::hasher& hasher,
-                            uint16_t arity)
+                            uint16_t arity,
+                            bool durable,
+                            const geometry& geom)
+{
+    e::intrusive_ptr<disk> ret = new disk(directory, hasher, arity, geom);
+    ret->create_shards();
+
+    if (durable)
+    {
+        ret->start_log();
+    }
+
+    return ret;
+}
+
+e::intrusive_ptr<hyperdisk::disk>
+hyperdisk :: disk :: open(const po6::pathname& directory,
+                          const hyperspacehashing::mask::hasher& hasher,
+                          uint16_t arity,
+                          bool durable,
+                          const geometry& geom)
 {
-    return new disk(directory, hasher, arity);
+    e::intrusive_ptr<disk> ret = new disk(directory, hasher, arity, geom);
+    ret->open_shards();
+    ret->replay_log();
+
+    if (durable)
+    {
+        ret->start_log();
+    }
+
+    return ret;
 }
 
 hyperdisk::returncode
@@ -90,61 +356,67 @@ hyperdisk :: disk :: get(const e::slice& key,
                          uint64_t* version,
                          reference* backing)
 {
+    bool sample = __sync_add_and_fetch(&m_gets, 1) % FAULT_SAMPLE_INTERVAL == 0;
+    fault_scope faults(this, sample ? FAULT_SAMPLE_INTERVAL : 0);
     coordinate coord = m_hasher.hash(key);
-    returncode shard_res = NOTFOUND;
+    e::intrusive_ptr<stored> st;
+
+    if (m_stored.lookup(stored_key(coord, key), &st))
+    {
+        po6::threads::mutex::hold hold(&st->lock);
+        backing->set(st->backing);
+
+        if (st->is_put)
+        {
+            *value = st->value;
+            *version = st->version;
+            return SUCCESS;
+        }
+
+        return NOTFOUND;
+    }
+
     e::intrusive_ptr<shard_vector> shards;
-    e::locking_iterable_fifo<log_entry>::iterator it = m_log.iterate();
 
     {
         po6::threads::mutex::hold b(&m_shards_lock);
         shards = m_shards;
     }
 
+    uint64_t bloom = shard::bloom_hash(coord.primary_hash, key);
+
     for (size_t i = 0; i < shards->size(); ++i)
     {
-        if (!shards->get_coordinate(i).primary_intersects(coord))
+        if (!shards->get_coordinate(i).primary_intersects(coord) ||
+            !shards->get_shard(i)->may_contain(bloom))
         {
             continue;
         }
 
-        shard_res = shards->get_shard(i)->get(coord.primary_hash, key, value, version);
+        std::tr1::shared_ptr<e::buffer> decompressed;
+        returncode ret = shards->get_shard(i)->get(coord.primary_hash, key, value,
+                                                   version, &decompressed, m_verify_reads);
 
-        if (shard_res == SUCCESS)
+        if (ret == CORRUPT)
         {
-            backing->set(shards->get_shard(i));
-            break;
+            return CORRUPT;
         }
-    }
-
-    bool found = false;
-    returncode wal_res = NOTFOUND;
 
-    for (; it.valid(); it.next())
-    {
-        if (it->coord.primary_intersects(coord) && it->key == key)
+        if (ret == SUCCESS)
         {
-            if (it->is_put)
-            {
-                *value = it->value;
-                *version = it->version;
-                wal_res = SUCCESS;
-            }
-            else
+            shards->get_shard(i)->count_read();
+            backing->set(shards->get_shard(i));
+
+            if (decompressed)
             {
-                wal_res = NOTFOUND;
+                backing->set(decompressed);
             }
 
-            found = true;
-            backing->set(it);
+            return SUCCESS;
         }
     }
 
-    if (found)
-    {
-        return wal_res;
-    }
-
-    return shard_res;
+    return NOTFOUND;
 }
 
 hyperdisk::returncode
@@ -159,7 +431,37 @@ hyperdisk :: disk :: put(std::tr1::shared_ptr<e::buffer> backing,
     }
 
     coordinate coord = m_hasher.hash(key, value);
-    m_log.append(log_entry(coord, backing, key, value, version));
+    log_append(log_entry(coord, backing, key, value, version));
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: put(const std::tr1::shared_ptr<e::buffer>* backings,
+                         const e::slice* keys,
+                         const std::vector<e::slice>* values,
+                         const uint64_t* versions,
+                         size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (values[i].size() + 1 != m_arity)
+        {
+            return WRONGARITY;
+        }
+    }
+
+    std::vector<coordinate> coords(count);
+
+    if (count > 0)
+    {
+        m_hasher.hash(keys, values, count, &coords[0]);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        log_append(log_entry(coords[i], backings[i], keys[i], values[i], versions[i]));
+    }
+
     return SUCCESS;
 }
 
@@ -168,7 +470,7 @@ hyperdisk :: disk :: del(std::tr1::shared_ptr<e::buffer> backing,
                          const e::slice& key)
 {
     coordinate coord = m_hasher.hash(key);
-    m_log.append(log_entry(coord, backing, key));
+    log_append(log_entry(coord, backing, key));
     return SUCCESS;
 }
 
@@ -206,19 +508,48 @@ hyperdisk :: disk :: make_snapshot(const hyperspacehashing::search& terms)
     {
         if (coord.intersects(shards->get_coordinate(i)))
         {
+            shards->get_shard(i)->count_read();
             snaps.push_back(shard_snapshot(offsets[i], shards->get_shard(i)));
         }
     }
 
+    std::auto_ptr<column_filter> filter(new column_filter(terms));
     e::intrusive_ptr<hyperdisk::snapshot> ret;
-    ret = new snapshot(coord, shards, &snaps);
+    ret = new snapshot(coord, filter, shards, &snaps);
     return ret;
 }
 
 e::intrusive_ptr<hyperdisk::rolling_snapshot>
-hyperdisk :: disk :: make_rolling_snapshot()
+hyperdisk :: disk :: make_rolling_snapshot(bool spill)
 {
     hyperspacehashing::search terms(m_arity);
+
+    if (spill)
+    {
+        // Take the iterator and its position together, so that the position
+        // agrees with the entries flushed so far.
+        po6::threads::mutex::hold hold(&m_spill_lock);
+        e::locking_iterable_fifo<log_entry>::iterator iter(m_log.iterate());
+        std::auto_ptr<log_spill> ls;
+
+        try
+        {
+            ls.reset(new log_spill(m_base, spill_filename()));
+        }
+        catch (po6::error&)
+        {
+        }
+
+        if (ls.get())
+        {
+            e::intrusive_ptr<snapshot> snap = make_snapshot(terms);
+            e::intrusive_ptr<rolling_snapshot> ret;
+            ret = new rolling_snapshot(iter, snap, this, m_log_flushed, ls);
+            m_spilling.insert(ret.get());
+            return ret;
+        }
+    }
+
     e::locking_iterable_fifo<log_entry>::iterator iter(m_log.iterate());
     e::intrusive_ptr<snapshot> snap = make_snapshot(terms);
     e::intrusive_ptr<rolling_snapshot> ret = new rolling_snapshot(iter, snap);
@@ -228,6 +559,7 @@ hyperdisk :: disk :: make_rolling_snapshot()
 hyperdisk::returncode
 hyperdisk :: disk :: drop()
 {
+    po6::threads::mutex::hold z(&m_compact_lock);
     po6::threads::mutex::hold a(&m_shards_mutate);
     po6::threads::mutex::hold b(&m_shards_lock);
     po6::threads::mutex::hold c(&m_spare_shards_lock);
@@ -244,24 +576,89 @@ hyperdisk :: disk :: drop()
         m_spare_shards.pop();
     }
 
+    while (!m_retired_shards.empty())
+    {
+        if (unlinkat(m_base.get(), m_retired_shards.front().first.get(), 0) < 0)
+        {
+            ret = DROPFAILED;
+        }
+
+        m_retired_shards.pop();
+    }
+
     for (size_t i = 0; i < shards->size(); ++i)
     {
+        shards->get_shard(i)->release();
+
         if (drop_shard(shards->get_coordinate(i)) != SUCCESS)
         {
             ret = DROPFAILED;
         }
     }
 
+    // Remove the durable log, and any spill file left behind by a crash.
+    m_wal.reset();
+
+    try
+    {
+        std::vector<uint64_t> seqs;
+        write_ahead_log::segments(m_base_filename, &seqs);
+
+        for (size_t i = 0; i < seqs.size(); ++i)
+        {
+            if (unlinkat(m_base.get(), write_ahead_log::segment_filename(seqs[i]).get(), 0) < 0)
+            {
+                ret = DROPFAILED;
+            }
+        }
+
+        DIR* dir = opendir(m_base_filename.get());
+
+        if (!dir)
+        {
+            throw po6::error(errno);
+        }
+
+        e::guard dir_guard = e::makeguard(closedir, dir);
+        dir_guard.use_variable();
+        std::vector<std::string> names;
+        struct dirent* ent;
+        errno = 0;
+
+        while ((ent = readdir(dir)))
+        {
+            names.push_back(ent->d_name);
+        }
+
+        if (errno != 0)
+        {
+            throw po6::error(errno);
+        }
+
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (names[i].compare(0, 6, "spill-") == 0 &&
+                unlinkat(m_base.get(), names[i].c_str(), 0) < 0)
+            {
+                ret = DROPFAILED;
+            }
+        }
+    }
+    catch (po6::error&)
+    {
+        ret = DROPFAILED;
+    }
+
     if (ret == SUCCESS)
     {
-        if (rmdir(m_base_filename.get()) < 0)
+        if (rmdir(m_base_filename.get()) < 0 ||
+            (m_cold.get() >= 0 && rmdir(m_cold_filename.get()) < 0))
         {
             ret = DROPFAILED;
         }
     }
 
     return ret;
-    return SUCCESS;
 }
 
 // This operation will return SUCCESS as long as it knows that progress is being
@@ -269,9 +666,11 @@ hyperdisk :: disk :: drop()
 hyperdisk::returncode
 hyperdisk :: disk :: flush(size_t num)
 {
+    fault_scope faults(this, 1);
+
     if (!m_shards_mutate.trylock())
     {
-        return SUCCESS;
+        return flush_help() ? SUCCESS : DIDNOTHING;
     }
 
     bool flushed = false;
@@ -279,145 +678,186 @@ hyperdisk :: disk :: flush(size_t num)
     e::guard hold = e::makeobjguard(m_shards_mutate, &po6::threads::mutex::unlock);
     hold.use_variable();
     e::locking_iterable_fifo<log_entry>::iterator it = m_log.iterate();
+    size_t nf = 0;
+
+    // Plan the longest prefix of the log which is certain to fit in the
+    // shards.  For each entry, find the shard it will PUT to, and the shard
+    // (if any) from which it will DEL the key, accounting for earlier entries
+    // in the batch.  Entries which share a shard are grouped together.
+    size_t num_shards = m_shards->size();
+    std::vector<size_t> roots(num_shards);
+    std::vector<uint64_t> bytes(num_shards, 0);
+    std::vector<uint64_t> puts(num_shards, 0);
+    std::map<e::slice, ssize_t> located;
+    std::vector<ssize_t> touched;
+    flush_batch batch;
+
+    for (size_t i = 0; i < num_shards; ++i)
+    {
+        roots[i] = i;
+    }
 
-    for (size_t nf = 0; nf < num && it.valid(); ++nf, it.next())
+    for (; nf < num && it.valid(); ++nf, it.next())
     {
-        const coordinate& coord = it->coord;
-        const e::slice& key = it->key;
-        bool del_needed = false;
-        size_t del_num = 0;
-        uint32_t del_offset = 0;
+        flush_result r;
+        std::map<e::slice, ssize_t>::iterator loc = located.find(it->key);
 
-        for (size_t i = 0; !del_needed && i < m_shards->size(); ++i)
+        if (loc == located.end())
         {
-            if (!m_shards->get_coordinate(i).primary_intersects(coord))
-            {
-                continue;
-            }
-
-            returncode ret;
-            ret = m_shards->get_shard(i)->get(coord.primary_hash, key);
-
-            if (ret == SUCCESS)
-            {
-                del_needed = true;
-                del_num = i;
-            }
-            else if (ret == NOTFOUND)
-            {
-            }
-            else
-            {
-                abort();
-            }
+            flush_locate(*it, &r);
+        }
+        else if (loc->second >= 0)
+        {
+            r.del_needed = true;
+            r.del_num = loc->second;
         }
 
-        bool put_succeeded = false;
-        size_t put_num = 0;
-        uint32_t put_offset = 0;
+        ssize_t target = -1;
+        uint64_t put_bytes = 0;
 
         if (it->is_put)
         {
-            const std::vector<e::slice>& value = it->value;
-            const uint64_t version = it->version;
-
-            for (ssize_t i = m_shards->size() - 1; !put_succeeded && i >= 0; --i)
+            // The shard flush_apply will PUT to.
+            for (target = num_shards - 1; target >= 0; --target)
             {
-                if (!m_shards->get_coordinate(i).intersects(coord))
-                {
-                    continue;
-                }
-
-                returncode ret;
-                ret = m_shards->get_shard(i)->put(coord, key, value,
-                                                  version, &put_offset);
-
-                if (ret == SUCCESS)
-                {
-                    put_succeeded = true;
-                    put_num = i;
-                }
-                else if (ret == DATAFULL || ret == SEARCHFULL)
+                if (m_shards->get_coordinate(target).intersects(it->coord))
                 {
-                    m_needs_io = i;
-                    flush_status = ret;
                     break;
                 }
-                else
-                {
-                    abort();
-                }
             }
 
-            if (!put_succeeded)
+            if (target < 0)
             {
                 break;
             }
-        }
 
-        if (del_needed && (!put_succeeded || del_num != put_num))
-        {
-            switch (m_shards->get_shard(del_num)->del(coord.primary_hash, key, &del_offset))
+            put_bytes = bytes[target] + m_shards->get_shard(target)->put_size(it->key, it->value);
+
+            if (!m_shards->get_shard(target)->has_room(put_bytes, puts[target] + 1))
             {
-                case SUCCESS:
-                    break;
-                case NOTFOUND:
-                case DATAFULL:
-                case WRONGARITY:
-                case SEARCHFULL:
-                case SYNCFAILED:
-                case DROPFAILED:
-                case MISSINGDISK:
-                case SPLITFAILED:
-                case DIDNOTHING:
-                default:
-                    abort();
+                break;
             }
         }
 
-        flushed = true;
+        // A DEL from another shard advances its data offset, so it must fit
+        // along with the PUTs already planned for that shard.
+        bool del_elsewhere = r.del_needed && r.del_num != static_cast<size_t>(target);
+
+        if (del_elsewhere &&
+            !m_shards->get_shard(r.del_num)->has_room(bytes[r.del_num] + shard::del_size(),
+                                                      puts[r.del_num]))
+        {
+            break;
+        }
+
+        if (target >= 0)
+        {
+            bytes[target] = put_bytes;
+            ++puts[target];
+        }
+
+        if (del_elsewhere)
+        {
+            bytes[r.del_num] += shard::del_size();
+        }
+
+        if (target >= 0 && r.del_needed)
+        {
+            size_t a = flush_root(&roots, target);
+            size_t b = flush_root(&roots, r.del_num);
+            roots[std::max(a, b)] = std::min(a, b);
+        }
+
+        located[it->key] = target;
+        touched.push_back(target >= 0 ? target : r.del_needed ? r.del_num : -1);
+        batch.entries.push_back(&*it);
+        batch.results.push_back(r);
+    }
+
+    // Entries which touch no shard need only be published.
+    std::vector<size_t> group_of(num_shards, SIZE_MAX);
+
+    for (size_t i = 0; i < batch.entries.size(); ++i)
+    {
+        if (touched[i] < 0)
+        {
+            continue;
+        }
 
-        // Here we prepare two offset_updates that we can push onto the offsets
-        // log.  We then make the offset changes to the shard_vector, and then
-        // finish by removing the items we put on the log.
-        std::vector<offset_update> updates;
+        size_t root = flush_root(&roots, touched[i]);
 
-        if (del_needed && del_num != put_num)
+        if (group_of[root] == SIZE_MAX)
         {
-            updates.push_back(offset_update());
-            updates.back().shard_generation = m_shards->generation();
-            updates.back().shard_num = del_num;
-            updates.back().new_offset = del_offset;
+            group_of[root] = batch.groups.size();
+            batch.groups.push_back(std::vector<size_t>());
         }
 
-        if (put_succeeded)
+        batch.groups[group_of[root]].push_back(i);
+    }
+
+    if (batch.groups.size() > 1)
+    {
+        po6::threads::mutex::hold holdf(&m_flush_lock);
+        m_flush_batch = &batch;
+        batch.workers = 1;
+    }
+
+    flush_work(&batch);
+
+    if (batch.groups.size() > 1)
+    {
+        po6::threads::mutex::hold holdf(&m_flush_lock);
+        m_flush_batch = NULL;
+        --batch.workers;
+
+        while (batch.workers > 0)
         {
-            updates.push_back(offset_update());
-            updates.back().shard_generation = m_shards->generation();
-            updates.back().shard_num = put_num;
-            updates.back().new_offset = put_offset;
+            m_flush_cond.wait();
         }
+    }
+
+    for (size_t i = 0; i < batch.entries.size(); ++i)
+    {
+        flush_publish(*batch.entries[i], batch.results[i]);
+        flushed = true;
+    }
 
-        // Log our intentions.
-        m_offsets.batch_append(updates);
+    // The next entry may not fit, so apply entries one at a time.
+    for (; nf < num && it.valid(); ++nf, it.next())
+    {
+        flush_result r;
+        flush_locate(*it, &r);
+        returncode ret = flush_apply(*it, &r);
 
-        // Do our updates.
-        for (size_t i = 0; i < updates.size(); ++i)
+        if (ret == DATAFULL || ret == SEARCHFULL)
         {
-            assert(updates[i].shard_generation == m_shards->generation());
-            assert(updates[i].new_offset > m_shards->get_offset(updates[i].shard_num));
-            m_shards->set_offset(updates[i].shard_num, updates[i].new_offset);
+            m_needs_io = r.full_num;
+            flush_status = ret;
         }
 
-        // Remove our updates from the log.
-        for (size_t i = 0; i < updates.size(); ++i)
+        if (ret != SUCCESS)
         {
-            assert(m_offsets.oldest() == updates[i]);
-            m_offsets.remove_oldest();
+            break;
         }
+
+        flush_publish(*it, r);
+        flushed = true;
     }
 
-    m_log.advance_to(it);
+    {
+        // Move the flushed entries out of memory for the snapshots which have
+        // yet to return them.
+        po6::threads::mutex::hold holds(&m_spill_lock);
+        m_log_flushed += nf;
+
+        for (std::set<rolling_snapshot*>::iterator rs = m_spilling.begin();
+                rs != m_spilling.end(); ++rs)
+        {
+            (*rs)->spill(m_log_flushed);
+        }
+
+        m_log.advance_to(it);
+    }
 
     if (flush_status != SUCCESS)
     {
@@ -438,13 +878,19 @@ hyperdisk :: disk :: flush(size_t num)
 hyperdisk::returncode
 hyperdisk :: disk :: do_mandatory_io()
 {
-    po6::threads::mutex::hold hold(&m_shards_mutate);
+    fault_scope faults(this, 1);
+    po6::threads::mutex::hold hold(&m_compact_lock);
+    size_t needs_io;
 
-    if (m_needs_io != static_cast<size_t>(-1))
     {
-        assert(m_needs_io <= m_shards->size());
-        size_t needs_io = m_needs_io;
+        po6::threads::mutex::hold holdm(&m_shards_mutate);
+        needs_io = m_needs_io;
         m_needs_io = -1;
+    }
+
+    if (needs_io != static_cast<size_t>(-1))
+    {
+        assert(needs_io <= m_shards->size());
         return deal_with_full_shard(needs_io);
     }
 
@@ -454,6 +900,7 @@ hyperdisk :: disk :: do_mandatory_io()
 hyperdisk::returncode
 hyperdisk :: disk :: do_optimistic_io()
 {
+    fault_scope faults(this, 1);
     e::intrusive_ptr<shard_vector> shards;
 
     {
@@ -465,10 +912,12 @@ hyperdisk :: disk :: do_optimistic_io()
     int most_loaded_amt = 0;
     uint64_t used = 0;
     uint64_t capacity = 0;
+    std::vector<int> live(shards->size());
 
     for (size_t i = 0; i < shards->size(); ++i)
     {
         int loaded = shards->get_shard(i)->used_space();
+        live[i] = std::max(loaded - shards->get_shard(i)->stale_space(), 0);
 
         if (loaded > most_loaded_amt)
         {
@@ -484,7 +933,7 @@ hyperdisk :: disk :: do_optimistic_io()
     {
         double flip = static_cast<double>(rand_r(&m_seed)) / static_cast<double>(RAND_MAX);
         double thresh = 1 / pow(1.01, 100 - used);
-        po6::threads::mutex::hold holdm(&m_shards_mutate);
+        po6::threads::mutex::hold holdc(&m_compact_lock);
 
         if (shards == m_shards && flip < thresh && most_loaded_amt >= 75)
         {
@@ -492,18 +941,53 @@ hyperdisk :: disk :: do_optimistic_io()
         }
     }
 
+    // Merge the pair of siblings with the least live data between them.
+    size_t merge1 = 0;
+    size_t merge2 = 0;
+    int merge_amt = MERGE_THRESHOLD + 1;
+    coordinate merged;
+
+    for (size_t i = 0; i < live.size(); ++i)
+    {
+        for (size_t j = i + 1; j < live.size(); ++j)
+        {
+            coordinate c;
+
+            if (live[i] + live[j] < merge_amt &&
+                siblings(shards->get_coordinate(i), shards->get_coordinate(j), &c))
+            {
+                merge1 = i;
+                merge2 = j;
+                merge_amt = live[i] + live[j];
+                merged = c;
+            }
+        }
+    }
+
+    if (merge_amt <= MERGE_THRESHOLD)
+    {
+        po6::threads::mutex::hold holdc(&m_compact_lock);
+
+        if (shards == m_shards)
+        {
+            return merge_shards(merge1, merge2, merged);
+        }
+    }
+
     return DIDNOTHING;
 }
 
 hyperdisk::returncode
 hyperdisk :: disk :: preallocate()
 {
+    bool recycled = recycle_retired_shards();
+
     {
         po6::threads::mutex::hold hold(&m_spare_shards_lock);
 
-        if (m_spare_shards.size() >= 16)
+        if (m_spare_shards.size() >= MAX_SPARE_SHARDS)
         {
-            return DIDNOTHING;
+            return recycled ? SUCCESS : DIDNOTHING;
         }
     }
 
@@ -556,16 +1040,9 @@ hyperdisk :: disk :: preallocate()
 
     if (need_shard)
     {
-        std::ostringstream ostr;
-
-        {
-            po6::threads::mutex::hold hold(&m_spare_shards_lock);
-            ostr << "spare-" << m_spare_shard_counter;
-            ++m_spare_shard_counter;
-        }
-
-        po6::pathname sparepath(ostr.str());
-        e::intrusive_ptr<hyperdisk::shard> spareshard = hyperdisk::shard::create(m_base, sparepath);
+        po6::pathname sparepath = spare_filename();
+        e::intrusive_ptr<hyperdisk::shard> spareshard;
+        spareshard = hyperdisk::shard::create(m_base, sparepath, current_geometry());
 
         {
             po6::threads::mutex::hold hold(&m_spare_shards_lock);
@@ -573,29 +1050,225 @@ hyperdisk :: disk :: preallocate()
         }
     }
 
-    return need_shard ? SUCCESS : DIDNOTHING;
+    return need_shard || recycled ? SUCCESS : DIDNOTHING;
+}
+
+void
+hyperdisk :: disk :: recycle_shards(bool recycle)
+{
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
+    m_recycle = recycle;
+}
+
+void
+hyperdisk :: disk :: verify_reads(bool verify)
+{
+    m_verify_reads = verify;
 }
 
 hyperdisk::returncode
-hyperdisk :: disk :: async()
+hyperdisk :: disk :: scrub(size_t num)
 {
+    po6::threads::mutex::hold hold(&m_scrub_lock);
     e::intrusive_ptr<shard_vector> shards;
-    returncode ret = SUCCESS;
 
     {
         po6::threads::mutex::hold b(&m_shards_lock);
         shards = m_shards;
     }
 
-    for (size_t i = 0; i < shards->size(); ++i)
+    // Follow the shard we were scrubbing if it moved within the vector.  If
+    // it is gone, whatever replaced it was verified as it was copied.
+    if (m_scrub_index >= shards->size() ||
+        shards->get_shard(m_scrub_index) != m_scrub_shard)
     {
-        if (shards->get_shard(i)->async() != SUCCESS)
+        m_scrub_entry = 0;
+
+        for (size_t i = 0; i < shards->size(); ++i)
         {
-            ret = SYNCFAILED;
+            if (shards->get_shard(i) == m_scrub_shard)
+            {
+                m_scrub_index = i;
+                break;
+            }
         }
     }
 
-    return ret;
+    while (num > 0 && m_scrub_index < shards->size())
+    {
+        uint32_t start = m_scrub_entry;
+        uint32_t count = std::min(num, static_cast<size_t>(UINT32_MAX));
+        returncode ret = shards->get_shard(m_scrub_index)->scrub(&m_scrub_entry, count);
+        num -= m_scrub_entry - start;
+
+        if (ret == CORRUPT)
+        {
+            m_scrub_shard = shards->get_shard(m_scrub_index);
+            return CORRUPT;
+        }
+        else if (ret == DIDNOTHING)
+        {
+            ++m_scrub_index;
+            m_scrub_entry = 0;
+        }
+    }
+
+    if (m_scrub_index >= shards->size())
+    {
+        m_scrub_shard = NULL;
+        m_scrub_index = 0;
+        m_scrub_entry = 0;
+        return DIDNOTHING;
+    }
+
+    m_scrub_shard = shards->get_shard(m_scrub_index);
+    return SUCCESS;
+}
+
+// The inverse of shard_filename.
+static bool
+parse_shard_filename(const std::string& name, coordinate* c)
+{
+    unsigned long long pm, ph, um, uh, lm, lh;
+    int len = 0;
+
+    if (name.size() != 6 * 16 + 5 ||
+        sscanf(name.c_str(), "%16llx-%16llx-%16llx-%16llx-%16llx-%16llx%n",
+               &pm, &ph, &um, &uh, &lm, &lh, &len) != 6 ||
+        static_cast<size_t>(len) != name.size())
+    {
+        return false;
+    }
+
+    *c = coordinate(pm, ph, lm, lh, um, uh);
+    return true;
+}
+
+void
+hyperdisk :: disk :: store_cold_shards(const po6::pathname& directory)
+{
+    po6::threads::mutex::hold hold(&m_compact_lock);
+
+    if (mkdir(directory.get(), S_IRWXU) < 0 && errno != EEXIST)
+    {
+        throw po6::error(errno);
+    }
+
+    // The links to cold shards must not depend upon the working directory.
+    char abspath[PATH_MAX];
+
+    if (!realpath(directory.get(), abspath))
+    {
+        throw po6::error(errno);
+    }
+
+    DIR* dir = opendir(abspath);
+
+    if (!dir)
+    {
+        throw po6::error(errno);
+    }
+
+    e::guard dir_guard = e::makeguard(closedir, dir);
+    dir_guard.use_variable();
+    std::vector<std::string> names;
+    struct dirent* ent;
+    errno = 0;
+
+    while ((ent = readdir(dir)))
+    {
+        names.push_back(ent->d_name);
+    }
+
+    if (errno != 0)
+    {
+        throw po6::error(errno);
+    }
+
+    // Remove the temporary shards of moves which never finished, and the
+    // cold shards which are no longer linked from m_base.
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        const std::string& name(names[i]);
+        coordinate c;
+        struct stat st;
+
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+
+        if ((name.size() > 4 && name.compare(name.size() - 4, 4, "-tmp") == 0) ||
+            (parse_shard_filename(name, &c) &&
+             (fstatat(m_base.get(), name.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+              !S_ISLNK(st.st_mode))))
+        {
+            unlinkat(dirfd(dir), name.c_str(), 0);
+        }
+    }
+
+    m_cold = ::open(abspath, O_RDONLY);
+
+    if (m_cold.get() < 0)
+    {
+        throw po6::error(errno);
+    }
+
+    m_cold_filename = po6::pathname(abspath);
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: tier_shards()
+{
+    po6::threads::mutex::hold hold(&m_compact_lock);
+
+    if (m_cold.get() < 0)
+    {
+        return DIDNOTHING;
+    }
+
+    size_t hottest = 0;
+    uint64_t hottest_heat = TIER_HOT_HEAT;
+    bool promote = false;
+    size_t coldest = 0;
+    uint64_t coldest_heat = TIER_COLD_HEAT;
+    bool demote = false;
+
+    // Every shard must be measured on each call for the heat to decay evenly.
+    for (size_t i = 0; i < m_shards->size(); ++i)
+    {
+        uint64_t calls;
+        uint64_t heat = m_shards->get_shard(i)->heat(&calls);
+        po6::pathname target;
+
+        if (cold_shard(m_shards->get_coordinate(i), &target))
+        {
+            if (heat >= hottest_heat)
+            {
+                hottest = i;
+                hottest_heat = heat;
+                promote = true;
+            }
+        }
+        else if (calls >= TIER_WARMUP && heat <= coldest_heat)
+        {
+            coldest = i;
+            coldest_heat = heat;
+            demote = true;
+        }
+    }
+
+    // Making room on the fast path comes before filling the slow one.
+    if (promote)
+    {
+        return tier_shard(hottest, false);
+    }
+    else if (demote)
+    {
+        return tier_shard(coldest, true);
+    }
+
+    return DIDNOTHING;
 }
 
 hyperdisk::returncode
@@ -620,47 +1293,574 @@ hyperdisk :: disk :: sync()
     return ret;
 }
 
+hyperdisk::returncode
+hyperdisk :: disk :: commit()
+{
+    if (!m_wal.get())
+    {
+        return DIDNOTHING;
+    }
+
+    returncode ret = m_wal->commit();
+
+    // A segment left with a torn entry is abandoned for a new one holding
+    // every entry not yet in the shards.
+    if (ret == SYNCFAILED && m_wal->failed())
+    {
+        return checkpoint();
+    }
+
+    if (ret == SYNCFAILED || m_wal->segment_size() < LOG_SEGMENT_SIZE)
+    {
+        return ret;
+    }
+
+    return checkpoint();
+}
+
+void
+hyperdisk :: disk :: page_faults(uint64_t* minor, uint64_t* major)
+{
+    *minor = __sync_add_and_fetch(&m_minor_faults, 0);
+    *major = __sync_add_and_fetch(&m_major_faults, 0);
+}
+
+void
+hyperdisk :: disk :: compression(uint64_t* raw, uint64_t* stored)
+{
+    *raw = 0;
+    *stored = 0;
+    e::intrusive_ptr<shard_vector> shards;
+
+    {
+        po6::threads::mutex::hold b(&m_shards_lock);
+        shards = m_shards;
+    }
+
+    for (size_t i = 0; i < shards->size(); ++i)
+    {
+        uint64_t r;
+        uint64_t s;
+        shards->get_shard(i)->compression(&r, &s);
+        *raw += r;
+        *stored += s;
+    }
+}
+
+void
+hyperdisk :: disk :: pressure(uint64_t* entries, uint64_t* bytes, int* fullest)
+{
+    *entries = __sync_add_and_fetch(&m_log_entries, 0);
+    *bytes = __sync_add_and_fetch(&m_log_bytes, 0);
+    *fullest = 0;
+    e::intrusive_ptr<shard_vector> shards;
+
+    {
+        po6::threads::mutex::hold b(&m_shards_lock);
+        shards = m_shards;
+    }
+
+    for (size_t i = 0; i < shards->size(); ++i)
+    {
+        *fullest = std::max(*fullest, shards->get_shard(i)->used_space());
+    }
+}
+
 hyperdisk :: disk :: disk(const po6::pathname& directory,
                           const hyperspacehashing::mask::hasher& hasher,
-                          const uint16_t arity)
+                          const uint16_t arity,
+                          const geometry& geom)
     : m_ref(0)
     , m_arity(arity)
     , m_hasher(hasher)
+    , m_compact_lock()
     , m_shards_mutate()
     , m_shards_lock()
     , m_shards()
     , m_log()
+    , m_stored(STORED_MAGNITUDE)
+    , m_stored_locks(STORED_LOCK_STRIPING)
     , m_offsets()
     , m_base()
     , m_base_filename(directory)
+    , m_cold()
+    , m_cold_filename()
     , m_spare_shards_lock()
     , m_spare_shards()
     , m_spare_shard_counter(0)
+    , m_retired_shards()
+    , m_recycle(false)
+    , m_verify_reads(false)
+    , m_scrub_lock()
+    , m_scrub_shard(NULL)
+    , m_scrub_index(0)
+    , m_scrub_entry(0)
+    , m_geometry(geom.is_adaptive() ? geometry(SEARCH_INDEX_ENTRIES, DATA_SEGMENT_SIZE, geom.columnar, geom.compression) : geom)
+    , m_adaptive(geom.is_adaptive())
     , m_needs_io(-1)
     , m_seed(0)
+    , m_wal()
+    , m_flush_lock()
+    , m_flush_cond(&m_flush_lock)
+    , m_flush_batch(NULL)
+    , m_gets(0)
+    , m_minor_faults(0)
+    , m_major_faults(0)
+    , m_log_entries(0)
+    , m_log_bytes(0)
+    , m_spill_lock()
+    , m_spilling()
+    , m_log_flushed(0)
+    , m_spill_counter(0)
 {
+    if (!m_geometry.valid())
+    {
+        throw std::invalid_argument("invalid shard geometry");
+    }
+
     if (mkdir(directory.get(), S_IRWXU) < 0 && errno != EEXIST)
     {
         throw po6::error(errno);
     }
 
-    m_base = open(directory.get(), O_RDONLY);
+    m_base = ::open(directory.get(), O_RDONLY);
 
     if (m_base.get() < 0)
     {
         throw po6::error(errno);
     }
+}
+
+hyperdisk :: disk :: ~disk() throw ()
+{
+}
 
+void
+hyperdisk :: disk :: create_shards()
+{
     // Create a starting disk which holds everything.
     po6::threads::mutex::hold a(&m_shards_mutate);
     po6::threads::mutex::hold b(&m_shards_lock);
     coordinate start;
-    e::intrusive_ptr<shard> s = create_shard(start);
+    e::intrusive_ptr<shard> s = create_shard(start, current_geometry());
     m_shards = new shard_vector(start, s);
 }
 
-hyperdisk :: disk :: ~disk() throw ()
+void
+hyperdisk :: disk :: replay_log()
+{
+    std::vector<uint64_t> seqs;
+    write_ahead_log::segments(m_base_filename, &seqs);
+
+    if (seqs.empty())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        std::vector<log_entry> entries;
+        write_ahead_log::read_segment(m_base, seqs[i], &entries);
+        // Hash the PUTs together, and the DELs together, rather than one
+        // entry at a time.
+        std::vector<e::slice> put_keys;
+        std::vector<std::vector<e::slice> > put_values;
+        std::vector<e::slice> del_keys;
+
+        for (size_t j = 0; j < entries.size(); ++j)
+        {
+            if (!entries[j].is_put)
+            {
+                del_keys.push_back(entries[j].key);
+            }
+            else if (entries[j].value.size() + 1 == m_arity)
+            {
+                put_keys.push_back(entries[j].key);
+                put_values.push_back(entries[j].value);
+            }
+        }
+
+        std::vector<coordinate> put_coords(put_keys.size());
+        std::vector<coordinate> del_coords(del_keys.size());
+
+        if (!put_keys.empty())
+        {
+            m_hasher.hash(&put_keys[0], &put_values[0], put_keys.size(), &put_coords[0]);
+        }
+
+        if (!del_keys.empty())
+        {
+            m_hasher.hash(&del_keys[0], del_keys.size(), &del_coords[0]);
+        }
+
+        for (size_t j = 0, p = 0, d = 0; j < entries.size(); ++j)
+        {
+            log_entry& ent(entries[j]);
+
+            if (ent.is_put && ent.value.size() + 1 != m_arity)
+            {
+                continue;
+            }
+
+            ent.coord = ent.is_put ? put_coords[p++] : del_coords[d++];
+            log_append(ent);
+        }
+    }
+
+    // The replayed entries must reach the shards before the log is removed.
+    returncode ret;
+
+    while ((ret = flush(10000)) != DIDNOTHING)
+    {
+        if (ret == DATAFULL || ret == SEARCHFULL)
+        {
+            ret = do_mandatory_io();
+        }
+
+        if (ret != SUCCESS && ret != DIDNOTHING)
+        {
+            // Only SYNCFAILED leaves errno set, so report the returncode.
+            std::ostringstream ostr;
+            ostr << "could not replay the durable log:  " << ret;
+            throw std::runtime_error(ostr.str());
+        }
+    }
+
+    // sync sets errno when it fails.
+    if (sync() != SUCCESS)
+    {
+        throw po6::error(errno);
+    }
+
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        unlinkat(m_base.get(), write_ahead_log::segment_filename(seqs[i]).get(), 0);
+    }
+}
+
+void
+hyperdisk :: disk :: start_log()
 {
+    std::vector<uint64_t> seqs;
+    write_ahead_log::segments(m_base_filename, &seqs);
+    uint64_t seq = seqs.empty() ? 0 : seqs.back() + 1;
+
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        if (unlinkat(m_base.get(), write_ahead_log::segment_filename(seqs[i]).get(), 0) < 0)
+        {
+            throw po6::error(errno);
+        }
+    }
+
+    m_wal.reset(new write_ahead_log(m_base));
+
+    if (m_wal->rotate(seq, m_log.iterate()) != SUCCESS)
+    {
+        throw po6::error(errno);
+    }
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: checkpoint()
+{
+    po6::threads::mutex::hold hold(&m_shards_mutate);
+    uint64_t old_seq = m_wal->sequence();
+
+    // Flush cannot run while we hold m_shards_mutate, so the new segment will
+    // hold every entry which is not in the shards.
+    if (m_wal->rotate(old_seq + 1, m_log.iterate()) != SUCCESS ||
+        m_wal->commit() == SYNCFAILED)
+    {
+        return SYNCFAILED;
+    }
+
+    for (size_t i = 0; i < m_shards->size(); ++i)
+    {
+        if (m_shards->get_shard(i)->sync() != SUCCESS)
+        {
+            return SYNCFAILED;
+        }
+    }
+
+    std::vector<uint64_t> seqs;
+
+    try
+    {
+        write_ahead_log::segments(m_base_filename, &seqs);
+    }
+    catch (po6::error& e)
+    {
+        return SYNCFAILED;
+    }
+
+    for (size_t i = 0; i < seqs.size() && seqs[i] <= old_seq; ++i)
+    {
+        unlinkat(m_base.get(), write_ahead_log::segment_filename(seqs[i]).get(), 0);
+    }
+
+    return SUCCESS;
+}
+
+void
+hyperdisk :: disk :: open_shards()
+{
+    po6::threads::mutex::hold a(&m_shards_mutate);
+    po6::threads::mutex::hold b(&m_shards_lock);
+    std::vector<std::string> names;
+    DIR* dir = opendir(m_base_filename.get());
+
+    if (!dir)
+    {
+        throw po6::error(errno);
+    }
+
+    e::guard dir_guard = e::makeguard(closedir, dir);
+    dir_guard.use_variable();
+    struct dirent* ent;
+    errno = 0;
+
+    while ((ent = readdir(dir)))
+    {
+        names.push_back(ent->d_name);
+    }
+
+    if (errno != 0)
+    {
+        throw po6::error(errno);
+    }
+
+    std::vector<std::pair<coordinate, e::intrusive_ptr<shard> > > shards;
+    std::vector<std::pair<coordinate, std::string> > lost;
+
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        const std::string& name(names[i]);
+        coordinate c;
+
+        // Spare shards are empty, temporary shards were never in use, and
+        // spill files are only left behind by a crash.
+        if (name.compare(0, 6, "spare-") == 0 ||
+            name.compare(0, 6, "spill-") == 0 ||
+            (name.size() > 4 && name.compare(name.size() - 4, 4, "-tmp") == 0))
+        {
+            unlinkat(m_base.get(), name.c_str(), 0);
+            continue;
+        }
+
+        if (!parse_shard_filename(name, &c))
+        {
+            continue;
+        }
+
+        e::intrusive_ptr<shard> s;
+
+        try
+        {
+            s = shard::open(m_base, po6::pathname(name.c_str()));
+        }
+        catch (std::exception& e)
+        {
+            lost.push_back(std::make_pair(c, name));
+            continue;
+        }
+
+        if (!(s->get_coordinate() == c))
+        {
+            throw std::runtime_error("shard header does not match its filename");
+        }
+
+        shards.push_back(std::make_pair(c, s));
+    }
+
+    // A shard whose header was torn by a crash is rebuilt from its search
+    // log.  Its geometry is lost with the header, so try each geometry in use
+    // and keep whichever recovers the most entries.  If none works, the file
+    // is set aside as "corrupt-<name>" and replaced by an empty shard, so that
+    // the rest of the disk remains usable.
+    std::vector<geometry> geometries(1, current_geometry());
+
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        const geometry& g(shards[i].second->get_geometry());
+
+        if (std::find(geometries.begin(), geometries.end(), g) == geometries.end())
+        {
+            geometries.push_back(g);
+        }
+    }
+
+    for (size_t i = 0; i < lost.size(); ++i)
+    {
+        const coordinate& c(lost[i].first);
+        po6::pathname name(lost[i].second.c_str());
+        e::intrusive_ptr<shard> best;
+
+        for (size_t j = 0; j < geometries.size(); ++j)
+        {
+            try
+            {
+                e::intrusive_ptr<shard> s = shard::rebuild(m_base, name, geometries[j], c);
+
+                if (!best || s->entries() > best->entries())
+                {
+                    best = s;
+                }
+            }
+            catch (std::exception& e)
+            {
+                // Try the next geometry.
+            }
+        }
+
+        if (!best)
+        {
+            std::string aside = "corrupt-" + lost[i].second;
+
+            if (renameat(m_base.get(), name.get(), m_base.get(), aside.c_str()) < 0)
+            {
+                throw po6::error(errno);
+            }
+
+            best = create_shard(c, current_geometry());
+        }
+        else if (best->sync() != SUCCESS)
+        {
+            throw po6::error(errno);
+        }
+
+        shards.push_back(std::make_pair(c, best));
+    }
+
+    // See superseded_shards for how an interrupted split or merge is
+    // recovered.
+    std::vector<coordinate> coords;
+
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        coords.push_back(shards[i].first);
+    }
+
+    std::vector<bool> dropped = superseded_shards(coords);
+    std::vector<std::pair<coordinate, e::intrusive_ptr<shard> > > kept;
+
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        if (dropped[i])
+        {
+            drop_shard(shards[i].first);
+        }
+        else
+        {
+            kept.push_back(shards[i]);
+        }
+    }
+
+    if (kept.empty())
+    {
+        coordinate start;
+        e::intrusive_ptr<shard> s = create_shard(start, current_geometry());
+        m_shards = new shard_vector(start, s);
+    }
+    else
+    {
+        m_shards = new shard_vector(&kept);
+    }
+}
+
+uint64_t
+hyperdisk :: disk :: hash(const std::string& s)
+{
+    assert(s.size() >= sizeof(uint64_t));
+    uint64_t h;
+    memmove(&h, s.data(), sizeof(uint64_t));
+    return h;
+}
+
+std::string
+hyperdisk :: disk :: stored_key(const coordinate& coord,
+                                const e::slice& key)
+{
+    std::string s(sizeof(uint64_t) + key.size(), '\0');
+    memmove(&s[0], &coord.primary_hash, sizeof(uint64_t));
+    memmove(&s[sizeof(uint64_t)], key.data(), key.size());
+    return s;
+}
+
+void
+hyperdisk :: disk :: log_append(const log_entry& e)
+{
+    std::string skey = stored_key(e.coord, e.key);
+    e::striped_lock<po6::threads::mutex>::hold hold(&m_stored_locks, e.coord.primary_hash);
+    m_log.append(e);
+    __sync_add_and_fetch(&m_log_entries, 1);
+    __sync_add_and_fetch(&m_log_bytes, log_entry_bytes(e));
+
+    if (m_wal.get())
+    {
+        m_wal->append(e);
+    }
+
+    e::intrusive_ptr<stored> st;
+
+    if (m_stored.lookup(skey, &st))
+    {
+        st->update(e);
+    }
+    else
+    {
+        st = new stored(e);
+        bool inserted = m_stored.insert(skey, st);
+        assert(inserted);
+    }
+}
+
+void
+hyperdisk :: disk :: unstore(const log_entry& e)
+{
+    __sync_sub_and_fetch(&m_log_entries, 1);
+    __sync_sub_and_fetch(&m_log_bytes, log_entry_bytes(e));
+    std::string skey = stored_key(e.coord, e.key);
+    e::striped_lock<po6::threads::mutex>::hold hold(&m_stored_locks, e.coord.primary_hash);
+    e::intrusive_ptr<stored> st;
+
+    if (!m_stored.lookup(skey, &st))
+    {
+        abort();
+    }
+
+    bool last = false;
+
+    {
+        po6::threads::mutex::hold hold_st(&st->lock);
+        --st->pending;
+        last = st->pending == 0;
+    }
+
+    if (last)
+    {
+        m_stored.remove(skey);
+    }
+}
+
+uint64_t
+hyperdisk :: disk :: log_entry_bytes(const log_entry& e)
+{
+    // The key and value point into the backing buffer, all of which stays in
+    // memory until the entry is flushed.
+    if (e.backing)
+    {
+        return e.backing->capacity();
+    }
+
+    uint64_t bytes = e.key.size();
+
+    for (size_t i = 0; i < e.value.size(); ++i)
+    {
+        bytes += e.value[i].size();
+    }
+
+    return bytes;
 }
 
 po6::pathname
@@ -690,29 +1890,70 @@ hyperdisk :: disk :: shard_tmp_filename(const coordinate& c)
     return po6::pathname(ostr.str());
 }
 
+po6::pathname
+hyperdisk :: disk :: spare_filename()
+{
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
+    std::ostringstream ostr;
+    ostr << "spare-" << m_spare_shard_counter;
+    ++m_spare_shard_counter;
+    return po6::pathname(ostr.str());
+}
+
+po6::pathname
+hyperdisk :: disk :: spill_filename()
+{
+    std::ostringstream ostr;
+    ostr << "spill-" << m_spill_counter;
+    ++m_spill_counter;
+    return po6::pathname(ostr.str());
+}
+
+void
+hyperdisk :: disk :: forget_rolling_snapshot(rolling_snapshot* rs)
+{
+    po6::threads::mutex::hold hold(&m_spill_lock);
+    m_spilling.erase(rs);
+}
+
 e::intrusive_ptr<hyperdisk::shard>
-hyperdisk :: disk :: create_shard(const coordinate& c)
+hyperdisk :: disk :: create_shard(const coordinate& c, const geometry& g)
 {
     po6::pathname spareshard_fn;
-    e::intrusive_ptr<hyperdisk::shard> spareshard;
+    e::intrusive_ptr<hyperdisk::shard> spareshard = take_spare_shard(g, &spareshard_fn);
+    po6::pathname path = shard_filename(c);
 
+    if (spareshard)
     {
-        po6::threads::mutex::hold hold(&m_spare_shards_lock);
+        spareshard->set_coordinate(c);
 
-        if (!m_spare_shards.empty())
+        if (renameat(m_base.get(), spareshard_fn.get(),
+                     m_base.get(), path.get()) < 0)
         {
-            std::pair<po6::pathname, e::intrusive_ptr<hyperdisk::shard> > p;
-            p = m_spare_shards.front();
-            spareshard_fn = p.first;
-            spareshard = p.second;
-            m_spare_shards.pop();
+            throw po6::error(errno);
         }
+
+        return spareshard;
+    }
+    else
+    {
+        e::intrusive_ptr<hyperdisk::shard> newshard = hyperdisk::shard::create(m_base, path, g);
+        newshard->set_coordinate(c);
+        return newshard;
     }
+}
 
-    po6::pathname path = shard_filename(c);
+e::intrusive_ptr<hyperdisk::shard>
+hyperdisk :: disk :: create_tmp_shard(const coordinate& c, const geometry& g)
+{
+    po6::pathname spareshard_fn;
+    e::intrusive_ptr<hyperdisk::shard> spareshard = take_spare_shard(g, &spareshard_fn);
+    po6::pathname path = shard_tmp_filename(c);
 
     if (spareshard)
     {
+        spareshard->set_coordinate(c);
+
         if (renameat(m_base.get(), spareshard_fn.get(),
                      m_base.get(), path.get()) < 0)
         {
@@ -723,55 +1964,92 @@ hyperdisk :: disk :: create_shard(const coordinate& c)
     }
     else
     {
-        e::intrusive_ptr<hyperdisk::shard> newshard = hyperdisk::shard::create(m_base, path);
+        e::intrusive_ptr<hyperdisk::shard> newshard = hyperdisk::shard::create(m_base, path, g);
+        newshard->set_coordinate(c);
         return newshard;
     }
 }
 
 e::intrusive_ptr<hyperdisk::shard>
-hyperdisk :: disk :: create_tmp_shard(const coordinate& c)
+hyperdisk :: disk :: take_spare_shard(const geometry& g, po6::pathname* filename)
 {
-    po6::pathname spareshard_fn;
-    e::intrusive_ptr<hyperdisk::shard> spareshard;
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
 
+    while (!m_spare_shards.empty())
     {
-        po6::threads::mutex::hold hold(&m_spare_shards_lock);
+        std::pair<po6::pathname, e::intrusive_ptr<hyperdisk::shard> > p;
+        p = m_spare_shards.front();
+        const geometry& spare = p.second->get_geometry();
 
-        if (!m_spare_shards.empty())
+        // The spare must be at least as large as "g" and have the same
+        // columns.
+        if (g.at_least(spare) == spare)
         {
-            std::pair<po6::pathname, e::intrusive_ptr<hyperdisk::shard> > p;
-            p = m_spare_shards.front();
-            spareshard_fn = p.first;
-            spareshard = p.second;
             m_spare_shards.pop();
+            *filename = p.first;
+            return p.second;
         }
-    }
-
-    po6::pathname path = shard_tmp_filename(c);
 
-    if (spareshard)
-    {
-        if (renameat(m_base.get(), spareshard_fn.get(),
-                     m_base.get(), path.get()) < 0)
+        // The spare is too small.  Keep it if it may be of use to another
+        // shard.
+        if (spare == m_geometry)
         {
-            throw po6::error(errno);
+            break;
         }
 
-        return spareshard;
+        m_spare_shards.pop();
+        unlinkat(m_base.get(), p.first.get(), 0);
     }
-    else
+
+    return e::intrusive_ptr<hyperdisk::shard>();
+}
+
+hyperdisk::shard_snapshot
+hyperdisk :: disk :: snapshot_shard(shard* s)
+{
+    po6::threads::mutex::hold hold(&m_shards_mutate);
+    return s->make_snapshot();
+}
+
+std::pair<hyperdisk::shard_snapshot, hyperdisk::shard_snapshot>
+hyperdisk :: disk :: snapshot_shards(shard* s1, shard* s2)
+{
+    po6::threads::mutex::hold hold(&m_shards_mutate);
+    return std::make_pair(s1->make_snapshot(), s2->make_snapshot());
+}
+
+hyperdisk::geometry
+hyperdisk :: disk :: current_geometry()
+{
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
+    return m_geometry;
+}
+
+hyperdisk::geometry
+hyperdisk :: disk :: replace_geometry(shard* s)
+{
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
+
+    if (m_adaptive)
     {
-        e::intrusive_ptr<hyperdisk::shard> newshard = hyperdisk::shard::create(m_base, path);
-        return newshard;
+        geometry g = geometry::for_object_size(s->average_entry_size());
+        m_geometry = m_geometry.at_least(g);
     }
+
+    return m_geometry.at_least(s->get_geometry());
 }
 
 hyperdisk::returncode
 hyperdisk :: disk :: drop_shard(const coordinate& c)
 {
+    po6::pathname target;
+    bool cold = cold_shard(c, &target);
+
     // What would we do with the error?  It's just going to leave dirty data,
-    // but if we can cleanly save state, then it doesn't matter.
-    if (unlinkat(m_base.get(), shard_filename(c).get(), 0) < 0)
+    // but if we can cleanly save state, then it doesn't matter.  The link goes
+    // first so that a crash never leaves it dangling.
+    if (unlinkat(m_base.get(), shard_filename(c).get(), 0) < 0 ||
+        (cold && unlink(target.get()) < 0))
     {
         return DROPFAILED;
     }
@@ -782,14 +2060,111 @@ hyperdisk :: disk :: drop_shard(const coordinate& c)
 hyperdisk::returncode
 hyperdisk :: disk :: drop_tmp_shard(const coordinate& c)
 {
-    // What would we do with the error?  It's just going to leave dirty data,
-    // but if we can cleanly save state, then it doesn't matter.
-    if (unlinkat(m_base.get(), shard_tmp_filename(c).get(), 0) < 0)
+    // What would we do with the error?  It's just going to leave dirty data,
+    // but if we can cleanly save state, then it doesn't matter.
+    if (unlinkat(m_base.get(), shard_tmp_filename(c).get(), 0) < 0)
+    {
+        return DROPFAILED;
+    }
+
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: drop_cold_tmp_shard(const coordinate& c)
+{
+    if (unlinkat(m_cold.get(), shard_tmp_filename(c).get(), 0) < 0)
+    {
+        return DROPFAILED;
+    }
+
+    return SUCCESS;
+}
+
+bool
+hyperdisk :: disk :: cold_shard(const coordinate& c, po6::pathname* target)
+{
+    char buf[PATH_MAX];
+    ssize_t len = readlinkat(m_base.get(), shard_filename(c).get(), buf, sizeof(buf) - 1);
+
+    if (len < 0)
+    {
+        return false;
+    }
+
+    buf[len] = '\0';
+    *target = po6::pathname(buf);
+    return true;
+}
+
+bool
+hyperdisk :: disk :: retire_shard(const coordinate& c, po6::pathname* retired)
+{
+    {
+        po6::threads::mutex::hold hold(&m_spare_shards_lock);
+
+        if (!m_recycle)
+        {
+            return false;
+        }
+    }
+
+    // Spares belong on the fast path.
+    po6::pathname target;
+
+    if (cold_shard(c, &target))
+    {
+        return false;
+    }
+
+    // A spare name, so that the file is removed if we crash before it is
+    // recycled.
+    *retired = spare_filename();
+    return linkat(m_base.get(), shard_filename(c).get(),
+                  m_base.get(), retired->get(), 0) == 0;
+}
+
+void
+hyperdisk :: disk :: keep_retired_shard(const po6::pathname& retired,
+                                        e::intrusive_ptr<shard> s)
+{
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
+    m_retired_shards.push(std::make_pair(retired, s));
+}
+
+bool
+hyperdisk :: disk :: recycle_retired_shards()
+{
+    po6::threads::mutex::hold hold(&m_spare_shards_lock);
+    bool recycled = false;
+
+    for (size_t n = m_retired_shards.size(); n > 0; --n)
     {
-        return DROPFAILED;
+        std::pair<po6::pathname, e::intrusive_ptr<hyperdisk::shard> > p;
+        p = m_retired_shards.front();
+        m_retired_shards.pop();
+
+        // Snapshots and readers of old shard vectors may still use the shard.
+        if (!p.second->unique())
+        {
+            m_retired_shards.push(p);
+            continue;
+        }
+
+        if (p.second->get_geometry() == m_geometry &&
+            m_spare_shards.size() < MAX_SPARE_SHARDS)
+        {
+            p.second->reset();
+            m_spare_shards.push(p);
+            recycled = true;
+        }
+        else
+        {
+            unlinkat(m_base.get(), p.first.get(), 0);
+        }
     }
 
-    return SUCCESS;
+    return recycled;
 }
 
 hyperdisk::returncode
@@ -822,22 +2197,65 @@ hyperdisk::returncode
 hyperdisk :: disk :: clean_shard(size_t shard_num)
 {
     coordinate c = m_shards->get_coordinate(shard_num);
-    shard* s = m_shards->get_shard(shard_num);
-    e::intrusive_ptr<hyperdisk::shard> newshard = create_tmp_shard(c);
+    e::intrusive_ptr<shard> s = m_shards->get_shard(shard_num);
+    e::intrusive_ptr<hyperdisk::shard> newshard = create_tmp_shard(c, replace_geometry(s.get()));
     e::guard disk_guard = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, c);
-    s->copy_to(c, newshard);
+    hyperdisk::shard_snapshot snap = snapshot_shard(s.get());
+    returncode ret;
+
+    if ((ret = s->copy_to(c, snap, newshard)) != SUCCESS ||
+        (m_wal.get() && (ret = newshard->sync()) != SUCCESS))
+    {
+        return ret == CORRUPT ? CORRUPT : DIDNOTHING;
+    }
+
+    po6::threads::mutex::hold hold(&m_shards_mutate);
+
+    if ((ret = s->copy_delta_to(c, snap, newshard)) != SUCCESS ||
+        (m_wal.get() && (ret = newshard->sync()) != SUCCESS))
+    {
+        return ret == CORRUPT ? CORRUPT : DIDNOTHING;
+    }
+
     e::intrusive_ptr<shard_vector> newshard_vector;
     newshard_vector = m_shards->replace(shard_num, newshard);
+    po6::pathname retired;
+    bool keep = retire_shard(c, &retired);
+    po6::pathname target;
+    bool cold = cold_shard(c, &target);
 
     if (renameat(m_base.get(), shard_tmp_filename(c).get(),
                  m_base.get(), shard_filename(c).get()) < 0)
     {
+        if (keep)
+        {
+            unlinkat(m_base.get(), retired.get(), 0);
+        }
+
         return DROPFAILED;
     }
 
     disk_guard.dismiss();
-    po6::threads::mutex::hold hold(&m_shards_lock);
-    m_shards = newshard_vector;
+
+    // The cleaned shard replaces the link to a cold shard.
+    if (cold)
+    {
+        unlink(target.get());
+    }
+
+    {
+        po6::threads::mutex::hold holds(&m_shards_lock);
+        m_shards = newshard_vector;
+    }
+
+    m_needs_io = -1;
+    s->release();
+
+    if (keep)
+    {
+        keep_retired_shard(retired, s);
+    }
+
     return SUCCESS;
 }
 
@@ -869,8 +2287,9 @@ hyperdisk::returncode
 hyperdisk :: disk :: split_shard(size_t shard_num)
 {
     coordinate c = m_shards->get_coordinate(shard_num);
-    shard* s = m_shards->get_shard(shard_num);
-    hyperdisk::shard_snapshot snap = s->make_snapshot();
+    e::intrusive_ptr<shard> s = m_shards->get_shard(shard_num);
+    const hyperdisk::shard_snapshot base = snapshot_shard(s.get());
+    hyperdisk::shard_snapshot snap = base;
 
     // Find which bit of the secondary hash is the best to split over.
     int zeros[64];
@@ -902,7 +2321,7 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
 
     int secondary_split = which_to_split(c.secondary_lower_mask, zeros, ones);
     uint64_t secondary_bit = 1ULL << secondary_split;
-    snap = s->make_snapshot();
+    snap = base;
 
     // Determine the splits for the two shards resulting from the split above.
     int zeros_lower[64];
@@ -969,23 +2388,75 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
                              c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash | secondary_bit,
                              c.secondary_upper_mask, c.secondary_upper_hash);
 
+    geometry g = replace_geometry(s.get());
+
     try
     {
-        e::intrusive_ptr<hyperdisk::shard> zero_zero = create_shard(zero_zero_coord);
-        e::guard zzg = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, zero_zero_coord);
-        s->copy_to(zero_zero_coord, zero_zero);
+        e::intrusive_ptr<hyperdisk::shard> zero_zero = create_tmp_shard(zero_zero_coord, g);
+        e::guard zzg = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, zero_zero_coord);
+        e::intrusive_ptr<hyperdisk::shard> zero_one = create_tmp_shard(zero_one_coord, g);
+        e::guard zog = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, zero_one_coord);
+        e::intrusive_ptr<hyperdisk::shard> one_zero = create_tmp_shard(one_zero_coord, g);
+        e::guard ozg = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, one_zero_coord);
+        e::intrusive_ptr<hyperdisk::shard> one_one = create_tmp_shard(one_one_coord, g);
+        e::guard oog = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, one_one_coord);
+
+        // Scatter the data visible in the snapshot while flushes continue.
+        returncode ret;
+
+        if ((ret = s->copy_to(zero_zero_coord, base, zero_zero)) != SUCCESS ||
+            (ret = s->copy_to(zero_one_coord, base, zero_one)) != SUCCESS ||
+            (ret = s->copy_to(one_zero_coord, base, one_zero)) != SUCCESS ||
+            (ret = s->copy_to(one_one_coord, base, one_one)) != SUCCESS)
+        {
+            return ret == CORRUPT ? CORRUPT : SPLITFAILED;
+        }
+
+        if (m_wal.get() &&
+            (zero_zero->sync() != SUCCESS || zero_one->sync() != SUCCESS ||
+             one_zero->sync() != SUCCESS || one_one->sync() != SUCCESS))
+        {
+            return SPLITFAILED;
+        }
+
+        // Catch up on the flushes which happened during the copy.
+        po6::threads::mutex::hold hold(&m_shards_mutate);
 
-        e::intrusive_ptr<hyperdisk::shard> zero_one = create_shard(zero_one_coord);
-        e::guard zog = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, zero_one_coord);
-        s->copy_to(zero_one_coord, zero_one);
+        if ((ret = s->copy_delta_to(zero_zero_coord, base, zero_zero)) != SUCCESS ||
+            (ret = s->copy_delta_to(zero_one_coord, base, zero_one)) != SUCCESS ||
+            (ret = s->copy_delta_to(one_zero_coord, base, one_zero)) != SUCCESS ||
+            (ret = s->copy_delta_to(one_one_coord, base, one_one)) != SUCCESS)
+        {
+            return ret == CORRUPT ? CORRUPT : SPLITFAILED;
+        }
+
+        if (m_wal.get() &&
+            (zero_zero->sync() != SUCCESS || zero_one->sync() != SUCCESS ||
+             one_zero->sync() != SUCCESS || one_one->sync() != SUCCESS))
+        {
+            return SPLITFAILED;
+        }
+
+        // Move the new shards into place.  See open_shards for how an
+        // interrupted split is recovered.  If a rename fails, the shards
+        // already moved are removed again, as they would otherwise be taken
+        // for the remains of a split when the disk is next opened.
+        const coordinate moving[] = {zero_zero_coord, zero_one_coord,
+                                     one_zero_coord, one_one_coord};
 
-        e::intrusive_ptr<hyperdisk::shard> one_zero = create_shard(one_zero_coord);
-        e::guard ozg = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, one_zero_coord);
-        s->copy_to(one_zero_coord, one_zero);
+        for (size_t i = 0; i < sizeof(moving) / sizeof(moving[0]); ++i)
+        {
+            if (renameat(m_base.get(), shard_tmp_filename(moving[i]).get(),
+                         m_base.get(), shard_filename(moving[i]).get()) < 0)
+            {
+                for (size_t j = 0; j < i; ++j)
+                {
+                    unlinkat(m_base.get(), shard_filename(moving[j]).get(), 0);
+                }
 
-        e::intrusive_ptr<hyperdisk::shard> one_one = create_shard(one_one_coord);
-        e::guard oog = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, one_one_coord);
-        s->copy_to(one_one_coord, one_one);
+                return SPLITFAILED;
+            }
+        }
 
         e::intrusive_ptr<shard_vector> newshard_vector;
         newshard_vector = m_shards->replace(shard_num,
@@ -995,14 +2466,23 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
                                             one_one_coord, one_one);
 
         {
-            po6::threads::mutex::hold hold(&m_shards_lock);
+            po6::threads::mutex::hold holds(&m_shards_lock);
             m_shards = newshard_vector;
         }
 
+        m_needs_io = -1;
         zzg.dismiss();
         zog.dismiss();
         ozg.dismiss();
         oog.dismiss();
+        s->release();
+        po6::pathname retired;
+
+        if (retire_shard(c, &retired))
+        {
+            keep_retired_shard(retired, s);
+        }
+
         return drop_shard(c);
     }
     catch (std::exception& e)
@@ -1010,3 +2490,388 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
         return SPLITFAILED;
     }
 }
+
+hyperdisk::returncode
+hyperdisk :: disk :: merge_shards(size_t shard_num1, size_t shard_num2, const coordinate& c)
+{
+    coordinate c1 = m_shards->get_coordinate(shard_num1);
+    coordinate c2 = m_shards->get_coordinate(shard_num2);
+    e::intrusive_ptr<shard> s1 = m_shards->get_shard(shard_num1);
+    e::intrusive_ptr<shard> s2 = m_shards->get_shard(shard_num2);
+    const std::pair<shard_snapshot, shard_snapshot> snaps = snapshot_shards(s1.get(), s2.get());
+    const hyperdisk::shard_snapshot& snap1(snaps.first);
+    const hyperdisk::shard_snapshot& snap2(snaps.second);
+    geometry g = replace_geometry(s1.get()).at_least(replace_geometry(s2.get()));
+
+    try
+    {
+        e::intrusive_ptr<hyperdisk::shard> newshard = create_tmp_shard(c, g);
+        e::guard disk_guard = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, c);
+
+        // Gather the data visible in the snapshots while flushes continue.
+        returncode ret;
+
+        if ((ret = s1->copy_to(c1, snap1, newshard)) != SUCCESS ||
+            (ret = s2->copy_to(c2, snap2, newshard)) != SUCCESS ||
+            (m_wal.get() && newshard->sync() != SUCCESS))
+        {
+            return ret == CORRUPT ? CORRUPT : MERGEFAILED;
+        }
+
+        // Catch up on the flushes which happened during the copy.  A flush
+        // may have moved an object from one shard to the other, so drop
+        // everything invalidated in either shard before appending the new
+        // versions from both.
+        po6::threads::mutex::hold hold(&m_shards_mutate);
+        s1->copy_invalidated_to(c1, snap1, newshard);
+        s2->copy_invalidated_to(c2, snap2, newshard);
+
+        if ((ret = s1->copy_appended_to(c1, snap1, newshard)) != SUCCESS ||
+            (ret = s2->copy_appended_to(c2, snap2, newshard)) != SUCCESS ||
+            (m_wal.get() && newshard->sync() != SUCCESS))
+        {
+            return ret == CORRUPT ? CORRUPT : MERGEFAILED;
+        }
+
+        // Move the new shard into place.  See open_shards for how an
+        // interrupted merge is recovered.
+        if (renameat(m_base.get(), shard_tmp_filename(c).get(),
+                     m_base.get(), shard_filename(c).get()) < 0)
+        {
+            return MERGEFAILED;
+        }
+
+        e::intrusive_ptr<shard_vector> newshard_vector;
+        newshard_vector = m_shards->replace(shard_num1, shard_num2, c, newshard);
+
+        {
+            po6::threads::mutex::hold holds(&m_shards_lock);
+            m_shards = newshard_vector;
+        }
+
+        m_needs_io = -1;
+        disk_guard.dismiss();
+        s1->release();
+        s2->release();
+        po6::pathname retired;
+
+        if (retire_shard(c1, &retired))
+        {
+            keep_retired_shard(retired, s1);
+        }
+
+        if (retire_shard(c2, &retired))
+        {
+            keep_retired_shard(retired, s2);
+        }
+
+        returncode ret1 = drop_shard(c1);
+        returncode ret2 = drop_shard(c2);
+        return ret1 != SUCCESS ? ret1 : ret2;
+    }
+    catch (std::exception& e)
+    {
+        return MERGEFAILED;
+    }
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: tier_shard(size_t shard_num, bool cold)
+{
+    coordinate c = m_shards->get_coordinate(shard_num);
+    e::intrusive_ptr<shard> s = m_shards->get_shard(shard_num);
+    po6::pathname filename = shard_filename(c);
+    po6::pathname tmp_filename = shard_tmp_filename(c);
+    po6::pathname target;
+    cold_shard(c, &target);
+    geometry g = replace_geometry(s.get());
+
+    try
+    {
+        // Cold shards are never made from spares, which live in m_base.
+        e::intrusive_ptr<hyperdisk::shard> newshard;
+
+        if (cold)
+        {
+            newshard = hyperdisk::shard::create(m_cold, tmp_filename, g);
+            newshard->set_coordinate(c);
+        }
+        else
+        {
+            newshard = create_tmp_shard(c, g);
+        }
+
+        e::guard disk_guard = cold
+                            ? e::makeobjguard(*this, &hyperdisk::disk::drop_cold_tmp_shard, c)
+                            : e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, c);
+        hyperdisk::shard_snapshot snap = snapshot_shard(s.get());
+        returncode ret;
+
+        if ((ret = s->copy_to(c, snap, newshard)) != SUCCESS ||
+            (m_wal.get() && (ret = newshard->sync()) != SUCCESS))
+        {
+            return ret == CORRUPT ? CORRUPT : DIDNOTHING;
+        }
+
+        po6::threads::mutex::hold hold(&m_shards_mutate);
+
+        if ((ret = s->copy_delta_to(c, snap, newshard)) != SUCCESS ||
+            (m_wal.get() && (ret = newshard->sync()) != SUCCESS))
+        {
+            return ret == CORRUPT ? CORRUPT : DIDNOTHING;
+        }
+
+        // Moving out renames the cold shard into place before linking to it,
+        // and moving back renames the new shard over the link before removing
+        // the cold shard.  A crash between the two leaves an unlinked cold
+        // shard, which "store_cold_shards" removes.
+        if (cold)
+        {
+            po6::pathname link = po6::join(m_cold_filename, filename);
+
+            if (renameat(m_cold.get(), tmp_filename.get(),
+                         m_cold.get(), filename.get()) < 0)
+            {
+                return DROPFAILED;
+            }
+
+            disk_guard.dismiss();
+
+            if (symlinkat(link.get(), m_base.get(), tmp_filename.get()) < 0 ||
+                renameat(m_base.get(), tmp_filename.get(),
+                         m_base.get(), filename.get()) < 0)
+            {
+                unlinkat(m_base.get(), tmp_filename.get(), 0);
+                unlinkat(m_cold.get(), filename.get(), 0);
+                return DROPFAILED;
+            }
+        }
+        else
+        {
+            if (renameat(m_base.get(), tmp_filename.get(),
+                         m_base.get(), filename.get()) < 0)
+            {
+                return DROPFAILED;
+            }
+
+            disk_guard.dismiss();
+            unlink(target.get());
+        }
+
+        e::intrusive_ptr<shard_vector> newshard_vector;
+        newshard_vector = m_shards->replace(shard_num, newshard);
+
+        {
+            po6::threads::mutex::hold holds(&m_shards_lock);
+            m_shards = newshard_vector;
+        }
+
+        m_needs_io = -1;
+        s->release();
+        return SUCCESS;
+    }
+    catch (po6::error&)
+    {
+        return DROPFAILED;
+    }
+}
+
+void
+hyperdisk :: disk :: flush_locate(const log_entry& e, flush_result* r)
+{
+    const coordinate& coord = e.coord;
+    uint64_t bloom = shard::bloom_hash(coord.primary_hash, e.key);
+
+    for (size_t i = 0; !r->del_needed && i < m_shards->size(); ++i)
+    {
+        if (!m_shards->get_coordinate(i).primary_intersects(coord) ||
+            !m_shards->get_shard(i)->may_contain(bloom))
+        {
+            continue;
+        }
+
+        returncode ret;
+        ret = m_shards->get_shard(i)->get(coord.primary_hash, e.key);
+
+        if (ret == SUCCESS)
+        {
+            r->del_needed = true;
+            r->del_num = i;
+        }
+        else if (ret == NOTFOUND)
+        {
+        }
+        else
+        {
+            abort();
+        }
+    }
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: flush_apply(const log_entry& e, flush_result* r)
+{
+    const coordinate& coord = e.coord;
+
+    if (e.is_put)
+    {
+        for (ssize_t i = m_shards->size() - 1; !r->put_succeeded && i >= 0; --i)
+        {
+            if (!m_shards->get_coordinate(i).intersects(coord))
+            {
+                continue;
+            }
+
+            returncode ret;
+            ret = m_shards->get_shard(i)->put(coord, e.key, e.value,
+                                              e.version, &r->put_offset);
+
+            if (ret == SUCCESS)
+            {
+                r->put_succeeded = true;
+                r->put_num = i;
+            }
+            else if (ret == DATAFULL || ret == SEARCHFULL)
+            {
+                r->full_num = i;
+                return ret;
+            }
+            else
+            {
+                abort();
+            }
+        }
+
+        if (!r->put_succeeded)
+        {
+            return NOTFOUND;
+        }
+    }
+
+    if (r->del_needed && (!r->put_succeeded || r->del_num != r->put_num))
+    {
+        switch (m_shards->get_shard(r->del_num)->del(coord.primary_hash, e.key, &r->del_offset))
+        {
+            case SUCCESS:
+                break;
+            case NOTFOUND:
+            case DATAFULL:
+            case WRONGARITY:
+            case SEARCHFULL:
+            case SYNCFAILED:
+            case DROPFAILED:
+            case MISSINGDISK:
+            case SPLITFAILED:
+            case DIDNOTHING:
+            default:
+                abort();
+        }
+    }
+
+    return SUCCESS;
+}
+
+void
+hyperdisk :: disk :: flush_publish(const log_entry& e, const flush_result& r)
+{
+    // Here we prepare two offset_updates that we can push onto the offsets
+    // log.  We then make the offset changes to the shard_vector, and then
+    // finish by removing the items we put on the log.
+    std::vector<offset_update> updates;
+
+    if (r.del_needed && r.del_num != r.put_num)
+    {
+        updates.push_back(offset_update());
+        updates.back().shard_generation = m_shards->generation();
+        updates.back().shard_num = r.del_num;
+        updates.back().new_offset = r.del_offset;
+    }
+
+    if (r.put_succeeded)
+    {
+        updates.push_back(offset_update());
+        updates.back().shard_generation = m_shards->generation();
+        updates.back().shard_num = r.put_num;
+        updates.back().new_offset = r.put_offset;
+    }
+
+    // Log our intentions.
+    m_offsets.batch_append(updates);
+
+    // Do our updates.
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        assert(updates[i].shard_generation == m_shards->generation());
+        assert(updates[i].new_offset > m_shards->get_offset(updates[i].shard_num));
+        m_shards->set_offset(updates[i].shard_num, updates[i].new_offset);
+    }
+
+    // Remove our updates from the log.
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        assert(m_offsets.oldest() == updates[i]);
+        m_offsets.remove_oldest();
+    }
+
+    unstore(e);
+}
+
+size_t
+hyperdisk :: disk :: flush_root(std::vector<size_t>* roots, size_t shard_num)
+{
+    while ((*roots)[shard_num] != shard_num)
+    {
+        shard_num = (*roots)[shard_num];
+    }
+
+    return shard_num;
+}
+
+void
+hyperdisk :: disk :: flush_work(flush_batch* b)
+{
+    size_t g;
+
+    while ((g = __sync_fetch_and_add(&b->next_group, 1)) < b->groups.size())
+    {
+        for (size_t i = 0; i < b->groups[g].size(); ++i)
+        {
+            size_t idx = b->groups[g][i];
+
+            // The batch was planned to fit.
+            if (flush_apply(*b->entries[idx], &b->results[idx]) != SUCCESS)
+            {
+                abort();
+            }
+        }
+    }
+}
+
+bool
+hyperdisk :: disk :: flush_help()
+{
+    flush_batch* b;
+
+    {
+        po6::threads::mutex::hold hold(&m_flush_lock);
+        b = m_flush_batch;
+
+        if (!b)
+        {
+            return false;
+        }
+
+        ++b->workers;
+    }
+
+    flush_work(b);
+    po6::threads::mutex::hold hold(&m_flush_lock);
+    --b->workers;
+
+    if (b->workers == 0)
+    {
+        m_flush_cond.broadcast();
+    }
+
+    return true;
+}
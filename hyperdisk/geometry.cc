@@ -0,0 +1,122 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// STL
+#include <algorithm>
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/compressor.h"
+#include "hyperdisk/hyperdisk/geometry.h"
+#include "hyperdisk/shard_constants.h"
+
+hyperdisk::geometry
+hyperdisk :: geometry :: adaptive()
+{
+    return geometry(0, DATA_SEGMENT_SIZE);
+}
+
+hyperdisk::geometry
+hyperdisk :: geometry :: for_object_size(uint64_t object_size)
+{
+    if (object_size == 0)
+    {
+        return geometry();
+    }
+
+    // Small objects get more entries, so that the data segment may fill up
+    // before the search index does.  Large objects get a larger data segment,
+    // so that each shard still holds a reasonable number of them.
+    uint64_t entries = SEARCH_INDEX_ENTRIES / 8;
+
+    while (entries < MAX_SEARCH_INDEX_ENTRIES &&
+           entries * object_size < DATA_SEGMENT_SIZE)
+    {
+        entries *= 2;
+    }
+
+    uint64_t data = entries * object_size;
+    data = (data + (1 << 20) - 1) & ~((1ULL << 20) - 1);
+    data = std::max(data, static_cast<uint64_t>(DATA_SEGMENT_SIZE));
+    data = std::min(data, static_cast<uint64_t>(MAX_DATA_SEGMENT_SIZE));
+    return geometry(entries, data);
+}
+
+unsigned int
+hyperdisk :: geometry :: max_columns()
+{
+    return MAX_COLUMNS;
+}
+
+hyperdisk :: geometry :: geometry()
+    : search_entries(SEARCH_INDEX_ENTRIES)
+    , data_size(DATA_SEGMENT_SIZE)
+    , columnar(0)
+    , compression(0)
+{
+}
+
+hyperdisk :: geometry :: geometry(uint32_t entries, uint32_t size, uint64_t cols,
+                                  uint16_t comp)
+    : search_entries(entries)
+    , data_size(size)
+    , columnar(cols)
+    , compression(comp)
+{
+}
+
+hyperdisk :: geometry :: ~geometry() throw ()
+{
+}
+
+bool
+hyperdisk :: geometry :: valid() const
+{
+    return search_entries >= MIN_SEARCH_INDEX_ENTRIES &&
+           search_entries <= MAX_SEARCH_INDEX_ENTRIES &&
+           (search_entries & (search_entries - 1)) == 0 &&
+           data_size >= MIN_DATA_SEGMENT_SIZE &&
+           data_size <= MAX_DATA_SEGMENT_SIZE &&
+           columns() <= MAX_COLUMNS &&
+           (compression == 0 || compressor::lookup(compression) != NULL);
+}
+
+hyperdisk::geometry
+hyperdisk :: geometry :: at_least(const geometry& other) const
+{
+    return geometry(std::max(search_entries, other.search_entries),
+                    std::max(data_size, other.data_size),
+                    columnar, compression);
+}
+
+bool
+hyperdisk :: geometry :: operator == (const geometry& rhs) const
+{
+    return search_entries == rhs.search_entries &&
+           data_size == rhs.data_size &&
+           columnar == rhs.columnar &&
+           compression == rhs.compression;
+}
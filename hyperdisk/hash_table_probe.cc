@@ -0,0 +1,108 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// SIMD
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// HyperDisk
+#include "hyperdisk/hash_table_probe.h"
+#include "hyperdisk/shard_constants.h"
+
+unsigned
+hyperdisk :: probe_hash_bucket(const uint64_t* bucket, uint32_t primary_hash)
+{
+#if defined(__AVX2__)
+    return probe_hash_bucket_avx2(bucket, primary_hash);
+#elif defined(__SSE2__)
+    return probe_hash_bucket_sse2(bucket, primary_hash);
+#else
+    return probe_hash_bucket_scalar(bucket, primary_hash);
+#endif
+}
+
+unsigned
+hyperdisk :: probe_hash_bucket_scalar(const uint64_t* bucket, uint32_t primary_hash)
+{
+    unsigned found = 0;
+
+    for (unsigned i = 0; i < HASH_TABLE_BUCKET_ENTRIES; ++i)
+    {
+        if (static_cast<uint32_t>(bucket[i]) == primary_hash)
+        {
+            found |= 1U << (2 * i);
+        }
+
+        if (static_cast<uint32_t>(bucket[i] >> 32) == 0)
+        {
+            found |= 2U << (2 * i);
+        }
+    }
+
+    return found;
+}
+
+// Comparing each entry against an entry holding "primary_hash" and a zero
+// offset answers both questions at once:  the low lane of each entry matches
+// the hash, and the high lane matches when the entry is empty.  The sign bits
+// of the 32-bit lanes are then exactly the mask to return.
+
+#ifdef __SSE2__
+unsigned
+hyperdisk :: probe_hash_bucket_sse2(const uint64_t* bucket, uint32_t primary_hash)
+{
+    const __m128i probe = _mm_set_epi32(0, primary_hash, 0, primary_hash);
+    const __m128i* p = reinterpret_cast<const __m128i*>(bucket);
+#define HYPERDISK_SSE2_PROBE(J) \
+    static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps( \
+        _mm_cmpeq_epi32(_mm_loadu_si128(p + (J)), probe))))
+    return HYPERDISK_SSE2_PROBE(0)
+         | (HYPERDISK_SSE2_PROBE(1) << 4)
+         | (HYPERDISK_SSE2_PROBE(2) << 8)
+         | (HYPERDISK_SSE2_PROBE(3) << 12);
+#undef HYPERDISK_SSE2_PROBE
+}
+#endif
+
+#ifdef __AVX2__
+unsigned
+hyperdisk :: probe_hash_bucket_avx2(const uint64_t* bucket, uint32_t primary_hash)
+{
+    const __m256i probe = _mm256_set1_epi64x(static_cast<int64_t>(primary_hash));
+    const __m256i* p = reinterpret_cast<const __m256i*>(bucket);
+#define HYPERDISK_AVX2_PROBE(J) \
+    static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps( \
+        _mm256_cmpeq_epi32(_mm256_loadu_si256(p + (J)), probe))))
+    return HYPERDISK_AVX2_PROBE(0) | (HYPERDISK_AVX2_PROBE(1) << 8);
+#undef HYPERDISK_AVX2_PROBE
+}
+#endif
@@ -0,0 +1,69 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_hash_table_probe_h_
+#define hyperdisk_hash_table_probe_h_
+
+// C
+#include <stdint.h>
+
+// These kernels probe one bucket of a shard's hash table.  A bucket is
+// HASH_TABLE_BUCKET_ENTRIES consecutive 64-bit entries, which fill one cache
+// line when the table is aligned.  The low-order 32 bits of an entry hold the
+// primary hash of its key, and the high-order 32 bits its offset, which is zero
+// for an empty entry.
+//
+// They return a mask in which bit 2i is set if entry i holds "primary_hash",
+// and bit 2i + 1 is set if entry i is empty.  Callers still compare the keys
+// of entries that hold "primary_hash".
+//
+// The vectorized kernels are only available when the compiler targets the
+// corresponding instruction set.  probe_hash_bucket picks the widest one.
+
+namespace hyperdisk
+{
+
+unsigned
+probe_hash_bucket(const uint64_t* bucket, uint32_t primary_hash);
+
+unsigned
+probe_hash_bucket_scalar(const uint64_t* bucket, uint32_t primary_hash);
+
+#ifdef __SSE2__
+unsigned
+probe_hash_bucket_sse2(const uint64_t* bucket, uint32_t primary_hash);
+#endif
+
+#ifdef __AVX2__
+unsigned
+probe_hash_bucket_avx2(const uint64_t* bucket, uint32_t primary_hash);
+#endif
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_hash_table_probe_h_
@@ -0,0 +1,89 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_compressor_h_
+#define hyperdisk_compressor_h_
+
+// C
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hyperdisk
+{
+
+// A compressor for the values stored in shards.  Compressors are registered
+// under a small id, which is recorded alongside every value compressed with
+// them, and so an id must always name the same algorithm.  Id 0 means that
+// values are stored uncompressed.
+//
+// Snappy is built in (as id 1, named "snappy") when the library is present.
+// Other algorithms may be added by registering a subclass before any shard
+// which uses them is created or opened.
+
+class compressor
+{
+    public:
+        static const uint16_t MAX_ID = 255;
+        // The compressor registered under "id" or "name", or NULL if there is
+        // none.
+        static const compressor* lookup(uint16_t id);
+        static const compressor* lookup(const char* name);
+        // Register "c", which must outlive every shard.  Returns false if its
+        // id is 0, above MAX_ID, or already taken.
+        static bool add(const compressor* c);
+
+    public:
+        compressor(uint16_t id, const char* name);
+        virtual ~compressor() throw ();
+
+    public:
+        uint16_t id() const { return m_id; }
+        const char* name() const { return m_name; }
+        // The most bytes "compress" may produce from "sz" bytes of input.
+        virtual size_t bound(size_t sz) const = 0;
+        // Compress "sz" bytes from "in" into "out", which has room for
+        // bound(sz) bytes, and return the size of the result.
+        virtual size_t compress(const uint8_t* in, size_t sz, uint8_t* out) const = 0;
+        // Decompress "sz" bytes from "in" into "out", which has room for
+        // exactly "raw" bytes.  Returns false if the input is corrupt or does
+        // not decompress to "raw" bytes.
+        virtual bool decompress(const uint8_t* in, size_t sz,
+                                uint8_t* out, size_t raw) const = 0;
+
+    private:
+        compressor(const compressor&);
+        compressor& operator = (const compressor&);
+
+    private:
+        const uint16_t m_id;
+        const char* const m_name;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_compressor_h_
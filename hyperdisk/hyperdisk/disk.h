@@ -29,24 +29,30 @@
 #define hyperdisk_disk_h_
 
 // STL
+#include <memory>
 #include <queue>
+#include <set>
 #include <string>
 #include <tr1/memory>
+#include <utility>
 #include <vector>
 
 // po6
 #include <po6/pathname.h>
+#include <po6/threads/cond.h>
 #include <po6/threads/mutex.h>
 
 // e
 #include <e/intrusive_ptr.h>
 #include <e/lockfree_hash_map.h>
 #include <e/locking_iterable_fifo.h>
+#include <e/striped_lock.h>
 
 // HyperspaceHashing
 #include <hyperspacehashing/mask.h>
 
 // HyperDisk
+#include <hyperdisk/geometry.h>
 #include <hyperdisk/reference.h>
 #include <hyperdisk/returncode.h>
 #include <hyperdisk/snapshot.h>
@@ -57,7 +63,9 @@ namespace hyperdisk
 class log_entry;
 class offset_update;
 class shard;
+class shard_snapshot;
 class shard_vector;
+class write_ahead_log;
 }
 
 namespace hyperdisk
@@ -72,29 +80,58 @@ namespace hyperdisk
 class disk
 {
     public:
+        // If "durable" is true, every PUT/DEL is also written to a log in
+        // "directory" (see "commit").  New shards are created with geometry
+        // "geom", unless it is geometry::adaptive(), in which case the
+        // geometry grows to suit the objects stored in the disk.  Either way,
+        // the columnar attributes and compression are taken from "geom".
         static e::intrusive_ptr<disk> create(const po6::pathname& directory,
                                              const hyperspacehashing::mask::hasher& hasher,
-                                             uint16_t arity);
+                                             uint16_t arity, bool durable = false,
+                                             const geometry& geom = geometry());
+        // Open a disk previously created in "directory", restoring its shards
+        // from the files left behind.  Shards which were not yet in use when
+        // the disk was closed are discarded, while the durable log (if any) is
+        // replayed into the shards.  A shard whose header is lost is rebuilt
+        // from its contents, or else set aside as "corrupt-<name>" and replaced
+        // by an empty shard.  This throws if the directory cannot be read or
+        // changed, or if the log cannot be replayed.  Existing shards keep the
+        // geometry they were created with.
+        static e::intrusive_ptr<disk> open(const po6::pathname& directory,
+                                           const hyperspacehashing::mask::hasher& hasher,
+                                           uint16_t arity, bool durable = false,
+                                           const geometry& geom = geometry());
 
     public:
-        // May return SUCCESS or NOTFOUND.
+        // May return SUCCESS or NOTFOUND, or CORRUPT if reads are verified.
         returncode get(const e::slice& key, std::vector<e::slice>* value,
                        uint64_t* version, reference* backing);
         // May return SUCCESS or WRONGARITY.
         returncode put(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
                        const std::vector<e::slice>& value, uint64_t version);
+        // PUT "count" objects, as if by calling put on each in turn, but
+        // hashing them together.  May return SUCCESS or WRONGARITY (in which
+        // case none of the objects is written).
+        returncode put(const std::tr1::shared_ptr<e::buffer>* backings,
+                       const e::slice* keys, const std::vector<e::slice>* values,
+                       const uint64_t* versions, size_t count);
         // May return SUCCESS.
         returncode del(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key);
         // Create a snapshot of the disk.  The snapshot will contain the result
-        // after applying a prefix of the execution history of the disk.
+        // after applying a prefix of the execution history of the disk.  It
+        // omits objects whose columnar attributes fall outside the ranges in
+        // "terms", but the caller must still check the objects it returns.
         e::intrusive_ptr<snapshot> make_snapshot(const hyperspacehashing::search& terms);
         // Create a snapshot of the disk.  This will return every result that
         // will be returned by make_snapshot(), but will then continue to return
         // any execution history past the point at which the snapshot was taken.
-        e::intrusive_ptr<rolling_snapshot> make_rolling_snapshot();
-        // Drop the disk.  This removes it from the filesystem.  All existing
-        // snapshots will continue to exist, but no calls should be made to the
-        // disk (except the destructor).
+        // If "spill" is true, the history which the snapshot has yet to return
+        // is moved from memory to a temporary file as it is flushed (falling
+        // back to holding it in memory if the file cannot be created).
+        e::intrusive_ptr<rolling_snapshot> make_rolling_snapshot(bool spill = false);
+        // Drop the disk.  This removes it (shards, log segments and all) from
+        // the filesystem.  All existing snapshots will continue to exist, but
+        // no calls should be made to the disk (except the destructor).
         returncode drop();
 
     public:
@@ -105,33 +142,109 @@ class disk
         // convenience.  It will flush at most 'num' items to the underlying
         // disk.  This will not split underlying shards which need to be split
         // to make more space.  If this returns a *FULL error, then you must
-        // call either 'do_mandatory_io' or 'do_optimistic_io'.
+        // call either 'do_mandatory_io' or 'do_optimistic_io'.  Concurrent
+        // calls help the first to apply its items to disjoint shards in
+        // parallel, and return SUCCESS (or DIDNOTHING if there was nothing
+        // left to help with).
         returncode flush(size_t num);
         // Do only the amount of shard-splitting necessary to split shards which
         // are 100% used.
         returncode do_mandatory_io();
-        // Possibly split one shard if our disk is getting full.
+        // Possibly split one shard if our disk is getting full, or else merge
+        // two sibling shards whose live data easily fits within one.
         returncode do_optimistic_io();
-        // Preallocate shards to ease the hit we would take from the large
-        // amount of disk I/O at once.
+        // Preallocate shards so that splits need not create them, and
+        // recycle retired shards which are no longer in use.
         returncode preallocate();
-        // Move data either synchronously or asynchronously from operating
-        // system buffers to the underlying FS.  May return SUCCESS or
-        // SYNCFAILED.  errno will be set to the reason the sync failed.
-        returncode async();
+        // If "recycle" is true, the files of shards retired by cleaning,
+        // splitting or merging are emptied and kept as spares by
+        // "preallocate", rather than being removed.  This is off by default.
+        void recycle_shards(bool recycle);
+        // If "verify" is true, GET checks the checksum of each entry it reads
+        // from a shard.  This is off by default.
+        void verify_reads(bool verify);
+        // Verify the checksums of up to "num" live entries in the shards,
+        // continuing from where the last call left off.  Shards which replace
+        // others are filled by copies which verify every entry, so the scrub
+        // carries on from the same position when the shards change.  May
+        // return SUCCESS, CORRUPT, or DIDNOTHING when a pass over every shard
+        // has finished.
+        returncode scrub(size_t num);
+        // Keep shards which see few GETs, snapshots and writes in "directory"
+        // (meant to be on a slower, cheaper device than the disk's own
+        // directory), which is created if need be.  A cold shard is linked
+        // into the disk's directory by a symbolic link of the same name.
+        // Until this is called, "tier_shards" does nothing.  This throws if
+        // the directory cannot be created or opened.
+        void store_cold_shards(const po6::pathname& directory);
+        // Measure how busy each shard has been since the last call, and move
+        // at most one shard:  the hottest cold shard back to the disk's own
+        // directory, or else the coldest shard to the cold directory.  Shards
+        // taking writes stay where they are.  Call this periodically, as the
+        // measure decays with each call.  May return SUCCESS, DIDNOTHING, or
+        // DROPFAILED.
+        returncode tier_shards();
+        // Move data synchronously from operating system buffers to the
+        // underlying FS.  May return SUCCESS or SYNCFAILED.  errno will be
+        // set to the reason the sync failed.
         returncode sync();
+        // Make every PUT/DEL issued before this call durable, using a single
+        // write and fdatasync of the durable log.  Periodically, this will
+        // also start a new log segment and remove the old segments after
+        // syncing the shards.  May return SUCCESS, DIDNOTHING (if there was
+        // nothing to commit or the disk is not durable), or SYNCFAILED, in
+        // which case the next call retries the same PUT/DELs.
+        returncode commit();
+
+    public:
+        // The page faults (minor and major) taken by operations on this disk.
+        // Only one in FAULT_SAMPLE_INTERVAL GETs is measured, so the counts
+        // are estimates.
+        void page_faults(uint64_t* minor, uint64_t* major);
+        // How urgently the disk needs background work:  the number of PUT/DEL
+        // operations waiting to be flushed, the bytes of memory they hold (the
+        // buffers backing their keys and values), and the used space (as a
+        // percentage) of the fullest shard.
+        void pressure(uint64_t* entries, uint64_t* bytes, int* fullest);
+        // The bytes of the values held by the current shards (including those
+        // since overwritten), before and after compression.  Their ratio is
+        // the compression achieved by the geometry's compressor.
+        void compression(uint64_t* raw, uint64_t* stored);
 
     private:
         friend class e::intrusive_ptr<disk>;
+        friend class rolling_snapshot;
+        class fault_scope;
+        class flush_batch;
+        class flush_result;
         class stored;
         static uint64_t hash(const std::string& s);
         typedef e::lockfree_hash_map<std::string, e::intrusive_ptr<stored>, hash>
                 stored_map_t;
+        // The number of buckets in m_stored is 2^STORED_MAGNITUDE.
+        static const uint16_t STORED_MAGNITUDE = 14;
+        static const size_t STORED_LOCK_STRIPING = 64;
+        // Start a new segment of the durable log once the current one exceeds
+        // this many bytes.
+        static const uint64_t LOG_SEGMENT_SIZE = 64ULL * 1024 * 1024;
+        static const uint64_t FAULT_SAMPLE_INTERVAL = 64;
+        static const size_t MAX_SPARE_SHARDS = 16;
+        // Sibling shards are merged when their live data together uses at
+        // most this percentage of a shard (well clear of the 75% at which
+        // do_optimistic_io splits a shard).
+        static const int MERGE_THRESHOLD = 25;
+        // "tier_shards" moves a cold shard back once its heat (roughly twice
+        // the reads and writes it sees between calls) reaches TIER_HOT_HEAT,
+        // and moves a shard out once its heat falls to TIER_COLD_HEAT, if it
+        // has been measured at least TIER_WARMUP times.
+        static const uint64_t TIER_HOT_HEAT = 256;
+        static const uint64_t TIER_COLD_HEAT = 16;
+        static const uint64_t TIER_WARMUP = 8;
 
     private:
         disk(const po6::pathname& directory,
              const hyperspacehashing::mask::hasher& hasher,
-             uint16_t arity);
+             uint16_t arity, const geometry& geom);
         disk();
         ~disk() throw ();
 
@@ -139,40 +252,158 @@ class disk
         // Reference counting for disks.
         void inc() { __sync_add_and_fetch(&m_ref, 1); }
         void dec() { if (__sync_sub_and_fetch(&m_ref, 1) == 0) delete this; }
+        // Populate m_shards, either with a single shard holding everything, or
+        // from the shard files in m_base.
+        void create_shards();
+        void open_shards();
+        // Apply the durable log left in m_base to the shards, and remove it.
+        void replay_log();
+        // Remove any existing durable log, and begin a new one.
+        void start_log();
+        // Move unflushed entries to a new log segment, sync the shards, and
+        // remove the old segments.
+        returncode checkpoint();
         // The pathname (relative to m_base) of a (tmp) shard at coordinate.
         po6::pathname shard_filename(const hyperspacehashing::mask::coordinate& c);
         po6::pathname shard_tmp_filename(const hyperspacehashing::mask::coordinate& c);
-        // Create a shard for the given coordinate.  This only creates/mmaps the
-        // appropriate file.
-        e::intrusive_ptr<shard> create_shard(const hyperspacehashing::mask::coordinate& c);
-        e::intrusive_ptr<shard> create_tmp_shard(const hyperspacehashing::mask::coordinate& c);
+        // A fresh pathname (relative to m_base) for a spare shard.
+        po6::pathname spare_filename();
+        // A fresh pathname (relative to m_base) for a rolling snapshot's
+        // spill file.  Call with m_spill_lock held.
+        po6::pathname spill_filename();
+        // Stop spilling the log to "rs", which is being destroyed.
+        void forget_rolling_snapshot(rolling_snapshot* rs);
+        // Create a shard for the given coordinate, at least as large as "g".
+        // This only creates/mmaps the appropriate file.
+        e::intrusive_ptr<shard> create_shard(const hyperspacehashing::mask::coordinate& c,
+                                             const geometry& g);
+        e::intrusive_ptr<shard> create_tmp_shard(const hyperspacehashing::mask::coordinate& c,
+                                                 const geometry& g);
+        // Take a preallocated shard at least as large as "g", if there is
+        // one.  Spares of an outdated geometry are discarded.
+        e::intrusive_ptr<shard> take_spare_shard(const geometry& g, po6::pathname* filename);
+        // Snapshot "s" while holding m_shards_mutate.
+        shard_snapshot snapshot_shard(shard* s);
+        // Snapshot both shards at the same point in the flush order, so that
+        // an object moved between them is visible in exactly one snapshot.
+        std::pair<shard_snapshot, shard_snapshot> snapshot_shards(shard* s1, shard* s2);
+        // The geometry for new shards.  "replace_geometry" also grows the
+        // geometry (if adaptive) to suit the contents of "s", and never
+        // returns a geometry smaller than that of "s".
+        geometry current_geometry();
+        geometry replace_geometry(shard* s);
         // Drop the shard for the given coordinate.  This ONLY unlinks the
         // appropriate file.
         returncode drop_shard(const hyperspacehashing::mask::coordinate& c);
         returncode drop_tmp_shard(const hyperspacehashing::mask::coordinate& c);
-        // Deal with shards which cannot hold more data.  The m_shard_mutate
-        // lock must be held prior to calling these functions.
+        returncode drop_cold_tmp_shard(const hyperspacehashing::mask::coordinate& c);
+        // True if the shard at "c" is a link to a file (stored in "target") in
+        // the cold directory.
+        bool cold_shard(const hyperspacehashing::mask::coordinate& c,
+                        po6::pathname* target);
+        // If recycling, link the file of the shard at "c" under a spare name
+        // (stored in "retired") so that the file outlives the shard being
+        // replaced or dropped.  Returns false if the file will not be kept.
+        bool retire_shard(const hyperspacehashing::mask::coordinate& c,
+                          po6::pathname* retired);
+        // Once the shard at "c" has been replaced or dropped, queue the file
+        // kept by "retire_shard" to be recycled.
+        void keep_retired_shard(const po6::pathname& retired, e::intrusive_ptr<shard> s);
+        // Reset retired shards which are no longer in use, and make them
+        // spares.  Returns true if any shard was recycled.
+        bool recycle_retired_shards();
+        // Deal with shards which cannot hold more data.  The m_compact_lock
+        // must be held prior to calling these functions.  The replacement
+        // shards are built without holding m_shards_mutate, which is only
+        // held to catch up on flushes made during the copy and swap shards.
         returncode deal_with_full_shard(size_t shard_num);
         returncode clean_shard(size_t shard_num);
         returncode split_shard(size_t shard_num);
+        returncode merge_shards(size_t shard_num1, size_t shard_num2,
+                                const hyperspacehashing::mask::coordinate& c);
+        // Copy a shard to the cold directory (if "cold") or back again.
+        returncode tier_shard(size_t shard_num, bool cold);
+        // Flushing.  "flush_locate" finds the shard holding the key of a log
+        // entry, "flush_apply" applies the entry to the shards, and
+        // "flush_publish" (called in log order) makes it visible to snapshots
+        // and removes it from m_stored.  "flush_root" finds the root of a
+        // shard in the forest which groups a batch, and "flush_work" applies
+        // groups of the batch until none are left.  "flush_help" joins the
+        // batch in progress, returning false if there is none.
+        void flush_locate(const log_entry& e, flush_result* r);
+        returncode flush_apply(const log_entry& e, flush_result* r);
+        void flush_publish(const log_entry& e, const flush_result& r);
+        static size_t flush_root(std::vector<size_t>* roots, size_t shard_num);
+        void flush_work(flush_batch* b);
+        bool flush_help();
+        // Append to m_log (and m_wal, if durable) while keeping m_stored (an
+        // index over the unflushed portion of m_log) in sync.  An index entry
+        // is removed by "unstore" once every write to its key has been flushed
+        // to the shards.  Both keep m_log_entries and m_log_bytes up to date.
+        void log_append(const log_entry& e);
+        void unstore(const log_entry& e);
+        static uint64_t log_entry_bytes(const log_entry& e);
+        static std::string stored_key(const hyperspacehashing::mask::coordinate& coord,
+                                      const e::slice& key);
 
     private:
         size_t m_ref;
         size_t m_arity;
         hyperspacehashing::mask::hasher m_hasher;
         // Read about locking in the source.
+        po6::threads::mutex m_compact_lock;
         po6::threads::mutex m_shards_mutate;
         po6::threads::mutex m_shards_lock;
         e::intrusive_ptr<shard_vector> m_shards;
         e::locking_iterable_fifo<log_entry> m_log;
+        stored_map_t m_stored;
+        e::striped_lock<po6::threads::mutex> m_stored_locks;
         e::locking_iterable_fifo<offset_update> m_offsets;
         po6::io::fd m_base;
         po6::pathname m_base_filename;
+        // The cold directory (an absolute path) if shards are tiered.
+        // Protected by m_compact_lock.
+        po6::io::fd m_cold;
+        po6::pathname m_cold_filename;
         po6::threads::mutex m_spare_shards_lock;
         std::queue<std::pair<po6::pathname, e::intrusive_ptr<shard> > > m_spare_shards;
         size_t m_spare_shard_counter;
+        // Protected by m_spare_shards_lock.
+        std::queue<std::pair<po6::pathname, e::intrusive_ptr<shard> > > m_retired_shards;
+        bool m_recycle;
+        bool m_verify_reads;
+        // The shard being scrubbed (only ever compared, never dereferenced),
+        // its index in m_shards, and the next entry to check.  Protected by
+        // m_scrub_lock.
+        po6::threads::mutex m_scrub_lock;
+        const shard* m_scrub_shard;
+        size_t m_scrub_index;
+        uint32_t m_scrub_entry;
+        geometry m_geometry;
+        const bool m_adaptive;
         size_t m_needs_io;
         unsigned int m_seed;
+        // NULL unless the disk is durable.
+        std::auto_ptr<write_ahead_log> m_wal;
+        // The batch being flushed, which other flushing threads may help
+        // apply.  Protected by m_flush_lock.
+        po6::threads::mutex m_flush_lock;
+        po6::threads::cond m_flush_cond;
+        flush_batch* m_flush_batch;
+        // Updated atomically by fault_scope.
+        uint64_t m_gets;
+        uint64_t m_minor_faults;
+        uint64_t m_major_faults;
+        // Updated atomically as entries enter and leave m_log.
+        uint64_t m_log_entries;
+        uint64_t m_log_bytes;
+        // The spilling rolling snapshots, the number of entries ever flushed
+        // from m_log, and a counter for naming spill files.  Entries are
+        // dropped from m_log only while holding m_spill_lock.
+        po6::threads::mutex m_spill_lock;
+        std::set<rolling_snapshot*> m_spilling;
+        uint64_t m_log_flushed;
+        uint64_t m_spill_counter;
 };
 
 } // namespace hyperdisk
@@ -0,0 +1,96 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef hyperdisk_geometry_h_
+#define hyperdisk_geometry_h_
+
+// C
+#include <stdint.h>
+
+namespace hyperdisk
+{
+
+// The geometry of a shard:  the number of entries in its search index, the
+// number of bytes in its data segment, and the value attributes which are also
+// stored in columns.  The hash table always has twice as many entries as the
+// search index.  Every shard records its geometry in its header, so shards of
+// differing geometries may coexist within one disk.
+
+class geometry
+{
+    public:
+        // Let the disk pick the geometry of new shards from the average size
+        // of the objects it holds.
+        static geometry adaptive();
+        // A geometry which fills its search index and data segment at roughly
+        // the same rate when storing objects of "object_size" bytes.
+        static geometry for_object_size(uint64_t object_size);
+        // The most attributes which may be columnar in one geometry.
+        static unsigned int max_columns();
+
+    public:
+        // The geometry used by every shard before it was configurable:  32768
+        // entries and a 32MB data segment.
+        geometry();
+        geometry(uint32_t search_entries, uint32_t data_size, uint64_t columnar = 0,
+                 uint16_t compression = 0);
+        ~geometry() throw ();
+
+    public:
+        bool is_adaptive() const { return search_entries == 0; }
+        // The search index must be a power of two between
+        // MIN_SEARCH_INDEX_ENTRIES and MAX_SEARCH_INDEX_ENTRIES, and the data
+        // segment must be no larger than MAX_DATA_SEGMENT_SIZE.  At most
+        // MAX_COLUMNS attributes may be columnar, and the compressor (if any)
+        // must be registered.
+        bool valid() const;
+        uint32_t hash_entries() const { return search_entries * 2; }
+        unsigned int columns() const { return __builtin_popcountll(columnar); }
+        // The smallest geometry at least as large as both this and "other".
+        // The columnar attributes and compression are those of this geometry.
+        geometry at_least(const geometry& other) const;
+
+    public:
+        bool operator == (const geometry& rhs) const;
+        bool operator != (const geometry& rhs) const { return !(*this == rhs); }
+
+    public:
+        uint32_t search_entries;
+        uint32_t data_size;
+        // Bit i is set if value attribute i is columnar.  Each columnar
+        // attribute is interpreted as a little-endian uint64 (as in a range
+        // search), and stored alongside the search index so that range
+        // searches need not parse the objects.
+        uint64_t columnar;
+        // The id of the compressor (see compressor.h) applied to the values
+        // of objects written to the shard, or 0 to store them as they are.
+        uint16_t compression;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_geometry_h_
@@ -28,7 +28,12 @@
 #ifndef hyperdisk_reference_h_
 #define hyperdisk_reference_h_
 
+// STL
+#include <memory>
+#include <tr1/memory>
+
 // e
+#include <e/buffer.h>
 #include <e/intrusive_ptr.h>
 #include <e/locking_iterable_fifo.h>
 
@@ -52,6 +57,7 @@ class reference
     public:
         void set(const e::locking_iterable_fifo<log_entry>::iterator& it);
         void set(const e::intrusive_ptr<shard>& shard);
+        void set(const std::tr1::shared_ptr<e::buffer>& backing);
 
     public:
         reference& operator = (const reference& rhs);
@@ -59,6 +65,7 @@ class reference
     private:
         std::auto_ptr<e::locking_iterable_fifo<log_entry>::iterator> m_it;
         e::intrusive_ptr<shard> m_shard;
+        std::tr1::shared_ptr<e::buffer> m_backing;
 };
 
 } // namespace hyperdisk
@@ -31,6 +31,9 @@
 // STL
 #include <memory>
 
+// po6
+#include <po6/threads/mutex.h>
+
 // e
 #include <e/intrusive_ptr.h>
 #include <e/locking_iterable_fifo.h>
@@ -42,7 +45,10 @@
 // Forward Declarations
 namespace hyperdisk
 {
+class column_filter;
+class disk;
 class log_entry;
+class log_spill;
 class shard_snapshot;
 class shard_vector;
 }
@@ -70,6 +76,7 @@ class snapshot
 
     private:
         snapshot(const hyperspacehashing::mask::coordinate& coord,
+                 std::auto_ptr<column_filter> filter,
                  e::intrusive_ptr<shard_vector> shards,
                  std::vector<hyperdisk::shard_snapshot>* snaps);
         snapshot(const snapshot&);
@@ -85,16 +92,27 @@ class snapshot
     private:
         size_t m_ref;
         hyperspacehashing::mask::coordinate m_coord;
+        std::auto_ptr<column_filter> m_filter;
         e::intrusive_ptr<shard_vector> m_shards;
         std::vector<hyperdisk::shard_snapshot> m_snaps;
 };
 
 // A rolling snapshot will replay the disks' log after iterating all shards.
+//
+// A plain rolling snapshot holds on to every entry of the log from the moment
+// it was taken, which pins them in memory for as long as the snapshot is slow
+// to read them.  A spilling rolling snapshot instead moves the entries it has
+// yet to return into a temporary file as the disk flushes them, so that its
+// memory use stays bounded however long it lives.
 class rolling_snapshot
 {
     public:
         bool valid();
         void next();
+        // True if entries which were spilled could not be read back.  The
+        // snapshot then stops at the lost entries (valid returns false) rather
+        // than skipping them, and must be abandoned.
+        bool failed();
 
     public:
         bool has_value();
@@ -113,16 +131,36 @@ class rolling_snapshot
     private:
         rolling_snapshot(const e::locking_iterable_fifo<log_entry>::iterator& iter,
                          const e::intrusive_ptr<snapshot>& snap);
+        // A spilling snapshot.  "seq" is the position of "iter" in the log of
+        // "d", counting every entry ever flushed from it.
+        rolling_snapshot(const e::locking_iterable_fifo<log_entry>::iterator& iter,
+                         const e::intrusive_ptr<snapshot>& snap,
+                         const e::intrusive_ptr<disk>& d, uint64_t seq,
+                         std::auto_ptr<log_spill> spill);
         rolling_snapshot(const rolling_snapshot&);
         ~rolling_snapshot() throw ();
 
     private:
+        // Move the entries before position "seq" of the log to the spill
+        // file.  The disk calls this before it drops them from the log.
+        void spill(uint64_t seq);
+        // Make the next entry of the log (or spill file) current, unless one
+        // already is.  Returns false if there is none.  Call with m_lock held.
+        bool load();
         rolling_snapshot& operator = (const rolling_snapshot&);
 
     private:
         size_t m_ref;
-        e::locking_iterable_fifo<log_entry>::iterator m_iter;
         e::intrusive_ptr<snapshot> m_snap;
+        // The log is read through m_lock, as the disk may spill it
+        // concurrently.  Entries in m_spill precede m_iter, which is at
+        // position m_seq.  m_current is a copy of the entry being returned.
+        po6::threads::mutex m_lock;
+        e::locking_iterable_fifo<log_entry>::iterator m_iter;
+        e::intrusive_ptr<disk> m_disk;
+        uint64_t m_seq;
+        std::auto_ptr<log_spill> m_spill;
+        std::auto_ptr<log_entry> m_current;
 };
 
 } // namespace hyperdisk
@@ -0,0 +1,148 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// STL
+#include <algorithm>
+#include <tr1/memory>
+
+// e
+#include <e/buffer.h>
+
+// HyperDisk
+#include "hyperdisk/log_spill.h"
+#include "hyperdisk/write_ahead_log.h"
+
+// Entries are read back SPILL_READ_SIZE bytes at a time, or one at a time if
+// they are larger.
+#define SPILL_READ_SIZE (1 << 20)
+
+hyperdisk :: log_spill :: log_spill(const po6::io::fd& dir, const po6::pathname& filename)
+    : m_fd(openat(dir.get(), filename.get(), O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR))
+    , m_written(0)
+    , m_read(0)
+    , m_failed(false)
+    , m_chunk()
+{
+    if (m_fd.get() < 0)
+    {
+        throw po6::error(errno);
+    }
+
+    if (unlinkat(dir.get(), filename.get(), 0) < 0)
+    {
+        throw po6::error(errno);
+    }
+}
+
+hyperdisk :: log_spill :: ~log_spill() throw ()
+{
+}
+
+bool
+hyperdisk :: log_spill :: append(const std::vector<char>& framed)
+{
+    if (framed.empty())
+    {
+        return true;
+    }
+
+    ssize_t ret = pwrite(m_fd.get(), &framed.front(), framed.size(), m_written);
+
+    if (ret != static_cast<ssize_t>(framed.size()))
+    {
+        return false;
+    }
+
+    m_written += framed.size();
+    return true;
+}
+
+bool
+hyperdisk :: log_spill :: take(log_entry* ent)
+{
+    if (m_failed || (m_chunk.empty() && !read_chunk()))
+    {
+        return false;
+    }
+
+    *ent = m_chunk.front();
+    m_chunk.pop_front();
+    return true;
+}
+
+bool
+hyperdisk :: log_spill :: read_chunk()
+{
+    size_t size = SPILL_READ_SIZE;
+
+    while (m_read < m_written)
+    {
+        size = std::min<uint64_t>(size, m_written - m_read);
+        std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(size));
+
+        if (pread(m_fd.get(), backing->data(), size, m_read) != static_cast<ssize_t>(size))
+        {
+            m_failed = true;
+            return false;
+        }
+
+        backing->resize(size);
+        size_t off = 0;
+        log_entry ent;
+
+        while (write_ahead_log::decode(backing, &off, &ent))
+        {
+            m_chunk.push_back(ent);
+        }
+
+        m_read += off;
+
+        if (off > 0)
+        {
+            return true;
+        }
+
+        // The rest of the file does not frame an entry, so the entries
+        // appended there are lost.
+        if (m_read + size >= m_written)
+        {
+            m_failed = true;
+            return false;
+        }
+
+        // The next entry is larger than a chunk.
+        size *= 2;
+    }
+
+    return false;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef hyperdisk_log_spill_h_
+#define hyperdisk_log_spill_h_
+
+// STL
+#include <deque>
+#include <vector>
+
+// po6
+#include <po6/io/fd.h>
+#include <po6/pathname.h>
+
+// HyperDisk
+#include "hyperdisk/log_entry.h"
+
+namespace hyperdisk
+{
+
+// The entries of a disk's log which a rolling snapshot has yet to return, moved
+// out of memory as the disk flushes them.  They are kept in an unlinked file in
+// the disk's directory, framed as in the durable log, and read back in order a
+// chunk at a time.  This is not thread-safe.
+
+class log_spill
+{
+    public:
+        // Create the file "filename" in "dir", and unlink it straight away.
+        // Throws po6::error if the file cannot be created.
+        log_spill(const po6::io::fd& dir, const po6::pathname& filename);
+        ~log_spill() throw ();
+
+    public:
+        // Append entries framed by write_ahead_log::encode.  Returns false if
+        // they could not all be written, in which case none were appended.
+        bool append(const std::vector<char>& framed);
+        // Take the oldest entry, if there is one.  Returns false if there is
+        // none, or if the file could not be read back (see "failed").
+        bool take(log_entry* ent);
+        // True if spilled entries were lost because the file could not be
+        // read, or did not decode.  This is sticky:  take never returns
+        // another entry.
+        bool failed() const { return m_failed; }
+
+    private:
+        log_spill(const log_spill&);
+
+    private:
+        // Read the next chunk of the file into m_chunk.
+        bool read_chunk();
+
+    private:
+        log_spill& operator = (const log_spill&);
+
+    private:
+        po6::io::fd m_fd;
+        uint64_t m_written;
+        uint64_t m_read;
+        bool m_failed;
+        std::deque<log_entry> m_chunk;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_log_spill_h_
@@ -33,12 +33,14 @@
 hyperdisk :: reference :: reference()
     : m_it()
     , m_shard()
+    , m_backing()
 {
 }
 
 hyperdisk :: reference :: reference(const reference& other)
     : m_it()
     , m_shard(other.m_shard)
+    , m_backing(other.m_backing)
 {
     if (other.m_it.get())
     {
@@ -62,6 +64,12 @@ hyperdisk :: reference :: set(const e::intrusive_ptr<shard>& shard)
     m_shard = shard;
 }
 
+void
+hyperdisk :: reference :: set(const std::tr1::shared_ptr<e::buffer>& backing)
+{
+    m_backing = backing;
+}
+
 hyperdisk::reference&
 hyperdisk :: reference :: operator = (const reference& rhs)
 {
@@ -80,5 +88,6 @@ hyperdisk :: reference :: operator = (const reference& rhs)
     }
 
     m_shard = rhs.m_shard;
+    m_backing = rhs.m_backing;
     return *this;
 }
@@ -0,0 +1,220 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// C
+#include <cstring>
+
+// STL
+#include <algorithm>
+
+// SIMD
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// HyperDisk
+#include "hyperdisk/search_log_scan.h"
+#include "hyperdisk/shard_constants.h"
+
+using hyperspacehashing::mask::coordinate;
+
+size_t
+hyperdisk :: scan_search_log(const char* log, size_t start, size_t end,
+                             const coordinate& coord, uint32_t limit)
+{
+#if defined(__AVX2__)
+    return scan_search_log_avx2(log, start, end, coord, limit);
+#elif defined(__SSE2__)
+    return scan_search_log_sse2(log, start, end, coord, limit);
+#else
+    return scan_search_log_scalar(log, start, end, coord, limit);
+#endif
+}
+
+size_t
+hyperdisk :: scan_search_log_scalar(const char* log, size_t start, size_t end,
+                                    const coordinate& coord, uint32_t limit)
+{
+    for (size_t i = start; i < end; ++i)
+    {
+        const char* ent = log + i * SEARCH_INDEX_ENTRY_SIZE;
+        uint32_t offset;
+        uint32_t invalid;
+        uint64_t primary;
+        uint64_t lower;
+        uint64_t upper;
+        memmove(&offset, ent, sizeof(offset));
+        memmove(&invalid, ent + 4, sizeof(invalid));
+        memmove(&primary, ent + 8, sizeof(primary));
+        memmove(&lower, ent + 16, sizeof(lower));
+        memmove(&upper, ent + 24, sizeof(upper));
+
+        if (offset == 0 || offset >= limit)
+        {
+            return i;
+        }
+
+        if ((primary & coord.primary_mask) == coord.primary_hash &&
+            (lower & coord.secondary_lower_mask) == coord.secondary_lower_hash &&
+            (upper & coord.secondary_upper_mask) == coord.secondary_upper_hash &&
+            (invalid == 0 || invalid >= limit))
+        {
+            return i;
+        }
+    }
+
+    return end;
+}
+
+// Offsets in the search log strictly increase until the unused, zeroed tail,
+// so an entry ends the snapshot only if every later entry does too.  The
+// vectorized kernels exploit this to check the offset of only the last entry
+// in each block of four, and leave the block containing the end of the
+// snapshot to the scalar loop.  The first few entries are also left to the
+// scalar loop, both to align the blocks and because dense searches usually
+// stop there.  The masks are compared with SIMD, producing a nibble per entry
+// which is all ones when every hash matches.  The invalid field is checked
+// only for entries that match.
+
+static inline bool
+block_is_live(const char* log, size_t i, uint32_t limit)
+{
+    uint32_t offset;
+    memmove(&offset, log + (i + 3) * SEARCH_INDEX_ENTRY_SIZE, sizeof(offset));
+    return offset != 0 && offset < limit;
+}
+
+static inline size_t
+first_valid(const char* log, size_t i, unsigned nibbles, uint32_t limit)
+{
+    unsigned matched = nibbles & (nibbles >> 1) & (nibbles >> 2) & (nibbles >> 3) & 0x1111;
+
+    while (matched)
+    {
+        size_t j = __builtin_ctz(matched) / 4;
+        uint32_t invalid;
+        memmove(&invalid, log + (i + j) * SEARCH_INDEX_ENTRY_SIZE + 4, sizeof(invalid));
+
+        if (invalid == 0 || invalid >= limit)
+        {
+            return j;
+        }
+
+        matched &= matched - 1;
+    }
+
+    return 4;
+}
+
+#ifdef __SSE2__
+size_t
+hyperdisk :: scan_search_log_sse2(const char* log, size_t start, size_t end,
+                                  const coordinate& coord, uint32_t limit)
+{
+    // The low half of an entry holds the offsets and the primary hash; the
+    // high half holds the secondary hashes.  The offsets are masked out.
+    const __m128i lo_mask = _mm_set_epi64x(coord.primary_mask, 0);
+    const __m128i lo_hash = _mm_set_epi64x(coord.primary_hash, 0);
+    const __m128i hi_mask = _mm_set_epi64x(coord.secondary_upper_mask, coord.secondary_lower_mask);
+    const __m128i hi_hash = _mm_set_epi64x(coord.secondary_upper_hash, coord.secondary_lower_hash);
+    size_t i = std::min(end, (start + 4) & ~static_cast<size_t>(3));
+    size_t hit = scan_search_log_scalar(log, start, i, coord, limit);
+
+    if (hit < i)
+    {
+        return hit;
+    }
+
+    for (; i + 4 <= end && block_is_live(log, i, limit); i += 4)
+    {
+        const __m128i* p = reinterpret_cast<const __m128i*>(log + i * SEARCH_INDEX_ENTRY_SIZE);
+#define HYPERDISK_SSE2_MATCH(J) \
+        _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(p + 2 * (J)), lo_mask), lo_hash), \
+                      _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(p + 2 * (J) + 1), hi_mask), hi_hash))
+        __m128i m01 = _mm_packs_epi32(HYPERDISK_SSE2_MATCH(0), HYPERDISK_SSE2_MATCH(1));
+        __m128i m23 = _mm_packs_epi32(HYPERDISK_SSE2_MATCH(2), HYPERDISK_SSE2_MATCH(3));
+#undef HYPERDISK_SSE2_MATCH
+        unsigned nibbles = _mm_movemask_epi8(_mm_packs_epi16(m01, m23));
+
+        if (nibbles)
+        {
+            size_t j = first_valid(log, i, nibbles, limit);
+
+            if (j < 4)
+            {
+                return i + j;
+            }
+        }
+    }
+
+    return scan_search_log_scalar(log, i, end, coord, limit);
+}
+#endif
+
+#ifdef __AVX2__
+size_t
+hyperdisk :: scan_search_log_avx2(const char* log, size_t start, size_t end,
+                                  const coordinate& coord, uint32_t limit)
+{
+    // An entry fits in one register.  The offsets are masked out.
+    const __m256i mask = _mm256_set_epi64x(coord.secondary_upper_mask,
+                                           coord.secondary_lower_mask,
+                                           coord.primary_mask, 0);
+    const __m256i hash = _mm256_set_epi64x(coord.secondary_upper_hash,
+                                           coord.secondary_lower_hash,
+                                           coord.primary_hash, 0);
+    size_t i = std::min(end, (start + 4) & ~static_cast<size_t>(3));
+    size_t hit = scan_search_log_scalar(log, start, i, coord, limit);
+
+    if (hit < i)
+    {
+        return hit;
+    }
+
+    for (; i + 4 <= end && block_is_live(log, i, limit); i += 4)
+    {
+        const __m256i* p = reinterpret_cast<const __m256i*>(log + i * SEARCH_INDEX_ENTRY_SIZE);
+#define HYPERDISK_AVX2_MATCH(J) \
+        static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd( \
+            _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_loadu_si256(p + (J)), mask), hash)))) << (4 * (J))
+        unsigned nibbles = HYPERDISK_AVX2_MATCH(0) | HYPERDISK_AVX2_MATCH(1)
+                         | HYPERDISK_AVX2_MATCH(2) | HYPERDISK_AVX2_MATCH(3);
+#undef HYPERDISK_AVX2_MATCH
+        size_t j = first_valid(log, i, nibbles, limit);
+
+        if (j < 4)
+        {
+            return i + j;
+        }
+    }
+
+    return scan_search_log_scalar(log, i, end, coord, limit);
+}
+#endif
@@ -0,0 +1,82 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef hyperdisk_search_log_scan_h_
+#define hyperdisk_search_log_scan_h_
+
+// C
+#include <stddef.h>
+#include <stdint.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// These kernels scan a shard's search log, which is an array of
+// SEARCH_INDEX_ENTRY_SIZE-byte entries laid out as:
+//
+//      uint32_t offset; uint32_t invalid; uint64_t primary;
+//      uint64_t lower; uint64_t upper;
+//
+// They return the index of the first entry in [start, end) which either ends
+// a snapshot taken at "limit" (its offset is 0 or is at least "limit"), or
+// which matches "coord" and was not invalidated before "limit".  If there is
+// no such entry, they return "end".  Like the shard that writes it, they
+// assume that offsets increase until the first zero offset.
+//
+// The vectorized kernels are only available when the compiler targets the
+// corresponding instruction set.  scan_search_log picks the widest one.
+
+namespace hyperdisk
+{
+
+size_t
+scan_search_log(const char* log, size_t start, size_t end,
+                const hyperspacehashing::mask::coordinate& coord,
+                uint32_t limit);
+
+size_t
+scan_search_log_scalar(const char* log, size_t start, size_t end,
+                       const hyperspacehashing::mask::coordinate& coord,
+                       uint32_t limit);
+
+#ifdef __SSE2__
+size_t
+scan_search_log_sse2(const char* log, size_t start, size_t end,
+                     const hyperspacehashing::mask::coordinate& coord,
+                     uint32_t limit);
+#endif
+
+#ifdef __AVX2__
+size_t
+scan_search_log_avx2(const char* log, size_t start, size_t end,
+                     const hyperspacehashing::mask::coordinate& coord,
+                     uint32_t limit);
+#endif
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_search_log_scan_h_
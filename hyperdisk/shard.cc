@@ -28,13 +28,14 @@
 #define __STDC_LIMIT_MACROS
 
 // C
+#include <cerrno>
 #include <cstdio>
 
 // POSIX
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/uio.h>
 #include <unistd.h>
 
 // C++
@@ -42,24 +43,37 @@
 
 // STL
 #include <algorithm>
+#include <stdexcept>
 
 // po6
 #include <po6/io/fd.h>
 
+// e
+#include <e/guard.h>
+
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/mask.h"
+#include "hyperspacehashing/hashes_internal.h"
 
 // HyperDisk
+#include "hyperdisk/hyperdisk/compressor.h"
+#include "hyperdisk/column_filter.h"
+#include "hyperdisk/hash_table_probe.h"
 #include "hyperdisk/shard.h"
-#include "hyperdisk/shard_constants.h"
 #include "hyperdisk/shard_snapshot.h"
 
 using hyperspacehashing::mask::coordinate;
 
 e::intrusive_ptr<hyperdisk::shard>
 hyperdisk :: shard :: create(const po6::io::fd& base,
-                             const po6::pathname& filename)
+                             const po6::pathname& filename,
+                             const geometry& g)
 {
+    if (!g.valid())
+    {
+        throw std::invalid_argument("invalid shard geometry");
+    }
+
     // Try removing the old shard.
     unlinkat(base.get(), filename.get(), 0);
     po6::io::fd fd(openat(base.get(), filename.get(), O_CREAT|O_EXCL|O_RDWR, S_IRWXU));
@@ -69,20 +83,18 @@ hyperdisk :: shard :: create(const po6::io::fd& base,
         throw po6::error(errno);
     }
 
-    std::vector<char> buf(1 << 20, '\0');
-    std::vector<iovec> iovs;
-    size_t rem = FILE_SIZE;
-
-    while (rem)
+    // The file is created sparse, so that no zeros need be written.  Where
+    // the filesystem supports fallocate, its blocks are then reserved so that
+    // writes to the mapping cannot fail for want of space.  This calls Linux
+    // fallocate directly, because posix_fallocate falls back to writing every
+    // block.  Elsewhere the file stays sparse.
+    if (ftruncate(fd.get(), mapped_size(g)) < 0)
     {
-        struct iovec iov;
-        iov.iov_base = &buf.front();
-        iov.iov_len = std::min(buf.size(), rem);
-        iovs.push_back(iov);
-        rem -= iov.iov_len;
+        throw po6::error(errno);
     }
 
-    if (writev(fd.get(), &iovs.front(), iovs.size()) != FILE_SIZE)
+    if (fallocate(fd.get(), 0, 0, mapped_size(g)) < 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS)
     {
         throw po6::error(errno);
     }
@@ -93,7 +105,8 @@ hyperdisk :: shard :: create(const po6::io::fd& base,
     }
 
     // Create the shard object.
-    e::intrusive_ptr<shard> ret = new shard(&fd);
+    e::intrusive_ptr<shard> ret = new shard(&fd, g);
+    ret->write_header();
     return ret;
 }
 
@@ -108,31 +121,82 @@ hyperdisk :: shard :: open(const po6::io::fd& base,
         throw po6::error(errno);
     }
 
+    // The header determines how much of the file to map.  Use the first copy
+    // which is intact.
+    header h;
+
+    if (!read_header(fd, 0, &h) &&
+        !read_header(fd, SHARD_HEADER_COPY_OFFSET, &h))
+    {
+        throw std::runtime_error("shard header is corrupt or has an unsupported version");
+    }
+
+    geometry g(h.search_entries, h.data_size, h.columnar, h.compression);
+    struct stat st;
+
+    if (fstat(fd.get(), &st) < 0)
+    {
+        throw po6::error(errno);
+    }
+
+    if (static_cast<uint64_t>(st.st_size) < mapped_size(g))
+    {
+        throw std::runtime_error("shard is smaller than its geometry");
+    }
+
     // Create the shard object.
-    e::intrusive_ptr<shard> ret = new shard(&fd);
+    e::intrusive_ptr<shard> ret = new shard(&fd, g);
+    *ret->m_header = h;
 
-    // XXX We don't correctly restore the offsets.
-    while (ret->m_search_offset < SEARCH_INDEX_ENTRIES &&
-           ret->m_search_log[ret->m_search_offset].offset != 0)
+    if (!ret->replay())
     {
-        ret->m_data_offset = ret->m_search_log[ret->m_search_offset].offset;
-        ++ ret->m_search_offset;
+        throw std::runtime_error("shard header is corrupt or has an unsupported version");
     }
 
-    // XXX If you're looking for bugs that stem from opening shards, it's
-    // probably in this code block.
-    if (ret->m_search_offset > 0)
+    return ret;
+}
+
+e::intrusive_ptr<hyperdisk::shard>
+hyperdisk :: shard :: rebuild(const po6::io::fd& base,
+                              const po6::pathname& filename,
+                              const geometry& g,
+                              const coordinate& c)
+{
+    if (!g.valid())
     {
-        e::slice key;
-        std::vector<e::slice> value;
-        size_t key_size = ret->data_key_size(ret->m_data_offset);
-        ret->data_key(ret->m_data_offset, key_size, &key);
-        ret->data_value(ret->m_data_offset, key_size, &value);
-        size_t entry_size = ret->data_size(key, value);
-        ret->m_data_offset = (ret->m_data_offset + entry_size + 7) & ~7; // Keep everything 8-byte aligned.
-        assert(ret->m_data_offset <= FILE_SIZE);
+        throw std::invalid_argument("invalid shard geometry");
     }
 
+    po6::io::fd fd(openat(base.get(), filename.get(), O_RDWR));
+
+    if (fd.get() < 0)
+    {
+        throw po6::error(errno);
+    }
+
+    struct stat st;
+
+    if (fstat(fd.get(), &st) < 0)
+    {
+        throw po6::error(errno);
+    }
+
+    if (static_cast<uint64_t>(st.st_size) != mapped_size(g))
+    {
+        throw std::runtime_error("shard does not match the geometry");
+    }
+
+    // Start from an empty header, and recover every entry in the search log
+    // as though it had been appended after the header was written.
+    e::intrusive_ptr<shard> ret = new shard(&fd, g);
+    ret->set_coordinate(c);
+
+    if (!ret->replay() || !ret->fsck())
+    {
+        throw std::runtime_error("shard cannot be rebuilt with the geometry");
+    }
+
+    ret->write_header();
     return ret;
 }
 
@@ -140,7 +204,9 @@ hyperdisk::returncode
 hyperdisk :: shard :: get(uint32_t primary_hash,
                           const e::slice& key,
                           std::vector<e::slice>* value,
-                          uint64_t* version)
+                          uint64_t* version,
+                          std::tr1::shared_ptr<e::buffer>* backing,
+                          bool verify)
 {
     // Find the bucket.
     size_t table_entry;
@@ -153,13 +219,17 @@ hyperdisk :: shard :: get(uint32_t primary_hash,
         return NOTFOUND;
     }
 
+    if (verify && !data_checksum_ok(table_offset))
+    {
+        return CORRUPT;
+    }
+
     // Load the information.
     *version = data_version(table_offset);
     // const size_t key_size = data_key_size(offset);
     // data_key(offset, &key);
     // ^ Skipped because hash_lookup ensures that the key matches.
-    data_value(table_offset, key.size(), value);
-    return SUCCESS;
+    return data_value(table_offset, key.size(), value, backing);
 }
 
 hyperdisk::returncode
@@ -187,12 +257,12 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
                           uint64_t version,
                           uint32_t* cached)
 {
-    if (data_size(key, value) + m_data_offset > FILE_SIZE)
+    if (stored_size(key, value) + m_data_offset > file_size())
     {
         return DATAFULL;
     }
 
-    if (m_search_offset == SEARCH_INDEX_ENTRIES)
+    if (m_search_offset == m_geometry.search_entries)
     {
         return SEARCHFULL;
     }
@@ -205,7 +275,6 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
 
     // Values to pack.
     uint32_t key_size = key.size();
-    uint16_t value_arity = value.size();
 
     // Pack the values on disk.
     uint32_t curr_offset = m_data_offset;
@@ -215,17 +284,10 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
     curr_offset += sizeof(key_size);
     memmove(m_data + curr_offset, key.data(), key.size());
     curr_offset += key.size();
-    memmove(m_data + curr_offset, &value_arity, sizeof(value_arity));
-    curr_offset += sizeof(value_arity);
-
-    for (size_t i = 0; i < value.size(); ++i)
-    {
-        uint32_t size = value[i].size();
-        memmove(m_data + curr_offset, &size, sizeof(size));
-        curr_offset += sizeof(size);
-        memmove(m_data + curr_offset, value[i].data(), value[i].size());
-        curr_offset += value[i].size();
-    }
+    curr_offset = data_put_value(curr_offset, value);
+    uint32_t checksum = data_checksum(m_data_offset, curr_offset);
+    memmove(m_data + curr_offset, &checksum, sizeof(checksum));
+    curr_offset += sizeof(checksum);
 
     // Invalidate anything pointing to the old version.
     if (table_offset < HASH_OFFSET_INVALID)
@@ -233,6 +295,8 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
         invalidate_search_log(table_offset, m_data_offset);
     }
 
+    column_insert(m_search_offset, value);
+
     // Insert into the search log.
     m_search_log[m_search_offset].offset = m_data_offset;
     m_search_log[m_search_offset].invalid = 0;
@@ -243,17 +307,12 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
     // Insert into the hash table.
     m_hash_table[entry] = (static_cast<uint64_t>(m_data_offset) << 32)
                         | (static_cast<uint64_t>(coord.primary_hash) & 0xffffffffULL);
+    bloom_insert(bloom_hash(static_cast<uint32_t>(coord.primary_hash), key));
 
     // Update the offsets
     ++m_search_offset;
     uint32_t new_data_offset = (curr_offset + 7) & ~7; // Keep everything 8-byte aligned.
 
-    // Flush if we've written over 4MB without flushing.
-    if ((m_data_offset & ~(1 << 22)) != (new_data_offset & ~(1 << 22)))
-    {
-        //async();
-    }
-
     if (cached)
     {
         *cached = new_data_offset;
@@ -279,7 +338,7 @@ hyperdisk :: shard :: del(uint32_t primary_hash,
     }
 
     invalidate_search_log(table_offset, m_data_offset);
-    m_data_offset += sizeof(uint64_t);
+    m_data_offset += del_size();
     m_hash_table[table_entry] = (static_cast<uint64_t>(table_offset) << 32)
                               | (static_cast<uint64_t>(HASH_OFFSET_INVALID) << 32)
                               | static_cast<uint64_t>(primary_hash);
@@ -301,13 +360,13 @@ hyperdisk :: shard :: stale_space() const
     uint32_t end;
     size_t i;
 
-    for (i = 1; i < SEARCH_INDEX_ENTRIES; ++i)
+    for (i = 1; i < m_geometry.search_entries; ++i)
     {
         end = m_search_log[i].offset;
 
         if (end == 0)
         {
-            end = std::min(m_data_offset, static_cast<uint32_t>(FILE_SIZE));
+            end = std::min(m_data_offset, static_cast<uint32_t>(file_size()));
             break;
         }
 
@@ -320,45 +379,46 @@ hyperdisk :: shard :: stale_space() const
         start = end;
     }
 
-    if (i == SEARCH_INDEX_ENTRIES)
+    if (i == m_geometry.search_entries)
     {
-        end = std::min(m_data_offset, static_cast<uint32_t>(FILE_SIZE));
+        end = std::min(m_data_offset, static_cast<uint32_t>(file_size()));
     }
 
     stale_data += end - start;
     stale_num += (end - start) ? 1 : 0;
 
-    double data = 100.0 * static_cast<double>(stale_data) / DATA_SEGMENT_SIZE;
-    double num = 100.0 * static_cast<double>(stale_num) / SEARCH_INDEX_ENTRIES;
+    double data = 100.0 * static_cast<double>(stale_data) / m_geometry.data_size;
+    double num = 100.0 * static_cast<double>(stale_num) / m_geometry.search_entries;
     return std::max(data, num);
 }
 
 int
 hyperdisk :: shard :: used_space() const
 {
-    double data = 100 * static_cast<double>(m_data_offset - INDEX_SEGMENT_SIZE)
-                        / DATA_SEGMENT_SIZE;
-    double num = 100 * static_cast<double>(m_search_offset) / SEARCH_INDEX_ENTRIES;
+    double data = 100 * static_cast<double>(m_data_offset - index_segment_size())
+                        / m_geometry.data_size;
+    double num = 100 * static_cast<double>(m_search_offset) / m_geometry.search_entries;
     return std::max(data, num);
 }
 
-hyperdisk::returncode
-hyperdisk :: shard :: async()
+uint64_t
+hyperdisk :: shard :: average_entry_size() const
 {
-    return SUCCESS;
-    if (msync(m_data, FILE_SIZE, MS_ASYNC) < 0)
+    if (m_search_offset == 0)
     {
-        return SYNCFAILED;
+        return 0;
     }
 
-    return SUCCESS;
+    uint32_t end = std::min(m_data_offset, static_cast<uint32_t>(file_size()));
+    return (end - index_segment_size()) / m_search_offset;
 }
 
 hyperdisk::returncode
 hyperdisk :: shard :: sync()
 {
-    return SUCCESS;
-    if (msync(m_data, FILE_SIZE, MS_SYNC) < 0)
+    write_header();
+
+    if (msync(m_header, mapped_size(), MS_SYNC) < 0)
     {
         return SYNCFAILED;
     }
@@ -366,16 +426,20 @@ hyperdisk :: shard :: sync()
     return SUCCESS;
 }
 
-void
+hyperdisk::returncode
 hyperdisk :: shard :: copy_to(const coordinate& c, e::intrusive_ptr<shard> s)
 {
     assert(m_data != s->m_data); // LCOV_EXCL_LINE
-    memset(s->m_hash_table, 0, HASH_TABLE_SIZE);
-    memset(s->m_search_log, 0, SEARCH_INDEX_SIZE);
-    s->m_data_offset = INDEX_SEGMENT_SIZE;
+    begin_scan();
+    e::guard g = e::makeobjguard(*this, &shard::end_scan);
+    memset(s->m_hash_table, 0, s->index_segment_size());
+    s->m_data_offset = s->index_segment_size();
     s->m_search_offset = 0;
+    s->m_value_bytes = 0;
+    s->m_stored_value_bytes = 0;
+    std::tr1::shared_ptr<e::buffer> decompressed;
 
-    for (size_t ent = 0; ent < SEARCH_INDEX_ENTRIES; ++ent)
+    for (size_t ent = 0; ent < m_geometry.search_entries; ++ent)
     {
         // Skip stale entries.
         if (m_search_log[ent].invalid != 0)
@@ -400,21 +464,25 @@ hyperdisk :: shard :: copy_to(const coordinate& c, e::intrusive_ptr<shard> s)
 
         uint32_t entry_end = 0;
 
-        if (ent < SEARCH_INDEX_ENTRIES - 1 && m_search_log[ent + 1].offset)
+        if (ent < m_geometry.search_entries - 1 && m_search_log[ent + 1].offset)
         {
             entry_end = m_search_log[ent + 1].offset;
         }
         else
         {
-            entry_end = std::min(m_data_offset, static_cast<uint32_t>(FILE_SIZE));
+            entry_end = std::min(m_data_offset, static_cast<uint32_t>(file_size()));
         }
 
+        // The other shard may have a different geometry.  The disk ensures
+        // that it is never smaller than this shard.
         assert(entry_start <= entry_end); // LCOV_EXCL_LINE
-        assert(entry_end <= FILE_SIZE); // LCOV_EXCL_LINE
-        assert(s->m_data_offset + (entry_end - entry_start) <= FILE_SIZE); // LCOV_EXCL_LINE
+        assert(entry_end <= file_size()); // LCOV_EXCL_LINE
+        assert(s->m_data_offset + (entry_end - entry_start) <= s->file_size()); // LCOV_EXCL_LINE
+        assert(s->m_search_offset < s->m_geometry.search_entries); // LCOV_EXCL_LINE
 
         // Copy the entry's data
         memmove(s->m_data + s->m_data_offset, m_data + entry_start, (entry_end - entry_start));
+        s->count_value(s->m_data_offset);
         // Insert into the search log.
         s->m_search_log[s->m_search_offset].offset = s->m_data_offset;
         s->m_search_log[s->m_search_offset].invalid = 0;
@@ -426,10 +494,182 @@ hyperdisk :: shard :: copy_to(const coordinate& c, e::intrusive_ptr<shard> s)
         s->hash_lookup(static_cast<uint32_t>(m_search_log[ent].primary), &bucket);
         s->m_hash_table[bucket] = (static_cast<uint64_t>(s->m_data_offset) << 32)
                                 | (static_cast<uint64_t>(m_search_log[ent].primary) & 0xffffffffULL);
+        e::slice key;
+        size_t key_size = data_key_size(entry_start);
+        data_key(entry_start, key_size, &key);
+        s->bloom_insert(bloom_hash(static_cast<uint32_t>(m_search_log[ent].primary), key));
+
+        if (s->m_geometry.columnar)
+        {
+            std::vector<e::slice> value;
+
+            if (data_value(entry_start, key_size, &value, &decompressed) != SUCCESS)
+            {
+                s->write_header();
+                return CORRUPT;
+            }
+
+            s->column_insert(s->m_search_offset, value);
+        }
+
         // Update the position trackers.
         ++s->m_search_offset;
         s->m_data_offset = (s->m_data_offset + (entry_end - entry_start) + 7) & ~7; // Keep everything 8-byte aligned.
     }
+
+    s->write_header();
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: shard :: copy_to(const coordinate& c,
+                              shard_snapshot snap,
+                              e::intrusive_ptr<shard> s)
+{
+    assert(m_data != s->m_data); // LCOV_EXCL_LINE
+    assert(snap.m_shard == this); // LCOV_EXCL_LINE
+    begin_scan();
+    e::guard g = e::makeobjguard(*this, &shard::end_scan);
+
+    for (; snap.valid(); snap.next())
+    {
+        if (!c.intersects(snap.coordinate()))
+        {
+            continue;
+        }
+
+        if (!data_checksum_ok(m_search_log[snap.m_entry].offset) || snap.corrupt())
+        {
+            return CORRUPT;
+        }
+
+        returncode ret = s->put(snap.coordinate(), snap.key(), snap.value(), snap.version());
+
+        if (ret != SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: shard :: copy_delta_to(const coordinate& c,
+                                    const shard_snapshot& snap,
+                                    e::intrusive_ptr<shard> s)
+{
+    copy_invalidated_to(c, snap, s);
+    return copy_appended_to(c, snap, s);
+}
+
+void
+hyperdisk :: shard :: copy_invalidated_to(const coordinate& c,
+                                          const shard_snapshot& snap,
+                                          e::intrusive_ptr<shard> s)
+{
+    assert(m_data != s->m_data); // LCOV_EXCL_LINE
+    assert(snap.m_shard == this); // LCOV_EXCL_LINE
+    const uint32_t limit = snap.m_limit;
+
+    // Every entry visible in the snapshot which has since been invalidated
+    // must be removed from the other shard.
+    for (uint32_t ent = 0; ent < m_search_offset && m_search_log[ent].offset < limit; ++ent)
+    {
+        const log_entry& le(m_search_log[ent]);
+
+        if (le.invalid < limit ||
+            !c.intersects(coordinate(UINT64_MAX, le.primary,
+                                     UINT64_MAX, le.lower,
+                                     UINT64_MAX, le.upper)))
+        {
+            continue;
+        }
+
+        e::slice key;
+        data_key(le.offset, data_key_size(le.offset), &key);
+        s->del(static_cast<uint32_t>(le.primary), key);
+    }
+}
+
+hyperdisk::returncode
+hyperdisk :: shard :: copy_appended_to(const coordinate& c,
+                                       const shard_snapshot& snap,
+                                       e::intrusive_ptr<shard> s)
+{
+    assert(m_data != s->m_data); // LCOV_EXCL_LINE
+    assert(snap.m_shard == this); // LCOV_EXCL_LINE
+    const uint32_t limit = snap.m_limit;
+    uint32_t ent = 0;
+    std::tr1::shared_ptr<e::buffer> decompressed;
+
+    while (ent < m_search_offset && m_search_log[ent].offset < limit)
+    {
+        ++ent;
+    }
+
+    // Every entry appended since the snapshot which is still current must be
+    // copied to the other shard.
+    for (; ent < m_search_offset; ++ent)
+    {
+        const log_entry& le(m_search_log[ent]);
+        coordinate lec(UINT64_MAX, le.primary,
+                       UINT64_MAX, le.lower,
+                       UINT64_MAX, le.upper);
+
+        if (le.invalid != 0 || !c.intersects(lec))
+        {
+            continue;
+        }
+
+        if (!data_checksum_ok(le.offset))
+        {
+            return CORRUPT;
+        }
+
+        e::slice key;
+        std::vector<e::slice> value;
+        size_t key_size = data_key_size(le.offset);
+        data_key(le.offset, key_size, &key);
+
+        if (data_value(le.offset, key_size, &value, &decompressed) != SUCCESS)
+        {
+            return CORRUPT;
+        }
+
+        returncode ret = s->put(lec, key, value, data_version(le.offset));
+
+        if (ret != SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: shard :: scrub(uint32_t* entry, uint32_t count)
+{
+    const uint32_t limit = std::min(m_search_offset, *entry + count);
+
+    if (*entry >= m_search_offset)
+    {
+        return DIDNOTHING;
+    }
+
+    for (; *entry < limit; ++*entry)
+    {
+        const log_entry& le(m_search_log[*entry]);
+
+        if (le.invalid == 0 && !data_checksum_ok(le.offset))
+        {
+            ++*entry;
+            return CORRUPT;
+        }
+    }
+
+    return SUCCESS;
 }
 
 bool
@@ -443,16 +683,11 @@ bool
 hyperdisk :: shard :: fsck(std::ostream& err)
 {
     bool ret = true;
-    bool hash_table[HASH_TABLE_ENTRIES];
     bool zero = false;
     uint32_t ent = 0;
+    std::tr1::shared_ptr<e::buffer> decompressed;
 
-    for (uint32_t i = 0; i < HASH_TABLE_ENTRIES; ++i)
-    {
-        hash_table[i] = false;
-    }
-
-    for (ent = 0; ent < SEARCH_INDEX_ENTRIES; ++ent)
+    for (ent = 0; ent < m_geometry.search_entries; ++ent)
     {
         if (m_search_log[ent].offset == 0)
         {
@@ -474,12 +709,50 @@ hyperdisk :: shard :: fsck(std::ostream& err)
             ret = false;
         }
 
+        if (!zero && !data_checksum_ok(m_search_log[ent].offset))
+        {
+            err << "entry " << ent << " at offset " << m_search_log[ent].offset
+                << " does not match its checksum" << std::endl;
+            ret = false;
+            continue;
+        }
+
         if (!zero)
         {
             uint32_t offset = m_search_log[ent].offset;
             e::slice key;
             size_t key_size = data_key_size(offset);
             data_key(offset, key_size, &key);
+            std::vector<e::slice> value;
+
+            if (data_value(offset, key_size, &value, &decompressed) != SUCCESS)
+            {
+                err << "entry " << ent << " at offset " << offset
+                    << " has a value which cannot be decompressed" << std::endl;
+                ret = false;
+            }
+
+            for (uint16_t attr = 0; attr < value.size() && attr < 64; ++attr)
+            {
+                const uint64_t* col = column(attr);
+                const uint64_t* zone = column_zones(attr);
+
+                if (!col)
+                {
+                    continue;
+                }
+
+                uint64_t val = hyperspacehashing::lendian(value[attr]);
+                zone += 2 * (ent / COLUMN_ZONE_ENTRIES);
+
+                if (col[ent] != val || zone[0] > val || val > zone[1])
+                {
+                    err << "entry " << ent << " has value " << val << " for attribute "
+                        << attr << " but its column holds " << col[ent]
+                        << " in a zone spanning [" << zone[0] << ", " << zone[1] << "]" << std::endl;
+                    ret = false;
+                }
+            }
 
             size_t table_entry;
             uint64_t table_value;
@@ -489,7 +762,10 @@ hyperdisk :: shard :: fsck(std::ostream& err)
 
             if (table_hash == static_cast<uint32_t>(m_search_log[ent].primary))
             {
-                if (table_offset < HASH_OFFSET_INVALID && m_search_log[ent].offset != table_offset)
+                // Entries which were overwritten no longer match the table.
+                if (table_offset < HASH_OFFSET_INVALID &&
+                    m_search_log[ent].invalid == 0 &&
+                    m_search_log[ent].offset != table_offset)
                 {
                     err << "entry " << ent << " in log and entry " << table_entry
                         << " in hash table do not match.\n"
@@ -540,45 +816,167 @@ hyperdisk :: shard :: make_snapshot()
     return shard_snapshot(m_data_offset, this);
 }
 
-hyperdisk :: shard :: shard(po6::io::fd* fd)
+uint64_t
+hyperdisk :: shard :: bloom_hash(uint32_t primary_hash, const e::slice& key)
+{
+    return hyperspacehashing::cityhash(key) ^ (primary_hash * 0x9e3779b97f4a7c15ULL);
+}
+
+bool
+hyperdisk :: shard :: may_contain(uint64_t h) const
+{
+    uint64_t word = m_bloom[(h >> 32) & (bloom_filter_size() / sizeof(uint64_t) - 1)];
+
+    for (int i = 0; i < BLOOM_FILTER_PROBES; ++i)
+    {
+        if (!(word & (1ULL << ((h >> (6 * i)) & 63))))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+coordinate
+hyperdisk :: shard :: get_coordinate() const
+{
+    return m_coord;
+}
+
+void
+hyperdisk :: shard :: set_coordinate(const coordinate& c)
+{
+    m_coord = c;
+    write_header();
+}
+
+hyperdisk :: shard :: shard(po6::io::fd* fd, const geometry& g)
     : m_ref(0)
+    , m_scans(0)
+    , m_geometry(g)
+    , m_header(NULL)
     , m_hash_table(NULL)
     , m_search_log(NULL)
+    , m_bloom(NULL)
+    , m_columns(NULL)
     , m_data(NULL)
-    , m_data_offset(INDEX_SEGMENT_SIZE)
+    , m_data_offset(index_segment_size())
     , m_search_offset(0)
+    , m_coord()
+    , m_compressor(compressor::lookup(g.compression))
+    , m_raw_value()
+    , m_packed_value()
+    , m_value_bytes(0)
+    , m_stored_value_bytes(0)
+    , m_reads(0)
+    , m_heat(0)
+    , m_heat_calls(0)
+    , m_heat_offset(0)
 {
     assert(SEARCH_INDEX_ENTRY_SIZE == sizeof(hyperdisk::shard::log_entry));
-    m_data = static_cast<char*>(mmap(NULL, FILE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd->get(), 0));
+    assert(sizeof(hyperdisk::shard::header) <= SHARD_HEADER_SIZE);
+    void* base = mmap(NULL, mapped_size(), PROT_READ|PROT_WRITE, MAP_SHARED, fd->get(), 0);
 
-    if (m_data == MAP_FAILED)
+    if (base == MAP_FAILED)
     {
         throw po6::error(errno);
     }
 
-    if (madvise(m_data, HASH_TABLE_SIZE, MADV_WILLNEED) < 0)
+    m_header = static_cast<header*>(base);
+    m_data = static_cast<char*>(base) + SHARD_HEADER_SIZE;
+    // GETs probe the hash table at random, and every operation touches the
+    // index segment, so keep it resident.  Huge pages only help shards whose
+    // index is larger than a huge page.
+#ifdef MADV_HUGEPAGE
+    madvise(m_data, index_segment_size(), MADV_HUGEPAGE);
+#endif
+    madvise(m_data, index_segment_size(), MADV_WILLNEED);
+    // Outside of scans, the data segment is read one object at a time, so
+    // readahead is wasted.
+    madvise(m_data + index_segment_size(), m_geometry.data_size, MADV_RANDOM);
+
+    m_hash_table = reinterpret_cast<uint64_t*>(m_data);
+    m_search_log = reinterpret_cast<log_entry*>(m_data + hash_table_size());
+    m_columns = reinterpret_cast<uint64_t*>(m_data + index_segment_size() - column_segment_size(m_geometry));
+    m_bloom = reinterpret_cast<uint64_t*>(reinterpret_cast<char*>(m_columns) - bloom_filter_size());
+}
+
+uint64_t
+hyperdisk :: shard :: heat(uint64_t* calls)
+{
+    uint64_t reads = __sync_lock_test_and_set(&m_reads, 0);
+    uint32_t offset = m_search_offset;
+
+    // The entries in a shard when it is first measured were copied from
+    // another shard or recovered when opening it, rather than written.
+    if (m_heat_calls == 0)
     {
-        throw po6::error(errno);
+        m_heat_offset = offset;
+    }
+
+    m_heat = m_heat / 2 + reads + (offset - std::min(m_heat_offset, offset));
+    m_heat_offset = offset;
+    *calls = ++m_heat_calls;
+    return m_heat;
+}
+
+void
+hyperdisk :: shard :: begin_scan()
+{
+    if (__sync_add_and_fetch(&m_scans, 1) == 1)
+    {
+        madvise(m_data + index_segment_size(), m_geometry.data_size, MADV_SEQUENTIAL);
     }
+}
 
-    if (madvise(m_data + HASH_TABLE_SIZE, SEARCH_INDEX_SIZE, MADV_WILLNEED) < 0)
+void
+hyperdisk :: shard :: end_scan()
+{
+    if (__sync_sub_and_fetch(&m_scans, 1) == 0)
     {
-        throw po6::error(errno);
+        madvise(m_data + index_segment_size(), m_geometry.data_size, MADV_RANDOM);
     }
+}
 
-    if (madvise(m_data + INDEX_SEGMENT_SIZE, DATA_SEGMENT_SIZE, MADV_SEQUENTIAL) < 0)
+void
+hyperdisk :: shard :: prefetch(uint32_t offset, size_t length) const
+{
+    // Offsets are relative to the end of the page-aligned header.
+    size_t start = std::max(static_cast<size_t>(offset), index_segment_size()) & ~4095ULL;
+    size_t end = std::min(static_cast<size_t>(offset) + length, file_size());
+
+    if (start < end)
     {
-        throw po6::error(errno);
+        madvise(m_data + start, end - start, MADV_WILLNEED);
     }
+}
 
-    m_hash_table = reinterpret_cast<uint64_t*>(m_data);
-    m_search_log = reinterpret_cast<log_entry*>(m_data + HASH_TABLE_SIZE);
+void
+hyperdisk :: shard :: release()
+{
+    madvise(m_header, mapped_size(), MADV_DONTNEED);
+}
+
+void
+hyperdisk :: shard :: reset()
+{
+    // The data segment is unreachable once the index is cleared, so it need
+    // not be zeroed.
+    memset(m_data, 0, index_segment_size());
+    m_data_offset = index_segment_size();
+    m_search_offset = 0;
+    m_coord = coordinate();
+    m_value_bytes = 0;
+    m_stored_value_bytes = 0;
+    write_header();
 }
 
 hyperdisk :: shard :: ~shard()
                     throw ()
 {
-    munmap(m_data, FILE_SIZE);
+    write_header();
+    munmap(m_header, mapped_size());
 }
 
 size_t
@@ -587,7 +985,8 @@ hyperdisk :: shard :: data_size(const e::slice& key,
 {
     size_t hypothetical_size = sizeof(uint64_t) + sizeof(uint32_t)
                              + sizeof(uint16_t) + key.size()
-                             + sizeof(uint32_t) * value.size();
+                             + sizeof(uint32_t) * value.size()
+                             + ENTRY_CHECKSUM_SIZE;
 
     for (size_t i = 0; i < value.size(); ++i)
     {
@@ -621,26 +1020,188 @@ hyperdisk :: shard :: data_key(uint32_t offset,
     *key = e::slice(m_data + cur_offset, keysize);
 }
 
-void
+hyperdisk::returncode
 hyperdisk :: shard :: data_value(uint32_t offset,
                                  size_t keysize,
-                                 std::vector<e::slice>* value) const
+                                 std::vector<e::slice>* value,
+                                 std::tr1::shared_ptr<e::buffer>* backing) const
 {
     assert(((offset + 7) & ~7) == offset); // LCOV_EXCL_LINE
     uint32_t cur_offset = offset + sizeof(uint64_t) + sizeof(uint32_t) + keysize;
     uint16_t num_dims;
     memmove(&num_dims, m_data + cur_offset, sizeof(uint16_t));
     cur_offset += sizeof(uint16_t);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_data) + cur_offset;
     value->clear();
 
+    if (num_dims & COMPRESSED_VALUE)
+    {
+        uint16_t id;
+        uint32_t raw;
+        uint32_t packed;
+        memmove(&id, data, sizeof(id));
+        memmove(&raw, data + sizeof(id), sizeof(raw));
+        memmove(&packed, data + sizeof(id) + sizeof(raw), sizeof(packed));
+        const compressor* c = m_compressor && m_compressor->id() == id ?
+                              m_compressor : compressor::lookup(id);
+        assert(backing); // LCOV_EXCL_LINE
+
+        if (!backing->get() || !backing->unique() || (*backing)->capacity() < raw)
+        {
+            backing->reset(e::buffer::create(raw));
+        }
+
+        // replay rejects entries whose compressor is missing, so this means
+        // the shard is corrupt, and there is no value to return.
+        if (!c || !c->decompress(data + COMPRESSED_VALUE_HEADER, packed,
+                                 (*backing)->data(), raw))
+        {
+            return CORRUPT;
+        }
+
+        (*backing)->resize(raw);
+        data = (*backing)->data();
+        num_dims &= ~COMPRESSED_VALUE;
+        const uint8_t* end = data + raw;
+
+        // The sizes of the attributes come from the decompressed bytes, which
+        // data_entry_end never saw.
+        for (uint16_t i = 0; i < num_dims; ++i)
+        {
+            uint32_t size;
+
+            if (static_cast<size_t>(end - data) < sizeof(size))
+            {
+                value->clear();
+                return CORRUPT;
+            }
+
+            memmove(&size, data, sizeof(size));
+            data += sizeof(size);
+
+            if (static_cast<size_t>(end - data) < size)
+            {
+                value->clear();
+                return CORRUPT;
+            }
+
+            value->push_back(e::slice(data, size));
+            data += size;
+        }
+
+        return SUCCESS;
+    }
+
     for (uint16_t i = 0; i < num_dims; ++i)
     {
         uint32_t size;
-        memmove(&size, m_data + cur_offset, sizeof(size));
-        cur_offset += sizeof(size);
-        value->push_back(e::slice(m_data + cur_offset, size));
-        cur_offset += size;
+        memmove(&size, data, sizeof(size));
+        data += sizeof(size);
+        value->push_back(e::slice(data, size));
+        data += size;
     }
+
+    return SUCCESS;
+}
+
+uint32_t
+hyperdisk :: shard :: data_put_value(uint32_t offset, const std::vector<e::slice>& value)
+{
+    uint16_t arity = value.size();
+    assert(!(arity & COMPRESSED_VALUE)); // LCOV_EXCL_LINE
+    uint32_t raw = sizeof(uint32_t) * value.size();
+
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        raw += value[i].size();
+    }
+
+    m_value_bytes += raw;
+
+    if (m_compressor && raw > 0)
+    {
+        m_raw_value.resize(raw);
+        uint8_t* ptr = &m_raw_value[0];
+
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            uint32_t size = value[i].size();
+            memmove(ptr, &size, sizeof(size));
+            ptr += sizeof(size);
+            memmove(ptr, value[i].data(), value[i].size());
+            ptr += value[i].size();
+        }
+
+        m_packed_value.resize(m_compressor->bound(raw));
+        uint32_t packed = m_compressor->compress(&m_raw_value[0], raw, &m_packed_value[0]);
+
+        // Only keep the compressed value if it takes less space, so that
+        // stored_size remains an upper bound.
+        if (packed + COMPRESSED_VALUE_HEADER < raw)
+        {
+            uint16_t flagged = arity | COMPRESSED_VALUE;
+            uint16_t id = m_compressor->id();
+            memmove(m_data + offset, &flagged, sizeof(flagged));
+            offset += sizeof(flagged);
+            memmove(m_data + offset, &id, sizeof(id));
+            offset += sizeof(id);
+            memmove(m_data + offset, &raw, sizeof(raw));
+            offset += sizeof(raw);
+            memmove(m_data + offset, &packed, sizeof(packed));
+            offset += sizeof(packed);
+            memmove(m_data + offset, &m_packed_value[0], packed);
+            offset += packed;
+            m_stored_value_bytes += packed + COMPRESSED_VALUE_HEADER;
+            return offset;
+        }
+    }
+
+    memmove(m_data + offset, &arity, sizeof(arity));
+    offset += sizeof(arity);
+
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        uint32_t size = value[i].size();
+        memmove(m_data + offset, &size, sizeof(size));
+        offset += sizeof(size);
+        memmove(m_data + offset, value[i].data(), value[i].size());
+        offset += value[i].size();
+    }
+
+    m_stored_value_bytes += raw;
+    return offset;
+}
+
+void
+hyperdisk :: shard :: count_value(uint32_t offset)
+{
+    uint32_t cur_offset = data_key_offset(offset) + data_key_size(offset);
+    uint16_t num_dims;
+    memmove(&num_dims, m_data + cur_offset, sizeof(uint16_t));
+    cur_offset += sizeof(uint16_t);
+
+    if (num_dims & COMPRESSED_VALUE)
+    {
+        uint32_t raw;
+        uint32_t packed;
+        memmove(&raw, m_data + cur_offset + sizeof(uint16_t), sizeof(raw));
+        memmove(&packed, m_data + cur_offset + sizeof(uint16_t) + sizeof(raw), sizeof(packed));
+        m_value_bytes += raw;
+        m_stored_value_bytes += packed + COMPRESSED_VALUE_HEADER;
+        return;
+    }
+
+    uint64_t raw = 0;
+
+    for (uint16_t i = 0; i < num_dims; ++i)
+    {
+        uint32_t size;
+        memmove(&size, m_data + cur_offset + raw, sizeof(size));
+        raw += sizeof(size) + size;
+    }
+
+    m_value_bytes += raw;
+    m_stored_value_bytes += raw;
 }
 
 // This hash lookup preserves the property that once a location in the table is
@@ -649,31 +1210,35 @@ void
 hyperdisk :: shard :: hash_lookup(uint32_t primary_hash, const e::slice& key,
                                   size_t* entry, uint64_t* value)
 {
-    size_t start = HASH_INTO_TABLE(primary_hash);
+    size_t start = hash_into_table(primary_hash) & ~static_cast<size_t>(HASH_TABLE_BUCKET_ENTRIES - 1);
 
-    for (size_t off = 0; off < HASH_TABLE_ENTRIES; ++off)
+    for (size_t off = 0; off < m_geometry.hash_entries(); off += HASH_TABLE_BUCKET_ENTRIES)
     {
-        size_t bucket = HASH_INTO_TABLE(start + off);
-        uint64_t this_entry = m_hash_table[bucket];
-        uint32_t this_hash = static_cast<uint32_t>(this_entry);
-        uint32_t this_offset = static_cast<uint32_t>(this_entry >> 32) & (HASH_OFFSET_INVALID - 1);
+        size_t bucket = hash_into_table(start + off);
+        unsigned found = probe_hash_bucket(m_hash_table + bucket, primary_hash);
+        // One bit per entry which either matches or is empty, in probe order.
+        unsigned candidates = (found | (found >> 1)) & 0x5555;
 
-        if (this_hash == primary_hash)
+        while (candidates)
         {
-            size_t key_size = data_key_size(this_offset);
+            unsigned bit = __builtin_ctz(candidates);
+            size_t this_bucket = bucket + bit / 2;
+            uint64_t this_entry = m_hash_table[this_bucket];
+            candidates &= candidates - 1;
 
-            if (key_size == key.size() &&
-                memcmp(m_data + data_key_offset(this_offset), key.data(), key_size) == 0)
+            if (!(found & (2U << bit)))
             {
-                *entry = bucket;
-                *value = this_entry;
-                return;
+                uint32_t this_offset = static_cast<uint32_t>(this_entry >> 32) & (HASH_OFFSET_INVALID - 1);
+                size_t key_size = data_key_size(this_offset);
+
+                if (key_size != key.size() ||
+                    memcmp(m_data + data_key_offset(this_offset), key.data(), key_size) != 0)
+                {
+                    continue;
+                }
             }
-        }
 
-        if (static_cast<uint32_t>(this_entry >> 32) == 0)
-        {
-            *entry = bucket;
+            *entry = this_bucket;
             *value = this_entry;
             return;
         }
@@ -685,16 +1250,16 @@ hyperdisk :: shard :: hash_lookup(uint32_t primary_hash, const e::slice& key,
 void
 hyperdisk :: shard :: hash_lookup(uint32_t primary_hash, size_t* entry)
 {
-    size_t start = HASH_INTO_TABLE(primary_hash);
+    size_t start = hash_into_table(primary_hash) & ~static_cast<size_t>(HASH_TABLE_BUCKET_ENTRIES - 1);
 
-    for (size_t off = 0; off < HASH_TABLE_ENTRIES; ++off)
+    for (size_t off = 0; off < m_geometry.hash_entries(); off += HASH_TABLE_BUCKET_ENTRIES)
     {
-        size_t bucket = HASH_INTO_TABLE(start + off);
-        uint64_t this_entry = m_hash_table[bucket];
+        size_t bucket = hash_into_table(start + off);
+        unsigned empty = probe_hash_bucket(m_hash_table + bucket, primary_hash) & 0xaaaa;
 
-        if (static_cast<uint32_t>(this_entry >> 32) == 0)
+        if (empty)
         {
-            *entry = bucket;
+            *entry = bucket + __builtin_ctz(empty) / 2;
             return;
         }
     }
@@ -706,7 +1271,7 @@ void
 hyperdisk :: shard :: invalidate_search_log(uint32_t to_invalidate, uint32_t invalidate_with)
 {
     int64_t low = 0;
-    int64_t high = SEARCH_INDEX_ENTRIES;
+    int64_t high = m_geometry.search_entries;
 
     while (low <= high)
     {
@@ -728,3 +1293,354 @@ hyperdisk :: shard :: invalidate_search_log(uint32_t to_invalidate, uint32_t inv
         }
     }
 }
+
+void
+hyperdisk :: shard :: bloom_insert(uint64_t h)
+{
+    uint64_t* word = m_bloom + ((h >> 32) & (bloom_filter_size() / sizeof(uint64_t) - 1));
+
+    for (int i = 0; i < BLOOM_FILTER_PROBES; ++i)
+    {
+        *word |= 1ULL << ((h >> (6 * i)) & 63);
+    }
+}
+
+void
+hyperdisk :: shard :: column_insert(uint32_t entry, const std::vector<e::slice>& value)
+{
+    if (!m_geometry.columnar)
+    {
+        return;
+    }
+
+    for (uint16_t attr = 0; attr < value.size() && attr < 64; ++attr)
+    {
+        uint64_t* col = column(attr);
+
+        if (!col)
+        {
+            continue;
+        }
+
+        uint64_t val = hyperspacehashing::lendian(value[attr]);
+        uint64_t* zone = column_zones(attr) + 2 * (entry / COLUMN_ZONE_ENTRIES);
+        col[entry] = val;
+
+        if (entry % COLUMN_ZONE_ENTRIES == 0)
+        {
+            zone[0] = val;
+            zone[1] = val;
+        }
+        else
+        {
+            zone[0] = std::min(zone[0], val);
+            zone[1] = std::max(zone[1], val);
+        }
+    }
+}
+
+uint32_t
+hyperdisk :: shard :: column_zone_end(uint32_t entry, const column_filter& f) const
+{
+    for (size_t i = 0; i < f.size(); ++i)
+    {
+        if (column(f.attr(i)))
+        {
+            return (entry / COLUMN_ZONE_ENTRIES + 1) * COLUMN_ZONE_ENTRIES;
+        }
+    }
+
+    return m_geometry.search_entries;
+}
+
+bool
+hyperdisk :: shard :: column_zone_matches(uint32_t entry, const column_filter& f) const
+{
+    for (size_t i = 0; i < f.size(); ++i)
+    {
+        const uint64_t* zone = column_zones(f.attr(i));
+
+        if (zone)
+        {
+            zone += 2 * (entry / COLUMN_ZONE_ENTRIES);
+
+            if (!f.overlaps(i, zone[0], zone[1]))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool
+hyperdisk :: shard :: column_matches(uint32_t entry, const column_filter& f) const
+{
+    for (size_t i = 0; i < f.size(); ++i)
+    {
+        const uint64_t* col = column(f.attr(i));
+
+        if (col && !f.matches(i, col[entry]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t*
+hyperdisk :: shard :: column(uint16_t attr) const
+{
+    if (attr >= 64 || !(m_geometry.columnar & (1ULL << attr)))
+    {
+        return NULL;
+    }
+
+    uint64_t slot = __builtin_popcountll(m_geometry.columnar & ((1ULL << attr) - 1));
+    return m_columns + slot * m_geometry.search_entries;
+}
+
+uint64_t*
+hyperdisk :: shard :: column_zones(uint16_t attr) const
+{
+    if (attr >= 64 || !(m_geometry.columnar & (1ULL << attr)))
+    {
+        return NULL;
+    }
+
+    uint64_t slot = __builtin_popcountll(m_geometry.columnar & ((1ULL << attr) - 1));
+    uint64_t zones = m_geometry.search_entries / COLUMN_ZONE_ENTRIES;
+    return m_columns + m_geometry.columns() * m_geometry.search_entries + slot * 2 * zones;
+}
+
+void
+hyperdisk :: shard :: write_header()
+{
+    m_header->magic = SHARD_MAGIC;
+    m_header->version = SHARD_VERSION;
+    m_header->data_offset = m_data_offset;
+    m_header->search_offset = m_search_offset;
+    m_header->search_entries = m_geometry.search_entries;
+    m_header->data_size = m_geometry.data_size;
+    m_header->compression = m_geometry.compression;
+    m_header->columnar = m_geometry.columnar;
+    m_header->primary_mask = m_coord.primary_mask;
+    m_header->primary_hash = m_coord.primary_hash;
+    m_header->secondary_lower_mask = m_coord.secondary_lower_mask;
+    m_header->secondary_lower_hash = m_coord.secondary_lower_hash;
+    m_header->secondary_upper_mask = m_coord.secondary_upper_mask;
+    m_header->secondary_upper_hash = m_coord.secondary_upper_hash;
+    m_header->value_bytes = m_value_bytes;
+    m_header->stored_value_bytes = m_stored_value_bytes;
+    m_header->checksum = header_checksum(*m_header);
+    memmove(reinterpret_cast<char*>(m_header) + SHARD_HEADER_COPY_OFFSET,
+            m_header, sizeof(header));
+}
+
+bool
+hyperdisk :: shard :: read_header(const po6::io::fd& fd, off_t offset, header* h)
+{
+    if (pread(fd.get(), h, sizeof(header), offset) != static_cast<ssize_t>(sizeof(header)))
+    {
+        return false;
+    }
+
+    geometry g(h->search_entries, h->data_size, h->columnar, h->compression);
+    return h->magic == SHARD_MAGIC &&
+           h->version == SHARD_VERSION &&
+           h->checksum == header_checksum(*h) &&
+           h->compression == g.compression &&
+           g.valid();
+}
+
+uint64_t
+hyperdisk :: shard :: header_checksum(const header& h)
+{
+    e::slice s(reinterpret_cast<const uint8_t*>(&h),
+               sizeof(header) - sizeof(uint64_t));
+    return hyperspacehashing::cityhash(s);
+}
+
+bool
+hyperdisk :: shard :: replay()
+{
+    if (m_header->data_offset < index_segment_size() ||
+        m_header->search_offset > m_geometry.search_entries)
+    {
+        return false;
+    }
+
+    m_coord = coordinate(m_header->primary_mask, m_header->primary_hash,
+                         m_header->secondary_lower_mask, m_header->secondary_lower_hash,
+                         m_header->secondary_upper_mask, m_header->secondary_upper_hash);
+    m_search_offset = m_header->search_offset;
+    m_data_offset = index_segment_size();
+    m_value_bytes = m_header->value_bytes;
+    m_stored_value_bytes = m_header->stored_value_bytes;
+
+    if (m_search_offset > 0)
+    {
+        uint32_t end = data_entry_end(m_search_log[m_search_offset - 1].offset);
+
+        if (end == 0)
+        {
+            return false;
+        }
+
+        m_data_offset = (end + 7) & ~7; // Keep everything 8-byte aligned.
+    }
+
+    // A PUT writes its data before linking it into the search log, so every
+    // linked entry which lies within the shard is complete.  The hash table
+    // update for the entry may have been lost, so redo it.
+    std::tr1::shared_ptr<e::buffer> decompressed;
+
+    while (m_search_offset < m_geometry.search_entries)
+    {
+        log_entry* ent = m_search_log + m_search_offset;
+        uint32_t end = 0;
+
+        if (ent->offset >= m_data_offset)
+        {
+            end = data_entry_end(ent->offset);
+        }
+
+        if (end == 0)
+        {
+            break;
+        }
+
+        // An entry whose value cannot be read ends the log, just as one which
+        // was only partly written.
+        std::vector<e::slice> value;
+
+        if (m_geometry.columnar &&
+            data_value(ent->offset, data_key_size(ent->offset), &value, &decompressed) != SUCCESS)
+        {
+            break;
+        }
+
+        if (ent->invalid == 0)
+        {
+            e::slice key;
+            data_key(ent->offset, data_key_size(ent->offset), &key);
+            size_t entry;
+            uint64_t table_value;
+            hash_lookup(static_cast<uint32_t>(ent->primary), key, &entry, &table_value);
+            m_hash_table[entry] = (static_cast<uint64_t>(ent->offset) << 32)
+                                | (ent->primary & 0xffffffffULL);
+            bloom_insert(bloom_hash(static_cast<uint32_t>(ent->primary), key));
+        }
+
+        if (m_geometry.columnar)
+        {
+            column_insert(m_search_offset, value);
+        }
+
+        count_value(ent->offset);
+        ++m_search_offset;
+        m_data_offset = (end + 7) & ~7; // Keep everything 8-byte aligned.
+    }
+
+    // A DEL advances the data offset without writing any data.  Keep the data
+    // offset beyond every invalidation so that snapshots remain consistent.
+    m_data_offset = std::max(m_data_offset, m_header->data_offset);
+
+    for (uint32_t i = 0; i < m_search_offset; ++i)
+    {
+        if (m_search_log[i].invalid >= m_data_offset)
+        {
+            m_data_offset = m_search_log[i].invalid + sizeof(uint64_t);
+        }
+    }
+
+    return true;
+}
+
+uint32_t
+hyperdisk :: shard :: data_entry_end(uint32_t offset) const
+{
+    if (offset < index_segment_size() || ((offset + 7) & ~7) != offset ||
+        data_key_offset(offset) > file_size())
+    {
+        return 0;
+    }
+
+    uint64_t end = data_key_offset(offset) + data_key_size(offset);
+
+    if (end + sizeof(uint16_t) > file_size())
+    {
+        return 0;
+    }
+
+    uint16_t num_dims;
+    memmove(&num_dims, m_data + end, sizeof(uint16_t));
+    end += sizeof(uint16_t);
+
+    if (num_dims & COMPRESSED_VALUE)
+    {
+        uint16_t id;
+        uint32_t packed;
+
+        if (end + COMPRESSED_VALUE_HEADER > file_size())
+        {
+            return 0;
+        }
+
+        memmove(&id, m_data + end, sizeof(id));
+        memmove(&packed, m_data + end + sizeof(id) + sizeof(uint32_t), sizeof(packed));
+        end += COMPRESSED_VALUE_HEADER + packed;
+
+        if (end > file_size() || !compressor::lookup(id))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        for (uint16_t i = 0; i < num_dims; ++i)
+        {
+            uint32_t size;
+
+            if (end + sizeof(size) > file_size())
+            {
+                return 0;
+            }
+
+            memmove(&size, m_data + end, sizeof(size));
+            end += sizeof(size) + size;
+
+            if (end > file_size())
+            {
+                return 0;
+            }
+        }
+    }
+
+    end += ENTRY_CHECKSUM_SIZE;
+    return end <= file_size() ? end : 0;
+}
+
+uint32_t
+hyperdisk :: shard :: data_checksum(uint32_t offset, uint32_t end) const
+{
+    e::slice entry(m_data + offset, end - offset);
+    return static_cast<uint32_t>(hyperspacehashing::cityhash(entry));
+}
+
+bool
+hyperdisk :: shard :: data_checksum_ok(uint32_t offset) const
+{
+    uint32_t end = data_entry_end(offset);
+
+    if (end == 0)
+    {
+        return false;
+    }
+
+    uint32_t checksum;
+    memmove(&checksum, m_data + end - ENTRY_CHECKSUM_SIZE, sizeof(checksum));
+    return checksum == data_checksum(offset, end - ENTRY_CHECKSUM_SIZE);
+}
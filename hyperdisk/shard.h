@@ -28,10 +28,15 @@
 #ifndef hyperdisk_shard_h_
 #define hyperdisk_shard_h_
 
+// STL
+#include <tr1/memory>
+#include <vector>
+
 // po6
 #include <po6/pathname.h>
 
 // e
+#include <e/buffer.h>
 #include <e/intrusive_ptr.h>
 #include <e/slice.h>
 
@@ -39,11 +44,15 @@
 #include "hyperspacehashing/hyperspacehashing/mask.h"
 
 // HyperDisk
+#include "hyperdisk/hyperdisk/geometry.h"
 #include "hyperdisk/hyperdisk/returncode.h"
+#include "hyperdisk/shard_constants.h"
 
 // Forward Declarations
 namespace hyperdisk
 {
+class column_filter;
+class compressor;
 class shard_snapshot;
 }
 
@@ -56,7 +65,7 @@ class shard_snapshot;
 //    order to return an accurate result and a failure to do so will lead to an
 //    increased number of false negatives.  These are possible anyway so it is
 //    not an issue.
-//  - Async/Sync require no special locking (they just call msync).
+//  - Sync requires no special locking (it just calls msync).
 //  - Making a snapshot requires a READ lock exclusive with PUT or DEL
 //    operations.
 //  - There is no guarantee about GET operations concurrent with PUT or
@@ -69,7 +78,9 @@ class shard_snapshot;
 // The hash table's entries are 64-bits in size.  The high-order 32-bit
 // number is the offset in the table at which the indexed object may be
 // fount.  The low-order 32-bit number is the hash used to index the
-// table.
+// table.  The entries are grouped into cache-line-sized buckets, which are
+// probed whole (see hash_table_probe.h), so that a lookup only reads the data
+// segment for entries whose hash matches.
 //
 // The append-only log's entries are 128-bits in size.  The first of the
 // 64-bit numbers is a combination of both the primary and secondary
@@ -81,6 +92,28 @@ class shard_snapshot;
 //
 // Entries are set/read as 64-bit words and then bitshifting is applied
 // to get high/low numbers.
+//
+// The Bloom filter follows the append-only log.  It is blocked:  each key
+// sets BLOOM_FILTER_PROBES bits within a single 64-bit word, so a lookup
+// touches one cache line.  Entries are never removed from the filter, so it
+// only becomes exact again when the shard is copied.
+//
+// The columns follow the Bloom filter.  Entry i of a column holds the value of
+// the attribute for entry i in the append-only log.  After the columns come
+// their zone maps.  Both are maintained alongside the search log, so that
+// zone maps only ever widen and a snapshot may read them concurrently with
+// PUT operations.
+//
+// If the geometry names a compressor, the value of each object is compressed
+// as it is written, unless that would not save space.  Every entry records
+// whether (and how) its value is compressed, so entries may be copied between
+// shards as they are.  Compressed values are decompressed only when read.
+//
+// Every entry ends with a checksum of its bytes (see ENTRY_CHECKSUM_SIZE).
+// GET verifies it only when asked, as it costs a pass over the value; copying
+// an entry to another shard always verifies it, so that corruption is not
+// laundered into a fresh checksum.  Scrubbing walks the live entries in the
+// background to find corruption before it is read.
 
 namespace hyperdisk
 {
@@ -90,19 +123,40 @@ class shard
     public:
         // Create will create a newly initialized shard at the given filename,
         // even if it already exists.  That is, it will overwrite the existing
-        // shard (or other file) at "filename".
+        // shard (or other file) at "filename".  The shard is laid out
+        // according to "g", which must be valid.  The file is sparse, but its
+        // space is reserved where the filesystem allows.
         static e::intrusive_ptr<shard> create(const po6::io::fd& dir,
-                                              const po6::pathname& filename);
-        // Open an existing shard.  This will fail if the file doesn't exist.
-        // XXX No sanity checking is done on the shard.
-        // XXX This method is broken.  It does not restore the offsets.
+                                              const po6::pathname& filename,
+                                              const geometry& g = geometry());
+        // Open an existing shard.  This will fail if the file doesn't exist,
+        // or if both copies of its header are corrupt.  The geometry and
+        // offsets are restored from the header and rolled forward over any
+        // entries appended after the header was last written.
         static e::intrusive_ptr<shard> open(const po6::io::fd& dir,
                                             const po6::pathname& filename);
+        // Recover a shard which cannot be opened because its header is lost,
+        // given the geometry it was created with and its coordinate.  Every
+        // complete entry in the search log is recovered.  This will fail if
+        // the file's size does not match "g", or if the recovered shard does
+        // not pass fsck.  A wrong geometry of the right size may still
+        // recover fewer entries than the shard holds.
+        static e::intrusive_ptr<shard> rebuild(const po6::io::fd& dir,
+                                               const po6::pathname& filename,
+                                               const geometry& g,
+                                               const hyperspacehashing::mask::coordinate& c);
 
     public:
-        // May return SUCCESS or NOTFOUND.
+        // May return SUCCESS or NOTFOUND.  A compressed value is decompressed
+        // into "*backing", which the slices of "value" then point into.  It
+        // may be NULL only if the shard holds no compressed values.  If
+        // "verify" is set, the entry's checksum is checked first, and CORRUPT
+        // is returned if it does not match.  CORRUPT is also returned if the
+        // value cannot be decompressed.
         returncode get(uint32_t primary_hash, const e::slice& key,
-                       std::vector<e::slice>* value, uint64_t* version);
+                       std::vector<e::slice>* value, uint64_t* version,
+                       std::tr1::shared_ptr<e::buffer>* backing = NULL,
+                       bool verify = false);
         returncode get(uint32_t primary_hash, const e::slice& key);
         // May return SUCCESS, DATAFULL, HASHFULL, or SEARCHFULL.
         returncode put(const hyperspacehashing::mask::coordinate& coord,
@@ -121,22 +175,107 @@ class shard
         // How much space (as a percentage) is used by either current or stale
         // data.
         int used_space() const;
-        // May return SUCCESS or SYNCFAILED.  errno will be set to the reason
-        // the sync failed.
-        returncode async();
+        // The number of bytes a PUT of "key" and "value" or a DEL appends to
+        // the data segment.
+        // When the shard compresses values, this is an upper bound.
+        size_t put_size(const e::slice& key, const std::vector<e::slice>& value) const
+        { return (stored_size(key, value) + 7) & ~7; }
+        static size_t del_size() { return sizeof(uint64_t); }
+        // True if PUTs which append "entries" entries to the search log, and
+        // (together with any DELs in between) "bytes" bytes to the data
+        // segment, are certain to succeed.
+        bool has_room(uint64_t bytes, uint64_t entries) const
+        { return m_data_offset + bytes <= file_size() &&
+                 m_search_offset + entries <= m_geometry.search_entries; }
         // May return SUCCESS or SYNCFAILED.  errno will be set to the reason
         // the sync failed.
         returncode sync();
         // Copy all non-stale data from this shard to the other shard,
         // completely erasing all the data in the other shard.  Only
-        // entries which match the coordinate will be kept.
-        void copy_to(const hyperspacehashing::mask::coordinate& c, e::intrusive_ptr<shard> s);
+        // entries which match the coordinate will be kept.  May return
+        // SUCCESS or CORRUPT.
+        returncode copy_to(const hyperspacehashing::mask::coordinate& c, e::intrusive_ptr<shard> s);
+        // Copy the entries in "snap" (a snapshot of this shard) which match
+        // the coordinate to the other shard.  This only reads the portion of
+        // the shard covered by the snapshot, and so it may run concurrently
+        // with PUT/DEL operations.  May return SUCCESS, DATAFULL, SEARCHFULL
+        // or CORRUPT.
+        returncode copy_to(const hyperspacehashing::mask::coordinate& c,
+                           shard_snapshot snap, e::intrusive_ptr<shard> s);
+        // Bring the other shard (previously filled by copying "snap") up to
+        // date with the PUT/DEL operations performed on this shard since
+        // "snap" was taken.  This requires a lock exclusive with PUT or DEL
+        // operations.  May return SUCCESS, DATAFULL, SEARCHFULL or CORRUPT.
+        returncode copy_delta_to(const hyperspacehashing::mask::coordinate& c,
+                                 const shard_snapshot& snap, e::intrusive_ptr<shard> s);
+        // The two halves of copy_delta_to.  When several shards are copied
+        // into one, an object may have moved between them since the
+        // snapshots were taken, so every source's invalidations must be
+        // applied before any source's appends.
+        void copy_invalidated_to(const hyperspacehashing::mask::coordinate& c,
+                                 const shard_snapshot& snap, e::intrusive_ptr<shard> s);
+        returncode copy_appended_to(const hyperspacehashing::mask::coordinate& c,
+                                    const shard_snapshot& snap, e::intrusive_ptr<shard> s);
+        // Verify the checksums of up to "count" live entries of the search
+        // log, starting at "*entry", and advance "*entry" past them.  This
+        // may run concurrently with PUT/DEL operations.  May return SUCCESS,
+        // CORRUPT (with "*entry" just past the corrupt entry), or DIDNOTHING
+        // if "*entry" is already at the end of the search log.
+        returncode scrub(uint32_t* entry, uint32_t count);
         // Perform a logical integrity check of the shard.
         bool fsck();
         bool fsck(std::ostream& err);
         // Create a snapshot of this shard.  The caller must ensure that the
         // shard outlasts the snapshot.  This is really just for testing.
         shard_snapshot make_snapshot();
+        // The coordinate recorded in the shard's header.  The disk sets this
+        // before a shard is given its final name.
+        hyperspacehashing::mask::coordinate get_coordinate() const;
+        void set_coordinate(const hyperspacehashing::mask::coordinate& c);
+        // The geometry with which the shard was created.
+        const geometry& get_geometry() const { return m_geometry; }
+        // The Bloom filter holds every key PUT into the shard, so a false
+        // result from "may_contain" means that GET or DEL will return
+        // NOTFOUND without touching the rest of the shard.  Compute the hash
+        // once for probing many shards.
+        static uint64_t bloom_hash(uint32_t primary_hash, const e::slice& key);
+        bool may_contain(uint64_t bloom_hash) const;
+        // The number of entries in the search index.
+        uint32_t entries() const { return m_search_offset; }
+        // The average number of bytes appended to the data segment per entry
+        // in the search index, or 0 if the shard is empty.
+        uint64_t average_entry_size() const;
+        // The bytes of the values appended to this shard (including those
+        // since overwritten or deleted), before and after compression.  The
+        // counts are kept in the header, so they cover entries copied into
+        // the shard and survive reopening it.
+        void compression(uint64_t* raw, uint64_t* stored) const
+        { *raw = m_value_bytes; *stored = m_stored_value_bytes; }
+        // Count a read which found an object in this shard.
+        void count_read() { __sync_add_and_fetch(&m_reads, 1); }
+        // Fold the reads counted and the entries appended since the last call
+        // into a measure of how busy the shard is, which halves with each
+        // call, and return it.  Entries already in the shard at the first call
+        // are not counted.  "*calls" is set to the number of calls made,
+        // including this one.  Only one thread may call this at a time.
+        uint64_t heat(uint64_t* calls);
+        // Advice to the kernel about how the mapping will be used.  These only
+        // affect performance, so errors are ignored.  The index segment is
+        // always resident (on huge pages where possible), and the data segment
+        // is read at random, except between begin_scan and end_scan, during
+        // which it is read sequentially.  Scans may nest and overlap.
+        void begin_scan();
+        void end_scan();
+        // Ask that the data segment from "offset" on be read ahead.
+        void prefetch(uint32_t offset, size_t length) const;
+        // The shard is no longer in use (though snapshots may still read it),
+        // so release its resident pages.
+        void release();
+        // Empty the shard, keeping its geometry and file, so that it may be
+        // reused.  The caller must hold the only reference to the shard.
+        void reset();
+        // True if the caller holds the only reference to the shard.
+        bool unique() const { return m_ref == 1; }
 
     private:
         friend class e::intrusive_ptr<shard>;
@@ -153,19 +292,81 @@ class shard
             uint64_t upper;
         } __attribute__ ((packed));
 
+        // The header is rewritten on sync and when the shard is closed.  The
+        // checksum covers every preceding field.
+        struct header
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t data_offset;
+            uint32_t search_offset;
+            uint32_t search_entries;
+            uint32_t data_size;
+            uint32_t compression;
+            uint64_t columnar;
+            uint64_t primary_mask;
+            uint64_t primary_hash;
+            uint64_t secondary_lower_mask;
+            uint64_t secondary_lower_hash;
+            uint64_t secondary_upper_mask;
+            uint64_t secondary_upper_hash;
+            uint64_t value_bytes;
+            uint64_t stored_value_bytes;
+            uint64_t checksum;
+        } __attribute__ ((packed));
+
     private:
-        shard(po6::io::fd* fd);
+        shard(po6::io::fd* fd, const geometry& g);
         shard(const shard&);
         ~shard() throw ();
 
+    private:
+        // The layout of the mapping, as determined by m_geometry.  The index
+        // segment holds the hash table followed by the search log, and every
+        // offset within the shard is less than file_size().
+        size_t hash_table_size() const
+        { return m_geometry.hash_entries() * HASH_TABLE_ENTRY_SIZE; }
+        size_t bloom_filter_size() const
+        { return bloom_filter_size(m_geometry); }
+        static size_t bloom_filter_size(const geometry& g)
+        { return (g.search_entries * BLOOM_FILTER_BITS_PER_ENTRY / 8 + 4095) & ~4095ULL; }
+        static size_t column_segment_size(const geometry& g)
+        { return (g.columns() * (g.search_entries + 2 * g.search_entries / COLUMN_ZONE_ENTRIES)
+                  * sizeof(uint64_t) + 4095) & ~4095ULL; }
+        size_t index_segment_size() const
+        { return hash_table_size() + m_geometry.search_entries * SEARCH_INDEX_ENTRY_SIZE
+               + bloom_filter_size() + column_segment_size(m_geometry); }
+        size_t file_size() const
+        { return index_segment_size() + m_geometry.data_size; }
+        size_t mapped_size() const
+        { return mapped_size(m_geometry); }
+        static size_t mapped_size(const geometry& g)
+        { return SHARD_HEADER_SIZE + g.hash_entries() * HASH_TABLE_ENTRY_SIZE
+               + g.search_entries * SEARCH_INDEX_ENTRY_SIZE + bloom_filter_size(g)
+               + column_segment_size(g) + g.data_size; }
+        size_t hash_into_table(uint64_t x) const
+        { return x & (m_geometry.hash_entries() - 1); }
+
     private:
         size_t data_size(const e::slice& key, const std::vector<e::slice>& value) const;
+        size_t stored_size(const e::slice& key, const std::vector<e::slice>& value) const
+        { return data_size(key, value) + (m_compressor ? COMPRESSED_VALUE_HEADER : 0); }
         uint64_t data_version(uint32_t offset) const;
         size_t data_key_size(uint32_t offset) const;
         size_t data_key_offset(uint32_t offset) const
         { return offset + sizeof(uint64_t) + sizeof(uint32_t); }
         void data_key(uint32_t offset, size_t keysize, e::slice* key) const;
-        void data_value(uint32_t offset, size_t keysize, std::vector<e::slice>* value) const;
+        // Compressed values are decompressed into "*backing", which is reused
+        // if nothing else refers to it.  May return SUCCESS, or CORRUPT if the
+        // value cannot be decompressed.
+        returncode data_value(uint32_t offset, size_t keysize, std::vector<e::slice>* value,
+                              std::tr1::shared_ptr<e::buffer>* backing) const;
+        // Write "value" at "offset", compressing it if worthwhile, and return
+        // the offset following it.
+        uint32_t data_put_value(uint32_t offset, const std::vector<e::slice>& value);
+        // Add the value of the entry at "offset" (which is complete) to the
+        // counts reported by "compression".
+        void count_value(uint32_t offset);
 
     private:
         void inc() { __sync_add_and_fetch(&m_ref, 1); }
@@ -184,17 +385,71 @@ class shard
         // This will invalidate any entry in the search log which references
         // the specified offset.
         void invalidate_search_log(uint32_t to_invalidate, uint32_t invalidate_with);
+        // Add the key to the Bloom filter.
+        void bloom_insert(uint64_t bloom_hash);
+        // Store the columnar attributes of "value" for the entry at index
+        // "entry" in the search log, which must be the next entry appended.
+        void column_insert(uint32_t entry, const std::vector<e::slice>& value);
+        // The end of the run of entries to which the zone map for "entry"
+        // applies, or the end of the search log if "f" constrains no columnar
+        // attribute of this shard.
+        uint32_t column_zone_end(uint32_t entry, const column_filter& f) const;
+        // False if no entry in the zone containing "entry" may satisfy "f".
+        bool column_zone_matches(uint32_t entry, const column_filter& f) const;
+        // False if the entry does not satisfy "f".
+        bool column_matches(uint32_t entry, const column_filter& f) const;
+        // The column and zone map in which value attribute "attr" is stored,
+        // or NULL if it is not columnar.  Zone z of a zone map holds the
+        // minimum at index 2z and the maximum at index 2z + 1.
+        uint64_t* column(uint16_t attr) const;
+        uint64_t* column_zones(uint16_t attr) const;
+        // Write the geometry, offsets and coordinate to both copies of the
+        // header.
+        void write_header();
+        static uint64_t header_checksum(const header& h);
+        // Read the copy of the header at "offset", and return true if it is
+        // intact and describes a valid geometry.
+        static bool read_header(const po6::io::fd& fd, off_t offset, header* h);
+        // Restore the offsets from the header, and then roll them forward
+        // over entries in the search log which were appended after the header
+        // was written.  Returns false if the offsets are not valid.
+        bool replay();
+        // The offset immediately following the entry starting at "offset", or
+        // 0 if the entry does not fit within the shard.
+        uint32_t data_entry_end(uint32_t offset) const;
+        // The checksum of the bytes [offset, end) of the data segment, and
+        // whether the entry starting at "offset" matches its checksum.
+        uint32_t data_checksum(uint32_t offset, uint32_t end) const;
+        bool data_checksum_ok(uint32_t offset) const;
 
     private:
         shard& operator = (const shard&);
 
     private:
         size_t m_ref;
+        size_t m_scans;
+        const geometry m_geometry;
+        header* m_header;
         uint64_t* m_hash_table;
         log_entry* m_search_log;
+        uint64_t* m_bloom;
+        uint64_t* m_columns;
         char* m_data;
         uint32_t m_data_offset;
         uint32_t m_search_offset;
+        hyperspacehashing::mask::coordinate m_coord;
+        // NULL unless the geometry names a compressor.  The buffers are used
+        // by PUT operations, and so are protected by the WRITE lock.
+        const compressor* m_compressor;
+        std::vector<uint8_t> m_raw_value;
+        std::vector<uint8_t> m_packed_value;
+        uint64_t m_value_bytes;
+        uint64_t m_stored_value_bytes;
+        // Updated atomically by count_read, and by heat respectively.
+        uint64_t m_reads;
+        uint64_t m_heat;
+        uint64_t m_heat_calls;
+        uint32_t m_heat_offset;
 };
 
 } // namespace hyperdisk
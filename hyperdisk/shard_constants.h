@@ -28,25 +28,80 @@
 #ifndef hyperdisk_shard_constants_h_
 #define hyperdisk_shard_constants_h_
 
-// Keep this a power of two or else change HASH_INTO_TABLE
+// The geometry of a shard is chosen when it is created (see geometry.h).  These
+// describe the default geometry.
 #define HASH_TABLE_ENTRIES 65536
 #define HASH_TABLE_ENTRY_SIZE 8
 #define HASH_TABLE_SIZE (HASH_TABLE_ENTRIES * HASH_TABLE_ENTRY_SIZE)
 
+// The hash table is probed one cache line at a time.  Each key hashes to a
+// bucket of HASH_TABLE_BUCKET_ENTRIES entries, and probing continues with the
+// buckets which follow it.
+#define HASH_TABLE_BUCKET_ENTRIES 8
+
 #define SEARCH_INDEX_ENTRIES 32768
 #define SEARCH_INDEX_ENTRY_SIZE 32
 #define SEARCH_INDEX_SIZE (SEARCH_INDEX_ENTRIES * SEARCH_INDEX_ENTRY_SIZE)
 
-#define INDEX_SEGMENT_SIZE (HASH_TABLE_SIZE + SEARCH_INDEX_SIZE)
+// Each shard has a Bloom filter over the keys it holds, which is stored after
+// the search index.  Its size is rounded up to a whole number of pages.
+#define BLOOM_FILTER_BITS_PER_ENTRY 16
+#define BLOOM_FILTER_PROBES 4
+#define BLOOM_FILTER_SIZE (SEARCH_INDEX_ENTRIES * BLOOM_FILTER_BITS_PER_ENTRY / 8)
+
+// Columnar attributes (see geometry.h) follow the Bloom filter.  Each column
+// holds one uint64 per search index entry, and a zone map holding the minimum
+// and maximum of every COLUMN_ZONE_ENTRIES consecutive entries.  The default
+// geometry has no columns.
+#define MAX_COLUMNS 16
+#define COLUMN_ZONE_ENTRIES 256
+
+// Snapshots read ahead SCAN_PREFETCH_SIZE bytes of the data segment once they
+// parse objects which are less than SCAN_PREFETCH_GAP bytes apart.
+#define SCAN_PREFETCH_SIZE (1 << 20)
+#define SCAN_PREFETCH_GAP (1 << 16)
+
+#define INDEX_SEGMENT_SIZE (HASH_TABLE_SIZE + SEARCH_INDEX_SIZE + BLOOM_FILTER_SIZE)
 #define DATA_SEGMENT_SIZE (SEARCH_INDEX_ENTRIES * 1024)
-#define FILE_SIZE (INDEX_SEGMENT_SIZE + DATA_SEGMENT_SIZE)
 
-#define HASH_INTO_TABLE(X) ((X) & (HASH_TABLE_ENTRIES - 1))
+#if HASH_TABLE_ENTRIES != 2 * SEARCH_INDEX_ENTRIES
+#error The hash table must have twice as many entries as the search index.
+#endif
 
-#if SEARCH_INDEX_ENTRIES > HASH_TABLE_ENTRIES
-#error There must be more entries in the hash table than SEARCH_INDEX_ENTRIES.
+#if HASH_TABLE_BUCKET_ENTRIES * HASH_TABLE_ENTRY_SIZE != 64
+#error A hash table bucket must fill one cache line.
 #endif
 
+// Bounds on the geometry.  The index segment (48 bytes per search index entry)
+// stays page-aligned so long as there are at least 256 entries, and every
+// offset within the shard must remain below HASH_OFFSET_INVALID.
+#define MIN_SEARCH_INDEX_ENTRIES 256
+#define MAX_SEARCH_INDEX_ENTRIES (1 << 20)
+#define MIN_DATA_SEGMENT_SIZE 4096
+#define MAX_DATA_SEGMENT_SIZE (1 << 30)
+
+// Every shard file begins with a header page.  All offsets within the shard
+// (including those stored in the hash table and search index) are relative to
+// the end of the header.  A second copy of the header is kept halfway through
+// the page, in a different sector, so that a torn write cannot take out both.
+#define SHARD_HEADER_SIZE 4096
+#define SHARD_HEADER_COPY_OFFSET (SHARD_HEADER_SIZE / 2)
+#define SHARD_MAGIC 0x6879706572646b73ULL
+#define SHARD_VERSION 8
+
 #define HASH_OFFSET_INVALID static_cast<uint32_t>(1 << 31)
 
+// A compressed value is marked by setting COMPRESSED_VALUE in its arity.  The
+// arity is then followed by the id of its compressor, and its uncompressed and
+// compressed sizes, which take COMPRESSED_VALUE_HEADER bytes in all.  The
+// value decompresses to the sizes and contents of its attributes, just as they
+// are stored when uncompressed.
+#define COMPRESSED_VALUE 0x8000
+#define COMPRESSED_VALUE_HEADER (sizeof(uint16_t) + 2 * sizeof(uint32_t))
+
+// Every entry in the data segment ends with the low 32 bits of the CityHash of
+// the bytes preceding it in the entry, so that corruption of the entry may be
+// detected when it is read, copied or scrubbed.
+#define ENTRY_CHECKSUM_SIZE sizeof(uint32_t)
+
 #endif // hyperdisk_shard_h_
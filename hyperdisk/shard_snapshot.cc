@@ -27,10 +27,15 @@
 
 #define __STDC_LIMIT_MACROS
 
+// STL
+#include <algorithm>
+
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/mask.h"
 
 // HyperDisk
+#include "hyperdisk/column_filter.h"
+#include "hyperdisk/search_log_scan.h"
 #include "hyperdisk/shard.h"
 #include "hyperdisk/shard_snapshot.h"
 
@@ -38,12 +43,17 @@ hyperdisk :: shard_snapshot :: shard_snapshot(uint32_t offset, shard* s)
     : m_shard(s)
     , m_limit(offset)
     , m_entry(0)
+    , m_last_parsed(0)
+    , m_prefetched(0)
     , m_valid(true)
     , m_parsed(false)
+    , m_value_parsed(false)
+    , m_value_corrupt(false)
     , m_coord()
     , m_version()
     , m_key()
     , m_value()
+    , m_backing()
 {
     valid();
 }
@@ -52,12 +62,17 @@ hyperdisk :: shard_snapshot :: shard_snapshot(const shard_snapshot& other)
     : m_shard(other.m_shard)
     , m_limit(other.m_limit)
     , m_entry(other.m_entry)
+    , m_last_parsed(other.m_last_parsed)
+    , m_prefetched(other.m_prefetched)
     , m_valid(other.m_valid)
     , m_parsed(other.m_parsed)
+    , m_value_parsed(other.m_value_parsed)
+    , m_value_corrupt(other.m_value_corrupt)
     , m_coord(other.m_coord)
     , m_version(other.m_version)
     , m_key(other.m_key)
     , m_value(other.m_value)
+    , m_backing(other.m_backing)
 {
 }
 
@@ -75,44 +90,85 @@ hyperdisk :: shard_snapshot :: valid()
 bool
 hyperdisk :: shard_snapshot :: valid(const hyperspacehashing::mask::coordinate& coord)
 {
-    uint32_t offset = 0;
-    uint32_t invalid = 0;
+    return valid(coord, column_filter());
+}
 
-    while (m_entry < SEARCH_INDEX_ENTRIES)
+bool
+hyperdisk :: shard_snapshot :: valid(const hyperspacehashing::mask::coordinate& coord,
+                                     const column_filter& filter)
+{
+    const uint32_t entries = m_shard->m_geometry.search_entries;
+    const char* log = reinterpret_cast<const char*>(m_shard->m_search_log);
+
+    // If the m_valid flag is not set, the current entry was already returned
+    // and we must step past it.
+    if (!m_valid && m_entry < entries)
     {
-        offset = m_shard->m_search_log[m_entry].offset;
-        invalid = m_shard->m_search_log[m_entry].invalid;
-
-        // If the m_valid flag is set; the offset is within the subsection of
-        // data we may observe; and the data was never invalidated, or was
-        // invalidated after we scanned it, then we may return true;
-        if ((m_shard->m_search_log[m_entry].lower & coord.secondary_lower_mask) == coord.secondary_lower_hash &&
-            (m_shard->m_search_log[m_entry].upper & coord.secondary_upper_mask) == coord.secondary_upper_hash &&
-            (m_shard->m_search_log[m_entry].primary & coord.primary_mask) == coord.primary_hash &&
-            m_valid && offset > 0 && offset < m_limit &&
-            (invalid == 0 || invalid >= m_limit))
-        {
-            m_parsed = false;
-            m_coord = hyperspacehashing::mask::coordinate(UINT64_MAX, m_shard->m_search_log[m_entry].primary,
-                                                          UINT64_MAX, m_shard->m_search_log[m_entry].lower,
-                                                          UINT64_MAX, m_shard->m_search_log[m_entry].upper);
-            return true;
-        }
+        ++m_entry;
+        m_valid = true;
+    }
 
+    while (m_entry < entries)
+    {
         // If offset is 0, then we know that there are no more entries further
         // on.  Stop iterating.  If offset is >= m_limit, we know that the
         // operation (and all succeeding it) happened after the snapshot.
+        uint32_t offset = m_shard->m_search_log[m_entry].offset;
+
         if (offset == 0 || offset >= m_limit)
         {
-            m_entry = SEARCH_INDEX_ENTRIES;
-            m_valid = false;
             break;
         }
 
-        ++m_entry;
-        m_valid = true;
+        // Skip whole zones whose columns cannot satisfy the filter.  Without a
+        // filter on a columnar attribute, this scans the rest of the log.
+        uint32_t end = m_shard->column_zone_end(m_entry, filter);
+
+        if (!m_shard->column_zone_matches(m_entry, filter))
+        {
+            m_entry = end;
+            continue;
+        }
+
+        // Find the next entry which is within the subsection of data we may
+        // observe and which was never invalidated, or was invalidated after we
+        // scanned it.
+        m_entry = scan_search_log(log, m_entry, end, coord, m_limit);
+
+        if (m_entry >= end)
+        {
+            continue;
+        }
+
+        offset = m_shard->m_search_log[m_entry].offset;
+
+        if (offset == 0 || offset >= m_limit)
+        {
+            break;
+        }
+
+        if (!m_shard->column_matches(m_entry, filter))
+        {
+            ++m_entry;
+            continue;
+        }
+
+        // The same entry may be found again by repeated calls, so keep what
+        // was already read from it.
+        if (offset != m_last_parsed)
+        {
+            m_parsed = false;
+            m_value_parsed = false;
+        }
+
+        m_coord = hyperspacehashing::mask::coordinate(UINT64_MAX, m_shard->m_search_log[m_entry].primary,
+                                                      UINT64_MAX, m_shard->m_search_log[m_entry].lower,
+                                                      UINT64_MAX, m_shard->m_search_log[m_entry].upper);
+        return true;
     }
 
+    m_entry = entries;
+    m_valid = false;
     return false;
 }
 
@@ -121,6 +177,7 @@ hyperdisk :: shard_snapshot :: next()
 {
     m_valid = false;
     m_parsed = false;
+    m_value_parsed = false;
 }
 
 uint64_t
@@ -153,18 +210,40 @@ hyperdisk :: shard_snapshot :: value()
         parse();
     }
 
+    if (!m_value_parsed)
+    {
+        m_value_corrupt = m_shard->data_value(m_last_parsed, m_key.size(), &m_value, &m_backing) != SUCCESS;
+        m_value_parsed = true;
+    }
+
     return m_value;
 }
 
+bool
+hyperdisk :: shard_snapshot :: corrupt()
+{
+    value();
+    return m_value_corrupt;
+}
+
 void
 hyperdisk :: shard_snapshot :: parse()
 {
     uint32_t offset = m_shard->m_search_log[m_entry].offset;
     assert(offset);
+
+    // Read ahead only when this snapshot reads most of the objects, as
+    // otherwise the readahead would be wasted.
+    if (offset >= m_prefetched && offset - m_last_parsed < SCAN_PREFETCH_GAP)
+    {
+        m_shard->prefetch(offset, std::min(static_cast<uint32_t>(SCAN_PREFETCH_SIZE), m_limit - offset));
+        m_prefetched = offset + SCAN_PREFETCH_SIZE;
+    }
+
+    m_last_parsed = offset;
     m_version = m_shard->data_version(offset);
     size_t key_size = m_shard->data_key_size(offset);
     m_shard->data_key(offset, key_size, &m_key);
-    m_shard->data_value(offset, key_size, &m_value);
     m_parsed = true;
 }
 
@@ -177,6 +256,8 @@ hyperdisk :: shard_snapshot :: operator = (const shard_snapshot& rhs)
         m_limit = rhs.m_limit;
         m_entry = rhs.m_entry;
         m_valid = rhs.m_valid;
+        m_parsed = false;
+        m_value_parsed = false;
     }
 
     return *this;
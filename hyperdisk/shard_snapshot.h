@@ -28,7 +28,12 @@
 #ifndef hyperdisk_shard_snapshot_h_
 #define hyperdisk_shard_snapshot_h_
 
+// STL
+#include <tr1/memory>
+#include <vector>
+
 // e
+#include <e/buffer.h>
 #include <e/intrusive_ptr.h>
 #include <e/slice.h>
 
@@ -39,6 +44,7 @@
 // Forward Declarations
 namespace hyperdisk
 {
+class column_filter;
 class shard;
 }
 
@@ -55,17 +61,27 @@ class shard_snapshot
     public:
         bool valid();
         bool valid(const hyperspacehashing::mask::coordinate& coord);
+        // Only return entries whose columnar attributes satisfy "filter".
+        bool valid(const hyperspacehashing::mask::coordinate& coord,
+                   const column_filter& filter);
         void next();
 
     public:
         hyperspacehashing::mask::coordinate coordinate() { return m_coord; }
         uint64_t version();
         const e::slice& key();
+        // The value is only read (and decompressed) when asked for, and
+        // remains valid until the snapshot moves on.  It is empty if it
+        // cannot be decompressed, in which case "corrupt" returns true.
         const std::vector<e::slice>& value();
+        bool corrupt();
 
     public:
         shard_snapshot& operator = (const shard_snapshot& rhs);
 
+    private:
+        friend class shard;
+
     private:
         void parse();
 
@@ -73,12 +89,17 @@ class shard_snapshot
         shard* m_shard;
         uint32_t m_limit;
         uint32_t m_entry;
+        uint32_t m_last_parsed;
+        uint32_t m_prefetched;
         bool m_valid;
         bool m_parsed;
+        bool m_value_parsed;
+        bool m_value_corrupt;
         hyperspacehashing::mask::coordinate m_coord;
         uint64_t m_version;
         e::slice m_key;
         std::vector<e::slice> m_value;
+        std::tr1::shared_ptr<e::buffer> m_backing;
 };
 
 } // namespace hyperdisk
@@ -38,6 +38,21 @@ hyperdisk :: shard_vector :: shard_vector(const coordinate& coord, e::intrusive_
 {
 }
 
+hyperdisk :: shard_vector :: shard_vector(std::vector<std::pair<coordinate, e::intrusive_ptr<shard> > >* shards)
+    : m_ref(0)
+    , m_generation(1)
+    , m_shards()
+    , m_offsets()
+{
+    m_shards.swap(*shards);
+    m_offsets.resize(m_shards.size());
+
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        m_offsets[i] = m_shards[i].second->m_data_offset;
+    }
+}
+
 size_t
 hyperdisk :: shard_vector :: size() const
 {
@@ -135,6 +150,29 @@ hyperdisk :: shard_vector :: replace(size_t shard_num,
     return ret;
 }
 
+e::intrusive_ptr<hyperdisk::shard_vector>
+hyperdisk :: shard_vector :: replace(size_t shard_num1, size_t shard_num2,
+                                     const coordinate& c, e::intrusive_ptr<shard> s)
+{
+    assert(shard_num1 != shard_num2);
+    std::vector<std::pair<coordinate, e::intrusive_ptr<shard> > > newvec;
+    newvec.reserve(m_shards.size() - 1);
+
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        if (i != shard_num1 && i != shard_num2)
+        {
+            newvec.push_back(m_shards[i]);
+        }
+    }
+
+    newvec.push_back(std::make_pair(c, s));
+
+    e::intrusive_ptr<hyperdisk::shard_vector> ret;
+    ret = new shard_vector(m_generation + 1, &newvec);
+    return ret;
+}
+
 hyperdisk :: shard_vector :: shard_vector(uint64_t gen,
                                           std::vector<std::pair<coordinate, e::intrusive_ptr<shard> > >* newvec)
     : m_ref(0)
@@ -154,3 +192,80 @@ hyperdisk :: shard_vector :: shard_vector(uint64_t gen,
 hyperdisk :: shard_vector :: ~shard_vector() throw ()
 {
 }
+
+bool
+hyperdisk :: covers(const coordinate& outer, const coordinate& inner)
+{
+    return !(outer == inner) &&
+           (outer.primary_mask & inner.primary_mask) == outer.primary_mask &&
+           (outer.primary_hash & outer.primary_mask) == (inner.primary_hash & outer.primary_mask) &&
+           (outer.secondary_lower_mask & inner.secondary_lower_mask) == outer.secondary_lower_mask &&
+           (outer.secondary_lower_hash & outer.secondary_lower_mask) == (inner.secondary_lower_hash & outer.secondary_lower_mask) &&
+           (outer.secondary_upper_mask & inner.secondary_upper_mask) == outer.secondary_upper_mask &&
+           (outer.secondary_upper_hash & outer.secondary_upper_mask) == (inner.secondary_upper_hash & outer.secondary_upper_mask);
+}
+
+bool
+hyperdisk :: siblings(const coordinate& a, const coordinate& b, coordinate* merged)
+{
+    if (a.primary_mask != b.primary_mask ||
+        a.secondary_lower_mask != b.secondary_lower_mask ||
+        a.secondary_upper_mask != b.secondary_upper_mask)
+    {
+        return false;
+    }
+
+    uint64_t primary = (a.primary_hash ^ b.primary_hash) & a.primary_mask;
+    uint64_t lower = (a.secondary_lower_hash ^ b.secondary_lower_hash) & a.secondary_lower_mask;
+    uint64_t upper = (a.secondary_upper_hash ^ b.secondary_upper_hash) & a.secondary_upper_mask;
+    int differing = (primary ? 1 : 0) + (lower ? 1 : 0) + (upper ? 1 : 0);
+    uint64_t bit = primary | lower | upper;
+
+    if (differing != 1 || (bit & (bit - 1)) != 0)
+    {
+        return false;
+    }
+
+    *merged = coordinate(a.primary_mask & ~primary, a.primary_hash & ~primary,
+                         a.secondary_lower_mask & ~lower, a.secondary_lower_hash & ~lower,
+                         a.secondary_upper_mask & ~upper, a.secondary_upper_hash & ~upper);
+    return true;
+}
+
+std::vector<bool>
+hyperdisk :: superseded_shards(const std::vector<coordinate>& coords)
+{
+    std::vector<bool> dropped(coords.size(), false);
+
+    for (size_t i = 0; i < coords.size(); ++i)
+    {
+        if (dropped[i])
+        {
+            continue;
+        }
+
+        std::vector<size_t> covered;
+
+        for (size_t j = 0; j < coords.size(); ++j)
+        {
+            if (!dropped[j] && covers(coords[i], coords[j]))
+            {
+                covered.push_back(j);
+            }
+        }
+
+        if (covered.size() >= 4)
+        {
+            dropped[i] = true;
+        }
+        else
+        {
+            for (size_t j = 0; j < covered.size(); ++j)
+            {
+                dropped[covered[j]] = true;
+            }
+        }
+    }
+
+    return dropped;
+}
@@ -48,6 +48,8 @@ class shard_vector
 {
     public:
         shard_vector(const hyperspacehashing::mask::coordinate& coord, e::intrusive_ptr<shard> s);
+        // Take the shards from "shards" (e.g., when reopening a disk).
+        shard_vector(std::vector<std::pair<hyperspacehashing::mask::coordinate, e::intrusive_ptr<shard> > >* shards);
 
     public:
         size_t size() const;
@@ -64,6 +66,10 @@ class shard_vector
                                                const hyperspacehashing::mask::coordinate& c2, e::intrusive_ptr<shard> s2,
                                                const hyperspacehashing::mask::coordinate& c3, e::intrusive_ptr<shard> s3,
                                                const hyperspacehashing::mask::coordinate& c4, e::intrusive_ptr<shard> s4);
+        // The inverse of a split:  replace two sibling shards with the one
+        // shard covering both.
+        e::intrusive_ptr<shard_vector> replace(size_t shard_num1, size_t shard_num2,
+                                               const hyperspacehashing::mask::coordinate& c, e::intrusive_ptr<shard> s);
 
     private:
         friend class e::intrusive_ptr<shard_vector>;
@@ -84,6 +90,28 @@ class shard_vector
         std::vector<uint32_t> m_offsets;
 };
 
+// True if "outer" covers a strictly larger portion of the hyperspace which
+// includes "inner".
+bool
+covers(const hyperspacehashing::mask::coordinate& outer,
+       const hyperspacehashing::mask::coordinate& inner);
+
+// True if "a" and "b" have the same masks and their hashes differ in exactly
+// one masked bit.  If so, "merged" is the coordinate which covers both.
+bool
+siblings(const hyperspacehashing::mask::coordinate& a,
+         const hyperspacehashing::mask::coordinate& b,
+         hyperspacehashing::mask::coordinate* merged);
+
+// Given the coordinates of the shards found when opening a disk, decide which
+// were superseded by an interrupted split or merge.  A split renames the four
+// new shards into place before dropping the old shard, so the old shard
+// remains authoritative unless all of the new shards made it into place.  A
+// merge renames the new shard into place before dropping the two old shards,
+// so a new shard covering just two others is authoritative.
+std::vector<bool>
+superseded_shards(const std::vector<hyperspacehashing::mask::coordinate>& coords);
+
 } // namespace hyperdisk
 
 #endif // hyperdisk_shard_vector_h_
@@ -27,17 +27,26 @@
 
 #define __STDC_LIMIT_MACROS
 
+// C
+#include <cstdlib>
+
 // HyperDisk
+#include "hyperdisk/hyperdisk/disk.h"
 #include "hyperdisk/hyperdisk/snapshot.h"
+#include "hyperdisk/column_filter.h"
 #include "hyperdisk/log_entry.h"
+#include "hyperdisk/log_spill.h"
 #include "hyperdisk/shard_snapshot.h"
 #include "hyperdisk/shard_vector.h"
+#include "hyperdisk/write_ahead_log.h"
 
 hyperdisk :: snapshot :: snapshot(const hyperspacehashing::mask::coordinate& coord,
+                                  std::auto_ptr<column_filter> filter,
                                   e::intrusive_ptr<shard_vector> shards,
                                   std::vector<hyperdisk::shard_snapshot>* ss)
     : m_ref(0)
     , m_coord(coord)
+    , m_filter(filter)
     , m_shards(shards)
     , m_snaps()
 {
@@ -53,13 +62,19 @@ hyperdisk :: snapshot :: valid()
 {
     while (!m_snaps.empty())
     {
-        if (m_snaps.back().valid(m_coord))
+        if (!m_snaps.back().valid(m_coord, *m_filter))
         {
-            return true;
+            m_snaps.pop_back();
+        }
+        // Skip objects whose value cannot be read, rather than return them
+        // without one.
+        else if (m_snaps.back().corrupt())
+        {
+            m_snaps.back().next();
         }
         else
         {
-            m_snaps.pop_back();
+            return true;
         }
     }
 
@@ -106,20 +121,52 @@ hyperdisk :: snapshot :: value()
 hyperdisk :: rolling_snapshot :: rolling_snapshot(const e::locking_iterable_fifo<log_entry>::iterator& iter,
                                                   const e::intrusive_ptr<snapshot>& snap)
     : m_ref(0)
+    , m_snap(snap)
+    , m_lock()
     , m_iter(iter)
+    , m_disk()
+    , m_seq(0)
+    , m_spill()
+    , m_current()
+{
+    valid();
+}
+
+hyperdisk :: rolling_snapshot :: rolling_snapshot(const e::locking_iterable_fifo<log_entry>::iterator& iter,
+                                                  const e::intrusive_ptr<snapshot>& snap,
+                                                  const e::intrusive_ptr<disk>& d,
+                                                  uint64_t seq,
+                                                  std::auto_ptr<log_spill> spill)
+    : m_ref(0)
     , m_snap(snap)
+    , m_lock()
+    , m_iter(iter)
+    , m_disk(d)
+    , m_seq(seq)
+    , m_spill(spill)
+    , m_current()
 {
     valid();
 }
 
 hyperdisk :: rolling_snapshot :: ~rolling_snapshot() throw ()
 {
+    if (m_disk)
+    {
+        m_disk->forget_rolling_snapshot(this);
+    }
 }
 
 bool
 hyperdisk :: rolling_snapshot :: valid()
 {
-    return m_snap->valid() || m_iter.valid();
+    if (m_snap->valid())
+    {
+        return true;
+    }
+
+    po6::threads::mutex::hold hold(&m_lock);
+    return load();
 }
 
 void
@@ -128,13 +175,24 @@ hyperdisk :: rolling_snapshot :: next()
     if (m_snap->valid())
     {
         m_snap->next();
+        return;
     }
-    else if (m_iter.valid())
+
+    po6::threads::mutex::hold hold(&m_lock);
+
+    if (load())
     {
-        m_iter.next();
+        m_current.reset();
     }
 }
 
+bool
+hyperdisk :: rolling_snapshot :: failed()
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    return m_spill.get() && m_spill->failed();
+}
+
 bool
 hyperdisk :: rolling_snapshot :: has_value()
 {
@@ -142,14 +200,9 @@ hyperdisk :: rolling_snapshot :: has_value()
     {
         return true;
     }
-    else if (m_iter.valid())
-    {
-        return m_iter->is_put;
-    }
-    else
-    {
-        return false;
-    }
+
+    po6::threads::mutex::hold hold(&m_lock);
+    return load() && m_current->is_put;
 }
 
 uint64_t
@@ -159,14 +212,9 @@ hyperdisk :: rolling_snapshot :: version()
     {
         return m_snap->version();
     }
-    else if (m_iter.valid())
-    {
-        return m_iter->version;
-    }
-    else
-    {
-        return uint64_t();
-    }
+
+    po6::threads::mutex::hold hold(&m_lock);
+    return load() ? m_current->version : uint64_t();
 }
 
 const e::slice&
@@ -176,14 +224,15 @@ hyperdisk :: rolling_snapshot :: key()
     {
         return m_snap->key();
     }
-    else if (m_iter.valid())
-    {
-        return m_iter->key;
-    }
-    else
+
+    po6::threads::mutex::hold hold(&m_lock);
+
+    if (!load())
     {
         abort();
     }
+
+    return m_current->key;
 }
 
 const std::vector<e::slice>&
@@ -193,12 +242,73 @@ hyperdisk :: rolling_snapshot :: value()
     {
         return m_snap->value();
     }
+
+    po6::threads::mutex::hold hold(&m_lock);
+
+    if (!load())
+    {
+        abort();
+    }
+
+    return m_current->value;
+}
+
+void
+hyperdisk :: rolling_snapshot :: spill(uint64_t seq)
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    e::locking_iterable_fifo<log_entry>::iterator it(m_iter);
+    std::vector<char> framed;
+    uint64_t count = 0;
+
+    for (; m_seq + count < seq && it.valid(); ++count, it.next())
+    {
+        write_ahead_log::encode(*it, &framed);
+    }
+
+    // If the entries cannot be spilled, they stay pinned in memory instead.
+    if (count == 0 || !m_spill->append(framed))
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        m_iter.next();
+    }
+
+    m_seq += count;
+}
+
+bool
+hyperdisk :: rolling_snapshot :: load()
+{
+    if (m_current.get())
+    {
+        return true;
+    }
+
+    std::auto_ptr<log_entry> ent(new log_entry());
+
+    if (m_spill.get() && m_spill->take(ent.get()))
+    {
+    }
+    // The lost entries precede m_iter, so it must not be read in their place.
+    else if (m_spill.get() && m_spill->failed())
+    {
+        return false;
+    }
     else if (m_iter.valid())
     {
-        return m_iter->value;
+        *ent = *m_iter;
+        m_iter.next();
+        ++m_seq;
     }
     else
     {
-        abort();
+        return false;
     }
+
+    m_current = ent;
+    return true;
 }
@@ -0,0 +1,484 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// C
+#include <cstdio>
+#include <cstdlib>
+
+// C++
+#include <iomanip>
+#include <iostream>
+
+// STL
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tr1/functional>
+#include <tr1/memory>
+#include <vector>
+
+// po6
+#include <po6/error.h>
+#include <po6/io/fd.h>
+#include <po6/pathname.h>
+#include <po6/threads/thread.h>
+
+// e
+#include <e/buffer.h>
+#include <e/convert.h>
+#include <e/guard.h>
+#include <e/intrusive_ptr.h>
+#include <e/timer.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+#include "hyperspacehashing/hyperspacehashing/search.h"
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/disk.h"
+#include "hyperdisk/hyperdisk/reference.h"
+#include "hyperdisk/hyperdisk/snapshot.h"
+#include "hyperdisk/shard.h"
+
+// Measure the throughput of shards and disks across key sizes, value sizes and
+// thread counts.  Each measurement is printed as one tab-separated line below
+// a header naming the columns, so that runs before and after a storage change
+// may be compared with standard tools.
+//
+// Shards are not thread-safe for PUT/DEL, so only shard GETs are measured
+// with more than one thread.  "wal_depth" is the number of writes which were
+// not yet flushed to the shards of the disk.  Splits are timed while flushing
+// distinct keys, and cleans while flushing overwrites of those keys.
+
+#define SHARD_PATH "hyperdisk-bench-shard.tmp"
+#define DISK_PATH "hyperdisk-bench-disk.tmp"
+#define FLUSH_BATCH 1000
+
+static const size_t KEY_SIZES[] = {8, 64};
+static const size_t VALUE_SIZES[] = {16, 256, 4096};
+static const size_t THREADS[] = {1, 2, 4};
+
+#define ELEMENTS(X) (sizeof(X) / sizeof((X)[0]))
+
+class workload
+{
+    public:
+        workload(size_t key_size, size_t value_size, size_t count);
+
+    public:
+        size_t key_size;
+        size_t value_size;
+        std::vector<std::string> keys;
+        std::vector<hyperspacehashing::mask::coordinate> coords;
+        std::vector<size_t> order;
+        std::string value;
+};
+
+workload :: workload(size_t ks, size_t vs, size_t count)
+    : key_size(ks)
+    , value_size(vs)
+    , keys()
+    , coords()
+    , order()
+    , value(vs, 'v')
+{
+    std::vector<hyperspacehashing::hash_t> funcs(2, hyperspacehashing::EQUALITY);
+    hyperspacehashing::mask::hasher hasher(funcs);
+    std::vector<e::slice> val(1, e::slice(value.data(), value.size()));
+    unsigned int seed = 0;
+    char buf[32];
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Zero-pad the index out to the key size.
+        snprintf(buf, sizeof(buf), "%016zu", i);
+        std::string key(buf);
+        key.resize(std::max(ks, key.size()), '0');
+        key = key.substr(key.size() - ks);
+        keys.push_back(key);
+        coords.push_back(hasher.hash(e::slice(key.data(), key.size()), val));
+        order.push_back(i);
+    }
+
+    for (size_t i = order.size(); i > 1; --i)
+    {
+        std::swap(order[i - 1], order[rand_r(&seed) % i]);
+    }
+}
+
+static void
+report(const char* name, const workload& w, size_t threads,
+       size_t wal_depth, uint64_t ops, uint64_t nanos)
+{
+    double secs = std::max(static_cast<double>(nanos) / 1e9, 1e-9);
+    std::cout << name
+              << "\t" << w.key_size
+              << "\t" << w.value_size
+              << "\t" << threads
+              << "\t" << wal_depth
+              << "\t" << ops
+              << "\t" << std::fixed << std::setprecision(6) << secs
+              << "\t" << std::setprecision(1) << ops / secs
+              << std::endl;
+}
+
+// Run "func" on each of "threads" threads and return the elapsed nanoseconds.
+static uint64_t
+run_threads(size_t threads, const std::tr1::function<void (size_t)>& func)
+{
+    std::vector<std::tr1::shared_ptr<po6::threads::thread> > ts;
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        std::tr1::shared_ptr<po6::threads::thread> t(new po6::threads::thread(std::tr1::bind(func, i)));
+        ts.push_back(t);
+    }
+
+    uint64_t start = e::time();
+
+    for (size_t i = 0; i < ts.size(); ++i)
+    {
+        ts[i]->start();
+    }
+
+    for (size_t i = 0; i < ts.size(); ++i)
+    {
+        ts[i]->join();
+    }
+
+    return e::time() - start;
+}
+
+// Each thread reads every key, starting from its own place in the order.
+static void
+shard_get(hyperdisk::shard* s, const workload* w,
+          const std::vector<size_t>* order, size_t thread)
+{
+    size_t n = order->size();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t k = (*order)[(i + thread * n / ELEMENTS(THREADS)) % n];
+        std::vector<e::slice> value;
+        uint64_t version;
+
+        if (s->get(static_cast<uint32_t>(w->coords[k].primary_hash),
+                   e::slice(w->keys[k].data(), w->keys[k].size()),
+                   &value, &version) != hyperdisk::SUCCESS)
+        {
+            std::cerr << "shard lost key " << k << std::endl;
+            abort();
+        }
+    }
+}
+
+static void
+bench_shard(const workload& w)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> s = hyperdisk::shard::create(cwd, SHARD_PATH);
+    e::guard g = e::makeguard(::unlink, SHARD_PATH);
+    g.use_variable();
+    std::vector<e::slice> value(1, e::slice(w.value.data(), w.value.size()));
+    std::vector<size_t> order;
+
+    // Fill the shard in random order until it runs out of space.
+    uint64_t start = e::time();
+
+    for (size_t i = 0; i < w.order.size(); ++i)
+    {
+        size_t k = w.order[i];
+
+        if (s->put(w.coords[k], e::slice(w.keys[k].data(), w.keys[k].size()),
+                   value, i) != hyperdisk::SUCCESS)
+        {
+            break;
+        }
+
+        order.push_back(k);
+    }
+
+    report("shard_put", w, 1, 0, order.size(), e::time() - start);
+
+    for (size_t t = 0; t < ELEMENTS(THREADS); ++t)
+    {
+        uint64_t nanos = run_threads(THREADS[t], std::tr1::bind(shard_get, s.get(), &w, &order,
+                                                                std::tr1::placeholders::_1));
+        report("shard_get", w, THREADS[t], 0, THREADS[t] * order.size(), nanos);
+    }
+
+    start = e::time();
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        size_t k = order[i];
+
+        if (s->del(static_cast<uint32_t>(w.coords[k].primary_hash),
+                   e::slice(w.keys[k].data(), w.keys[k].size())) != hyperdisk::SUCCESS)
+        {
+            break;
+        }
+    }
+
+    report("shard_del", w, 1, 0, order.size(), e::time() - start);
+}
+
+// Each thread writes every "threads"th key, offset by "version".
+static void
+disk_put(hyperdisk::disk* d, const workload* w, size_t begin, size_t end,
+         size_t threads, uint64_t version, size_t thread)
+{
+    std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(0));
+    std::vector<e::slice> value(1, e::slice(w->value.data(), w->value.size()));
+
+    for (size_t i = begin + thread; i < end; i += threads)
+    {
+        size_t k = w->order[i];
+
+        if (d->put(backing, e::slice(w->keys[k].data(), w->keys[k].size()),
+                   value, version + i) != hyperdisk::SUCCESS)
+        {
+            std::cerr << "disk refused key " << k << std::endl;
+            abort();
+        }
+    }
+}
+
+static void
+disk_get(hyperdisk::disk* d, const workload* w, size_t thread)
+{
+    size_t n = w->order.size();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t k = w->order[(i + thread * n / ELEMENTS(THREADS)) % n];
+        std::vector<e::slice> value;
+        uint64_t version;
+        hyperdisk::reference ref;
+
+        if (d->get(e::slice(w->keys[k].data(), w->keys[k].size()),
+                   &value, &version, &ref) != hyperdisk::SUCCESS)
+        {
+            std::cerr << "disk lost key " << k << std::endl;
+            abort();
+        }
+    }
+}
+
+static void
+disk_scan(hyperdisk::disk* d, size_t arity, size_t expected, size_t)
+{
+    e::intrusive_ptr<hyperdisk::snapshot> snap = d->make_snapshot(hyperspacehashing::search(arity));
+    size_t seen = 0;
+
+    for (; snap->valid(); snap->next())
+    {
+        if (snap->value().size() == 1)
+        {
+            ++seen;
+        }
+    }
+
+    if (seen != expected)
+    {
+        std::cerr << "snapshot saw " << seen << " objects instead of " << expected << std::endl;
+        abort();
+    }
+}
+
+// Flush everything, timing the flushes and the splits or cleans they force
+// separately.
+static void
+flush_all(hyperdisk::disk* d, uint64_t* flush_nanos, uint64_t* io_nanos, uint64_t* ios)
+{
+    while (true)
+    {
+        uint64_t start = e::time();
+        hyperdisk::returncode rc = d->flush(FLUSH_BATCH);
+        *flush_nanos += e::time() - start;
+
+        if (rc == hyperdisk::DIDNOTHING)
+        {
+            return;
+        }
+        else if (rc == hyperdisk::SUCCESS)
+        {
+            continue;
+        }
+
+        start = e::time();
+        rc = d->do_mandatory_io();
+        *io_nanos += e::time() - start;
+
+        if (rc != hyperdisk::SUCCESS)
+        {
+            std::cerr << "mandatory I/O failed with " << rc << std::endl;
+            abort();
+        }
+
+        ++*ios;
+    }
+}
+
+static void
+bench_disk(const workload& w, const hyperspacehashing::mask::hasher& hasher)
+{
+    const size_t n = w.keys.size();
+
+    for (size_t t = 0; t < ELEMENTS(THREADS); ++t)
+    {
+        e::intrusive_ptr<hyperdisk::disk> d;
+        d = hyperdisk::disk::create(po6::pathname(DISK_PATH), hasher, 2);
+        e::guard g = e::makeobjguard(*d, &hyperdisk::disk::drop);
+        g.use_variable();
+        uint64_t nanos = run_threads(THREADS[t], std::tr1::bind(disk_put, d.get(), &w, 0, n, THREADS[t], 1,
+                                                                std::tr1::placeholders::_1));
+        report("disk_put", w, THREADS[t], 0, n, nanos);
+
+        uint64_t flush_nanos = 0;
+        uint64_t split_nanos = 0;
+        uint64_t splits = 0;
+        flush_all(d.get(), &flush_nanos, &split_nanos, &splits);
+        report("disk_flush", w, 1, 0, n, flush_nanos);
+        report("disk_split", w, 1, 0, splits, split_nanos);
+
+        nanos = run_threads(THREADS[t], std::tr1::bind(disk_scan, d.get(), 2, n,
+                                                       std::tr1::placeholders::_1));
+        report("snapshot_scan", w, THREADS[t], 0, THREADS[t] * n, nanos);
+
+        uint64_t clean_nanos = 0;
+        uint64_t cleans = 0;
+        flush_nanos = 0;
+
+        for (size_t round = 1; round <= 2; ++round)
+        {
+            disk_put(d.get(), &w, 0, n, 1, round * n + 1, 0);
+            flush_all(d.get(), &flush_nanos, &clean_nanos, &cleans);
+        }
+
+        report("disk_clean", w, 1, 0, cleans, clean_nanos);
+    }
+
+    // Read with a quarter, then all of the writes left in the write-ahead log.
+    const size_t depths[] = {0, n / 4, n};
+
+    for (size_t i = 0; i < ELEMENTS(depths); ++i)
+    {
+        e::intrusive_ptr<hyperdisk::disk> d;
+        d = hyperdisk::disk::create(po6::pathname(DISK_PATH), hasher, 2);
+        e::guard g = e::makeobjguard(*d, &hyperdisk::disk::drop);
+        g.use_variable();
+        uint64_t flush_nanos = 0;
+        uint64_t io_nanos = 0;
+        uint64_t ios = 0;
+        disk_put(d.get(), &w, 0, n - depths[i], 1, 1, 0);
+        flush_all(d.get(), &flush_nanos, &io_nanos, &ios);
+        disk_put(d.get(), &w, n - depths[i], n, 1, 1, 0);
+
+        for (size_t t = 0; t < ELEMENTS(THREADS); ++t)
+        {
+            uint64_t nanos = run_threads(THREADS[t], std::tr1::bind(disk_get, d.get(), &w,
+                                                                    std::tr1::placeholders::_1));
+            report("disk_get", w, THREADS[t], depths[i], THREADS[t] * n, nanos);
+        }
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint64_t operations = 100000;
+    uint64_t megabytes = 64;
+
+    if (argc > 3)
+    {
+        std::cerr << "usage: " << argv[0] << " [operations [megabytes]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        if (argc > 1)
+        {
+            operations = e::convert::to_uint64_t(argv[1]);
+        }
+
+        if (argc > 2)
+        {
+            megabytes = e::convert::to_uint64_t(argv[2]);
+        }
+    }
+    catch (std::domain_error& e)
+    {
+        std::cerr << "The operation count and megabytes must be integers." << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (std::out_of_range& e)
+    {
+        std::cerr << "The operation count and megabytes must be suitably small." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<hyperspacehashing::hash_t> funcs(2, hyperspacehashing::EQUALITY);
+    hyperspacehashing::mask::hasher hasher(funcs);
+    std::cout << "benchmark\tkey_size\tvalue_size\tthreads\twal_depth"
+              << "\toperations\tseconds\tops_per_second" << std::endl;
+
+    try
+    {
+        for (size_t k = 0; k < ELEMENTS(KEY_SIZES); ++k)
+        {
+            for (size_t v = 0; v < ELEMENTS(VALUE_SIZES); ++v)
+            {
+                // Each workload writes at most "megabytes" of keys and values.
+                uint64_t count = (megabytes << 20) / (KEY_SIZES[k] + VALUE_SIZES[v]);
+                workload w(KEY_SIZES[k], VALUE_SIZES[v], std::min(operations, count));
+                bench_shard(w);
+                bench_disk(w, hasher);
+            }
+        }
+    }
+    catch (po6::error& e)
+    {
+        std::cerr << "error:  [" << e << "] " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (std::runtime_error& e)
+    {
+        std::cerr << "error:  " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,789 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdio>
+#include <cstring>
+
+// POSIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// STL
+#include <string>
+#include <tr1/functional>
+#include <tr1/memory>
+#include <vector>
+
+// Google Test
+#include <gtest/gtest.h>
+
+// po6
+#include <po6/io/fd.h>
+#include <po6/threads/thread.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/disk.h"
+
+using hyperdisk::returncode;
+
+#define DISK_DIR "tmp-disk-dir"
+
+// Shards small enough that a few hundred objects split them.
+static hyperdisk::geometry
+small_geometry()
+{
+    return hyperdisk::geometry(256, 65536);
+}
+
+static e::intrusive_ptr<hyperdisk::disk>
+create_disk()
+{
+    std::vector<hyperspacehashing::hash_t> hf(2, hyperspacehashing::EQUALITY);
+    return hyperdisk::disk::create(DISK_DIR, hyperspacehashing::mask::hasher(hf),
+                                   2, false, small_geometry());
+}
+
+static e::intrusive_ptr<hyperdisk::disk>
+open_disk()
+{
+    std::vector<hyperspacehashing::hash_t> hf(2, hyperspacehashing::EQUALITY);
+    return hyperdisk::disk::open(DISK_DIR, hyperspacehashing::mask::hasher(hf),
+                                 2, false, small_geometry());
+}
+
+static std::string
+key(size_t i)
+{
+    char buf[32];
+    sprintf(buf, "key%lu", static_cast<unsigned long>(i));
+    return buf;
+}
+
+// The value of object "i" is "val" followed by its key, so that objects
+// written with the same "val" still hash to different secondary coordinates.
+static std::string
+value(const char* val, size_t i)
+{
+    return val + key(i);
+}
+
+static returncode
+put(e::intrusive_ptr<hyperdisk::disk> d, size_t i, const char* val, uint64_t version)
+{
+    std::string k(key(i));
+    std::string v(value(val, i));
+    std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(k.size() + v.size()));
+    backing->pack() << e::buffer::padding(k.size() + v.size());
+    memmove(backing->data(), k.data(), k.size());
+    memmove(backing->data() + k.size(), v.data(), v.size());
+    std::vector<e::slice> vs(1, e::slice(backing->data() + k.size(), v.size()));
+    return d->put(backing, e::slice(backing->data(), k.size()), vs, version);
+}
+
+static returncode
+del(e::intrusive_ptr<hyperdisk::disk> d, size_t i)
+{
+    std::string k(key(i));
+    std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(k.size()));
+    backing->pack() << e::buffer::padding(k.size());
+    memmove(backing->data(), k.data(), k.size());
+    return d->del(backing, e::slice(backing->data(), k.size()));
+}
+
+static returncode
+get(e::intrusive_ptr<hyperdisk::disk> d, size_t i, std::string* val, uint64_t* version)
+{
+    std::string k(key(i));
+    std::vector<e::slice> value;
+    hyperdisk::reference ref;
+    returncode rc = d->get(e::slice(k.data(), k.size()), &value, version, &ref);
+
+    if (rc == hyperdisk::SUCCESS && value.size() == 1)
+    {
+        val->assign(reinterpret_cast<const char*>(value[0].data()), value[0].size());
+    }
+
+    return rc;
+}
+
+// Flush everything, splitting or cleaning shards as they fill.
+static void
+flush_all(e::intrusive_ptr<hyperdisk::disk> d)
+{
+    returncode rc;
+
+    while ((rc = d->flush(1000)) != hyperdisk::DIDNOTHING)
+    {
+        if (rc != hyperdisk::SUCCESS)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, d->do_mandatory_io());
+        }
+    }
+}
+
+// The names of the shard files in the disk's directory.
+static std::vector<std::string>
+shard_files()
+{
+    std::vector<std::string> names;
+    DIR* dir = opendir(DISK_DIR);
+    struct dirent* ent;
+
+    while (dir && (ent = readdir(dir)))
+    {
+        std::string name(ent->d_name);
+
+        if (name.size() == 6 * 16 + 5 && name.find("-tmp") == std::string::npos)
+        {
+            names.push_back(name);
+        }
+    }
+
+    if (dir)
+    {
+        closedir(dir);
+    }
+
+    return names;
+}
+
+static std::string
+shard_path(const std::string& name)
+{
+    return std::string(DISK_DIR) + "/" + name;
+}
+
+// Copy a shard file, as a crash would have left it in place.
+static bool
+copy_file(const std::string& from, const std::string& to)
+{
+    po6::io::fd in(open(from.c_str(), O_RDONLY));
+    po6::io::fd out(open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR));
+    char buf[65536];
+    ssize_t amt;
+
+    if (in.get() < 0 || out.get() < 0)
+    {
+        return false;
+    }
+
+    while ((amt = in.xread(buf, sizeof(buf))) > 0)
+    {
+        if (out.xwrite(buf, amt) != amt)
+        {
+            return false;
+        }
+    }
+
+    return amt == 0;
+}
+
+// Fill the single shard of a new disk, save a copy of it, and split it.
+// Newer versions of every object then go to the four new shards.
+static void
+split_and_rewrite(e::intrusive_ptr<hyperdisk::disk> d, std::string* parent)
+{
+    for (size_t i = 0; i < 300; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, "a", i));
+    }
+
+    returncode rc;
+
+    while ((rc = d->flush(1000)) == hyperdisk::SUCCESS)
+        ;
+
+    ASSERT_EQ(hyperdisk::SEARCHFULL, rc);
+    std::vector<std::string> names = shard_files();
+    ASSERT_EQ(1U, names.size());
+    *parent = names[0];
+    ASSERT_TRUE(copy_file(shard_path(*parent), shard_path(*parent) + ".saved"));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->do_mandatory_io());
+    ASSERT_EQ(4U, shard_files().size());
+    flush_all(d);
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, "b", 1000 + i));
+    }
+
+    flush_all(d);
+    ASSERT_EQ(4U, shard_files().size());
+}
+
+namespace
+{
+
+TEST(DiskTest, ReopenAfterSplit)
+{
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+    std::string parent;
+    split_and_rewrite(d, &parent);
+    d = e::intrusive_ptr<hyperdisk::disk>();
+
+    // The old shard reappears as if the split crashed before dropping it.
+    // All four new shards are in place, so they win.
+    ASSERT_EQ(0, rename(shard_path(parent + ".saved").c_str(), shard_path(parent).c_str()));
+    d = open_disk();
+    EXPECT_EQ(4U, shard_files().size());
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        std::string val;
+        uint64_t version;
+        ASSERT_EQ(hyperdisk::SUCCESS, get(d, i, &val, &version));
+        EXPECT_EQ(1000 + i, version);
+        EXPECT_EQ(value("b", i), val);
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+TEST(DiskTest, ReopenAfterPartialSplit)
+{
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+    std::string parent;
+    split_and_rewrite(d, &parent);
+    d = e::intrusive_ptr<hyperdisk::disk>();
+
+    // The split crashed after renaming only three of the new shards, so
+    // the old shard is authoritative and the new shards go.
+    std::vector<std::string> names = shard_files();
+    ASSERT_EQ(0, unlink(shard_path(names[0]).c_str()));
+    ASSERT_EQ(0, rename(shard_path(parent + ".saved").c_str(), shard_path(parent).c_str()));
+    d = open_disk();
+    names = shard_files();
+    ASSERT_EQ(1U, names.size());
+    EXPECT_EQ(parent, names[0]);
+    size_t found = 0;
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        std::string val;
+        uint64_t version;
+        returncode rc = get(d, i, &val, &version);
+
+        if (rc == hyperdisk::SUCCESS)
+        {
+            EXPECT_EQ(i, version);
+            EXPECT_EQ(value("a", i), val);
+            ++found;
+        }
+        else
+        {
+            EXPECT_EQ(hyperdisk::NOTFOUND, rc);
+        }
+    }
+
+    EXPECT_EQ(256U, found);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+TEST(DiskTest, ReopenWithCorruptHeader)
+{
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+    std::string parent;
+    split_and_rewrite(d, &parent);
+    ASSERT_EQ(0, unlink(shard_path(parent + ".saved").c_str()));
+    d = e::intrusive_ptr<hyperdisk::disk>();
+
+    // Both copies of one shard's header are lost, so the shard is rebuilt.
+    std::vector<std::string> names = shard_files();
+    ASSERT_EQ(4U, names.size());
+    po6::io::fd fd(open(shard_path(names[0]).c_str(), O_RDWR));
+    char garbage[4096];
+    memset(garbage, 0xff, sizeof(garbage));
+    ASSERT_EQ(4096, pwrite(fd.get(), garbage, sizeof(garbage), 0));
+    d = open_disk();
+    EXPECT_EQ(4U, shard_files().size());
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        std::string val;
+        uint64_t version;
+        ASSERT_EQ(hyperdisk::SUCCESS, get(d, i, &val, &version));
+        EXPECT_EQ(1000 + i, version);
+        EXPECT_EQ(value("b", i), val);
+    }
+
+    d = e::intrusive_ptr<hyperdisk::disk>();
+
+    // A shard which cannot be rebuilt is set aside, and replaced by an empty
+    // shard, while the rest of the disk remains readable.
+    ASSERT_EQ(4096, pwrite(fd.get(), garbage, sizeof(garbage), 0));
+    ASSERT_EQ(0, ftruncate(fd.get(), 8192));
+    d = open_disk();
+    EXPECT_EQ(4U, shard_files().size());
+    struct stat st;
+    ASSERT_EQ(0, stat(shard_path("corrupt-" + names[0]).c_str(), &st));
+    size_t found = 0;
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        std::string val;
+        uint64_t version;
+        returncode rc = get(d, i, &val, &version);
+
+        if (rc == hyperdisk::SUCCESS)
+        {
+            EXPECT_EQ(1000 + i, version);
+            ++found;
+        }
+        else
+        {
+            EXPECT_EQ(hyperdisk::NOTFOUND, rc);
+        }
+    }
+
+    EXPECT_LT(0U, found);
+    EXPECT_GT(300U, found);
+    ASSERT_EQ(0, unlink(shard_path("corrupt-" + names[0]).c_str()));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+TEST(DiskTest, ReopenAfterMerge)
+{
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+    std::string parent;
+    split_and_rewrite(d, &parent);
+    ASSERT_EQ(0, unlink(shard_path(parent + ".saved").c_str()));
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        if (i % 10 != 0)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, del(d, i));
+        }
+    }
+
+    flush_all(d);
+    std::vector<std::string> before = shard_files();
+
+    for (size_t i = 0; i < before.size(); ++i)
+    {
+        ASSERT_TRUE(copy_file(shard_path(before[i]), shard_path(before[i]) + ".saved"));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->do_optimistic_io());
+    ASSERT_EQ(3U, shard_files().size());
+    d = e::intrusive_ptr<hyperdisk::disk>();
+
+    // The two merged shards reappear as if the merge crashed before
+    // dropping them.  The merged shard covers just the two, so it wins.
+    for (size_t i = 0; i < before.size(); ++i)
+    {
+        std::string saved(shard_path(before[i]) + ".saved");
+
+        if (access(shard_path(before[i]).c_str(), F_OK) == 0)
+        {
+            ASSERT_EQ(0, unlink(saved.c_str()));
+        }
+        else
+        {
+            ASSERT_EQ(0, rename(saved.c_str(), shard_path(before[i]).c_str()));
+        }
+    }
+
+    ASSERT_EQ(5U, shard_files().size());
+    d = open_disk();
+    EXPECT_EQ(3U, shard_files().size());
+
+    for (size_t i = 0; i < 300; ++i)
+    {
+        std::string val;
+        uint64_t version;
+        returncode rc = get(d, i, &val, &version);
+
+        if (i % 10 == 0)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, rc);
+            EXPECT_EQ(1000 + i, version);
+        }
+        else
+        {
+            EXPECT_EQ(hyperdisk::NOTFOUND, rc);
+        }
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+// Flush until the log is empty, as one of several threads doing the same.
+static void
+flusher(e::intrusive_ptr<hyperdisk::disk> d)
+{
+    uint64_t entries = 1;
+    uint64_t bytes;
+    int fullest;
+
+    // A thread which finds another flushing, with no batch to help with,
+    // gets DIDNOTHING even though the log is not yet empty.
+    while (entries > 0)
+    {
+        returncode rc = d->flush(100);
+
+        if (rc == hyperdisk::DATAFULL || rc == hyperdisk::SEARCHFULL)
+        {
+            // Another thread may have dealt with the full shard already.
+            d->do_mandatory_io();
+        }
+        else if (rc != hyperdisk::DIDNOTHING)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, rc);
+        }
+
+        d->pressure(&entries, &bytes, &fullest);
+    }
+}
+
+// Rewrites objects with values alternating round by round, so that they
+// move between shards, while the main thread merges shards.
+class rewriter
+{
+    public:
+        rewriter(e::intrusive_ptr<hyperdisk::disk> d, size_t objects,
+                 size_t rounds, uint64_t version)
+            : m_disk(d), m_objects(objects), m_rounds(rounds),
+              m_version(version), m_versions(objects), m_done(false) {}
+
+    public:
+        void run()
+        {
+            for (size_t r = 0; r < m_rounds; ++r)
+            {
+                for (size_t i = 0; i < m_objects; ++i)
+                {
+                    EXPECT_EQ(hyperdisk::SUCCESS, put(m_disk, i, m_version / m_objects % 2 ? "b" : "a", m_version));
+                    m_versions[i] = m_version;
+                    ++m_version;
+                    returncode rc = m_disk->flush(1);
+
+                    if (rc == hyperdisk::DATAFULL || rc == hyperdisk::SEARCHFULL)
+                    {
+                        m_disk->do_mandatory_io();
+                    }
+
+                    check();
+                }
+            }
+
+            __sync_synchronize();
+            m_done = true;
+        }
+        bool done() { __sync_synchronize(); return m_done; }
+        // Every object written so far must be visible at its last version,
+        // no matter which shards are being merged.
+        void check()
+        {
+            for (size_t i = 0; i < m_objects; ++i)
+            {
+                std::string val;
+                uint64_t version;
+
+                if (m_versions[i] == 0)
+                {
+                    continue;
+                }
+
+                ASSERT_EQ(hyperdisk::SUCCESS, get(m_disk, i, &val, &version)) << "object " << i;
+                ASSERT_EQ(m_versions[i], version);
+            }
+        }
+        uint64_t version() const { return m_version; }
+
+    private:
+        rewriter(const rewriter&);
+        rewriter& operator = (const rewriter&);
+
+    private:
+        e::intrusive_ptr<hyperdisk::disk> m_disk;
+        size_t m_objects;
+        size_t m_rounds;
+        uint64_t m_version;
+        std::vector<uint64_t> m_versions;
+        bool m_done;
+};
+
+TEST(DiskTest, MergeWhileRewriting)
+{
+    const size_t objects = 50;
+    const size_t fillers = 2000;
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+    uint64_t version = objects;
+    size_t merges = 0;
+
+    for (size_t cycle = 0; cycle < 20; ++cycle)
+    {
+        // Split the disk into many shards, and then empty them.
+        for (size_t i = objects; i < fillers; ++i)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, "f", 0));
+        }
+
+        flush_all(d);
+
+        for (size_t i = objects; i < fillers; ++i)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, del(d, i));
+        }
+
+        flush_all(d);
+        ASSERT_LT(4U, shard_files().size());
+
+        // Merge them back together while objects move between them.
+        rewriter rw(d, objects, 20, version);
+        po6::threads::thread t(std::tr1::bind(&rewriter::run, &rw));
+        t.start();
+
+        while (!rw.done())
+        {
+            if (d->do_optimistic_io() == hyperdisk::SUCCESS)
+            {
+                ++merges;
+            }
+        }
+
+        t.join();
+        version = rw.version();
+    }
+
+    flush_all(d);
+    EXPECT_LT(0U, merges);
+
+    // Every object has its last version, in exactly one shard.
+    for (size_t i = 0; i < fillers; ++i)
+    {
+        std::string val;
+        uint64_t v;
+        returncode rc = get(d, i, &val, &v);
+
+        if (i < objects)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, rc) << "object " << i;
+            EXPECT_EQ(version - objects + i, v);
+            EXPECT_EQ(value(v / objects % 2 ? "b" : "a", i), val);
+        }
+        else
+        {
+            EXPECT_EQ(hyperdisk::NOTFOUND, rc);
+        }
+    }
+
+    e::intrusive_ptr<hyperdisk::snapshot> snap = d->make_snapshot(hyperspacehashing::search(2));
+    size_t count = 0;
+
+    for (; snap->valid(); snap->next())
+    {
+        ++count;
+    }
+
+    EXPECT_EQ(objects, count);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+TEST(DiskTest, ParallelFlush)
+{
+    const size_t objects = 1000;
+    const size_t threads = 4;
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+    std::vector<uint64_t> versions(objects, 0);
+
+    for (size_t i = 0; i < objects; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, "a", i + 1));
+        versions[i] = i + 1;
+    }
+
+    flush_all(d);
+    ASSERT_LT(4U, shard_files().size());
+
+    // Every round moves objects between shards and deletes a tenth of them,
+    // while several threads flush at once.
+    for (size_t round = 1; round <= 5; ++round)
+    {
+        for (size_t i = 0; i < objects; ++i)
+        {
+            if (i % 10 == round)
+            {
+                ASSERT_EQ(hyperdisk::SUCCESS, del(d, i));
+                versions[i] = 0;
+            }
+            else
+            {
+                uint64_t version = round * objects + i + 1;
+                ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, round % 2 ? "b" : "a", version));
+                versions[i] = version;
+            }
+        }
+
+        std::vector<std::tr1::shared_ptr<po6::threads::thread> > ts;
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            ts.push_back(std::tr1::shared_ptr<po6::threads::thread>(
+                        new po6::threads::thread(std::tr1::bind(flusher, d))));
+            ts.back()->start();
+        }
+
+        for (size_t t = 0; t < threads; ++t)
+        {
+            ts[t]->join();
+        }
+
+        flush_all(d);
+
+        for (size_t i = 0; i < objects; ++i)
+        {
+            std::string val;
+            uint64_t version;
+            returncode rc = get(d, i, &val, &version);
+
+            if (versions[i] == 0)
+            {
+                ASSERT_EQ(hyperdisk::NOTFOUND, rc) << "object " << i;
+            }
+            else
+            {
+                ASSERT_EQ(hyperdisk::SUCCESS, rc) << "object " << i;
+                ASSERT_EQ(versions[i], version);
+                ASSERT_EQ(value(round % 2 ? "b" : "a", i), val);
+            }
+        }
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+TEST(DiskTest, SpillingRollingSnapshot)
+{
+    const size_t objects = 100;
+    e::intrusive_ptr<hyperdisk::disk> d = create_disk();
+
+    for (size_t i = 0; i < objects; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, "a", i));
+    }
+
+    flush_all(d);
+    e::intrusive_ptr<hyperdisk::rolling_snapshot> snap = d->make_rolling_snapshot(true);
+
+    // Each round is flushed, and so spilled, before the snapshot reads any of
+    // it.  Every third write of a round is a DEL, recorded with version 0.
+    std::vector<std::pair<size_t, uint64_t> > expected;
+    uint64_t version = objects;
+
+    for (size_t round = 0; round < 5; ++round)
+    {
+        for (size_t i = 0; i < objects; ++i)
+        {
+            size_t obj = (i * 7 + round) % objects;
+
+            if (i % 3 == 2)
+            {
+                ASSERT_EQ(hyperdisk::SUCCESS, del(d, obj));
+                expected.push_back(std::make_pair(obj, 0));
+            }
+            else
+            {
+                ASSERT_EQ(hyperdisk::SUCCESS, put(d, obj, "b", version));
+                expected.push_back(std::make_pair(obj, version));
+                ++version;
+            }
+        }
+
+        flush_all(d);
+    }
+
+    // The objects in the shards when the snapshot was taken come first.
+    for (size_t i = 0; i < objects; ++i)
+    {
+        ASSERT_TRUE(snap->valid());
+        ASSERT_TRUE(snap->has_value());
+        EXPECT_GT(objects, snap->version());
+        snap->next();
+    }
+
+    // Then every write made since, in order.
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        size_t obj = expected[i].first;
+        ASSERT_TRUE(snap->valid()) << "entry " << i;
+        EXPECT_EQ(key(obj), std::string(reinterpret_cast<const char*>(snap->key().data()),
+                                        snap->key().size()));
+
+        if (expected[i].second == 0)
+        {
+            EXPECT_FALSE(snap->has_value());
+        }
+        else
+        {
+            ASSERT_TRUE(snap->has_value());
+            EXPECT_EQ(expected[i].second, snap->version());
+            ASSERT_EQ(1U, snap->value().size());
+            EXPECT_EQ(value("b", obj), std::string(reinterpret_cast<const char*>(snap->value()[0].data()),
+                                                   snap->value()[0].size()));
+        }
+
+        snap->next();
+    }
+
+    EXPECT_FALSE(snap->valid());
+    EXPECT_FALSE(snap->failed());
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+}
+
+TEST(DiskTest, DropDurable)
+{
+    std::vector<hyperspacehashing::hash_t> hf(2, hyperspacehashing::EQUALITY);
+    hyperspacehashing::mask::hasher hasher(hf);
+    e::intrusive_ptr<hyperdisk::disk> d;
+    d = hyperdisk::disk::create(DISK_DIR, hasher, 2, true, small_geometry());
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, put(d, i, "a", i));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->commit());
+    d = e::intrusive_ptr<hyperdisk::disk>();
+
+    // The reopened disk starts a new log segment holding the replayed writes.
+    d = hyperdisk::disk::open(DISK_DIR, hasher, 2, true, small_geometry());
+    ASSERT_EQ(hyperdisk::SUCCESS, d->drop());
+    struct stat st;
+    EXPECT_GT(0, stat(DISK_DIR, &st));
+}
+
+} // namespace
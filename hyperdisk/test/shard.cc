@@ -31,8 +31,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+// C
+#include <cstdlib>
+#include <cstring>
+
 // STL
 #include <memory>
+#include <stdexcept>
+#include <tr1/memory>
+#include <vector>
 
 // Google Test
 #include <gtest/gtest.h>
@@ -44,7 +51,12 @@
 #include "hyperspacehashing/hyperspacehashing/mask.h"
 
 // HyperDisk
+#include "hyperdisk/hyperdisk/compressor.h"
+#include "hyperdisk/column_filter.h"
+#include "hyperdisk/hash_table_probe.h"
+#include "hyperdisk/search_log_scan.h"
 #include "hyperdisk/shard.h"
+#include "hyperdisk/shard_constants.h"
 #include "hyperdisk/shard_snapshot.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-default"
@@ -206,22 +218,22 @@ TEST(ShardTest, DataFull)
 
     for (size_t i = 0; i < 32263; ++i)
     {
-        std::auto_ptr<e::buffer> key(e::buffer::create(1018 + sizeof(uint64_t)));
-        key->pack() << static_cast<uint64_t>(i) << e::buffer::padding(1018);
-        assert(key->size() == 1026);
+        std::auto_ptr<e::buffer> key(e::buffer::create(1014 + sizeof(uint64_t)));
+        key->pack() << static_cast<uint64_t>(i) << e::buffer::padding(1014);
+        assert(key->size() == 1022);
 
         ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(i, 0), key->as_slice(), value, 0));
         ASSERT_EQ(100 * 1040 * (i + 1) / DATA_SEGMENT_SIZE, d->used_space());
     }
 
-    std::auto_ptr<e::buffer> keya(e::buffer::create(899));
-    keya->pack() << static_cast<uint64_t>(32263) << e::buffer::padding(891);
-    assert(keya->size() == 899);
+    std::auto_ptr<e::buffer> keya(e::buffer::create(895));
+    keya->pack() << static_cast<uint64_t>(32263) << e::buffer::padding(887);
+    assert(keya->size() == 895);
     ASSERT_EQ(hyperdisk::DATAFULL, d->put(coord(32263, 0), keya->as_slice(), value, 0));
 
-    std::auto_ptr<e::buffer> keyb(e::buffer::create(898));
-    keyb->pack() << static_cast<uint64_t>(32263) << e::buffer::padding(890);
-    assert(keyb->size() == 898);
+    std::auto_ptr<e::buffer> keyb(e::buffer::create(894));
+    keyb->pack() << static_cast<uint64_t>(32263) << e::buffer::padding(886);
+    assert(keyb->size() == 894);
     ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(32263, 0), keyb->as_slice(), value, 0));
 
     ASSERT_TRUE(d->fsck());
@@ -253,8 +265,8 @@ TEST(ShardTest, StaleSpaceByData)
     po6::io::fd cwd(AT_FDCWD);
     e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
     e::guard g = e::makeguard(::unlink, "tmp-disk");
-    std::auto_ptr<e::buffer> key(e::buffer::create(2026));
-    key->pack() << e::buffer::padding(2026);
+    std::auto_ptr<e::buffer> key(e::buffer::create(2022));
+    key->pack() << e::buffer::padding(2022);
     std::vector<e::slice> value;
 
     for (size_t i = 0; i < 16384; ++i)
@@ -273,9 +285,9 @@ TEST(ShardTest, CopyFromFull)
     e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
     e::guard g = e::makeguard(::unlink, "tmp-disk");
     hyperspacehashing::mask::hasher h(std::vector<hyperspacehashing::hash_t>(2, hyperspacehashing::EQUALITY));
-    std::auto_ptr<e::buffer> value_backing(e::buffer::create(998));
+    std::auto_ptr<e::buffer> value_backing(e::buffer::create(994));
     std::vector<e::slice> value(1);
-    value_backing->pack() << e::buffer::padding(998);
+    value_backing->pack() << e::buffer::padding(994);
     value[0] = value_backing->as_slice();
 
     for (uint64_t i = 0; i < 32768; ++i)
@@ -515,4 +527,751 @@ TEST(ShardTest, Snapshot)
     EXPECT_FALSE(s5b.valid());
 }
 
+TEST(ShardTest, Reopen)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    const hyperspacehashing::mask::coordinate c(1, 1, 2, 0, 0, 0);
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    uint64_t version;
+    d->set_coordinate(c);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xb5e57068UL, 0), e::slice("one", 3), value, 1));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xa3a81e5fUL, 0), e::slice("two", 3), value, 2));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->sync());
+
+    // These are not reflected in the header, and must be replayed.
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0x6e9accf9UL, 0), e::slice("three", 5), value, 3));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->del(0xb5e57068UL, e::slice("one", 3)));
+
+    e::intrusive_ptr<hyperdisk::shard> r = hyperdisk::shard::open(cwd, "tmp-disk");
+    EXPECT_TRUE(r->get_coordinate() == c);
+    EXPECT_EQ(d->used_space(), r->used_space());
+    EXPECT_EQ(hyperdisk::NOTFOUND, r->get(0xb5e57068UL, e::slice("one", 3), &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, r->get(0xa3a81e5fUL, e::slice("two", 3), &value, &version));
+    EXPECT_EQ(2, version);
+    ASSERT_EQ(hyperdisk::SUCCESS, r->get(0x6e9accf9UL, e::slice("three", 5), &value, &version));
+    EXPECT_EQ(3, version);
+    ASSERT_TRUE(value.size() == 1 && value[0] == e::slice("value", 5));
+    ASSERT_TRUE(r->fsck());
+    d = r = NULL;
+
+    // Reopen after a clean close, and keep writing.
+    d = hyperdisk::shard::open(cwd, "tmp-disk");
+    value.assign(1, e::slice("value", 5));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xb5e57068UL, 0), e::slice("one", 3), value, 4));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xb5e57068UL, e::slice("one", 3), &value, &version));
+    EXPECT_EQ(4, version);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0x6e9accf9UL, e::slice("three", 5), &value, &version));
+    EXPECT_EQ(3, version);
+    d = NULL;
+
+    // A corrupt header falls back to its copy, and must be detected when
+    // both are corrupt.
+    po6::io::fd fd(open("tmp-disk", O_RDWR));
+    ASSERT_EQ(8, pwrite(fd.get(), "garbage!", 8, 0));
+    d = hyperdisk::shard::open(cwd, "tmp-disk");
+    EXPECT_TRUE(d->get_coordinate() == c);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xb5e57068UL, e::slice("one", 3), &value, &version));
+    EXPECT_EQ(4, version);
+    d = NULL;
+    ASSERT_EQ(8, pwrite(fd.get(), "garbage!", 8, 0));
+    ASSERT_EQ(8, pwrite(fd.get(), "garbage!", 8, SHARD_HEADER_COPY_OFFSET));
+    EXPECT_THROW(hyperdisk::shard::open(cwd, "tmp-disk"), std::runtime_error);
+}
+
+TEST(ShardTest, Rebuild)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    const hyperdisk::geometry small(256, 65536);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk", small);
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    const hyperspacehashing::mask::coordinate c(1, 1, 2, 0, 0, 0);
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    uint64_t version;
+    d->set_coordinate(c);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xb5e57068UL, 0), e::slice("one", 3), value, 1));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xa3a81e5fUL, 0), e::slice("two", 3), value, 2));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->del(0xb5e57068UL, e::slice("one", 3)));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->sync());
+    d = NULL;
+
+    po6::io::fd fd(open("tmp-disk", O_RDWR));
+    ASSERT_EQ(8, pwrite(fd.get(), "garbage!", 8, 0));
+    ASSERT_EQ(8, pwrite(fd.get(), "garbage!", 8, SHARD_HEADER_COPY_OFFSET));
+    EXPECT_THROW(hyperdisk::shard::open(cwd, "tmp-disk"), std::runtime_error);
+
+    // The file is too small for the default geometry.
+    EXPECT_THROW(hyperdisk::shard::rebuild(cwd, "tmp-disk", hyperdisk::geometry(), c),
+                 std::runtime_error);
+    d = hyperdisk::shard::rebuild(cwd, "tmp-disk", small, c);
+    EXPECT_TRUE(d->get_coordinate() == c);
+    EXPECT_EQ(2U, d->entries());
+    EXPECT_EQ(hyperdisk::NOTFOUND, d->get(0xb5e57068UL, e::slice("one", 3), &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xa3a81e5fUL, e::slice("two", 3), &value, &version));
+    EXPECT_EQ(2, version);
+    ASSERT_TRUE(d->fsck());
+    d = NULL;
+
+    // The rebuilt header is written out.
+    d = hyperdisk::shard::open(cwd, "tmp-disk");
+    EXPECT_TRUE(d->get_coordinate() == c);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xa3a81e5fUL, e::slice("two", 3), &value, &version));
+}
+
+TEST(ShardTest, Geometry)
+{
+    const hyperdisk::geometry small(256, 65536);
+    ASSERT_TRUE(small.valid());
+    ASSERT_FALSE(hyperdisk::geometry(300, 65536).valid());
+    ASSERT_TRUE(hyperdisk::geometry::for_object_size(1024) == hyperdisk::geometry());
+    ASSERT_LT(SEARCH_INDEX_ENTRIES, hyperdisk::geometry::for_object_size(100).search_entries);
+    ASSERT_LT(DATA_SEGMENT_SIZE, hyperdisk::geometry::for_object_size(65536).data_size);
+
+    po6::io::fd cwd(AT_FDCWD);
+    EXPECT_THROW(hyperdisk::shard::create(cwd, "tmp-disk", hyperdisk::geometry(300, 65536)),
+                 std::invalid_argument);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk", small);
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    uint64_t version;
+
+    for (uint64_t i = 0; i < 256; ++i)
+    {
+        std::auto_ptr<e::buffer> key(e::buffer::create(sizeof(i)));
+        key->pack() << i;
+        ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(i, 0), key->as_slice(), value, i));
+    }
+
+    ASSERT_EQ(hyperdisk::SEARCHFULL, d->put(coord(256, 0), e::slice("key", 3), value, 0));
+    ASSERT_EQ(100, d->used_space());
+    ASSERT_EQ(40U, d->average_entry_size());
+    d = NULL;
+
+    // The geometry is recovered from the header.
+    d = hyperdisk::shard::open(cwd, "tmp-disk");
+    ASSERT_TRUE(d->get_geometry() == small);
+    ASSERT_EQ(100, d->used_space());
+
+    // Copy into a shard of a larger geometry.
+    e::intrusive_ptr<hyperdisk::shard> big = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    d->copy_to(hyperspacehashing::mask::coordinate(), big);
+    ASSERT_EQ(0, big->used_space());
+
+    for (uint64_t i = 0; i < 256; ++i)
+    {
+        std::auto_ptr<e::buffer> key(e::buffer::create(sizeof(i)));
+        key->pack() << i;
+        ASSERT_EQ(hyperdisk::SUCCESS, big->get(i, key->as_slice(), &value, &version));
+        ASSERT_EQ(i, version);
+    }
+
+    ASSERT_TRUE(d->fsck());
+    ASSERT_TRUE(big->fsck());
+}
+
+TEST(ShardTest, Columns)
+{
+    // Attribute 1 is columnar; attribute 0 is not.
+    const hyperdisk::geometry geom(1024, 1 << 20, 0x2);
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk", geom);
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<uint64_t> nums(1001);
+    std::vector<std::tr1::shared_ptr<e::buffer> > keys;
+
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        nums[i] = i;
+        keys.push_back(std::tr1::shared_ptr<e::buffer>(e::buffer::create(sizeof(i))));
+        keys.back()->pack() << i;
+        std::vector<e::slice> value;
+        value.push_back(e::slice("value", 5));
+        value.push_back(e::slice(&nums[i], sizeof(uint64_t)));
+        ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(i, 0), keys[i]->as_slice(), value, i));
+    }
+
+    // Move object 305 out of the range.
+    nums[1000] = 5000;
+    std::vector<e::slice> value;
+    value.push_back(e::slice("value", 5));
+    value.push_back(e::slice(&nums[1000], sizeof(uint64_t)));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(305, 0), keys[305]->as_slice(), value, 1000));
+
+    hyperspacehashing::search terms(3);
+    terms.range_set(2, 300, 310);
+    hyperdisk::column_filter filter(terms);
+    ASSERT_EQ(1U, filter.size());
+    ASSERT_EQ(1U, filter.attr(0));
+
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        hyperdisk::shard_snapshot snap = d->make_snapshot();
+        std::vector<uint64_t> versions;
+
+        for (; snap.valid(hyperspacehashing::mask::coordinate(), filter); snap.next())
+        {
+            versions.push_back(snap.version());
+        }
+
+        ASSERT_EQ(9U, versions.size());
+
+        for (uint64_t i = 0; i < 9; ++i)
+        {
+            ASSERT_EQ(i < 5 ? 300 + i : 301 + i, versions[i]);
+        }
+
+        ASSERT_TRUE(d->fsck());
+
+        // The columns survive a reopen, and are rebuilt on copy.
+        if (pass == 0)
+        {
+            ASSERT_EQ(hyperdisk::SUCCESS, d->sync());
+            d = hyperdisk::shard::open(cwd, "tmp-disk");
+            ASSERT_TRUE(d->get_geometry() == geom);
+        }
+        else if (pass == 1)
+        {
+            e::intrusive_ptr<hyperdisk::shard> c = hyperdisk::shard::create(cwd, "tmp-disk2", geom);
+            e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+            d->copy_to(hyperspacehashing::mask::coordinate(), c);
+            d = c;
+        }
+    }
+}
+
+TEST(ShardTest, CopySnapshotAndDelta)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    std::vector<std::tr1::shared_ptr<e::buffer> > keys;
+    uint64_t version;
+
+    for (uint64_t i = 0; i < 201; ++i)
+    {
+        keys.push_back(std::tr1::shared_ptr<e::buffer>(e::buffer::create(sizeof(i))));
+        keys.back()->pack() << i;
+    }
+
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(i, 0), keys[i]->as_slice(), value, i));
+    }
+
+    hyperdisk::shard_snapshot snap = d->make_snapshot();
+
+    // Changes made after the snapshot.
+    ASSERT_EQ(hyperdisk::SUCCESS, d->del(1, keys[1]->as_slice()));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(2, 0), keys[2]->as_slice(), value, 102));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(200, 0), keys[200]->as_slice(), value, 200));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(3, 0), keys[3]->as_slice(), value, 103));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->del(3, keys[3]->as_slice()));
+
+    e::intrusive_ptr<hyperdisk::shard> t = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    ASSERT_EQ(hyperdisk::SUCCESS, d->copy_to(hyperspacehashing::mask::coordinate(), snap, t));
+
+    // The copy reflects the snapshot.
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(1, keys[1]->as_slice(), &value, &version));
+    EXPECT_EQ(1U, version);
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(2, keys[2]->as_slice(), &value, &version));
+    EXPECT_EQ(2U, version);
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(3, keys[3]->as_slice(), &value, &version));
+    EXPECT_EQ(3U, version);
+    EXPECT_EQ(hyperdisk::NOTFOUND, t->get(200, keys[200]->as_slice(), &value, &version));
+
+    // After catching up, it reflects the shard.
+    ASSERT_EQ(hyperdisk::SUCCESS, d->copy_delta_to(hyperspacehashing::mask::coordinate(), snap, t));
+    EXPECT_EQ(hyperdisk::NOTFOUND, t->get(1, keys[1]->as_slice(), &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(2, keys[2]->as_slice(), &value, &version));
+    EXPECT_EQ(102U, version);
+    EXPECT_EQ(hyperdisk::NOTFOUND, t->get(3, keys[3]->as_slice(), &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(200, keys[200]->as_slice(), &value, &version));
+    EXPECT_EQ(200U, version);
+
+    for (uint64_t i = 4; i < 100; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, t->get(i, keys[i]->as_slice(), &value, &version));
+        EXPECT_EQ(i, version);
+    }
+
+    ASSERT_TRUE(t->fsck());
+}
+
+TEST(ShardTest, CopyDeltaFromSiblings)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d1 = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk");
+    e::intrusive_ptr<hyperdisk::shard> d2 = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    uint64_t version;
+
+    // Key 1 starts out in the first shard and key 2 in the second.
+    ASSERT_EQ(hyperdisk::SUCCESS, d1->put(coord(1, 0), e::slice("k1", 2), value, 1));
+    ASSERT_EQ(hyperdisk::SUCCESS, d2->put(coord(2, 1), e::slice("k2", 2), value, 2));
+    hyperdisk::shard_snapshot snap1 = d1->make_snapshot();
+    hyperdisk::shard_snapshot snap2 = d2->make_snapshot();
+
+    // Each key moves to the other shard after the snapshots.
+    ASSERT_EQ(hyperdisk::SUCCESS, d1->del(1, e::slice("k1", 2)));
+    ASSERT_EQ(hyperdisk::SUCCESS, d2->put(coord(1, 1), e::slice("k1", 2), value, 11));
+    ASSERT_EQ(hyperdisk::SUCCESS, d2->del(2, e::slice("k2", 2)));
+    ASSERT_EQ(hyperdisk::SUCCESS, d1->put(coord(2, 0), e::slice("k2", 2), value, 12));
+
+    e::intrusive_ptr<hyperdisk::shard> t = hyperdisk::shard::create(cwd, "tmp-disk3");
+    e::guard g3 = e::makeguard(::unlink, "tmp-disk3");
+    ASSERT_EQ(hyperdisk::SUCCESS, d1->copy_to(hyperspacehashing::mask::coordinate(), snap1, t));
+    ASSERT_EQ(hyperdisk::SUCCESS, d2->copy_to(hyperspacehashing::mask::coordinate(), snap2, t));
+
+    // Both shards' invalidations go first, so that neither removes the
+    // version the other appended.
+    d1->copy_invalidated_to(hyperspacehashing::mask::coordinate(), snap1, t);
+    d2->copy_invalidated_to(hyperspacehashing::mask::coordinate(), snap2, t);
+    EXPECT_EQ(hyperdisk::NOTFOUND, t->get(1, e::slice("k1", 2), &value, &version));
+    EXPECT_EQ(hyperdisk::NOTFOUND, t->get(2, e::slice("k2", 2), &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, d1->copy_appended_to(hyperspacehashing::mask::coordinate(), snap1, t));
+    ASSERT_EQ(hyperdisk::SUCCESS, d2->copy_appended_to(hyperspacehashing::mask::coordinate(), snap2, t));
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(1, e::slice("k1", 2), &value, &version));
+    EXPECT_EQ(11U, version);
+    ASSERT_EQ(hyperdisk::SUCCESS, t->get(2, e::slice("k2", 2), &value, &version));
+    EXPECT_EQ(12U, version);
+
+    ASSERT_TRUE(t->fsck());
+}
+
+TEST(ShardTest, BloomFilter)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    std::vector<std::tr1::shared_ptr<e::buffer> > keys;
+
+    for (uint64_t i = 0; i < 20000; ++i)
+    {
+        keys.push_back(std::tr1::shared_ptr<e::buffer>(e::buffer::create(sizeof(i))));
+        keys.back()->pack() << i;
+    }
+
+    for (uint64_t i = 0; i < 10000; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(i, 0), keys[i]->as_slice(), value, i));
+    }
+
+    size_t false_positives = 0;
+
+    for (uint64_t i = 0; i < 20000; ++i)
+    {
+        bool may = d->may_contain(hyperdisk::shard::bloom_hash(i, keys[i]->as_slice()));
+
+        if (i < 10000)
+        {
+            ASSERT_TRUE(may);
+        }
+        else if (may)
+        {
+            ++false_positives;
+        }
+    }
+
+    EXPECT_LT(false_positives, 500U);
+
+    // Keys survive a reopen, and deleted keys are dropped on copy.
+    for (uint64_t i = 0; i < 5000; ++i)
+    {
+        ASSERT_EQ(hyperdisk::SUCCESS, d->del(i, keys[i]->as_slice()));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->sync());
+    d = hyperdisk::shard::open(cwd, "tmp-disk");
+    e::intrusive_ptr<hyperdisk::shard> c = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    d->copy_to(hyperspacehashing::mask::coordinate(), c);
+    false_positives = 0;
+
+    for (uint64_t i = 0; i < 10000; ++i)
+    {
+        uint64_t h = hyperdisk::shard::bloom_hash(i, keys[i]->as_slice());
+        ASSERT_TRUE(d->may_contain(h));
+
+        if (i >= 5000)
+        {
+            ASSERT_TRUE(c->may_contain(h));
+        }
+        else if (c->may_contain(h))
+        {
+            ++false_positives;
+        }
+    }
+
+    EXPECT_LT(false_positives, 250U);
+}
+
+TEST(ShardTest, SearchLogScan)
+{
+    const size_t entries = 1024;
+    std::vector<char> log(entries * SEARCH_INDEX_ENTRY_SIZE);
+    unsigned int seed = 0;
+    uint32_t offset = INDEX_SEGMENT_SIZE;
+
+    // Hashes come from a small range so that masked comparisons hit often.
+    for (size_t i = 0; i < entries; ++i)
+    {
+        uint32_t invalid = rand_r(&seed) % 4 == 0 ? offset + (rand_r(&seed) % 64) * 64 : 0;
+        uint64_t primary = rand_r(&seed) % 4;
+        uint64_t lower = rand_r(&seed) % 4;
+        uint64_t upper = rand_r(&seed) % 4;
+        char* ent = &log[i * SEARCH_INDEX_ENTRY_SIZE];
+        memmove(ent, &offset, sizeof(offset));
+        memmove(ent + 4, &invalid, sizeof(invalid));
+        memmove(ent + 8, &primary, sizeof(primary));
+        memmove(ent + 16, &lower, sizeof(lower));
+        memmove(ent + 24, &upper, sizeof(upper));
+        offset += 64;
+    }
+
+    // Leave the tail of the log unused, as in a partially-filled shard.
+    memset(&log[(entries - 37) * SEARCH_INDEX_ENTRY_SIZE], 0, 37 * SEARCH_INDEX_ENTRY_SIZE);
+
+    for (size_t trial = 0; trial < 1000; ++trial)
+    {
+        hyperspacehashing::mask::coordinate c(rand_r(&seed) % 4, rand_r(&seed) % 4,
+                                              rand_r(&seed) % 4, rand_r(&seed) % 4,
+                                              rand_r(&seed) % 4, rand_r(&seed) % 4);
+        uint32_t limit = INDEX_SEGMENT_SIZE + rand_r(&seed) % (entries * 64 + 128);
+        size_t start = rand_r(&seed) % entries;
+        size_t end = start + rand_r(&seed) % (entries - start + 1);
+        size_t expected = hyperdisk::scan_search_log_scalar(&log.front(), start, end, c, limit);
+        ASSERT_EQ(expected, hyperdisk::scan_search_log(&log.front(), start, end, c, limit));
+#ifdef __SSE2__
+        ASSERT_EQ(expected, hyperdisk::scan_search_log_sse2(&log.front(), start, end, c, limit));
+#endif
+#ifdef __AVX2__
+        ASSERT_EQ(expected, hyperdisk::scan_search_log_avx2(&log.front(), start, end, c, limit));
+#endif
+    }
+}
+
+TEST(ShardTest, HashTableProbe)
+{
+    uint64_t bucket[HASH_TABLE_BUCKET_ENTRIES];
+    unsigned int seed = 0;
+
+    // Hashes and offsets come from a small range so that both bits are set
+    // often, including on the same entry.
+    for (size_t trial = 0; trial < 1000; ++trial)
+    {
+        uint32_t primary_hash = rand_r(&seed) % 4;
+        unsigned expected = 0;
+
+        for (size_t i = 0; i < HASH_TABLE_BUCKET_ENTRIES; ++i)
+        {
+            uint64_t hash = rand_r(&seed) % 4;
+            uint64_t offset = rand_r(&seed) % 3;
+            offset = offset == 2 ? HASH_OFFSET_INVALID | 8 : offset;
+            bucket[i] = (offset << 32) | hash;
+            expected |= (hash == primary_hash ? 1U : 0U) << (2 * i);
+            expected |= (offset == 0 ? 2U : 0U) << (2 * i);
+        }
+
+        ASSERT_EQ(expected, hyperdisk::probe_hash_bucket_scalar(bucket, primary_hash));
+        ASSERT_EQ(expected, hyperdisk::probe_hash_bucket(bucket, primary_hash));
+#ifdef __SSE2__
+        ASSERT_EQ(expected, hyperdisk::probe_hash_bucket_sse2(bucket, primary_hash));
+#endif
+#ifdef __AVX2__
+        ASSERT_EQ(expected, hyperdisk::probe_hash_bucket_avx2(bucket, primary_hash));
+#endif
+    }
+}
+
+TEST(ShardTest, Advice)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<e::slice> value;
+    uint64_t version;
+
+    value.push_back(e::slice("value", 5));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0x6e9accf9UL, 0), e::slice("key", 3), value, 1));
+
+    // Advice changes residency, never contents.
+    d->begin_scan();
+    d->prefetch(0, 1 << 20);
+    d->end_scan();
+    d->release();
+    value.clear();
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0x6e9accf9UL, e::slice("key", 3), &value, &version));
+    ASSERT_EQ(1U, version);
+    ASSERT_EQ(1, value.size());
+    ASSERT_TRUE(e::slice("value", 5) == value[0]);
+    ASSERT_TRUE(d->fsck());
+}
+
+TEST(ShardTest, Reset)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<e::slice> value;
+    uint64_t version;
+
+    value.push_back(e::slice("value", 5));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0x6e9accf9UL, 0), e::slice("key", 3), value, 1));
+    d->reset();
+    ASSERT_EQ(hyperdisk::NOTFOUND, d->get(0x6e9accf9UL, e::slice("key", 3), &value, &version));
+    ASSERT_TRUE(d->fsck());
+
+    // The reset shard is as good as new, and so is the file.
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0x6e9accf9UL, 0), e::slice("key", 3), value, 2));
+    d = hyperdisk::shard::open(cwd, "tmp-disk");
+    value.clear();
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0x6e9accf9UL, e::slice("key", 3), &value, &version));
+    ASSERT_EQ(2U, version);
+    ASSERT_TRUE(d->fsck());
+}
+
+// Run-length encoding, as (count, byte) pairs.
+class run_length : public hyperdisk::compressor
+{
+    public:
+        run_length() : compressor(200, "test-rle") {}
+        virtual ~run_length() throw () {}
+
+    public:
+        virtual size_t bound(size_t sz) const { return 2 * sz; }
+
+        virtual size_t compress(const uint8_t* in, size_t sz, uint8_t* out) const
+        {
+            size_t out_sz = 0;
+
+            for (size_t i = 0; i < sz; )
+            {
+                size_t run = 1;
+
+                while (i + run < sz && run < 255 && in[i + run] == in[i])
+                {
+                    ++run;
+                }
+
+                out[out_sz++] = run;
+                out[out_sz++] = in[i];
+                i += run;
+            }
+
+            return out_sz;
+        }
+
+        virtual bool decompress(const uint8_t* in, size_t sz, uint8_t* out, size_t raw) const
+        {
+            size_t out_sz = 0;
+
+            for (size_t i = 0; i + 1 < sz; i += 2)
+            {
+                if (out_sz + in[i] > raw)
+                {
+                    return false;
+                }
+
+                memset(out + out_sz, in[i + 1], in[i]);
+                out_sz += in[i];
+            }
+
+            return sz % 2 == 0 && out_sz == raw;
+        }
+};
+
+TEST(ShardTest, Compression)
+{
+    static run_length rle;
+    hyperdisk::compressor::add(&rle);
+    ASSERT_TRUE(hyperdisk::compressor::lookup("test-rle") == &rle);
+    hyperdisk::geometry geom(SEARCH_INDEX_ENTRIES, DATA_SEGMENT_SIZE, 0, rle.id());
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk", geom);
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk");
+    e::intrusive_ptr<hyperdisk::shard> c = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    const std::string big(4096, 'x');
+    const std::string mixed("abcdefghijklmnop");
+    std::vector<e::slice> value;
+    value.push_back(e::slice(big.data(), big.size()));
+    value.push_back(e::slice("small", 5));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0x6e9accf9UL, 0), e::slice("key", 3), value, 1));
+    value.clear();
+    value.push_back(e::slice(mixed.data(), mixed.size()));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xb5e57068UL, 0), e::slice("one", 3), value, 2));
+
+    // The compressible value is stored in a fraction of the space.
+    uint64_t raw;
+    uint64_t stored;
+    d->compression(&raw, &stored);
+    ASSERT_EQ(4096U + 5 + 16 + 3 * sizeof(uint32_t), raw);
+    ASSERT_GT(raw / 10, stored);
+    ASSERT_TRUE(d->fsck());
+
+    // Compressed entries are decompressed into the backing buffer, and are
+    // copied between shards as they are.  The counts follow the entries
+    // through the copy and into the reopened shard.
+    for (int i = 0; i < 3; ++i)
+    {
+        std::tr1::shared_ptr<e::buffer> backing;
+        uint64_t version;
+        uint64_t now_raw;
+        uint64_t now_stored;
+        d->compression(&now_raw, &now_stored);
+        ASSERT_EQ(raw, now_raw);
+        ASSERT_EQ(stored, now_stored);
+        ASSERT_EQ(hyperdisk::SUCCESS, d->get(0x6e9accf9UL, e::slice("key", 3), &value, &version, &backing));
+        ASSERT_TRUE(backing.get());
+        ASSERT_EQ(2U, value.size());
+        ASSERT_TRUE(value[0] == e::slice(big.data(), big.size()));
+        ASSERT_TRUE(value[1] == e::slice("small", 5));
+        backing.reset();
+        ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xb5e57068UL, e::slice("one", 3), &value, &version, &backing));
+        ASSERT_FALSE(backing.get());
+        ASSERT_EQ(1U, value.size());
+        ASSERT_TRUE(value[0] == e::slice(mixed.data(), mixed.size()));
+
+        if (i == 0)
+        {
+            d->copy_to(hyperspacehashing::mask::coordinate(), c);
+            d = c;
+        }
+        else if (i == 1)
+        {
+            d = hyperdisk::shard::open(cwd, "tmp-disk2");
+        }
+    }
+
+    // Snapshots decompress values when they are read.
+    hyperdisk::shard_snapshot snap = d->make_snapshot();
+    ASSERT_TRUE(snap.valid());
+    ASSERT_TRUE(snap.key() == e::slice("key", 3));
+    ASSERT_EQ(2U, snap.value().size());
+    ASSERT_TRUE(snap.value()[0] == e::slice(big.data(), big.size()));
+    snap.next();
+    ASSERT_TRUE(snap.valid());
+    ASSERT_EQ(1U, snap.value().size());
+    ASSERT_TRUE(snap.value()[0] == e::slice(mixed.data(), mixed.size()));
+    snap.next();
+    ASSERT_FALSE(snap.valid());
+    ASSERT_TRUE(d->fsck());
+}
+
+TEST(ShardTest, CorruptCompressedValue)
+{
+    static run_length rle;
+    hyperdisk::compressor::add(&rle);
+    hyperdisk::geometry geom(SEARCH_INDEX_ENTRIES, DATA_SEGMENT_SIZE, 0, rle.id());
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk", geom);
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk");
+    e::intrusive_ptr<hyperdisk::shard> c = hyperdisk::shard::create(cwd, "tmp-disk2", geom);
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    const std::string big(4096, 'x');
+    std::vector<e::slice> value(1, e::slice(big.data(), big.size()));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0x6e9accf9UL, 0), e::slice("key", 3), value, 1));
+
+    // Shorten the first run, so that the value no longer decompresses to its
+    // recorded size.
+    po6::io::fd fd(open("tmp-disk", O_RDWR));
+    std::string contents(lseek(fd.get(), 0, SEEK_END), '\0');
+    ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+              pread(fd.get(), &contents[0], contents.size(), 0));
+    size_t pos = contents.find("\xff" "x" "\xff" "x");
+    ASSERT_NE(std::string::npos, pos);
+    ASSERT_EQ(1, pwrite(fd.get(), "\x01", 1, pos));
+
+    // Even unverified reads notice, as do snapshots, copying and fsck.
+    std::tr1::shared_ptr<e::buffer> backing;
+    uint64_t version;
+    ASSERT_EQ(hyperdisk::CORRUPT, d->get(0x6e9accf9UL, e::slice("key", 3), &value, &version, &backing));
+    hyperdisk::shard_snapshot snap = d->make_snapshot();
+    ASSERT_TRUE(snap.valid());
+    ASSERT_TRUE(snap.key() == e::slice("key", 3));
+    ASSERT_TRUE(snap.corrupt());
+    ASSERT_TRUE(snap.value().empty());
+    ASSERT_EQ(hyperdisk::CORRUPT, d->copy_to(hyperspacehashing::mask::coordinate(), d->make_snapshot(), c));
+    ASSERT_FALSE(d->fsck());
+}
+
+TEST(ShardTest, Checksum)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk");
+    e::intrusive_ptr<hyperdisk::shard> c = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    uint64_t version;
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xb5e57068UL, 0), e::slice("one", 3), value, 1));
+    value.assign(1, e::slice("precious", 8));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xa3a81e5fUL, 0), e::slice("two", 3), value, 2));
+    uint32_t entry = 0;
+    ASSERT_EQ(hyperdisk::SUCCESS, d->scrub(&entry, 10));
+    ASSERT_EQ(2U, entry);
+    ASSERT_EQ(hyperdisk::DIDNOTHING, d->scrub(&entry, 10));
+    ASSERT_TRUE(d->fsck());
+
+    // Flip a byte of the second value behind the shard's back.
+    po6::io::fd fd(open("tmp-disk", O_RDWR));
+    std::string contents(lseek(fd.get(), 0, SEEK_END), '\0');
+    ASSERT_EQ(static_cast<ssize_t>(contents.size()),
+              pread(fd.get(), &contents[0], contents.size(), 0));
+    size_t pos = contents.find("precious");
+    ASSERT_NE(std::string::npos, pos);
+    ASSERT_EQ(1, pwrite(fd.get(), "P", 1, pos));
+
+    // Unverified reads return the corrupt value, but verified reads, scrubbing,
+    // copying, and fsck all notice.
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xa3a81e5fUL, e::slice("two", 3), &value, &version));
+    ASSERT_TRUE(value[0] == e::slice("Precious", 8));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get(0xb5e57068UL, e::slice("one", 3), &value, &version, NULL, true));
+    ASSERT_EQ(hyperdisk::CORRUPT, d->get(0xa3a81e5fUL, e::slice("two", 3), &value, &version, NULL, true));
+    entry = 0;
+    ASSERT_EQ(hyperdisk::CORRUPT, d->scrub(&entry, 10));
+    ASSERT_EQ(2U, entry);
+    ASSERT_EQ(hyperdisk::CORRUPT, d->copy_to(hyperspacehashing::mask::coordinate(), d->make_snapshot(), c));
+    ASSERT_FALSE(d->fsck());
+
+    // Once overwritten, the corrupt entry is no longer live.
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xa3a81e5fUL, 0), e::slice("two", 3), value, 3));
+    entry = 0;
+    ASSERT_EQ(hyperdisk::SUCCESS, d->scrub(&entry, 10));
+    ASSERT_EQ(3U, entry);
+}
+
+TEST(ShardTest, Heat)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    std::vector<e::slice> value(1, e::slice("value", 5));
+    uint64_t calls;
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xb5e57068UL, 0), e::slice("one", 3), value, 1));
+
+    // Entries present at the first call are not counted.
+    ASSERT_EQ(0U, d->heat(&calls));
+    ASSERT_EQ(1U, calls);
+
+    // Reads and PUTs both count, and the heat halves with each call.
+    for (int i = 0; i < 12; ++i)
+    {
+        d->count_read();
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(0xa3a81e5fUL, 0), e::slice("two", 3), value, 2));
+    ASSERT_EQ(13U, d->heat(&calls));
+    ASSERT_EQ(6U, d->heat(&calls));
+    ASSERT_EQ(3U, d->heat(&calls));
+    ASSERT_EQ(4U, calls);
+}
+
 } // namespace
@@ -0,0 +1,225 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#define __STDC_LIMIT_MACROS
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// STL
+#include <vector>
+
+// Google Test
+#include <gtest/gtest.h>
+
+// e
+#include <e/guard.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/shard.h"
+#include "hyperdisk/shard_vector.h"
+
+using hyperspacehashing::mask::coordinate;
+
+// A coordinate which fixes the low "bits" bits of the primary and lower
+// secondary hashes.
+static coordinate
+coord(unsigned pbits, uint64_t p, unsigned sbits, uint64_t s)
+{
+    uint64_t pm = pbits ? UINT64_MAX >> (64 - pbits) : 0;
+    uint64_t sm = sbits ? UINT64_MAX >> (64 - sbits) : 0;
+    return coordinate(pm, p & pm, sm, s & sm, 0, 0);
+}
+
+namespace
+{
+
+TEST(ShardVectorTest, Covers)
+{
+    EXPECT_TRUE(hyperdisk::covers(coord(0, 0, 0, 0), coord(1, 1, 1, 0)));
+    EXPECT_TRUE(hyperdisk::covers(coord(1, 1, 0, 0), coord(1, 1, 1, 0)));
+    EXPECT_TRUE(hyperdisk::covers(coord(1, 1, 1, 0), coord(2, 3, 2, 2)));
+    EXPECT_FALSE(hyperdisk::covers(coord(1, 1, 1, 0), coord(1, 1, 1, 0)));
+    EXPECT_FALSE(hyperdisk::covers(coord(1, 1, 1, 0), coord(0, 0, 0, 0)));
+    EXPECT_FALSE(hyperdisk::covers(coord(1, 0, 0, 0), coord(1, 1, 1, 0)));
+    EXPECT_FALSE(hyperdisk::covers(coord(1, 1, 1, 1), coord(2, 3, 2, 2)));
+}
+
+TEST(ShardVectorTest, Siblings)
+{
+    coordinate merged;
+
+    // The four shards of a split pair up along either dimension.
+    ASSERT_TRUE(hyperdisk::siblings(coord(1, 0, 1, 0), coord(1, 1, 1, 0), &merged));
+    EXPECT_TRUE(coord(0, 0, 1, 0) == merged);
+    ASSERT_TRUE(hyperdisk::siblings(coord(1, 1, 1, 0), coord(1, 1, 1, 1), &merged));
+    EXPECT_TRUE(coord(1, 1, 0, 0) == merged);
+    ASSERT_TRUE(hyperdisk::siblings(coord(2, 2, 1, 1), coord(2, 0, 1, 1), &merged));
+    EXPECT_TRUE(coord(1, 0, 1, 1) == merged);
+
+    // But not along the diagonal, nor with themselves.
+    EXPECT_FALSE(hyperdisk::siblings(coord(1, 0, 1, 0), coord(1, 1, 1, 1), &merged));
+    EXPECT_FALSE(hyperdisk::siblings(coord(1, 0, 1, 0), coord(1, 0, 1, 0), &merged));
+    // Nor do shards with different masks pair up.
+    EXPECT_FALSE(hyperdisk::siblings(coord(1, 0, 1, 0), coord(2, 2, 1, 0), &merged));
+    // Nor do hashes differing in two bits of one dimension.
+    EXPECT_FALSE(hyperdisk::siblings(coord(2, 0, 1, 0), coord(2, 3, 1, 0), &merged));
+    // Nor do bits outside of the mask count.
+    EXPECT_FALSE(hyperdisk::siblings(coordinate(1, 0, 0, 0, 0, 0),
+                                     coordinate(1, 2, 0, 0, 0, 0), &merged));
+}
+
+TEST(ShardVectorTest, SupersededAfterSplit)
+{
+    std::vector<coordinate> coords;
+    coords.push_back(coord(1, 0, 1, 0));
+    coords.push_back(coord(1, 1, 1, 0));
+    coords.push_back(coord(1, 0, 1, 1));
+    coords.push_back(coord(1, 1, 1, 1));
+    coords.push_back(coord(0, 0, 0, 0));
+    std::vector<bool> dropped = hyperdisk::superseded_shards(coords);
+
+    // All four new shards made it into place, so the old shard goes.
+    ASSERT_EQ(5U, dropped.size());
+    EXPECT_FALSE(dropped[0]);
+    EXPECT_FALSE(dropped[1]);
+    EXPECT_FALSE(dropped[2]);
+    EXPECT_FALSE(dropped[3]);
+    EXPECT_TRUE(dropped[4]);
+}
+
+TEST(ShardVectorTest, SupersededAfterPartialSplit)
+{
+    for (size_t missing = 0; missing < 4; ++missing)
+    {
+        std::vector<coordinate> coords;
+        coords.push_back(coord(0, 0, 0, 0));
+
+        for (size_t i = 0; i < 4; ++i)
+        {
+            if (i != missing)
+            {
+                coords.push_back(coord(1, i & 1, 1, i >> 1));
+            }
+        }
+
+        // The old shard remains authoritative.
+        std::vector<bool> dropped = hyperdisk::superseded_shards(coords);
+        ASSERT_EQ(4U, dropped.size());
+        EXPECT_FALSE(dropped[0]);
+        EXPECT_TRUE(dropped[1]);
+        EXPECT_TRUE(dropped[2]);
+        EXPECT_TRUE(dropped[3]);
+    }
+}
+
+TEST(ShardVectorTest, SupersededAfterMerge)
+{
+    std::vector<coordinate> coords;
+    coords.push_back(coord(1, 0, 1, 0));
+    coords.push_back(coord(1, 0, 1, 1));
+    coords.push_back(coord(1, 1, 0, 0));
+    coords.push_back(coord(1, 0, 0, 0));
+    std::vector<bool> dropped = hyperdisk::superseded_shards(coords);
+
+    // The merged shard replaces the two it covers, leaving its neighbor.
+    ASSERT_EQ(4U, dropped.size());
+    EXPECT_TRUE(dropped[0]);
+    EXPECT_TRUE(dropped[1]);
+    EXPECT_FALSE(dropped[2]);
+    EXPECT_FALSE(dropped[3]);
+}
+
+TEST(ShardVectorTest, SupersededNothing)
+{
+    std::vector<coordinate> coords;
+    coords.push_back(coord(1, 0, 1, 0));
+    coords.push_back(coord(1, 1, 1, 0));
+    coords.push_back(coord(1, 0, 1, 1));
+    coords.push_back(coord(2, 1, 1, 1));
+    coords.push_back(coord(2, 3, 1, 1));
+    std::vector<bool> dropped = hyperdisk::superseded_shards(coords);
+    ASSERT_EQ(5U, dropped.size());
+
+    for (size_t i = 0; i < dropped.size(); ++i)
+    {
+        EXPECT_FALSE(dropped[i]);
+    }
+}
+
+TEST(ShardVectorTest, Replace)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> s0 = hyperdisk::shard::create(cwd, "tmp-disk0");
+    e::guard g0 = e::makeguard(::unlink, "tmp-disk0");
+    e::intrusive_ptr<hyperdisk::shard> s1 = hyperdisk::shard::create(cwd, "tmp-disk1");
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk1");
+    e::intrusive_ptr<hyperdisk::shard> s2 = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk2");
+    e::intrusive_ptr<hyperdisk::shard> s3 = hyperdisk::shard::create(cwd, "tmp-disk3");
+    e::guard g3 = e::makeguard(::unlink, "tmp-disk3");
+    e::intrusive_ptr<hyperdisk::shard> s4 = hyperdisk::shard::create(cwd, "tmp-disk4");
+    e::guard g4 = e::makeguard(::unlink, "tmp-disk4");
+    e::intrusive_ptr<hyperdisk::shard_vector> v1;
+    v1 = new hyperdisk::shard_vector(coord(0, 0, 0, 0), s0);
+    ASSERT_EQ(1U, v1->size());
+
+    // A split replaces one shard with four.
+    e::intrusive_ptr<hyperdisk::shard_vector> v2;
+    v2 = v1->replace(0, coord(1, 0, 1, 0), s1, coord(1, 1, 1, 0), s2,
+                        coord(1, 0, 1, 1), s3, coord(1, 1, 1, 1), s4);
+    ASSERT_EQ(4U, v2->size());
+    EXPECT_EQ(v1->generation() + 1, v2->generation());
+    EXPECT_EQ(s1.get(), v2->get_shard(0));
+    EXPECT_EQ(s4.get(), v2->get_shard(3));
+    EXPECT_TRUE(coord(1, 1, 1, 1) == v2->get_coordinate(3));
+
+    // A clean replaces one shard in place.
+    e::intrusive_ptr<hyperdisk::shard_vector> v3 = v2->replace(1, s0);
+    ASSERT_EQ(4U, v3->size());
+    EXPECT_EQ(v2->generation() + 1, v3->generation());
+    EXPECT_EQ(s0.get(), v3->get_shard(1));
+    EXPECT_TRUE(coord(1, 1, 1, 0) == v3->get_coordinate(1));
+
+    // A merge replaces two siblings with one shard at the end.
+    e::intrusive_ptr<hyperdisk::shard_vector> v4;
+    v4 = v3->replace(0, 2, coord(1, 0, 0, 0), s3);
+    ASSERT_EQ(3U, v4->size());
+    EXPECT_EQ(v3->generation() + 1, v4->generation());
+    EXPECT_EQ(s0.get(), v4->get_shard(0));
+    EXPECT_EQ(s4.get(), v4->get_shard(1));
+    EXPECT_EQ(s3.get(), v4->get_shard(2));
+    EXPECT_TRUE(coord(1, 1, 1, 0) == v4->get_coordinate(0));
+    EXPECT_TRUE(coord(1, 1, 1, 1) == v4->get_coordinate(1));
+    EXPECT_TRUE(coord(1, 0, 0, 0) == v4->get_coordinate(2));
+}
+
+} // namespace
@@ -0,0 +1,317 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// C
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// STL
+#include <string>
+#include <tr1/memory>
+#include <vector>
+
+// Google Test
+#include <gtest/gtest.h>
+
+// po6
+#include <po6/io/fd.h>
+
+// e
+#include <e/guard.h>
+#include <e/locking_iterable_fifo.h>
+
+// HyperDisk
+#include "hyperdisk/log_entry.h"
+#include "hyperdisk/write_ahead_log.h"
+
+#define WAL_DIR "tmp-wal-dir"
+
+static void
+remove_wal_dir()
+{
+    std::vector<uint64_t> seqs;
+    hyperdisk::write_ahead_log::segments(WAL_DIR, &seqs);
+
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        std::string name(WAL_DIR "/");
+        name += hyperdisk::write_ahead_log::segment_filename(seqs[i]).get();
+        unlink(name.c_str());
+    }
+
+    rmdir(WAL_DIR);
+}
+
+static std::string
+segment_path(uint64_t seq)
+{
+    return std::string(WAL_DIR "/") + hyperdisk::write_ahead_log::segment_filename(seq).get();
+}
+
+// A PUT of "key<i>" with a value of "i" bytes at version "i", or for every
+// third "i", a DEL of "key<i>".
+static hyperdisk::log_entry
+entry(size_t i)
+{
+    char key[32];
+    int key_sz = sprintf(key, "key%lu", static_cast<unsigned long>(i));
+    std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(key_sz + i));
+    backing->pack() << e::buffer::padding(key_sz + i);
+    memmove(backing->data(), key, key_sz);
+    memset(backing->data() + key_sz, 'v', i);
+    e::slice k(backing->data(), key_sz);
+
+    if (i % 3 == 2)
+    {
+        return hyperdisk::log_entry(hyperspacehashing::mask::coordinate(), backing, k);
+    }
+
+    std::vector<e::slice> value(1, e::slice(backing->data() + key_sz, i));
+    return hyperdisk::log_entry(hyperspacehashing::mask::coordinate(), backing, k, value, i);
+}
+
+static void
+expect_entry(size_t i, const hyperdisk::log_entry& ent)
+{
+    hyperdisk::log_entry expected(entry(i));
+    EXPECT_EQ(expected.is_put, ent.is_put);
+    EXPECT_TRUE(expected.key == ent.key);
+    EXPECT_EQ(expected.version, ent.version);
+    ASSERT_EQ(expected.value.size(), ent.value.size());
+
+    for (size_t v = 0; v < ent.value.size(); ++v)
+    {
+        EXPECT_TRUE(expected.value[v] == ent.value[v]);
+    }
+}
+
+namespace
+{
+
+TEST(WriteAheadLogTest, EncodeDecode)
+{
+    std::vector<char> buf;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        hyperdisk::write_ahead_log::encode(entry(i), &buf);
+    }
+
+    std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(buf.size()));
+    backing->pack() << e::buffer::padding(buf.size());
+    memmove(backing->data(), &buf.front(), buf.size());
+    size_t off = 0;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        hyperdisk::log_entry ent;
+        ASSERT_TRUE(hyperdisk::write_ahead_log::decode(backing, &off, &ent));
+        expect_entry(i, ent);
+        EXPECT_TRUE(ent.backing == backing);
+    }
+
+    hyperdisk::log_entry ent;
+    EXPECT_EQ(buf.size(), off);
+    EXPECT_FALSE(hyperdisk::write_ahead_log::decode(backing, &off, &ent));
+    EXPECT_EQ(buf.size(), off);
+}
+
+TEST(WriteAheadLogTest, DecodeCorrupt)
+{
+    std::vector<char> buf;
+    hyperdisk::write_ahead_log::encode(entry(7), &buf);
+
+    for (size_t b = 0; b < buf.size(); ++b)
+    {
+        std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(buf.size()));
+        backing->pack() << e::buffer::padding(buf.size());
+        memmove(backing->data(), &buf.front(), buf.size());
+        backing->data()[b] ^= 0x40;
+        size_t off = 0;
+        hyperdisk::log_entry ent;
+        EXPECT_FALSE(hyperdisk::write_ahead_log::decode(backing, &off, &ent)) << "byte " << b;
+        EXPECT_EQ(0U, off);
+    }
+}
+
+TEST(WriteAheadLogTest, CommitAndReplay)
+{
+    ASSERT_EQ(0, mkdir(WAL_DIR, S_IRWXU));
+    e::guard g = e::makeguard(remove_wal_dir);
+    po6::io::fd dir(open(WAL_DIR, O_RDONLY));
+    hyperdisk::write_ahead_log wal(dir);
+    e::locking_iterable_fifo<hyperdisk::log_entry> log;
+    log.append(entry(0));
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.rotate(1, log.iterate()));
+    EXPECT_EQ(1U, wal.sequence());
+
+    // The entries handed to rotate begin the segment.
+    for (size_t i = 1; i < 100; ++i)
+    {
+        wal.append(entry(i));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+    EXPECT_EQ(hyperdisk::DIDNOTHING, wal.commit());
+
+    for (size_t i = 100; i < 200; ++i)
+    {
+        wal.append(entry(i));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+    struct stat st;
+    ASSERT_EQ(0, stat(segment_path(1).c_str(), &st));
+    EXPECT_EQ(static_cast<uint64_t>(st.st_size), wal.segment_size());
+
+    std::vector<uint64_t> seqs;
+    hyperdisk::write_ahead_log::segments(WAL_DIR, &seqs);
+    ASSERT_EQ(1U, seqs.size());
+    EXPECT_EQ(1U, seqs[0]);
+    std::vector<hyperdisk::log_entry> entries;
+    hyperdisk::write_ahead_log::read_segment(dir, 1, &entries);
+    ASSERT_EQ(200U, entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        expect_entry(i, entries[i]);
+    }
+
+    // A new segment starts empty, apart from the entries handed over.
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.rotate(2, log.iterate()));
+    EXPECT_EQ(0U, wal.segment_size());
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+    entries.clear();
+    hyperdisk::write_ahead_log::read_segment(dir, 2, &entries);
+    ASSERT_EQ(1U, entries.size());
+    expect_entry(0, entries[0]);
+}
+
+TEST(WriteAheadLogTest, TornTail)
+{
+    ASSERT_EQ(0, mkdir(WAL_DIR, S_IRWXU));
+    e::guard g = e::makeguard(remove_wal_dir);
+    po6::io::fd dir(open(WAL_DIR, O_RDONLY));
+    e::locking_iterable_fifo<hyperdisk::log_entry> log;
+    uint64_t intact;
+
+    {
+        hyperdisk::write_ahead_log wal(dir);
+        ASSERT_EQ(hyperdisk::SUCCESS, wal.rotate(1, log.iterate()));
+
+        for (size_t i = 0; i < 50; ++i)
+        {
+            wal.append(entry(i));
+        }
+
+        ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+        intact = wal.segment_size();
+        wal.append(entry(50));
+        ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+    }
+
+    // Every cut through the last entry leaves the others readable.
+    struct stat st;
+    ASSERT_EQ(0, stat(segment_path(1).c_str(), &st));
+
+    for (off_t size = st.st_size - 1; size >= static_cast<off_t>(intact); --size)
+    {
+        ASSERT_EQ(0, truncate(segment_path(1).c_str(), size));
+        std::vector<hyperdisk::log_entry> entries;
+        hyperdisk::write_ahead_log::read_segment(dir, 1, &entries);
+        ASSERT_EQ(50U, entries.size());
+        expect_entry(49, entries.back());
+    }
+}
+
+TEST(WriteAheadLogTest, FailedCommit)
+{
+    ASSERT_EQ(0, mkdir(WAL_DIR, S_IRWXU));
+    e::guard g = e::makeguard(remove_wal_dir);
+    po6::io::fd dir(open(WAL_DIR, O_RDONLY));
+    hyperdisk::write_ahead_log wal(dir);
+    e::locking_iterable_fifo<hyperdisk::log_entry> log;
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.rotate(1, log.iterate()));
+
+    for (size_t i = 0; i < 50; ++i)
+    {
+        wal.append(entry(i));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+    uint64_t committed = wal.segment_size();
+
+    // Cap the size of files so that the next commit is cut short.
+    struct rlimit saved;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &saved));
+    void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    struct rlimit capped = saved;
+    capped.rlim_cur = committed + 1000;
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &capped));
+
+    for (size_t i = 50; i < 150; ++i)
+    {
+        wal.append(entry(i));
+    }
+
+    hyperdisk::returncode rc = wal.commit();
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &saved));
+    signal(SIGXFSZ, handler);
+    ASSERT_EQ(hyperdisk::SYNCFAILED, rc);
+    EXPECT_FALSE(wal.failed());
+
+    // The partial write was cut off.
+    struct stat st;
+    ASSERT_EQ(0, stat(segment_path(1).c_str(), &st));
+    EXPECT_EQ(committed, static_cast<uint64_t>(st.st_size));
+    EXPECT_EQ(committed, wal.segment_size());
+
+    // The failed entries go out with the next commit, ahead of newer ones.
+    for (size_t i = 150; i < 200; ++i)
+    {
+        wal.append(entry(i));
+    }
+
+    ASSERT_EQ(hyperdisk::SUCCESS, wal.commit());
+    std::vector<hyperdisk::log_entry> entries;
+    hyperdisk::write_ahead_log::read_segment(dir, 1, &entries);
+    ASSERT_EQ(200U, entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        expect_entry(i, entries[i]);
+    }
+}
+
+} // namespace
@@ -40,7 +40,6 @@
 
 // HyperDisk
 #include "hyperdisk/shard.h"
-#include "hyperdisk/shard_constants.h"
 #include "hyperdisk/shard_snapshot.h"
 
 int
@@ -55,7 +54,7 @@ main(int argc, char* argv[])
             po6::io::fd cwd(AT_FDCWD);
             e::intrusive_ptr<hyperdisk::shard> shard;
             shard = hyperdisk::shard::open(cwd, argv[i]);
-            hyperdisk::shard_snapshot snap(FILE_SIZE, shard.get());
+            hyperdisk::shard_snapshot snap(shard->make_snapshot());
 
             while (snap.valid())
             {
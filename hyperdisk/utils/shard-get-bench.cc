@@ -0,0 +1,207 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdio>
+#include <cstdlib>
+
+// C++
+#include <iomanip>
+#include <iostream>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// STL
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// po6
+#include <po6/error.h>
+#include <po6/io/fd.h>
+
+// e
+#include <e/convert.h>
+#include <e/guard.h>
+#include <e/intrusive_ptr.h>
+#include <e/timer.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/shard.h"
+
+// Measure GET against a shard of the default geometry.  The shard is filled to
+// seven eighths of its search index, and one in eight of the keys is deleted
+// again so that the hash table holds tombstones as it would in practice.  Keys
+// are then looked up in random order, both those present and those never
+// stored.
+
+static void
+run(const char* name, e::intrusive_ptr<hyperdisk::shard> s,
+    const std::vector<std::string>& keys,
+    const std::vector<uint32_t>& hashes,
+    hyperdisk::returncode expected, uint64_t iterations)
+{
+    std::vector<size_t> order(keys.size());
+    unsigned int seed = 0;
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+
+    for (size_t i = order.size(); i > 1; --i)
+    {
+        std::swap(order[i - 1], order[rand_r(&seed) % i]);
+    }
+
+    size_t unexpected = 0;
+    uint64_t start = e::time();
+
+    for (uint64_t it = 0; it < iterations; ++it)
+    {
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const std::string& key(keys[order[i]]);
+            std::vector<e::slice> value;
+            uint64_t version;
+
+            if (s->get(hashes[order[i]], e::slice(key.data(), key.size()),
+                       &value, &version) != expected)
+            {
+                ++unexpected;
+            }
+        }
+    }
+
+    uint64_t end = e::time();
+    double ns = static_cast<double>(end - start) / (iterations * order.size());
+    std::cout << std::setw(8) << name
+              << " keys=" << std::setw(8) << keys.size()
+              << " unexpected=" << unexpected
+              << " ns/get=" << std::fixed << std::setprecision(3) << ns
+              << std::endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint64_t iterations = 100;
+
+    if (argc > 2)
+    {
+        std::cerr << "usage: " << argv[0] << " [iterations]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 2)
+    {
+        try
+        {
+            iterations = e::convert::to_uint64_t(argv[1]);
+        }
+        catch (std::domain_error& e)
+        {
+            std::cerr << "The iteration count must be an integer." << std::endl;
+            return EXIT_FAILURE;
+        }
+        catch (std::out_of_range& e)
+        {
+            std::cerr << "The iteration count must be suitably small." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        po6::io::fd cwd(AT_FDCWD);
+        const char* path = "shard-get-bench.tmp";
+        e::intrusive_ptr<hyperdisk::shard> s = hyperdisk::shard::create(cwd, path);
+        e::guard g = e::makeguard(::unlink, path);
+        g.use_variable();
+        std::vector<hyperspacehashing::hash_t> funcs(1, hyperspacehashing::EQUALITY);
+        hyperspacehashing::mask::hasher hasher(funcs);
+        std::vector<std::string> present;
+        std::vector<uint32_t> present_hashes;
+        std::vector<std::string> absent;
+        std::vector<uint32_t> absent_hashes;
+        std::vector<e::slice> value(1, e::slice("0123456789abcdef0123456789abcdef"
+                                                "0123456789abcdef0123456789abcdef", 64));
+        char buf[32];
+
+        for (size_t i = 0; i < SEARCH_INDEX_ENTRIES / 8 * 7; ++i)
+        {
+            snprintf(buf, sizeof(buf), "key-%zu", i);
+            std::string key(buf);
+            hyperspacehashing::mask::coordinate c = hasher.hash(e::slice(key.data(), key.size()));
+
+            if (s->put(c, e::slice(key.data(), key.size()), value, i) != hyperdisk::SUCCESS)
+            {
+                std::cerr << "could not fill the shard" << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            if (i % 8 == 7)
+            {
+                s->del(static_cast<uint32_t>(c.primary_hash), e::slice(key.data(), key.size()));
+                absent.push_back(key);
+                absent_hashes.push_back(static_cast<uint32_t>(c.primary_hash));
+            }
+            else
+            {
+                present.push_back(key);
+                present_hashes.push_back(static_cast<uint32_t>(c.primary_hash));
+            }
+        }
+
+        for (size_t i = 0; i < present.size(); ++i)
+        {
+            snprintf(buf, sizeof(buf), "missing-%zu", i);
+            std::string key(buf);
+            hyperspacehashing::mask::coordinate c = hasher.hash(e::slice(key.data(), key.size()));
+            absent.push_back(key);
+            absent_hashes.push_back(static_cast<uint32_t>(c.primary_hash));
+        }
+
+        run("hit", s, present, present_hashes, hyperdisk::SUCCESS, iterations);
+        run("miss", s, absent, absent_hashes, hyperdisk::NOTFOUND, iterations);
+    }
+    catch (po6::error& e)
+    {
+        std::cerr << "error:  [" << e << "] " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdlib>
+#include <cstring>
+
+// C++
+#include <iomanip>
+#include <iostream>
+
+// STL
+#include <vector>
+
+// e
+#include <e/convert.h>
+#include <e/timer.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/search_log_scan.h"
+#include "hyperdisk/shard_constants.h"
+
+// Compare the search-log scan kernels on the search log of a full shard.  The
+// log is synthesized in memory so that only the scan itself is measured.
+
+typedef size_t (*scan_func)(const char* log, size_t start, size_t end,
+                            const hyperspacehashing::mask::coordinate& coord,
+                            uint32_t limit);
+
+static void
+fill_log(std::vector<char>* log, uint32_t* limit)
+{
+    unsigned int seed = 0;
+    uint32_t offset = INDEX_SEGMENT_SIZE;
+
+    for (size_t i = 0; i < SEARCH_INDEX_ENTRIES; ++i)
+    {
+        uint64_t primary = (static_cast<uint64_t>(rand_r(&seed)) << 32) | rand_r(&seed);
+        uint64_t lower = (static_cast<uint64_t>(rand_r(&seed)) << 32) | rand_r(&seed);
+        uint64_t upper = (static_cast<uint64_t>(rand_r(&seed)) << 32) | rand_r(&seed);
+        // Roughly one in eight entries has been overwritten.
+        uint32_t invalid = rand_r(&seed) % 8 == 0 ? offset + 1024 : 0;
+        char* ent = &(*log)[i * SEARCH_INDEX_ENTRY_SIZE];
+        memmove(ent, &offset, sizeof(offset));
+        memmove(ent + 4, &invalid, sizeof(invalid));
+        memmove(ent + 8, &primary, sizeof(primary));
+        memmove(ent + 16, &lower, sizeof(lower));
+        memmove(ent + 24, &upper, sizeof(upper));
+        offset += 1024;
+    }
+
+    *limit = offset;
+}
+
+static void
+run(const char* name, scan_func scan, const std::vector<char>& log,
+    uint32_t limit, uint64_t mask, uint64_t iterations)
+{
+    hyperspacehashing::mask::coordinate coord(0, 0, mask, 0, 0, 0);
+    size_t matches = 0;
+    uint64_t start = e::time();
+
+    for (uint64_t it = 0; it < iterations; ++it)
+    {
+        size_t i = 0;
+
+        while ((i = scan(&log.front(), i, SEARCH_INDEX_ENTRIES, coord, limit)) < SEARCH_INDEX_ENTRIES)
+        {
+            ++matches;
+            ++i;
+        }
+    }
+
+    uint64_t end = e::time();
+    double ns = static_cast<double>(end - start) / (iterations * SEARCH_INDEX_ENTRIES);
+    std::cout << std::setw(8) << name
+              << " mask=" << std::setw(16) << std::setfill('0') << std::hex << mask
+              << std::setfill(' ') << std::dec
+              << " matches=" << std::setw(8) << matches / iterations
+              << " ns/entry=" << std::fixed << std::setprecision(3) << ns
+              << std::endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint64_t iterations = 1000;
+
+    if (argc > 2)
+    {
+        std::cerr << "usage: " << argv[0] << " [iterations]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 2)
+    {
+        try
+        {
+            iterations = e::convert::to_uint64_t(argv[1]);
+        }
+        catch (std::domain_error& e)
+        {
+            std::cerr << "The iteration count must be an integer." << std::endl;
+            return EXIT_FAILURE;
+        }
+        catch (std::out_of_range& e)
+        {
+            std::cerr << "The iteration count must be suitably small." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<char> log(SEARCH_INDEX_SIZE);
+    uint32_t limit;
+    fill_log(&log, &limit);
+    // Select everything, about 1/16th, and about 1/4096th of the entries.
+    const uint64_t masks[] = {0, 0xf, 0xfff};
+
+    for (size_t m = 0; m < sizeof(masks) / sizeof(masks[0]); ++m)
+    {
+        run("scalar", hyperdisk::scan_search_log_scalar, log, limit, masks[m], iterations);
+#ifdef __SSE2__
+        run("sse2", hyperdisk::scan_search_log_sse2, log, limit, masks[m], iterations);
+#endif
+#ifdef __AVX2__
+        run("avx2", hyperdisk::scan_search_log_avx2, log, limit, masks[m], iterations);
+#endif
+    }
+
+    return EXIT_SUCCESS;
+}
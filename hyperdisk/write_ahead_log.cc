@@ -0,0 +1,326 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// C
+#include <cstdio>
+#include <cstring>
+
+// POSIX
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// STL
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+// e
+#include <e/guard.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hashes_internal.h"
+
+// HyperDisk
+#include "hyperdisk/write_ahead_log.h"
+
+// Each entry is preceded by its size and the checksum of its contents.
+#define ENTRY_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint64_t))
+
+void
+hyperdisk :: write_ahead_log :: segments(const po6::pathname& dir,
+                                         std::vector<uint64_t>* seqs)
+{
+    DIR* d = opendir(dir.get());
+
+    if (!d)
+    {
+        throw po6::error(errno);
+    }
+
+    e::guard dir_guard = e::makeguard(closedir, d);
+    dir_guard.use_variable();
+    struct dirent* ent;
+    seqs->clear();
+    errno = 0;
+
+    while ((ent = readdir(d)))
+    {
+        unsigned long long seq;
+        int len = 0;
+
+        if (sscanf(ent->d_name, "log-%16llx%n", &seq, &len) == 1 &&
+            len == 20 && ent->d_name[len] == '\0')
+        {
+            seqs->push_back(seq);
+        }
+    }
+
+    if (errno != 0)
+    {
+        throw po6::error(errno);
+    }
+
+    std::sort(seqs->begin(), seqs->end());
+}
+
+po6::pathname
+hyperdisk :: write_ahead_log :: segment_filename(uint64_t seq)
+{
+    std::ostringstream ostr;
+    ostr << "log-" << std::hex << std::setfill('0') << std::setw(16) << seq;
+    return po6::pathname(ostr.str());
+}
+
+void
+hyperdisk :: write_ahead_log :: read_segment(const po6::io::fd& dir,
+                                             uint64_t seq,
+                                             std::vector<log_entry>* entries)
+{
+    po6::io::fd fd(openat(dir.get(), segment_filename(seq).get(), O_RDONLY));
+    struct stat st;
+
+    if (fd.get() < 0 || fstat(fd.get(), &st) < 0)
+    {
+        throw po6::error(errno);
+    }
+
+    // Every entry read from the segment shares the segment's buffer.
+    std::tr1::shared_ptr<e::buffer> backing(e::buffer::create(st.st_size));
+
+    if (fd.xread(backing->data(), st.st_size) != st.st_size)
+    {
+        throw po6::error(errno);
+    }
+
+    backing->resize(st.st_size);
+    size_t off = 0;
+    log_entry ent;
+
+    while (decode(backing, &off, &ent))
+    {
+        entries->push_back(ent);
+    }
+}
+
+void
+hyperdisk :: write_ahead_log :: encode(const log_entry& ent, std::vector<char>* buf)
+{
+    size_t size = sizeof(uint8_t) + sizeof(uint64_t)
+                + sizeof(uint32_t) + ent.key.size()
+                + sizeof(uint32_t);
+
+    for (size_t i = 0; i < ent.value.size(); ++i)
+    {
+        size += sizeof(uint32_t) + ent.value[i].size();
+    }
+
+    std::auto_ptr<e::buffer> framed(e::buffer::create(ENTRY_HEADER_SIZE + size));
+    uint8_t is_put = ent.is_put ? 1 : 0;
+    e::buffer::packer pa = framed->pack_at(ENTRY_HEADER_SIZE);
+    pa = pa << is_put << ent.version << ent.key << ent.value;
+    assert(!pa.error());
+    uint64_t checksum = hyperspacehashing::cityhash(e::slice(framed->data() + ENTRY_HEADER_SIZE, size));
+    pa = framed->pack_at(0) << static_cast<uint32_t>(size) << checksum;
+    assert(!pa.error());
+    buf->insert(buf->end(), framed->data(), framed->data() + framed->size());
+}
+
+bool
+hyperdisk :: write_ahead_log :: decode(const std::tr1::shared_ptr<e::buffer>& backing,
+                                       size_t* off, log_entry* ent)
+{
+    uint32_t size;
+    uint64_t checksum;
+
+    if (*off + ENTRY_HEADER_SIZE > backing->size() ||
+        (backing->unpack_from(*off) >> size >> checksum).error() ||
+        *off + ENTRY_HEADER_SIZE + size > backing->size())
+    {
+        return false;
+    }
+
+    size_t start = *off + ENTRY_HEADER_SIZE;
+    e::slice contents(backing->data() + start, size);
+
+    if (hyperspacehashing::cityhash(contents) != checksum)
+    {
+        return false;
+    }
+
+    uint8_t is_put = 0;
+    *ent = log_entry();
+    e::buffer::unpacker up = backing->unpack_from(start);
+    up = up >> is_put >> ent->version >> ent->key >> ent->value;
+
+    if (up.error())
+    {
+        return false;
+    }
+
+    ent->is_put = is_put != 0;
+    ent->backing = backing;
+    *off = start + size;
+    return true;
+}
+
+hyperdisk :: write_ahead_log :: write_ahead_log(const po6::io::fd& dir)
+    : m_dir(dir)
+    , m_commit_lock()
+    , m_lock()
+    , m_fd()
+    , m_seq(0)
+    , m_segment_size(0)
+    , m_failed(false)
+    , m_pending()
+{
+}
+
+hyperdisk :: write_ahead_log :: ~write_ahead_log() throw ()
+{
+}
+
+uint64_t
+hyperdisk :: write_ahead_log :: sequence()
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    return m_seq;
+}
+
+uint64_t
+hyperdisk :: write_ahead_log :: segment_size()
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    return m_segment_size;
+}
+
+void
+hyperdisk :: write_ahead_log :: append(const log_entry& ent)
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    append_locked(ent);
+}
+
+hyperdisk::returncode
+hyperdisk :: write_ahead_log :: commit()
+{
+    po6::threads::mutex::hold hold_c(&m_commit_lock);
+    std::vector<char> pending;
+
+    {
+        po6::threads::mutex::hold hold(&m_lock);
+        pending.swap(m_pending);
+    }
+
+    if (pending.empty())
+    {
+        return DIDNOTHING;
+    }
+
+    if (m_failed)
+    {
+        restore_pending(&pending);
+        return SYNCFAILED;
+    }
+
+    // Only commit and rotate change m_fd and m_segment_size, so they are safe
+    // to use without m_lock.
+    if (m_fd.xwrite(&pending.front(), pending.size()) != static_cast<ssize_t>(pending.size()) ||
+        fdatasync(m_fd.get()) < 0)
+    {
+        // Cut off whatever part of the entries made it to the segment, so
+        // that the next commit writes them whole after the last good entry.
+        // If that fails, the segment ends in a torn entry which would hide
+        // everything written after it, so no more commits go to it.
+        int saved = errno;
+
+        if (ftruncate(m_fd.get(), m_segment_size) < 0)
+        {
+            m_failed = true;
+        }
+
+        restore_pending(&pending);
+        errno = saved;
+        return SYNCFAILED;
+    }
+
+    po6::threads::mutex::hold hold(&m_lock);
+    m_segment_size += pending.size();
+    return SUCCESS;
+}
+
+bool
+hyperdisk :: write_ahead_log :: failed()
+{
+    po6::threads::mutex::hold hold_c(&m_commit_lock);
+    return m_failed;
+}
+
+hyperdisk::returncode
+hyperdisk :: write_ahead_log :: rotate(uint64_t seq,
+                                       e::locking_iterable_fifo<log_entry>::iterator it)
+{
+    po6::threads::mutex::hold hold_c(&m_commit_lock);
+    po6::io::fd fd(openat(m_dir.get(), segment_filename(seq).get(),
+                          O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, S_IRUSR|S_IWUSR));
+
+    // Make sure the new segment will be found after a crash.
+    if (fd.get() < 0 || fsync(m_dir.get()) < 0)
+    {
+        return SYNCFAILED;
+    }
+
+    po6::threads::mutex::hold hold(&m_lock);
+    m_fd.swap(&fd);
+    m_seq = seq;
+    m_segment_size = 0;
+    m_failed = false;
+    m_pending.clear();
+
+    for (; it.valid(); it.next())
+    {
+        append_locked(*it);
+    }
+
+    return SUCCESS;
+}
+
+void
+hyperdisk :: write_ahead_log :: append_locked(const log_entry& ent)
+{
+    encode(ent, &m_pending);
+}
+
+void
+hyperdisk :: write_ahead_log :: restore_pending(std::vector<char>* pending)
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    pending->insert(pending->end(), m_pending.begin(), m_pending.end());
+    pending->swap(m_pending);
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef hyperdisk_write_ahead_log_h_
+#define hyperdisk_write_ahead_log_h_
+
+// STL
+#include <vector>
+
+// po6
+#include <po6/io/fd.h>
+#include <po6/pathname.h>
+#include <po6/threads/mutex.h>
+
+// e
+#include <e/locking_iterable_fifo.h>
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/returncode.h"
+#include "hyperdisk/log_entry.h"
+
+namespace hyperdisk
+{
+
+// The durable counterpart to a disk's in-memory log.  Appended entries are
+// buffered until the next commit, which writes them to the current segment and
+// syncs them with a single fdatasync.  Each segment is a file in the disk's
+// directory named by a sequence number.  The disk starts a new segment (and
+// removes the old ones) once the entries in the old segments are safe in the
+// shards.
+//
+// Every entry is framed by its size and a checksum, so a segment which was
+// being written when the machine failed is read up to the torn entry.
+
+class write_ahead_log
+{
+    public:
+        // The sequence numbers of the segments in "dir", oldest first.
+        static void segments(const po6::pathname& dir, std::vector<uint64_t>* seqs);
+        static po6::pathname segment_filename(uint64_t seq);
+        // Read the entries of a segment.  The coordinates of the entries are
+        // not stored, and must be recomputed by the caller.
+        static void read_segment(const po6::io::fd& dir, uint64_t seq,
+                                 std::vector<log_entry>* entries);
+        // Append the framed entry to "buf".
+        static void encode(const log_entry& ent, std::vector<char>* buf);
+        // Read the framed entry at "*off" in "backing", which becomes the
+        // entry's backing, and advance "*off" past it.  Returns false if
+        // "backing" does not hold a whole, intact entry at "*off".
+        static bool decode(const std::tr1::shared_ptr<e::buffer>& backing,
+                           size_t* off, log_entry* ent);
+
+    public:
+        // "dir" must outlast the log.
+        write_ahead_log(const po6::io::fd& dir);
+        ~write_ahead_log() throw ();
+
+    public:
+        uint64_t sequence();
+        // The number of bytes committed to the current segment.
+        uint64_t segment_size();
+        // Queue an entry for the next commit.
+        void append(const log_entry& ent);
+        // Write queued entries to the current segment, and wait for them to
+        // reach the disk.  May return SUCCESS, DIDNOTHING or SYNCFAILED.  On
+        // failure, the entries stay queued for the next commit, and the
+        // segment is cut back to its last committed entry.  If the segment
+        // cannot be cut back, every commit fails until the next rotate.
+        returncode commit();
+        // True if a failed commit left the current segment unusable.
+        bool failed();
+        // Switch to a new segment, "seq", which begins with every entry from
+        // "it" onward in place of anything which was queued.  May return
+        // SUCCESS or SYNCFAILED.
+        returncode rotate(uint64_t seq, e::locking_iterable_fifo<log_entry>::iterator it);
+
+    private:
+        write_ahead_log(const write_ahead_log&);
+
+    private:
+        void append_locked(const log_entry& ent);
+        // Put entries taken for a failed commit back in front of any queued
+        // since.
+        void restore_pending(std::vector<char>* pending);
+
+    private:
+        write_ahead_log& operator = (const write_ahead_log&);
+
+    private:
+        const po6::io::fd& m_dir;
+        // Serializes commit/rotate, and is always acquired before m_lock.
+        po6::threads::mutex m_commit_lock;
+        po6::threads::mutex m_lock;
+        po6::io::fd m_fd;
+        uint64_t m_seq;
+        uint64_t m_segment_size;
+        // Set when a failed commit left a torn entry in the segment.
+        bool m_failed;
+        std::vector<char> m_pending;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_write_ahead_log_h_
@@ -150,4 +150,73 @@ double_lower_interlace(uint64_t* nums, size_t sz, uint64_t* lower, uint64_t* upp
     *upper = result[1];
 }
 
+// The batched variants interlace "sz" numbers for each of "count" objects, and
+// give the same results as the functions above would for each object.  The
+// numbers are grouped by position, so that number j of object k is
+// nums[j * count + k].  Every object takes each bit of its result from the
+// same bit of the same position, so the inner loops over objects have no
+// branches or varying shifts, and vectorize.
+
+inline void
+upper_interlace(const uint64_t* nums, size_t sz, size_t count, uint64_t* out)
+{
+    for (size_t k = 0; k < count; ++k)
+    {
+        out[k] = 0;
+    }
+
+    if (!sz)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 64; ++i)
+    {
+        size_t quotient = i / sz;
+        size_t modulus = i % sz;
+        const uint64_t* hashes = nums + modulus * count;
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            out[k] |= ((hashes[k] >> (63 - quotient)) & 1) << (63 - i);
+        }
+    }
+}
+
+inline void
+double_lower_interlace(const uint64_t* nums, size_t sz, size_t count,
+                       uint64_t* lower, uint64_t* upper)
+{
+    for (size_t k = 0; k < count; ++k)
+    {
+        lower[k] = 0;
+        upper[k] = 0;
+    }
+
+    if (!sz)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 128; ++i)
+    {
+        size_t quotient = i / sz;
+        size_t modulus = i % sz;
+
+        if (quotient >= 64)
+        {
+            break;
+        }
+
+        const uint64_t* hashes = nums + modulus * count;
+        uint64_t* result = i >= 64 ? upper : lower;
+        int shift = i % 64;
+
+        for (size_t k = 0; k < count; ++k)
+        {
+            result[k] |= ((hashes[k] >> quotient) & 1) << shift;
+        }
+    }
+}
+
 #endif // bithacks_h_
@@ -25,6 +25,8 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#define __STDC_LIMIT_MACROS
+
 // C
 #include <cstring>
 
@@ -55,3 +57,60 @@ hyperspacehashing :: lendian(const e::slice& buf)
     memmove(&ret, buf.data(), std::min(buf.size(), sizeof(ret)));
     return le64toh(ret);
 }
+
+uint64_t
+hyperspacehashing :: ordered(const e::slice& buf)
+{
+    uint64_t ret = 0;
+    memmove(&ret, buf.data(), std::min(buf.size(), sizeof(ret)));
+    return be64toh(ret);
+}
+
+uint64_t
+hyperspacehashing :: quantile(const std::vector<uint64_t>& bounds, uint64_t num)
+{
+    if (bounds.empty())
+    {
+        return num;
+    }
+
+    // Slice idx covers [bounds[idx - 1], bounds[idx]).
+    size_t idx = std::upper_bound(bounds.begin(), bounds.end(), num) - bounds.begin();
+    uint64_t width = UINT64_MAX / (bounds.size() + 1);
+    double lower = idx > 0 ? bounds[idx - 1] : 0;
+    double upper = idx < bounds.size() ? bounds[idx] : UINT64_MAX;
+    double frac = (num - lower) / (upper - lower + 1);
+    return idx * width + static_cast<uint64_t>(frac * width);
+}
+
+void
+hyperspacehashing :: ordered_range(const e::slice& prefix,
+                                   uint64_t* lower, uint64_t* upper)
+{
+    *lower = ordered(prefix);
+    *upper = *lower;
+
+    // Bytes beyond the prefix may take on any value.
+    if (prefix.size() < sizeof(uint64_t))
+    {
+        *upper |= UINT64_MAX >> (prefix.size() * 8);
+    }
+}
+
+bool
+hyperspacehashing :: ordered_range(const search& s, size_t idx,
+                                   uint64_t* lower, uint64_t* upper)
+{
+    if (s.is_prefix(idx))
+    {
+        ordered_range(s.prefix_value(idx), lower, upper);
+        return true;
+    }
+    else if (s.is_equality(idx))
+    {
+        ordered_range(s.equality_value(idx), lower, upper);
+        return true;
+    }
+
+    return false;
+}
@@ -39,6 +39,7 @@
 
 // HyperspaceHashing
 #include "hyperspacehashing/hashes.h"
+#include "hyperspacehashing/search.h"
 
 namespace hyperspacehashing
 {
@@ -48,7 +49,22 @@ uint64_t
 cityhash(const e::slice& buf);
 uint64_t
 lendian(const e::slice& buf);
+uint64_t
+ordered(const e::slice& buf);
+// Map num onto the full 64-bit space such that each of the slices between
+// consecutive boundaries takes an equal share.  The mapping preserves order
+// and is the identity when there are no boundaries.
+uint64_t
+quantile(const std::vector<uint64_t>& bounds, uint64_t num);
 
+// The ORDERED hashes of every string with the given prefix fall within
+// [*lower, *upper] (note that the upper bound is inclusive).
+void
+ordered_range(const e::slice& prefix, uint64_t* lower, uint64_t* upper);
+// Bound the ORDERED hashes that the search permits for attribute idx.  This
+// returns false if the search places no prefix or equality term on idx.
+bool
+ordered_range(const search& s, size_t idx, uint64_t* lower, uint64_t* upper);
 
 } // namespace hyperspacehashing
 
@@ -36,7 +36,10 @@ enum hash_t
 {
     EQUALITY = 1,
     RANGE    = 2,
-    NONE     = 3
+    NONE     = 3,
+    // Strings hashed by their leading bytes so that every string sharing a
+    // prefix lands in one contiguous stretch of the space.
+    ORDERED  = 4
 };
 
 } // namespace hyperspacehashing
@@ -95,7 +95,12 @@ class search_coordinate
 class hasher
 {
     public:
-        hasher(const std::vector<hash_t>& funcs);
+        // If quantiles[i] is non-empty, it holds sorted boundaries which
+        // split the values of RANGE attribute i into equal slices of the
+        // space, so that skewed values spread evenly across regions.
+        hasher(const std::vector<hash_t>& funcs,
+               const std::vector<std::vector<uint64_t> >& quantiles
+                   = std::vector<std::vector<uint64_t> >());
         hasher(const hasher& other);
         ~hasher() throw ();
 
@@ -104,12 +109,19 @@ class hasher
         coordinate hash(const std::vector<e::slice>& value) const;
         coordinate hash(const e::slice& key, const std::vector<e::slice>& value) const;
         search_coordinate hash(const search& s) const;
+        // Hash "count" keys (or objects) at once, storing the coordinate of
+        // each in "coords".  The results are the same as those of the methods
+        // above, but the hashes of every object are interlaced together.
+        void hash(const e::slice* keys, size_t count, coordinate* coords) const;
+        void hash(const e::slice* keys, const std::vector<e::slice>* values,
+                  size_t count, coordinate* coords) const;
 
     public:
         hasher& operator = (const hasher& rhs);
 
     private:
         std::vector<hash_t> m_funcs;
+        std::vector<std::vector<uint64_t> > m_quantiles;
 };
 
 } // namespace prefix
@@ -52,16 +52,21 @@ class search
         const e::slice& equality_value(size_t idx) const;
         bool is_range(size_t idx) const;
         void range_value(size_t idx, uint64_t* lower, uint64_t* upper) const;
+        bool is_prefix(size_t idx) const;
+        const e::slice& prefix_value(size_t idx) const;
         bool matches(const e::slice& key, const std::vector<e::slice>& value) const;
         size_t packed_size() const;
 
-    // It is an error to call equality_set or range_set on an index which has
-    // already been provided as an index to equality_set or range_set.  It will
-    // fail an assertion.  This is to prevent misconceptions about the way in
-    // which these two interact.
+    // It is an error to call equality_set, range_set or prefix_set on an
+    // index which has already been provided as an index to any of them.  It
+    // will fail an assertion.  This is to prevent misconceptions about the way
+    // in which these interact.
     public:
         void equality_set(size_t idx, const e::slice& val);
         void range_set(size_t idx, uint64_t start, uint64_t end);
+        // Match every value which starts with val.  Only attributes hashed
+        // with ORDERED can use this to narrow the regions searched.
+        void prefix_set(size_t idx, const e::slice& val);
 
     private:
         friend e::buffer::packer operator << (e::buffer::packer lhs, const search& rhs);
@@ -73,6 +78,8 @@ class search
         e::bitfield m_range_bits;
         std::vector<uint64_t> m_range_lower;
         std::vector<uint64_t> m_range_upper;
+        e::bitfield m_prefix_bits;
+        std::vector<e::slice> m_prefix;
 };
 
 e::buffer::packer
@@ -102,13 +102,16 @@ hyperspacehashing :: mask :: coordinate :: operator == (const coordinate& rhs) c
            secondary_upper_hash == rhs.secondary_upper_hash;
 }
 
-hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs)
+hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs,
+                                              const std::vector<std::vector<uint64_t> >& quantiles)
     : m_funcs(funcs)
     , m_num()
     , m_nums(funcs.size(), -1)
     , m_space(funcs.size(), 64)
+    , m_quantiles(quantiles)
 {
     assert(m_funcs.size() >= 1);
+    m_quantiles.resize(m_funcs.size());
 
     for (size_t i = 1; m_num < 128 && i < m_funcs.size(); ++i)
     {
@@ -119,6 +122,7 @@ hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs)
                 ++m_num;
                 break;
             case RANGE:
+            case ORDERED:
                 m_nums[i] = m_num;
                 ++m_num;
                 break;
@@ -146,6 +150,7 @@ hyperspacehashing :: mask :: hasher :: hasher(const hasher& other)
     , m_num(other.m_num)
     , m_nums(other.m_nums)
     , m_space(other.m_space)
+    , m_quantiles(other.m_quantiles)
 {
     assert(m_funcs.size() >= 1);
     assert(m_funcs.size() == m_nums.size());
@@ -170,7 +175,11 @@ hyperspacehashing :: mask :: hasher :: hash(const e::slice& key) const
             break;
         case RANGE:
             key_mask = UINT64_MAX;
-            key_hash = cfloat(lendian(key), 64);
+            key_hash = cfloat(quantile(m_quantiles[0], lendian(key)), 64);
+            break;
+        case ORDERED:
+            key_mask = UINT64_MAX;
+            key_hash = cfloat(ordered(key), 64);
             break;
         case NONE:
             key_mask = 0;
@@ -219,7 +228,13 @@ hyperspacehashing :: mask :: hasher :: hash(const std::vector<e::slice>& value)
                     break;
                 case RANGE:
                     assert(m_space[i] <= 64);
-                    cfl = cfloat(lendian(value[i - 1]), m_space[i]);
+                    cfl = cfloat(quantile(m_quantiles[i], lendian(value[i - 1])), m_space[i]);
+                    masks[m_nums[i]] = UINT64_MAX;
+                    hashes[m_nums[i]] = cfl;
+                    break;
+                case ORDERED:
+                    assert(m_space[i] <= 64);
+                    cfl = cfloat(ordered(value[i - 1]), m_space[i]);
                     masks[m_nums[i]] = UINT64_MAX;
                     hashes[m_nums[i]] = cfl;
                     break;
@@ -275,6 +290,16 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
                 if (s.is_range(0))
                 {
                     s.range_value(0, &lower, &upper);
+                    clower = cfloat(quantile(m_quantiles[0], lower), 64);
+                    cupper = cfloat(quantile(m_quantiles[0], upper), 64);
+                    cfloat_range(clower, cupper, 64, &primary_mask, &primary_hash);
+                }
+
+                break;
+            case ORDERED:
+
+                if (ordered_range(s, 0, &lower, &upper))
+                {
                     clower = cfloat(lower, 64);
                     cupper = cfloat(upper, 64);
                     cfloat_range(clower, cupper, 64, &primary_mask, &primary_hash);
@@ -319,6 +344,16 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
                     if (s.is_range(i))
                     {
                         s.range_value(i, &lower, &upper);
+                        clower = cfloat(quantile(m_quantiles[i], lower), m_space[i]);
+                        cupper = cfloat(quantile(m_quantiles[i], upper), m_space[i]);
+                        cfloat_range(clower, cupper, m_space[i], &masks[m_nums[i]], &hashes[m_nums[i]]);
+                    }
+
+                    break;
+                case ORDERED:
+
+                    if (ordered_range(s, i, &lower, &upper))
+                    {
                         clower = cfloat(lower, m_space[i]);
                         cupper = cfloat(upper, m_space[i]);
                         cfloat_range(clower, cupper, m_space[i], &masks[m_nums[i]], &hashes[m_nums[i]]);
@@ -341,3 +376,128 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
     double_lower_interlace(hashes, m_num, &lower_hash, &upper_hash);
     return coordinate(0, 0, lower_mask, lower_hash, upper_mask, upper_hash);
 }
+
+void
+hyperspacehashing :: mask :: hasher :: hash(const e::slice* keys, size_t count,
+                                            coordinate* coords) const
+{
+    // Switch once for the batch, rather than once per key.
+    switch (m_funcs[0])
+    {
+        case EQUALITY:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate(UINT64_MAX, cityhash(keys[k]), 0, 0, 0, 0);
+            }
+
+            break;
+        case RANGE:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate(UINT64_MAX, cfloat(quantile(m_quantiles[0], lendian(keys[k])), 64), 0, 0, 0, 0);
+            }
+
+            break;
+        case ORDERED:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate(UINT64_MAX, cfloat(ordered(keys[k]), 64), 0, 0, 0, 0);
+            }
+
+            break;
+        case NONE:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate();
+            }
+
+            break;
+        default:
+            abort();
+    }
+}
+
+void
+hyperspacehashing :: mask :: hasher :: hash(const e::slice* keys,
+                                            const std::vector<e::slice>* values,
+                                            size_t count, coordinate* coords) const
+{
+    assert(m_nums.size() == m_funcs.size());
+    assert(m_nums.size() == m_space.size());
+    hash(keys, count, coords);
+
+    // Every object sets the same masks, so they are interlaced just once.
+    uint64_t masks[128];
+    memset(masks, 0, sizeof(masks));
+    // The hashes are grouped by attribute for the batched interlace.
+    std::vector<uint64_t> hashes(m_num * count);
+
+    for (size_t i = 1; i < m_funcs.size(); ++i)
+    {
+        if (m_nums[i] != static_cast<unsigned int>(-1))
+        {
+            uint64_t* column = &hashes[0] + m_nums[i] * count;
+            masks[m_nums[i]] = UINT64_MAX;
+
+            switch (m_funcs[i])
+            {
+                case EQUALITY:
+
+                    for (size_t k = 0; k < count; ++k)
+                    {
+                        assert(values[k].size() + 1 == m_funcs.size());
+                        column[k] = cityhash(values[k][i - 1]);
+                    }
+
+                    break;
+                case RANGE:
+                    assert(m_space[i] <= 64);
+
+                    for (size_t k = 0; k < count; ++k)
+                    {
+                        assert(values[k].size() + 1 == m_funcs.size());
+                        column[k] = cfloat(quantile(m_quantiles[i], lendian(values[k][i - 1])), m_space[i]);
+                    }
+
+                    break;
+                case ORDERED:
+                    assert(m_space[i] <= 64);
+
+                    for (size_t k = 0; k < count; ++k)
+                    {
+                        assert(values[k].size() + 1 == m_funcs.size());
+                        column[k] = cfloat(ordered(values[k][i - 1]), m_space[i]);
+                    }
+
+                    break;
+                case NONE:
+                    abort();
+                default:
+                    abort();
+            }
+        }
+    }
+
+    uint64_t lower_mask = 0;
+    uint64_t upper_mask = 0;
+    double_lower_interlace(masks, m_num, &lower_mask, &upper_mask);
+    std::vector<uint64_t> lower_hash(count);
+    std::vector<uint64_t> upper_hash(count);
+
+    if (m_num > 0 && count > 0)
+    {
+        double_lower_interlace(&hashes[0], m_num, count, &lower_hash[0], &upper_hash[0]);
+    }
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        coords[k].secondary_lower_mask = lower_mask;
+        coords[k].secondary_lower_hash = lower_hash[k];
+        coords[k].secondary_upper_mask = upper_mask;
+        coords[k].secondary_upper_hash = upper_hash[k];
+    }
+}
@@ -129,13 +129,17 @@ hyperspacehashing :: prefix :: search_coordinate :: search_coordinate(uint64_t m
 {
 }
 
-hyperspacehashing :: prefix :: hasher :: hasher(const std::vector<hash_t>& funcs)
+hyperspacehashing :: prefix :: hasher :: hasher(const std::vector<hash_t>& funcs,
+                                                const std::vector<std::vector<uint64_t> >& quantiles)
     : m_funcs(funcs)
+    , m_quantiles(quantiles)
 {
+    m_quantiles.resize(m_funcs.size());
 }
 
 hyperspacehashing :: prefix :: hasher :: hasher(const hasher& other)
     : m_funcs(other.m_funcs)
+    , m_quantiles(other.m_quantiles)
 {
 }
 
@@ -165,7 +169,9 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key) const
         case EQUALITY:
             return coordinate(64, cityhash(key));
         case RANGE:
-            return coordinate(64, cfloat(lendian(key), 64));
+            return coordinate(64, cfloat(quantile(m_quantiles[0], lendian(key)), 64));
+        case ORDERED:
+            return coordinate(64, cfloat(ordered(key), 64));
         case NONE:
             abort();
         default:
@@ -187,6 +193,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key, const std::ve
             ++num;
             break;
         case RANGE:
+        case ORDERED:
             hashes[num] = 0;
             ++num;
             break;
@@ -205,6 +212,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key, const std::ve
                 ++num;
                 break;
             case RANGE:
+            case ORDERED:
                 hashes[num] = 0;
                 ++num;
                 break;
@@ -232,7 +240,13 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key, const std::ve
             break;
         case RANGE:
             space = numbits + (idx < plusones ? 1 : 0);
-            hashes[idx] = cfloat(lendian(key), space);
+            hashes[idx] = cfloat(quantile(m_quantiles[0], lendian(key)), space);
+            hashes[idx] <<= 64 - space;
+            ++idx;
+            break;
+        case ORDERED:
+            space = numbits + (idx < plusones ? 1 : 0);
+            hashes[idx] = cfloat(ordered(key), space);
             hashes[idx] <<= 64 - space;
             ++idx;
             break;
@@ -251,7 +265,13 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key, const std::ve
                 break;
             case RANGE:
                 space = numbits + (idx < plusones ? 1 : 0);
-                hashes[idx] = cfloat(lendian(value[i - 1]), space);
+                hashes[idx] = cfloat(quantile(m_quantiles[i], lendian(value[i - 1])), space);
+                hashes[idx] <<= 64 - space;
+                ++idx;
+                break;
+            case ORDERED:
+                space = numbits + (idx < plusones ? 1 : 0);
+                hashes[idx] = cfloat(ordered(value[i - 1]), space);
                 hashes[idx] <<= 64 - space;
                 ++idx;
                 break;
@@ -293,6 +313,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 ++num;
                 break;
             case RANGE:
+            case ORDERED:
                 masks[num] = 0;
                 hashes[num] = 0;
                 ++num;
@@ -317,14 +338,26 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
 
         for (size_t i = 0; idx < num && i < s.size(); ++i)
         {
+            uint64_t lower;
+            uint64_t upper;
+            bool hashed = false;
+
             if (s.is_range(i) && m_funcs[i] == RANGE)
             {
-                uint64_t lower;
-                uint64_t upper;
                 s.range_value(i, &lower, &upper);
+                hashed = true;
+            }
+            // Prefixes of (and equality on) an ORDERED attribute are ranges.
+            else if (m_funcs[i] == ORDERED)
+            {
+                hashed = ordered_range(s, i, &lower, &upper);
+            }
+
+            if (hashed)
+            {
                 space = numbits + (idx < plusones ? 1 : 0);
-                uint64_t clower = cfloat(lower, space);
-                uint64_t cupper = cfloat(upper, space);
+                uint64_t clower = cfloat(quantile(m_quantiles[i], lower), space);
+                uint64_t cupper = cfloat(quantile(m_quantiles[i], upper), space);
                 cfloat_range(clower, cupper, space, &masks[idx], &hashes[idx]);
                 // Create the partial matching which is folded into
                 // equality coordinate.
@@ -339,15 +372,13 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 cupper = upper_interlace(scratch, num);
                 scratch[idx] = UINT64_MAX;
                 uint64_t cmask = upper_interlace(scratch, num);
-                range.push_back(range_match(i, lower, upper, cmask, clower, cupper));
+                range.push_back(range_match(i, m_funcs[i], lower, upper, cmask, clower, cupper));
                 scratch[idx] = 0;
             }
             else if (s.is_range(i))
             {
-                uint64_t lower;
-                uint64_t upper;
                 s.range_value(i, &lower, &upper);
-                range.push_back(range_match(i, lower, upper, 0, 0, 0));
+                range.push_back(range_match(i, RANGE, lower, upper, 0, 0, 0));
             }
 
             switch (m_funcs[i])
@@ -356,6 +387,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                     ++idx;
                     break;
                 case RANGE:
+                case ORDERED:
                     ++idx;
                     break;
                 case NONE:
@@ -375,7 +407,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
             uint64_t lower;
             uint64_t upper;
             s.range_value(i, &lower, &upper);
-            range.push_back(range_match(i, lower, upper, 0, 0, 0));
+            range.push_back(range_match(i, RANGE, lower, upper, 0, 0, 0));
         }
 
         switch (m_funcs[i])
@@ -384,6 +416,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 ++idx;
                 break;
             case RANGE:
+            case ORDERED:
                 ++idx;
                 break;
             case NONE:
@@ -400,5 +433,127 @@ hyperspacehashing::prefix::hasher&
 hyperspacehashing :: prefix :: hasher :: operator = (const hasher& rhs)
 {
     m_funcs = rhs.m_funcs;
+    m_quantiles = rhs.m_quantiles;
     return *this;
 }
+
+void
+hyperspacehashing :: prefix :: hasher :: hash(const e::slice* keys, size_t count,
+                                              coordinate* coords) const
+{
+    for (size_t i = 1; i < m_funcs.size(); ++i)
+    {
+        assert(m_funcs[i] == NONE);
+    }
+
+    // Switch once for the batch, rather than once per key.
+    switch (m_funcs[0])
+    {
+        case EQUALITY:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate(64, cityhash(keys[k]));
+            }
+
+            break;
+        case RANGE:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate(64, cfloat(quantile(m_quantiles[0], lendian(keys[k])), 64));
+            }
+
+            break;
+        case ORDERED:
+
+            for (size_t k = 0; k < count; ++k)
+            {
+                coords[k] = coordinate(64, cfloat(ordered(keys[k]), 64));
+            }
+
+            break;
+        case NONE:
+            abort();
+        default:
+            abort();
+    }
+}
+
+void
+hyperspacehashing :: prefix :: hasher :: hash(const e::slice* keys,
+                                              const std::vector<e::slice>* values,
+                                              size_t count, coordinate* coords) const
+{
+    size_t num = 0;
+
+    for (size_t i = 0; num < 64 && i < m_funcs.size(); ++i)
+    {
+        if (m_funcs[i] == EQUALITY || m_funcs[i] == RANGE || m_funcs[i] == ORDERED)
+        {
+            ++num;
+        }
+    }
+
+    if (num == 0 || count == 0)
+    {
+        for (size_t k = 0; k < count; ++k)
+        {
+            coords[k] = coordinate(0, 0);
+        }
+
+        return;
+    }
+
+    unsigned int numbits = 64 / num;
+    unsigned int plusones = 64 % num;
+    // The hashes are grouped by attribute for the batched interlace.
+    std::vector<uint64_t> hashes(num * count);
+    size_t idx = 0;
+
+    for (size_t i = 0; idx < num && i < m_funcs.size(); ++i)
+    {
+        uint64_t* column = &hashes[0] + idx * count;
+        unsigned int space = numbits + (idx < plusones ? 1 : 0);
+
+        switch (m_funcs[i])
+        {
+            case EQUALITY:
+
+                for (size_t k = 0; k < count; ++k)
+                {
+                    assert(values[k].size() + 1 == m_funcs.size());
+                    column[k] = cityhash(i == 0 ? keys[k] : values[k][i - 1]);
+                }
+
+                ++idx;
+                break;
+            case RANGE:
+            case ORDERED:
+
+                for (size_t k = 0; k < count; ++k)
+                {
+                    assert(values[k].size() + 1 == m_funcs.size());
+                    const e::slice& v(i == 0 ? keys[k] : values[k][i - 1]);
+                    uint64_t num = m_funcs[i] == RANGE ? quantile(m_quantiles[i], lendian(v)) : ordered(v);
+                    column[k] = cfloat(num, space);
+                    column[k] <<= 64 - space;
+                }
+
+                ++idx;
+                break;
+            case NONE:
+                break;
+            default:
+                abort();
+        }
+    }
+
+    std::vector<uint64_t> points(count);
+    upper_interlace(&hashes[0], num, count, &points[0]);
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        coords[k] = coordinate(64, points[k]);
+    }
+}
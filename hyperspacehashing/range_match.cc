@@ -55,11 +55,12 @@
 //      upper ranges to the hash.  This case is folded into the equality
 //      comparison and thus is not handled by range_match.
 
-hyperspacehashing :: range_match :: range_match(unsigned int idx,
+hyperspacehashing :: range_match :: range_match(unsigned int idx, hash_t func,
                                                 uint64_t lower, uint64_t upper,
                                                 uint64_t cmask,
                                                 uint64_t clower, uint64_t cupper)
     : m_idx(idx)
+    , m_func(func)
     , m_lower(lower)
     , m_upper(upper)
     , m_cmask(cmask)
@@ -90,16 +91,22 @@ bool
 hyperspacehashing :: range_match :: matches(const e::slice& key,
                                             const std::vector<e::slice>& value) const
 {
+    hash_func hf = m_func == ORDERED ? ordered : lendian;
     uint64_t hash;
 
     // If we are dealing with the key
     if (m_idx == 0)
     {
-        hash = lendian(key);
+        hash = hf(key);
     }
     else
     {
-        hash = lendian(value[m_idx - 1]);
+        hash = hf(value[m_idx - 1]);
+    }
+
+    if (m_func == ORDERED)
+    {
+        return (m_lower <= hash) && (hash <= m_upper);
     }
 
     return (m_lower <= hash) && (hash < m_upper);
@@ -29,6 +29,7 @@
 #define hyperspacehashing_range_match_h_
 
 // HyperspaceHashing
+#include "hyperspacehashing/hashes.h"
 #include "hyperspacehashing/mask.h"
 #include "hyperspacehashing/prefix.h"
 
@@ -38,7 +39,7 @@ namespace hyperspacehashing
 class range_match
 {
     public:
-        range_match(unsigned int idx,
+        range_match(unsigned int idx, hash_t func,
                     uint64_t lower, uint64_t upper,
                     uint64_t cmask,
                     uint64_t clower, uint64_t cupper);
@@ -50,6 +51,9 @@ class range_match
 
     public:
         unsigned int m_idx;
+        // For RANGE, m_upper is exclusive.  For ORDERED it is inclusive, and
+        // only the leading eight bytes of a string are compared.
+        hash_t m_func;
         uint64_t m_lower;
         uint64_t m_upper;
         uint64_t m_cmask;
@@ -25,6 +25,9 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+// C
+#include <cstring>
+
 // HyperspaceHashing
 #include "hashes_internal.h"
 #include <hyperspacehashing/search.h>
@@ -37,6 +40,8 @@ hyperspacehashing :: search :: search(size_t n)
     , m_range_bits(n)
     , m_range_lower(n)
     , m_range_upper(n)
+    , m_prefix_bits(n)
+    , m_prefix(n)
 {
 }
 
@@ -50,7 +55,9 @@ hyperspacehashing :: search :: sanity_check() const
     return m_equality_bits.bits() == m_equality.size() &&
            m_equality.size() == m_range_bits.bits() &&
            m_range_bits.bits() == m_range_lower.size() &&
-           m_range_lower.size() == m_range_upper.size();
+           m_range_lower.size() == m_range_upper.size() &&
+           m_range_upper.size() == m_prefix_bits.bits() &&
+           m_prefix_bits.bits() == m_prefix.size();
 }
 
 size_t
@@ -95,6 +102,30 @@ hyperspacehashing :: search :: range_value(size_t idx, uint64_t* lower, uint64_t
     *upper = m_range_upper[idx];
 }
 
+bool
+hyperspacehashing :: search :: is_prefix(size_t idx) const
+{
+    assert(sanity_check());
+    assert(idx < m_prefix_bits.bits());
+    return m_prefix_bits.get(idx);
+}
+
+const e::slice&
+hyperspacehashing :: search :: prefix_value(size_t idx) const
+{
+    assert(sanity_check());
+    assert(idx < m_prefix_bits.bits());
+    assert(m_prefix_bits.get(idx));
+    return m_prefix[idx];
+}
+
+static bool
+starts_with(const e::slice& val, const e::slice& prefix)
+{
+    return val.size() >= prefix.size() &&
+           memcmp(val.data(), prefix.data(), prefix.size()) == 0;
+}
+
 bool
 hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e::slice>& value) const
 {
@@ -116,6 +147,13 @@ hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e:
             return false;
         }
     }
+    else if (m_prefix_bits.get(0))
+    {
+        if (!starts_with(key, m_prefix[0]))
+        {
+            return false;
+        }
+    }
 
     for (size_t i = 1; i < m_equality.size(); ++i)
     {
@@ -135,6 +173,13 @@ hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e:
                 return false;
             }
         }
+        else if (m_prefix_bits.get(i))
+        {
+            if (!starts_with(value[i - 1], m_prefix[i]))
+            {
+                return false;
+            }
+        }
     }
 
     return true;
@@ -143,11 +188,12 @@ hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e:
 size_t
 hyperspacehashing :: search :: packed_size() const
 {
-    size_t sz = size() * (sizeof(uint8_t) * 2 + sizeof(uint64_t) * 4 + sizeof(uint32_t));
+    size_t sz = size() * (sizeof(uint8_t) * 3 + sizeof(uint64_t) * 4 + sizeof(uint32_t) * 2);
 
     for (size_t i = 0; i < size(); ++i)
     {
         sz += m_equality[i].size();
+        sz += m_prefix[i].size();
     }
 
     return sz;
@@ -160,6 +206,7 @@ hyperspacehashing :: search :: equality_set(size_t idx, const e::slice& val)
     assert(idx < m_equality_bits.bits());
     assert(!m_equality_bits.get(idx));
     assert(!m_range_bits.get(idx));
+    assert(!m_prefix_bits.get(idx));
     m_equality_bits.set(idx);
     m_equality[idx] = val;
 }
@@ -171,21 +218,36 @@ hyperspacehashing :: search :: range_set(size_t idx, uint64_t start, uint64_t en
     assert(idx < m_equality_bits.bits());
     assert(!m_equality_bits.get(idx));
     assert(!m_range_bits.get(idx));
+    assert(!m_prefix_bits.get(idx));
     m_range_bits.set(idx);
     m_range_lower[idx] = start;
     m_range_upper[idx] = end;
 }
 
+void
+hyperspacehashing :: search :: prefix_set(size_t idx, const e::slice& val)
+{
+    assert(sanity_check());
+    assert(idx < m_equality_bits.bits());
+    assert(!m_equality_bits.get(idx));
+    assert(!m_range_bits.get(idx));
+    assert(!m_prefix_bits.get(idx));
+    m_prefix_bits.set(idx);
+    m_prefix[idx] = val;
+}
+
 e::buffer::packer
 hyperspacehashing :: operator << (e::buffer::packer lhs, const search& rhs)
 {
     return lhs << rhs.m_equality_bits << rhs.m_equality
-               << rhs.m_range_bits << rhs.m_range_lower << rhs.m_range_upper;
+               << rhs.m_range_bits << rhs.m_range_lower << rhs.m_range_upper
+               << rhs.m_prefix_bits << rhs.m_prefix;
 }
 
 e::buffer::unpacker
 hyperspacehashing :: operator >> (e::buffer::unpacker lhs, search& rhs)
 {
     return lhs >> rhs.m_equality_bits >> rhs.m_equality
-               >> rhs.m_range_bits >> rhs.m_range_lower >> rhs.m_range_upper;
+               >> rhs.m_range_bits >> rhs.m_range_lower >> rhs.m_range_upper
+               >> rhs.m_prefix_bits >> rhs.m_prefix;
 }
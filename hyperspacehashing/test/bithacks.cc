@@ -103,4 +103,40 @@ TEST(BithacksTest, DoubleLowerInterlace)
     ASSERT_EQ(0x482486cb6c26986dULL, upper);
 }
 
+TEST(BithacksTest, BatchedInterlace)
+{
+    // Three objects of three numbers each, grouped by position.
+    uint64_t objs[3][3] = {{0xdeadbeefcafebabeULL, 0x1eaff00ddefec8edULL, 0},
+                           {UINT64_MAX, 0, 0x0123456789abcdefULL},
+                           {0x8badf00d8badf00dULL, 0xfeedfacefeedfaceULL, 0xc0ffeec0ffeec0ffULL}};
+    uint64_t nums[9];
+
+    for (size_t sz = 0; sz <= 3; ++sz)
+    {
+        for (size_t j = 0; j < sz; ++j)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                nums[j * 3 + k] = objs[k][j];
+            }
+        }
+
+        uint64_t out[3];
+        uint64_t lower[3];
+        uint64_t upper[3];
+        upper_interlace(nums, sz, 3, out);
+        double_lower_interlace(nums, sz, 3, lower, upper);
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint64_t l = 0;
+            uint64_t u = 0;
+            double_lower_interlace(objs[k], sz, &l, &u);
+            ASSERT_EQ(upper_interlace(objs[k], sz), out[k]);
+            ASSERT_EQ(l, lower[k]);
+            ASSERT_EQ(u, upper[k]);
+        }
+    }
+}
+
 } // namespace
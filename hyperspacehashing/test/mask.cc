@@ -33,6 +33,7 @@
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/hashes.h"
 #include "hyperspacehashing/hyperspacehashing/mask.h"
+#include "hyperspacehashing/hyperspacehashing/search.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-default"
 
@@ -201,4 +202,74 @@ TEST(MaskTest, KeyValueRange)
                      UINT64_MAX, 0xf0ccfffccfcccffcULL, UINT64_MAX, 0xf3fcccf3cffcfcffULL, value);
 }
 
+
+TEST(MaskTest, Batch)
+{
+    std::vector<hash_t> hf(4);
+    hf[0] = EQUALITY;
+    hf[1] = RANGE;
+    hf[2] = EQUALITY;
+    hf[3] = NONE;
+    hasher h(hf);
+    const char* keys[] = {"key", "another key", "", "\xbe\xba\xfe\xca\xef\xbe\xad\xde"};
+    e::slice ks[4];
+    std::vector<e::slice> vs[4];
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ks[k] = e::slice(keys[k], strlen(keys[k]));
+        vs[k].push_back(e::slice(keys[3 - k], strlen(keys[3 - k])));
+        vs[k].push_back(e::slice(keys[k], strlen(keys[k])));
+        vs[k].push_back(e::slice("unused", 6));
+    }
+
+    coordinate cs[4];
+    h.hash(ks, 4, cs);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ASSERT_TRUE(h.hash(ks[k]) == cs[k]);
+    }
+
+    h.hash(ks, vs, 4, cs);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ASSERT_TRUE(h.hash(ks[k], vs[k]) == cs[k]);
+    }
+}
+
+TEST(MaskTest, Ordered)
+{
+    std::vector<hash_t> hf(2);
+    hf[0] = ORDERED;
+    hf[1] = ORDERED;
+    hasher h(hf);
+    const char* names[] = {"smith", "smithers", "jones", "sma"};
+    e::slice ks[4];
+    std::vector<e::slice> vs[4];
+    coordinate cs[4];
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ks[k] = e::slice(names[k], strlen(names[k]));
+        vs[k].push_back(ks[k]);
+    }
+
+    h.hash(ks, vs, 4, cs);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ASSERT_TRUE(h.hash(ks[k], vs[k]) == cs[k]);
+    }
+
+    search s(2);
+    s.prefix_set(1, e::slice("smi", 3));
+    coordinate sc = h.hash(s);
+    ASSERT_TRUE(sc.intersects(cs[0]));
+    ASSERT_TRUE(sc.intersects(cs[1]));
+    ASSERT_FALSE(sc.intersects(cs[2]));
+    ASSERT_FALSE(sc.intersects(cs[3]));
+}
+
 } // namespace
@@ -33,6 +33,7 @@
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/hashes.h"
 #include "hyperspacehashing/hyperspacehashing/prefix.h"
+#include "hyperspacehashing/hyperspacehashing/search.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-default"
 
@@ -216,4 +217,118 @@ TEST(PrefixTest, KeyValueRange)
     ASSERT_EQ(17581152392886156543ULL, c.point);
 }
 
+
+TEST(PrefixTest, Batch)
+{
+    std::vector<hash_t> hf(4);
+    hf[0] = EQUALITY;
+    hf[1] = RANGE;
+    hf[2] = EQUALITY;
+    hf[3] = NONE;
+    hasher h(hf);
+    const char* keys[] = {"key", "another key", "", "\xbe\xba\xfe\xca\xef\xbe\xad\xde"};
+    e::slice ks[4];
+    std::vector<e::slice> vs[4];
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ks[k] = e::slice(keys[k], strlen(keys[k]));
+        vs[k].push_back(e::slice(keys[3 - k], strlen(keys[3 - k])));
+        vs[k].push_back(e::slice(keys[k], strlen(keys[k])));
+        vs[k].push_back(e::slice("unused", 6));
+    }
+
+    coordinate cs[4];
+    hasher kh(std::vector<hash_t>(1, EQUALITY));
+    kh.hash(ks, 4, cs);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ASSERT_EQ(kh.hash(ks[k]).prefix, cs[k].prefix);
+        ASSERT_EQ(kh.hash(ks[k]).point, cs[k].point);
+    }
+
+    h.hash(ks, vs, 4, cs);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ASSERT_EQ(h.hash(ks[k], vs[k]).prefix, cs[k].prefix);
+        ASSERT_EQ(h.hash(ks[k], vs[k]).point, cs[k].point);
+    }
+}
+
+TEST(PrefixTest, Ordered)
+{
+    std::vector<hash_t> hf(2);
+    hf[0] = EQUALITY;
+    hf[1] = ORDERED;
+    hasher h(hf);
+    std::vector<e::slice> value(1);
+    value[0] = e::slice("smith", 5);
+    coordinate smith = h.hash(e::slice("k1", 2), value);
+    value[0] = e::slice("smithers", 8);
+    coordinate smithers = h.hash(e::slice("k2", 2), value);
+    value[0] = e::slice("jones", 5);
+    coordinate jones = h.hash(e::slice("k3", 2), value);
+    value[0] = e::slice("sma", 3);
+    coordinate sma = h.hash(e::slice("k4", 2), value);
+
+    search s(2);
+    s.prefix_set(1, e::slice("smi", 3));
+    search_coordinate sc = h.hash(s);
+    ASSERT_TRUE(sc.matches(smith));
+    ASSERT_TRUE(sc.matches(smithers));
+    ASSERT_FALSE(sc.matches(jones));
+    ASSERT_FALSE(sc.matches(sma));
+
+    // Equality on an ordered attribute is a degenerate prefix.
+    search e(2);
+    e.equality_set(1, e::slice("smith", 5));
+    sc = h.hash(e);
+    ASSERT_TRUE(sc.matches(smith));
+    ASSERT_FALSE(sc.matches(jones));
+}
+
+TEST(PrefixTest, Quantiles)
+{
+    std::vector<hash_t> hf(2);
+    hf[0] = NONE;
+    hf[1] = RANGE;
+    std::vector<std::vector<uint64_t> > quantiles(2);
+    quantiles[1].push_back(1000);
+    quantiles[1].push_back(2000);
+    quantiles[1].push_back(3000);
+    hasher h(hf, quantiles);
+    uint64_t nums[] = {500, 1500, 2500, 3500};
+    e::slice ks[4];
+    std::vector<e::slice> vs[4];
+    coordinate cs[4];
+
+    // Each quarter of the values gets its own quarter of the space.
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ks[k] = e::slice("key", 3);
+        vs[k].push_back(e::slice(&nums[k], sizeof(uint64_t)));
+        cs[k] = h.hash(ks[k], vs[k]);
+        ASSERT_EQ(64, cs[k].prefix);
+        ASSERT_EQ(k, cs[k].point >> 62);
+    }
+
+    coordinate batch[4];
+    h.hash(ks, vs, 4, batch);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+        ASSERT_EQ(cs[k].point, batch[k].point);
+    }
+
+    search s(2);
+    s.range_set(1, 1000, 2000);
+    search_coordinate sc = h.hash(s);
+    ASSERT_FALSE(sc.matches(cs[0]));
+    ASSERT_TRUE(sc.matches(cs[1]));
+    ASSERT_FALSE(sc.matches(cs[2]));
+    ASSERT_FALSE(sc.matches(cs[3]));
+}
+
 } // namespace
@@ -42,6 +42,7 @@
 using hyperspacehashing::hash_t;
 using hyperspacehashing::EQUALITY;
 using hyperspacehashing::NONE;
+using hyperspacehashing::ORDERED;
 using namespace hyperspacehashing;
 
 void
@@ -76,7 +77,7 @@ main(int, char* [])
             nums[j] = static_cast<uint32_t>(rand());
         }
 
-        for (size_t k = EQUALITY; k <= NONE; ++k)
+        for (size_t k = EQUALITY; k <= ORDERED; ++k)
         {
             std::vector<hash_t> hf(1);
             hf[0] = static_cast<hash_t>(k);
@@ -86,22 +87,22 @@ main(int, char* [])
             validate(hf, key, value);
             EXPAND;
 
-            for (size_t v1 = EQUALITY; v1 <= NONE; ++v1)
+            for (size_t v1 = EQUALITY; v1 <= ORDERED; ++v1)
             {
                 TESTPOS(1);
                 EXPAND;
 
-                for (size_t v2 = EQUALITY; v2 <= NONE; ++v2)
+                for (size_t v2 = EQUALITY; v2 <= ORDERED; ++v2)
                 {
                     TESTPOS(2);
                     EXPAND;
 
-                    for (size_t v3 = EQUALITY; v3 <= NONE; ++v3)
+                    for (size_t v3 = EQUALITY; v3 <= ORDERED; ++v3)
                     {
                         TESTPOS(3);
                         EXPAND;
 
-                        for (size_t v4 = EQUALITY; v4 <= NONE; ++v4)
+                        for (size_t v4 = EQUALITY; v4 <= ORDERED; ++v4)
                         {
                             TESTPOS(4);
                         }
@@ -171,6 +172,19 @@ validate(const std::vector<hash_t> hf, const e::slice& key, const std::vector<e:
         assert(msc.intersects(mc));
     }
 
+    // Do a prefix search for each attribute
+    for (size_t i = 0; i < value.size() + 1; ++i)
+    {
+        search s(value.size() + 1);
+        const e::slice& v(i == 0 ? key : value[i - 1]);
+        s.prefix_set(i, e::slice(v.data(), v.size() / 2));
+        assert(s.matches(key, value));
+        prefix::search_coordinate psc = ph.hash(s);
+        mask::coordinate msc = mh.hash(s);
+        assert(psc.matches(pc));
+        assert(msc.intersects(mc));
+    }
+
     // Do an equality/range search for two attributes
     for (size_t i = 0; i < value.size() + 1; ++i)
     {
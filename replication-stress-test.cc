@@ -394,7 +394,7 @@ present(int testno,
     hyperclient_returncode lstatus;
     hyperclient_attribute* attrs;
     size_t attrs_sz;
-    int64_t gid = cl->get(space, reinterpret_cast<char*>(&A), sizeof(uint32_t), &gstatus, &attrs, &attrs_sz);
+    int64_t gid = cl->get(space, reinterpret_cast<char*>(&A), sizeof(uint32_t), NULL, 0, &gstatus, &attrs, &attrs_sz);
 
     if (gid < 0)
     {
@@ -457,7 +457,7 @@ absent(int testno,
     hyperclient_returncode lstatus;
     hyperclient_attribute* attrs = NULL;
     size_t attrs_sz = 0;
-    int64_t gid = cl->get(space, reinterpret_cast<char*>(&A), sizeof(uint32_t), &gstatus, &attrs, &attrs_sz);
+    int64_t gid = cl->get(space, reinterpret_cast<char*>(&A), sizeof(uint32_t), NULL, 0, &gstatus, &attrs, &attrs_sz);
 
     if (gid < 0)
     {
@@ -354,7 +354,7 @@ handle_line(hyperclient* cl,
         int64_t id;
 
         if ((id = cl->get(space, words[1].first, words[1].second - words[1].first,
-                          &op->status, &op->attrs, &op->attrs_sz)) < 0)
+                          NULL, 0, &op->status, &op->attrs, &op->attrs_sz)) < 0)
         {
             std::cerr << __FILE__ << ":" << __LINE__ << " GET op failed " << op->status << std::endl;
             return;